@@ -29,6 +29,9 @@
 #define MAX_RECV_CALLBACKS 5
 #endif
 
+//Set in the CAN id passed to CanCallback::HandleRx() when a remote frame was received
+#define CAN_RTR_FLAG 0x40000000
+
 class CanCallback
 {
 public:
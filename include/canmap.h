@@ -20,6 +20,7 @@
 #define CANMAP_H
 #include "params.h"
 #include "canhardware.h"
+#include "flashstore.h"
 
 #define CAN_ERR_INVALID_ID -1
 #define CAN_ERR_INVALID_OFS -2
@@ -60,7 +61,11 @@ class CanMap: CanCallback
       };
 
       explicit CanMap(CanHardware* hw, bool loadFromFlash = true);
+      ~CanMap();
       CanHardware* GetHardware() { return canHardware; }
+      /** \brief Receive into and send from the given store instead of the default store */
+      void SetParamStore(Param::Store* store) { paramStore = store; }
+      Param::Store* GetParamStore() { return paramStore; }
       void HandleClear() override;
       void HandleRx(uint32_t canId, uint32_t data[2], uint8_t dlc) override;
       void Clear();
@@ -72,16 +77,15 @@ class CanMap: CanCallback
       int AddRecv(Param::PARAM_NUM param, uint32_t canId, uint8_t offsetBits, int8_t length, float gain, int8_t offset);
       int Remove(Param::PARAM_NUM param);
       int Remove(bool rx, uint8_t ididx, uint8_t itemidx);
-      void Save();
+      bool Save();
       bool FindMap(Param::PARAM_NUM param, uint32_t& canId, uint8_t& start, int8_t& length, float& gain, int8_t& offset, bool& rx);
       const CANPOS* GetMap(bool rx, uint8_t ididx, uint8_t itemidx, uint32_t& canId);
       void IterateCanMap(void (*callback)(Param::PARAM_NUM, uint32_t, uint8_t, int8_t, float, int8_t, bool));
+      static int CheckPosition(uint8_t offsetBits, int8_t length);
 
    protected:
 
    private:
-      static volatile bool isSaving;
-
       struct CANIDMAP
       {
          #ifdef CAN_EXT
@@ -92,7 +96,13 @@ class CanMap: CanCallback
          uint8_t first;
       };
 
+      //Flash image of the last Save(), written in the background. Its size follows
+      //MAX_MESSAGES and MAX_ITEMS, not the flash page size
+      static uint32_t saveImage[(2 * MAX_MESSAGES * sizeof(CANIDMAP) + MAX_ITEMS * sizeof(CANPOS)) / sizeof(uint32_t)];
+
       CanHardware* canHardware;
+      Param::Store* paramStore;
+      FlashStore::Client storeClient;
       CANIDMAP canSendMap[MAX_MESSAGES];
       CANIDMAP canRecvMap[MAX_MESSAGES];
       CANPOS canPosMap[MAX_ITEMS + 1]; //Last item is a "tail"
@@ -100,14 +110,16 @@ class CanMap: CanCallback
       bool Send(CANIDMAP *map);
       void ClearMap(CANIDMAP *canMap);
       int Add(CANIDMAP *canMap, Param::PARAM_NUM param, uint32_t canId, uint8_t offsetBits, int8_t length, float gain, int8_t offset);
-      uint32_t SaveToFlash(uint32_t baseAddress, uint32_t* data, int len);
       int LoadFromFlash();
-      int LegacyLoadFromFlash();
+      int LoadUnversioned(uint32_t address);
+      int LegacyLoadFromFlash(uint32_t address);
       CANIDMAP *FindById(CANIDMAP *canMap, uint32_t canId);
       int CopyIdMapExcept(CANIDMAP *source, CANIDMAP *dest, Param::PARAM_NUM param);
-      void ReplaceParamEnumByUid(CANIDMAP *canMap);
+      void ReplaceParamEnumByUid(CANIDMAP *canMap, CANPOS *posMap);
       void ReplaceParamUidByEnum(CANIDMAP *canMap);
-      uint32_t GetFlashAddress();
+      static uint32_t SerializeSection(void* context, uint32_t* image, uint32_t maxWords);
+      static bool LoadSection(void* context, uint16_t version, const uint32_t* data, uint32_t words);
+      static bool MigrateSection(void* context, uint32_t address);
 };
 
 #endif // CANMAP_H
@@ -0,0 +1,55 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CANMAPSTREAM_H
+#define CANMAPSTREAM_H
+
+#include "streamsource.h"
+#include "canmap.h"
+
+//Size of one mapping record, COB Id, UID/position/length, gain/offset
+#define CANMAP_RECORD_SIZE 12
+//Set in the COB Id of a record to add a receive mapping
+#define CANMAP_RECORD_RX   0x80000000
+
+/** \brief Adds a stream of CAN mapping records to a CanMap.
+ * Every record consists of three little endian 32-bit words with the same
+ * content as sub indexes 0, 1 and 2 of a single SDO mapping. Records are
+ * applied as soon as they are complete, the stream stops at the first invalid one.
+ */
+class CanMapStream: public IStreamSink
+{
+   public:
+      explicit CanMapStream(CanMap* cm);
+      void SetCanMap(CanMap* cm) { canMap = cm; }
+      uint32_t Begin(uint32_t size) override;
+      uint32_t Write(const uint8_t* buf, int len) override;
+      uint32_t End() override;
+
+      static void EncodeRecord(uint32_t cobId, bool rx, const CanMap::CANPOS& mapping, uint32_t record[3]);
+      static uint32_t CheckRecord(const uint32_t record[3]);
+
+   private:
+      CanMap* canMap;
+      uint32_t record[3];
+      uint8_t recordBytes;
+
+      uint32_t AddRecord();
+};
+
+#endif // CANMAPSTREAM_H
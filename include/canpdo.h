@@ -0,0 +1,84 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CANPDO_H
+#define CANPDO_H
+
+#include "canmap.h"
+
+#define PDO_SYNC_ID           0x80
+
+//Transmission types as defined by CiA 301
+#define PDO_TYPE_SYNC_ACYCLIC 0   //on SYNC, but only if a mapped value has changed
+#define PDO_TYPE_SYNC_MAX     240 //1..240: on every n-th SYNC
+#define PDO_TYPE_RTR          253 //only on remote transmission request
+#define PDO_TYPE_CYCLIC       254 //manufacturer specific: sent by SendAll(), the default
+#define PDO_TYPE_EVENT        255 //on change of a mapped value, limited by inhibit time and event timer
+
+//Number of CAN map send messages that can have a transmission type other than PDO_TYPE_CYCLIC
+#ifndef PDO_MAX_TPDOS
+#define PDO_MAX_TPDOS         MAX_MESSAGES
+#endif
+
+/** \brief Transmits the send messages of a CanMap as CANopen TPDOs.
+ * Messages are identified by their CAN id. Unless configured otherwise they are
+ * sent whenever SendAll() is called, just like with CanMap::SendAll().
+ * Synchronous messages are sampled and sent from the receive context of the SYNC
+ * message, so all nodes on the bus transmit in lockstep.
+ */
+class CanPdo: CanCallback
+{
+   public:
+      explicit CanPdo(CanMap* cm);
+      void HandleClear() override;
+      void HandleRx(uint32_t canId, uint32_t data[2], uint8_t dlc) override;
+      void SetSyncId(uint32_t id);
+      uint32_t GetSyncId() { return syncId; }
+      bool Configure(uint32_t cobId, uint8_t type, uint16_t inhibitTime = 0, uint16_t eventTimer = 0);
+      void GetConfig(uint32_t cobId, uint8_t& type, uint16_t& inhibitTime, uint16_t& eventTimer);
+      void TriggerEvent(uint32_t cobId);
+      void SendAll();
+      void Tick(int callingFrequency);
+      CanMap* GetCanMap() { return canMap; }
+
+   private:
+      struct Tpdo
+      {
+         uint32_t cobId; //0 if unused
+         uint32_t changeSeq; //parameter change sequence number at last transmission
+         int32_t inhibit; //remaining inhibit time in 100us
+         int32_t eventTime; //remaining time until event timer expires in ms
+         uint16_t inhibitTime; //in 100us as in CiA 301
+         uint16_t eventTimer; //in ms, 0 to disable
+         uint8_t type;
+         uint8_t syncCount;
+         volatile bool event;
+      };
+
+      CanMap* canMap;
+      CanHardware* canHardware;
+      uint32_t syncId;
+      Tpdo tpdos[PDO_MAX_TPDOS];
+
+      Tpdo* Find(uint32_t cobId);
+      int FindMessage(uint32_t cobId);
+      bool MappedValueChanged(Tpdo* tpdo);
+      void Send(Tpdo* tpdo);
+};
+
+#endif // CANPDO_H
@@ -22,6 +22,15 @@
 #include "printf.h"
 #include "canhardware.h"
 #include "canmap.h"
+#include "canpdo.h"
+#include "streamsource.h"
+#include "paramvalues.h"
+#include "paramdelta.h"
+#include "canmapstream.h"
+#include "paramimport.h"
+#include "paramschema.h"
+#include "paramrecorder.h"
+#include "parambinary.h"
 
 #define SDO_REQUEST_DOWNLOAD  (1 << 5)
 #define SDO_REQUEST_UPLOAD    (2 << 5)
@@ -36,10 +45,120 @@
 #define SDO_ABORT             0x80
 #define SDO_WRITE_REPLY       SDO_RESPONSE_DOWNLOAD
 #define SDO_READ_REPLY        (SDO_RESPONSE_UPLOAD | SDO_EXPEDITED | SDO_SIZE_SPECIFIED)
+#define SDO_REQUEST_BLOCK_UPLOAD  (5 << 5)
+#define SDO_RESPONSE_BLOCK_UPLOAD (6 << 5)
+#define SDO_BLOCK_INITIATE    0
+#define SDO_BLOCK_END         1
+#define SDO_BLOCK_ACK         2
+#define SDO_BLOCK_START       3
+#define SDO_BLOCK_SUBCMD_MASK 3
+#define SDO_BLOCK_CRC         (1 << 2)
+#define SDO_BLOCK_SIZE_IND    (1 << 1)
+#define SDO_REQUEST_DOWNLOAD_SEGMENT (0 << 5)
+#define SDO_RESPONSE_DOWNLOAD_SEGMENT (1 << 5)
+#define SDO_LAST_SEGMENT      (1)
+#define SDO_BLOCK_LAST_SEG    0x80
+#define SDO_REQUEST_BLOCK_DOWNLOAD  (6 << 5)
+#define SDO_RESPONSE_BLOCK_DOWNLOAD (5 << 5)
+#define SDO_INDEX_MAP_TX      0x3000
+#define SDO_INDEX_MAP_RX      0x3001
+#define SDO_INDEX_MAP_LIST    0x3002
+#define SDO_INDEX_IMPORT      0x5005
+#define SDO_ERR_TOGGLE        0x05030000
+#define SDO_ERR_TIMEOUT       0x05040000
+#define SDO_ERR_CMD           0x05040001
+#define SDO_ERR_BLKSIZE       0x05040002
+#define SDO_ERR_CRC           0x05040004
+#define SDO_ERR_WRITEONLY     0x06010001
+#define SDO_ERR_READONLY      0x06010002
 #define SDO_ERR_INVIDX        0x06020000
+#define SDO_ERR_LENGTH        0x06070010
 #define SDO_ERR_RANGE         0x06090030
 #define SDO_ERR_GENERAL       0x08000000
 
+//Maximum number of 7 byte segments per block upload or client block download.
+//The peer may ask for less but not more. Keep it below the CAN send buffer size
+//as an entire block is queued at once.
+#ifndef SDO_BLOCK_SIZE
+#define SDO_BLOCK_SIZE        16
+#endif
+
+//Sub indexes of SDO_INDEX_STRINGS
+#define SDO_STRINGS_JSON      0 //printed by the main loop, see GetPrintRequest()
+#define SDO_STRINGS_SCHEMA    1 //static parameter schema, see ParamSchema
+#define SDO_STRINGS_BINARY    2 //binary parameter table, register a ParamBinary with SetBinarySource()
+#define SDO_STRINGS_BINARY_LZ 3 //the same, compressed by an LzStream
+
+//Maximum length of the print arguments that can be downloaded to SDO_INDEX_STRINGS
+#ifndef SDO_PRINT_ARGS_LEN
+#define SDO_PRINT_ARGS_LEN    32
+#endif
+
+//Number of SDO_INDEX_STRINGS sub indexes that can be served by a stream source
+#ifndef SDO_MAX_STRING_SOURCES
+#define SDO_MAX_STRING_SOURCES 4
+#endif
+
+//Maximum number of parameters that can be transferred with one bulk read or write
+#ifndef SDO_MAX_BULK_PARAMS
+#define SDO_MAX_BULK_PARAMS   32
+#endif
+
+//Number of client requests that can be queued or in flight at the same time
+#ifndef SDO_CLIENT_QUEUE_LEN
+#define SDO_CLIENT_QUEUE_LEN  8
+#endif
+
+//Default time in ms to wait for a server reply
+#ifndef SDO_CLIENT_TIMEOUT
+#define SDO_CLIENT_TIMEOUT    100
+#endif
+
+/** \brief Receives the outcome of an asynchronous SDO client request.
+ * Called from the CAN receive context or from TriggerTimeout()
+ */
+class SdoClientCallback
+{
+public:
+   /** \brief Request finished
+    * \param success true if the server confirmed the request
+    * \param data value read on success, abort code on failure. SDO_ERR_TIMEOUT if the server didn't answer
+    */
+   virtual void SdoComplete(uint8_t nodeId, uint16_t index, uint8_t subIndex, bool success, uint32_t data) = 0;
+
+   /** \brief Server confirmed having received part of a download
+    * \param bytes number of bytes received so far, counted from the start of the stream
+    */
+   virtual void SdoAcknowledged(uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t bytes) { (void)nodeId; (void)index; (void)subIndex; (void)bytes; }
+};
+
+/** \brief Collects a downloaded text in a fixed size buffer */
+class StringSink: public IStreamSink
+{
+public:
+   StringSink(char* buf, int size) : buf(buf), size(size), pos(0), complete(false) { buf[0] = 0; }
+   uint32_t Begin(uint32_t len) override { pos = 0; buf[0] = 0; complete = false; return len < (uint32_t)size ? 0 : SDO_ERR_LENGTH; }
+   uint32_t Write(const uint8_t* data, int len) override
+   {
+      for (int i = 0; i < len; i++)
+      {
+         if (pos >= size - 1) return SDO_ERR_LENGTH;
+         buf[pos++] = data[i];
+      }
+      buf[pos] = 0;
+      return 0;
+   }
+   uint32_t End() override { complete = true; return 0; }
+   /** \brief Whether the last download ran to its end */
+   bool IsComplete() { return complete; }
+
+private:
+   char* buf;
+   int size;
+   int pos;
+   bool complete;
+};
+
 class CanSdo: CanCallback, public IPutChar
 {
    public:
@@ -59,17 +178,60 @@ class CanSdo: CanCallback, public IPutChar
       void SDOWrite(uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data);
       void SDORead(uint8_t nodeId, uint16_t index, uint8_t subIndex);
       bool SDOReadReply(uint32_t& data);
+      bool SDOWriteAsync(uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data, SdoClientCallback* cb, int timeout = SDO_CLIENT_TIMEOUT);
+      bool SDOReadAsync(uint8_t nodeId, uint16_t index, uint8_t subIndex, SdoClientCallback* cb, int timeout = SDO_CLIENT_TIMEOUT);
+      bool SDODownloadAsync(uint8_t nodeId, uint16_t index, uint8_t subIndex, IStreamSource* source, SdoClientCallback* cb, int timeout = SDO_CLIENT_TIMEOUT);
+      bool SDOBlockDownloadAsync(uint8_t nodeId, uint16_t index, uint8_t subIndex, IStreamSource* source, SdoClientCallback* cb, int timeout = SDO_CLIENT_TIMEOUT);
+      int GetPendingRequests();
       void RemoteMap(uint8_t nodeId, bool rx, uint32_t cobId, CanMap::CANPOS mapping);
       void SetNodeId(uint8_t id);
+      void SetParamStore(Param::Store* store);
+      Param::Store* GetParamStore() { return paramStore; }
       int GetPrintRequest() { return printRequest; }
+      char* GetPrintArgs() { return printArgs; }
+      void SetStringSource(uint8_t subIndex, IStreamSource* source);
+      void SetBinarySource(ParamBinary* binary, IStreamSource* compressed = 0);
+      void SetCanPdo(CanPdo* pdo) { canPdo = pdo; }
+      void SetRecorder(ParamRecorder* r) { recorder = r; }
+      void SetImportBuffer(uint8_t* buf, uint32_t size) { paramImport.SetBuffer(buf, size); }
       virtual bool ProcessUserSpaceSdo(SdoFrame*) { return false; }
       void SendSdoReply(SdoFrame* sdoFrame);
       void PutChar(char c) override;
       void TriggerTimeout(int callingFrequency);
 
    private:
+      enum BlockState { BLOCK_IDLE, BLOCK_INITIATED, BLOCK_READY, BLOCK_SENT, BLOCK_DONE };
+      enum ClientState { CLIENT_FREE, CLIENT_QUEUED, CLIENT_PENDING };
+
+      struct ClientRequest
+      {
+         SdoClientCallback* callback;
+         IStreamSource* source; //data of segmented or block download
+         uint32_t data; //value or size of download
+         uint32_t offset; //bytes of a block download read from source
+         uint32_t blockStart; //offset of the first byte of the block in flight
+         uint32_t seq; //orders requests to the same node
+         int timeout; //remaining time in ms
+         int timeoutReload;
+         uint16_t index;
+         uint8_t subIndex;
+         uint8_t nodeId;
+         uint8_t cmd;
+         uint8_t toggle;
+         uint8_t blockSize; //segments per block as requested by the server
+         uint8_t blockSegments; //segments of the block in flight
+         uint16_t crc; //CRC of the bytes read from source
+         bool crcEnabled;
+         bool segmented; //download initiated, now sending segments
+         volatile uint8_t state;
+      };
+
       CanHardware* canHardware;
       CanMap* canMap;
+      CanPdo* canPdo;
+      ParamRecorder* recorder;
+      Param::Store* paramStore;
+      ParamBinary* paramBinary;
       uint8_t nodeId;
       uint8_t remoteNodeId;
       int printRequest;
@@ -85,11 +247,83 @@ class CanSdo: CanCallback, public IPutChar
       CanMap::CANPOS mapInfo;
       bool sdoReplyValid;
       uint32_t sdoReplyData;
+      uint16_t sdoRequestIndex;
+      uint8_t sdoRequestSubIndex;
+      bool clientFilterActive;
+      uint32_t clientSeq;
+      ClientRequest clientRequests[SDO_CLIENT_QUEUE_LEN];
+      //Block upload state. The print producer fills blockBuffer, a complete
+      //block is sent once the client is ready and acknowledged as a whole.
+      volatile uint8_t blockState;
+      volatile uint8_t blockIdle;
+      volatile uint16_t blockBytes; //bytes currently held in blockBuffer
+      uint16_t blockBytesSent; //bytes of blockBuffer sent with the last block
+      uint16_t blockCrc;
+      uint8_t blockSize; //segments per block as requested by the client
+      uint8_t blockUnusedBytes; //bytes without data in the last segment
+      bool blockCrcEnabled;
+      bool blockLast;
+      uint8_t blockBuffer[SDO_BLOCK_SIZE * 7 + 1]; //one extra byte to look ahead for the end of a stream
+      IStreamSource* stringSources[SDO_MAX_STRING_SOURCES];
+      IStreamSource* activeSource;
+      //Segmented download state
+      IStreamSink* activeSink;
+      uint16_t sinkIndex;
+      uint8_t sinkSubIndex;
+      uint8_t sinkToggle;
+      //Block download state, segments are passed to activeSink as they arrive
+      volatile uint8_t dlBlockState;
+      uint8_t dlSeq; //last segment received in order within the current block
+      uint16_t dlCrc;
+      bool dlCrcEnabled;
+      int dlTimeout;
+      uint8_t dlLastSegment[7]; //held back until we know how many bytes are valid
+      //Bulk transfer list, holds parameter indexes resolved from their UIDs
+      uint16_t bulkParams[SDO_MAX_BULK_PARAMS];
+      uint8_t bulkCount;
+      //Values of a bulk write, applied once all of them arrived
+      s32fp bulkStaging[SDO_MAX_BULK_PARAMS];
+      ParamValues bulkValues;
+      ParamValues allValues;
+      ParamDelta deltaValues;
+      ParamSchema schema;
+      CanMapStream mapStream;
+      ParamImport paramImport;
+      char printArgs[SDO_PRINT_ARGS_LEN];
+      StringSink printArgsSink;
+      bool printArgsFresh;
 
       void ProcessSDO(uint32_t* data);
+      bool ProcessBlockUpload(uint32_t* data);
+      void ProcessDownload(SdoFrame* sdo, IStreamSink* sink);
+      void ProcessDownloadSegment(uint32_t* data);
+      void ProcessBlockDownload(uint32_t* data);
+      bool ProcessBlockDownloadSegment(uint32_t* data);
+      uint32_t WriteBlockData(const uint8_t* data, int len);
+      IStreamSink* GetSinkObject(SdoFrame* sdo);
+      void ProcessBulkList(SdoFrame* sdo);
+      ParamValues* GetValuesObject(SdoFrame* sdo);
+      IStreamSource* GetStreamObject(SdoFrame* sdo);
+      void ProcessPdoConfig(SdoFrame* sdo);
+      void ProcessRecorder(SdoFrame* sdo);
+      void SendBlock(bool last);
+      void SendSourceBlock();
+      void StartStringUpload(uint8_t subIndex);
       void ReadOrDeleteCanMap(SdoFrame *sdo);
       void AddCanMap(SdoFrame *sdo, bool rx);
       void InitiateSDOTransfer(uint8_t req, uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data);
+      void EnableClientFilter();
+      bool QueueRequest(uint8_t req, uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data, SdoClientCallback* cb, int timeout, IStreamSource* source = 0);
+      void SendSegment(ClientRequest* request);
+      void SendDownloadBlock(ClientRequest* request);
+      void ProcessBlockAck(ClientRequest* request, uint8_t ackSeq, uint8_t blockSize);
+      void SeekSource(ClientRequest* request, uint32_t offset);
+      bool ProcessClientReply(uint8_t nodeId, SdoFrame* sdoFrame);
+      void CompleteRequest(ClientRequest* request, bool success, uint32_t data);
+      void SendRequest(ClientRequest* request);
+      void SendNextRequest(uint8_t nodeId);
+      void SendAbort(uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t err);
+      void SendClientFrame(uint8_t cmd, uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data);
 };
 
 #endif // CANSDO_H
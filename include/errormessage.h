@@ -20,8 +20,17 @@
 #define ERRORMESSAGE_H
 
 #include "errormessage_prj.h"
+#include "flashstore.h"
 #include <stdint.h>
 
+//Changed errors that one SaveLog() appends to the journal
+#ifndef ERRLOG_JOURNAL_BATCH
+#define ERRLOG_JOURNAL_BATCH 8
+#endif // ERRLOG_JOURNAL_BATCH
+
+//Records on the journal page after its 2 word header, 5 words each
+#define ERRLOG_JOURNAL_RECORDS ((FLASH_PAGE_SIZE / 4 - 2) / 5)
+
 #define ERROR_MESSAGE_ENTRY(id, type) ERR_##id,
 typedef enum
 {
@@ -39,6 +48,20 @@ typedef enum
    ERROR_LAST
 } ERROR_TYPE;
 
+/** \brief Error messages with a RAM ring of recent posts and a persistent log.
+ *
+ * The log counts the posts of each error and keeps the time of the first and
+ * last post. It is stored as FlashStore section at ERRLOG_BLKNUM and
+ * ERRLOG_BACKUP_BLKNUM, a reset while saving keeps the previous log. SaveLog()
+ * appends the changed errors to the journal page at ERRLOG_JOURNAL_BLKNUM and
+ * only commits the complete log and erases the journal when it is full.
+ *
+ * Call LoadLog() at startup and SaveLog() from a slow task, posting never touches
+ * flash. SaveLog() only returns before the flash is written when the application
+ * enabled FlashWriter::SetBackground() and calls FlashWriter::Run(). Otherwise it
+ * waits for the records to be programmed and, once per full journal, for two
+ * page erases.
+ */
 class ErrorMessage
 {
    public:
@@ -50,15 +73,40 @@ class ErrorMessage
       static ERROR_MESSAGE_NUM GetLastError();
       static ERROR_MESSAGE_NUM GetErrorNum(uint8_t index);
       static uint32_t GetErrorTime(uint8_t index);
+      static uint32_t GetPostCount() { return postCount; }
+      static const char* GetName(ERROR_MESSAGE_NUM err);
+      static uint32_t GetCount(ERROR_MESSAGE_NUM err);
+      static uint32_t GetFirstTime(ERROR_MESSAGE_NUM err);
+      static uint32_t GetLastTime(ERROR_MESSAGE_NUM err);
+      static bool LoadLog();
+      static int SaveLog();
+      static void ClearLog();
    protected:
    private:
+      struct LogEntry
+      {
+         uint32_t count;
+         uint32_t firstTime;
+         uint32_t lastTime;
+      };
+
       static void PrintError(uint32_t time, ERROR_MESSAGE_NUM err);
+      static uint32_t SerializeLog(void* context, uint32_t* image, uint32_t maxWords);
+      static bool LoadLogSection(void* context, uint16_t version, const uint32_t* data, uint32_t words);
+      static void ReplayJournal();
+      static int AppendLog();
+      static int CompactLog();
 
       static uint32_t timeTick;
       static uint32_t currentBufIdx;
       static uint32_t lastPrintIdx;
-      static bool posted[ERROR_MESSAGE_LAST];
+      static uint32_t postCount;
+      static uint32_t posted[(ERROR_MESSAGE_LAST + 31) / 32];
+      static uint32_t logDirty[(ERROR_MESSAGE_LAST + 31) / 32];
       static ERROR_MESSAGE_NUM lastError;
+      static LogEntry log[ERROR_MESSAGE_LAST];
+      static volatile bool logChanged;
+      static const FlashStore::Client logClient;
 };
 
 #endif // ERRORMESSAGE_H
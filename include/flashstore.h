@@ -0,0 +1,143 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FLASHSTORE_H
+#define FLASHSTORE_H
+
+#include <stdint.h>
+#include "flashwriter.h"
+#include "hwdefs.h"
+
+//Block numbers of the sections like CAN1_BLKNUM, 0 for none.
+//Without a backup block a section is overwritten in place.
+#ifndef CAN1_BACKUP_BLKNUM
+#define CAN1_BACKUP_BLKNUM 0
+#endif // CAN1_BACKUP_BLKNUM
+
+#ifndef USER_BLKNUM
+#define USER_BLKNUM 0
+#endif // USER_BLKNUM
+
+#ifndef USER_BACKUP_BLKNUM
+#define USER_BACKUP_BLKNUM 0
+#endif // USER_BACKUP_BLKNUM
+
+#ifndef ERRLOG_BLKNUM
+#define ERRLOG_BLKNUM 0
+#endif // ERRLOG_BLKNUM
+
+#ifndef ERRLOG_BACKUP_BLKNUM
+#define ERRLOG_BACKUP_BLKNUM 0
+#endif // ERRLOG_BACKUP_BLKNUM
+
+//Journal page of the error log, written by ErrorMessage and not a section
+#ifndef ERRLOG_JOURNAL_BLKNUM
+#define ERRLOG_JOURNAL_BLKNUM 0
+#endif // ERRLOG_JOURNAL_BLKNUM
+
+#define FLASHSTORE_FOOTER_WORDS 9
+
+/** \brief Versioned sections of persistent data that are committed together.
+ *
+ * Every section occupies one flash page at a block number counted from the end
+ * of flash, like PARAM_BLKNUM. The page holds the section data followed by a
+ * footer at the end of the page with type, schema version, commit generation
+ * and CRC. The footer is programmed after the data, so a section is only valid
+ * once it was completely written.
+ *
+ * Commit() writes all registered sections whose data changed with one new
+ * generation. When a section has a backup block, the copy that is not in use
+ * is overwritten and the previous one stays intact. Every footer names the
+ * generation of each section's copy at its commit. Load() follows the newest
+ * commit whose sections are all valid, so a reset during a commit returns
+ * every section to the previous commit.
+ *
+ * A section without a backup block is overwritten in place. A reset while it
+ * is written loses that section, the others still load from their last
+ * complete commit.
+ *
+ * Data from before this engine is read by the migrate function of a client.
+ * Newer schema versions are handled by the load function of a client, which
+ * gets the version the data was written with.
+ */
+class FlashStore
+{
+   public:
+      enum Section
+      {
+         SECTION_CANMAP, //CAN1_BLKNUM, CAN1_BACKUP_BLKNUM
+         SECTION_USER,   //USER_BLKNUM, USER_BACKUP_BLKNUM, free for the application
+         SECTION_ERRORLOG, //ERRLOG_BLKNUM, ERRLOG_BACKUP_BLKNUM
+         SECTION_LAST
+      };
+
+      struct Client
+      {
+         uint16_t version; //Schema version written by serialize
+         /** Write the section data to image, return the number of words */
+         uint32_t (*serialize)(void* context, uint32_t* image, uint32_t maxWords);
+         /** Load data written with schema version, return false if it can't be used */
+         bool (*load)(void* context, uint16_t version, const uint32_t* data, uint32_t words);
+         /** Load data from before this engine at the given page, 0 if there is none */
+         bool (*migrate)(void* context, uint32_t address);
+         void* context;
+         uint32_t* image; //Written by FlashWriter, must not change during a commit
+         uint32_t imageWords;
+      };
+
+      static void Register(Section section, const Client* client);
+      static void Unregister(Section section, const Client* client);
+      static bool Load(Section section);
+      static int Commit(uint32_t sections = 0xFFFFFFFF);
+      static bool IsBusy();
+      static int GetStatus();
+      static uint32_t GetMaxWords();
+      static uint32_t GetBlockAddress(uint32_t blockNum, uint32_t blockSize);
+      static uint32_t Crc(const uint32_t* data, uint32_t words);
+      static uint32_t CrcWord(uint32_t crc, uint32_t data);
+      static bool IsErased(uint32_t address, uint32_t bytes);
+
+   private:
+      struct Footer
+      {
+         uint32_t magic;
+         uint16_t type;
+         uint16_t version;
+         uint32_t generation;
+         uint32_t mask; //Sections that must be valid for this commit to be complete
+         uint32_t words;
+         uint32_t gens[SECTION_LAST]; //Generation of the copy of each section at this commit, 0 for none
+         uint32_t crc; //Over the data and the footer words before it
+      };
+
+      static const Client* clients[SECTION_LAST];
+      static FlashWriter::Job dataJobs[SECTION_LAST];
+      static FlashWriter::Job footerJobs[SECTION_LAST];
+      static Footer footers[SECTION_LAST];
+      static volatile bool committing;
+
+      static uint32_t GetCopyAddress(int section, int copy);
+      static const Footer* GetValidFooter(int section, int copy);
+      static int QueueCommit(uint32_t sections);
+      static uint32_t GetCrc(const uint32_t* data, const Footer* footer);
+      static bool IsComplete(const Footer* footer);
+      static const Footer* GetCommittedState();
+      static int FindCopy(int section);
+};
+
+#endif // FLASHSTORE_H
@@ -0,0 +1,84 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FLASHWRITER_H
+#define FLASHWRITER_H
+
+#include <stdint.h>
+
+//Number of jobs that can wait for the writer
+#ifndef FLASH_WRITER_QUEUE_LEN
+#define FLASH_WRITER_QUEUE_LEN 8
+#endif // FLASH_WRITER_QUEUE_LEN
+
+//Words programmed per call of Run()
+#ifndef FLASH_WRITER_CHUNK_WORDS
+#define FLASH_WRITER_CHUNK_WORDS 16
+#endif // FLASH_WRITER_CHUNK_WORDS
+
+/** \brief Erases and programs flash in small steps so interrupts stay enabled.
+ *
+ * Callers prepare the complete flash image in RAM and queue a job. Jobs are
+ * processed in order, one page erase or FLASH_WRITER_CHUNK_WORDS words per call
+ * of Run(). Every programmed chunk is read back and compared with the source.
+ *
+ * Without background mode Queue() writes the job right away, which is how saving
+ * worked before. With background mode the application calls Run() from a low
+ * priority task, e.g. every 10 ms, and saving no longer stalls the control loop.
+ * Note that on single bank devices the CPU still waits for an erase or program
+ * operation when it fetches code from flash meanwhile.
+ */
+class FlashWriter
+{
+   public:
+      enum Status
+      {
+         STATUS_IDLE,
+         STATUS_QUEUED,
+         STATUS_DONE,
+         STATUS_ERROR //read back did not match the source
+      };
+
+      struct Job
+      {
+         uint32_t address; //word aligned, page aligned when erasing
+         const uint32_t* data; //must stay unchanged until the job is done
+         uint32_t words;
+         uint32_t eraseBytes; //erased from address before programming, multiple of the page size
+         volatile uint8_t status;
+         uint32_t erased;
+         uint32_t written;
+      };
+
+      static bool Queue(Job* job, uint32_t address, const uint32_t* data, uint32_t words, uint32_t eraseBytes = 0);
+      static void Prepare(Job* job, uint32_t address, const uint32_t* data, uint32_t words, uint32_t eraseBytes = 0);
+      static bool Queue(Job* const* jobs, int count);
+      static bool Run();
+      static void Flush();
+      static bool IsBusy() { return head != tail; }
+      static void SetBackground(bool on) { background = on; }
+
+   private:
+      static Job* queue[FLASH_WRITER_QUEUE_LEN];
+      static volatile uint8_t head;
+      static volatile uint8_t tail;
+      static volatile bool running;
+      static bool background;
+};
+
+#endif // FLASHWRITER_H
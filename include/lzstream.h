@@ -0,0 +1,87 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LZSTREAM_H
+#define LZSTREAM_H
+
+#include "streamsource.h"
+
+//Size of the history a match can refer to, must be a power of 2 and not above 256
+#ifndef LZ_WINDOW_SIZE
+#define LZ_WINDOW_SIZE 256
+#endif
+
+//Longest match that is searched for, at most 258
+#ifndef LZ_MAX_MATCH
+#define LZ_MAX_MATCH   34
+#endif
+
+//Number of history positions starting with the right byte that are compared
+//against the lookahead. Bounds the time spent per byte, which matters as the
+//stream may be read from the CAN receive interrupt
+#ifndef LZ_MAX_CANDIDATES
+#define LZ_MAX_CANDIDATES 8
+#endif
+
+#define LZ_MIN_MATCH   3
+
+/** \brief Compresses another stream on the fly with a small LZ77 codec.
+ * Output comes in groups of a flag byte followed by up to 8 items. Bit n of
+ * the flag byte (LSB first) tells whether item n is a literal byte (0) or a
+ * match (1). A match consists of two bytes, the distance - 1 and the
+ * length - LZ_MIN_MATCH, and copies that many bytes starting distance bytes
+ * back in the output, the source may overlap the destination. The stream
+ * simply ends after the last item.
+ *
+ * A host side decoder:
+ *    while i < len(data):
+ *       flags = data[i]; i += 1
+ *       for bit in range(8):
+ *          if i >= len(data): break
+ *          if flags & (1 << bit):
+ *             dist, n = data[i] + 1, data[i + 1] + 3; i += 2
+ *             for _ in range(n): out.append(out[-dist])
+ *          else:
+ *             out.append(data[i]); i += 1
+ */
+class LzStream: public IStreamSource
+{
+   public:
+      explicit LzStream(IStreamSource* src);
+      void Rewind() override;
+      int Read(uint8_t* buf, int len) override;
+
+   private:
+      IStreamSource* source;
+      uint32_t historyLen; //bytes in window, saturates at LZ_WINDOW_SIZE
+      uint8_t windowPos; //next write position in window
+      uint8_t aheadLen;
+      uint8_t outLen;
+      uint8_t outPos;
+      bool sourceEnd;
+      uint8_t window[LZ_WINDOW_SIZE];
+      uint8_t ahead[LZ_MAX_MATCH];
+      uint8_t out[1 + 8 * 2]; //one group
+
+      void CompressGroup();
+      int FindMatch(int& distance);
+      void Consume(int len);
+      uint8_t HistoryByte(int distance, int offset);
+};
+
+#endif // LZSTREAM_H
@@ -19,6 +19,8 @@
 #ifndef MY_STRING_H
 #define MY_STRING_H
 
+#include <stdint.h>
+
 #ifndef NULL
 #define NULL 0L
 #endif
@@ -34,9 +36,11 @@ extern "C"
 int my_strcmp(const char *str1, const char *str2);
 void my_strcat(char *str1, const char *str2);
 int my_strlen(const char *str);
+uint16_t my_strhash(const char *str);
 const char *my_strchr(const char *str, const char c);
 int my_ltoa(char *buf, int val, int base);
 int my_atoi(const char *str);
+unsigned my_atou(const char *str);
 char *my_trim(char *str);
 void memcpy32(int* target, int *source, int length);
 void memset32(int* target, int value, int length);
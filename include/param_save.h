@@ -19,12 +19,24 @@
 #ifndef PARAM_SAVE_H_INCLUDED
 #define PARAM_SAVE_H_INCLUDED
 
+/* Parameters are saved as a record log in PARAM_LOG_PAGES blocks of PARAM_BLKSIZE,
+ * starting at PARAM_BLKNUM from the end of flash. With 2 or more blocks a save
+ * that is interrupted by a reset leaves the previous parameters readable.
+ * The default of 1 block keeps the flash layout of older projects but is NOT
+ * power fail safe: when the block is full, it is erased and rewritten in place
+ * and a reset in between loses all saved parameters.
+ */
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+//Returned by parm_save() when the previous save is still being written
+#define PARM_SAVE_BUSY 0xFFFFFFFF
+
 uint32_t parm_save(void);
+int parm_save_status(void);
 int parm_load(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,80 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMBINARY_H
+#define PARAMBINARY_H
+
+#include "streamsource.h"
+#include "params.h"
+
+//Maximum number of distinct unit and category strings that are interned
+#ifndef PARAMBINARY_MAX_STRINGS
+#define PARAMBINARY_MAX_STRINGS 64
+#endif
+
+#define PARAMBINARY_VERSION 1
+
+/** \brief Compact binary encoding of the parameter table.
+ * Integers are unsigned LEB128 varints, values are raw little endian s32fp.
+ *
+ * Header: 'O' 'B' version, varint number of entries
+ * Entry:  varint index, varint id, type byte (PARAM_TYPE | hidden << 2),
+ *         varint name length, name, unit string,
+ *         for parameters only: category string, minimum, maximum, default,
+ *         value
+ * String: varint n, n = 0: inline, followed by varint length and the characters
+ *         n = 1: inline like 0, then appended to the string table
+ *         n > 1: entry n - 2 of the string table
+ *
+ * The table starts out empty, units and categories are sent once and then
+ * referenced. Like ParamJson the document is produced piece by piece.
+ */
+class ParamBinary: public IStreamSource
+{
+   public:
+      explicit ParamBinary(bool printHidden = false);
+      void SetPrintHidden(bool h) { printHidden = h; }
+      /** \brief Encode values and flags of the given store instead of the default store */
+      void SetStore(Param::Store* s) { store = s; }
+      void Rewind() override;
+      int Read(uint8_t* buf, int len) override;
+
+   private:
+      enum State { STATE_START, STATE_ENTRY, STATE_NAME, STATE_UNITREF, STATE_UNIT,
+                   STATE_CATEGORYREF, STATE_CATEGORY, STATE_VALUES, STATE_DONE };
+
+      bool NextPiece();
+      void NextEntry(int start);
+      void AddVarint(uint32_t value);
+      void AddFixed(s32fp value);
+      void AddString(const char* str);
+      bool IsVisible(int param);
+
+      Param::Store* store;
+      bool printHidden;
+      uint8_t state;
+      uint8_t numStrings;
+      int item;
+      const char* inlineString; //string to be sent after its reference
+      const uint8_t* current; //remaining part of the current piece
+      int remaining;
+      uint8_t formatBuf[24];
+      const char* strings[PARAMBINARY_MAX_STRINGS];
+};
+
+#endif // PARAMBINARY_H
@@ -0,0 +1,62 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMDELTA_H
+#define PARAMDELTA_H
+
+#include "streamsource.h"
+#include "params.h"
+
+/** \brief Binary stream of the parameter values that changed since a given sequence number.
+ * The stream starts with the current change sequence number as little endian 32-bit word,
+ * the client passes it to SetSince() on its next poll. It is followed by one record per
+ * changed parameter: 16-bit parameter index and 32-bit s32fp value, both little endian.
+ * The records are in the order of the last change when the change journal still reaches
+ * back to the given sequence number, otherwise in parameter index order.
+ * A parameter that changes while the stream is read may be sent again on the next poll,
+ * but a change is never lost.
+ */
+class ParamDelta: public IStreamSource
+{
+   public:
+      ParamDelta();
+      void SetStore(Param::Store* s) { store = s; }
+      /** \brief Set the sequence number received with the previous poll, 0 to transfer all values */
+      void SetSince(uint32_t seq) { since = seq; }
+      uint32_t GetSince() { return since; }
+      void Rewind() override;
+      int Read(uint8_t* buf, int len) override;
+
+   private:
+      static const int RECORD_SIZE = 6;
+
+      Param::Store* store;
+      uint32_t since;
+      int nextParam;
+      uint32_t journalSeq;
+      uint32_t endSeq;
+      bool useJournal;
+      uint8_t record[RECORD_SIZE];
+      uint8_t recordLen;
+      uint8_t recordPos;
+
+      int NextChanged();
+      void SetRecord(uint32_t value, int len);
+};
+
+#endif // PARAMDELTA_H
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMFILTER_H
+#define PARAMFILTER_H
+
+#include "params.h"
+
+/** \brief Selects a subset of the parameter table for listing.
+ * The filter is given as comma separated options, all must match:
+ *   h           include hidden parameters
+ *   c=name      only parameters of category name
+ *   t=p|t|v     only parameters, test parameters or spot values
+ *   u=min-max   only UIDs from min to max
+ *   d           only items that differ from their default
+ *   s=index     start listing at parameter index (page cursor)
+ *   n=count     list at most count items (page size)
+ * e.g. "c=Motor,d,n=20"
+ */
+class ParamFilter
+{
+   public:
+      ParamFilter();
+      void Clear();
+      bool Parse(const char* args);
+      bool Matches(Param::PARAM_NUM param, Param::Store* store = &Param::defaultStore) const;
+      bool IncludeHidden() const { return hidden; }
+      int GetStart() const { return start; }
+      int GetPageSize() const { return pageSize; }
+
+   private:
+      const char* category; //0 for all categories
+      uint16_t minId;
+      uint16_t maxId;
+      uint16_t start;
+      uint16_t pageSize; //0 for unlimited
+      uint8_t types; //bit mask of PARAM_TYPE, 0 for all
+      bool changedOnly;
+      bool hidden;
+      bool noCategory; //category given but not found, nothing matches
+};
+
+#endif // PARAMFILTER_H
@@ -0,0 +1,77 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMIMPORT_H
+#define PARAMIMPORT_H
+
+#include "streamsource.h"
+#include "canmapstream.h"
+
+#define PARAMIMPORT_MAGIC0      'O'
+#define PARAMIMPORT_MAGIC1      'C'
+#define PARAMIMPORT_VERSION     1
+#define PARAMIMPORT_HEADER_SIZE 8
+#define PARAMIMPORT_PARAM_SIZE  6
+#define PARAMIMPORT_CRC_SIZE    4
+
+//Header flags
+#define PARAMIMPORT_SAVE        1 //save parameters and CAN map to flash after applying them
+#define PARAMIMPORT_CANMAP      2 //the records replace the entire CAN map, otherwise it is left alone
+
+/** \brief Imports a parameter set and CAN map as one blob and applies it atomically.
+ * The blob is laid out as follows, all numbers little endian:
+ * - header: 'O', 'C', version, flags, 16-bit parameter count, 16-bit mapping count
+ * - per parameter: 16-bit UID, 32-bit s32fp value
+ * - per mapping: one 12 byte CanMapStream record
+ * - CRC-32 (as used by zlib) over all preceding bytes
+ *
+ * The blob is collected in a buffer supplied by the application. Only when it
+ * is complete and every value and mapping has been validated, the parameters
+ * are set and the CAN map is replaced. A faulty blob changes nothing.
+ */
+class ParamImport: public IStreamSink
+{
+   public:
+      explicit ParamImport(CanMap* cm);
+      void SetCanMap(CanMap* cm) { canMap = cm; mapStream.SetCanMap(cm); }
+      void SetStore(Param::Store* s) { store = s; }
+      void SetBuffer(uint8_t* buf, uint32_t size);
+      bool HasBuffer() { return 0 != buffer; }
+      uint32_t Begin(uint32_t size) override;
+      uint32_t Write(const uint8_t* buf, int len) override;
+      uint32_t End() override;
+
+      static uint32_t Crc32(uint32_t crc, const uint8_t* data, uint32_t len);
+
+   private:
+      CanMap* canMap;
+      Param::Store* store;
+      CanMapStream mapStream;
+      uint8_t* buffer;
+      uint32_t bufSize;
+      uint32_t pos;
+
+      uint32_t Validate(uint16_t& paramCount, uint16_t& mapCount);
+      uint32_t ValidateMap(const uint8_t* records, uint16_t count);
+      uint32_t Apply(uint16_t paramCount, uint16_t mapCount);
+      uint32_t Save();
+      static uint32_t GetWord(const uint8_t* data);
+      static uint16_t GetHalfWord(const uint8_t* data) { return data[0] | (data[1] << 8); }
+};
+
+#endif // PARAMIMPORT_H
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMJSON_H
+#define PARAMJSON_H
+
+#include "streamsource.h"
+#include "canmap.h"
+#include "paramfilter.h"
+
+/** \brief Resumable writer for the parameter JSON.
+ * The document is produced as a sequence of small pieces, either flash
+ * resident strings or short formatted numbers. Only the current piece is held
+ * in RAM so any number of bytes can be pulled at any time at bounded cost.
+ */
+class ParamJson: public IStreamSource
+{
+   public:
+      explicit ParamJson(CanMap* cm = 0, bool printHidden = false);
+      void SetCanMap(CanMap* cm) { canMap = cm; }
+      void SetPrintHidden(bool h) { printHidden = h; }
+      void SetFilter(const ParamFilter* f) { filter = f; }
+      /** \brief List values and flags of the given store instead of the default store */
+      void SetStore(Param::Store* s) { store = s; }
+      void Rewind() override;
+      int Read(uint8_t* buf, int len) override;
+
+   private:
+      enum State
+      {
+         STATE_START, STATE_ENTRY, STATE_NAME, STATE_UNITKEY, STATE_UNIT, STATE_VALUE, STATE_CANMAP,
+         STATE_CANRX, STATE_TYPE, STATE_CATEGORY, STATE_INDEX, STATE_NEXT, STATE_SERIAL, STATE_END, STATE_DONE
+      };
+
+      bool NextPiece();
+      void NextEntry(int start);
+
+      CanMap* canMap;
+      Param::Store* store;
+      const ParamFilter* filter;
+      bool printHidden;
+      uint8_t state;
+      char comma;
+      bool canRx;
+      int item;
+      int listed; //number of entries on this page so far
+      const char* current; //remaining part of the current piece
+      char formatBuf[128];
+};
+
+#endif // PARAMJSON_H
@@ -0,0 +1,111 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMRECORDER_H
+#define PARAMRECORDER_H
+
+#include "streamsource.h"
+#include "params.h"
+
+#ifndef RECORDER_MAX_CHANNELS
+#define RECORDER_MAX_CHANNELS 8
+#endif // RECORDER_MAX_CHANNELS
+
+#define RECORDER_HEADER_SIZE 8
+
+/** \brief Oscilloscope that records selected parameters at a fixed rate into a RAM ring buffer.
+ * Sample() is called from a scheduler task or an ISR, its calling rate is the timebase.
+ * Every n-th call (decimation) records one sample of all channels. When armed the recorder
+ * fills the ring buffer and waits for the trigger, then records until the buffer holds the
+ * configured number of samples before the trigger and the rest after it.
+ *
+ * The captured block is read as a stream, all numbers little endian:
+ * - header: 16-bit channel count, 16-bit sample count, 16-bit index of the trigger sample,
+ *   16-bit decimation
+ * - per channel: 16-bit parameter UID
+ * - per sample, oldest first: one 32-bit s32fp value per channel
+ * Until a capture is complete the sample count is 0.
+ */
+class ParamRecorder: public IStreamSource
+{
+   public:
+      enum Trigger
+      {
+         TRIG_NONE,    //start immediately after the pre-trigger samples are recorded
+         TRIG_ABOVE,   //trigger parameter is above the threshold
+         TRIG_BELOW,   //trigger parameter is below the threshold
+         TRIG_RISING,  //trigger parameter crosses the threshold upwards
+         TRIG_FALLING, //trigger parameter crosses the threshold downwards
+         TRIG_ERROR,   //an error message is posted
+         TRIG_LAST
+      };
+
+      enum State { STATE_IDLE, STATE_ARMED, STATE_TRIGGERED, STATE_DONE };
+
+      ParamRecorder();
+      void SetStore(Param::Store* s) { store = s; }
+      void SetBuffer(s32fp* buf, uint32_t size);
+      bool SetChannels(const Param::PARAM_NUM* params, int count);
+      bool SetChannel(int channel, Param::PARAM_NUM param);
+      int GetChannelCount() { return numChannels; }
+      Param::PARAM_NUM GetChannel(int channel) { return channels[channel]; }
+      void SetDecimation(uint16_t n) { decimation = n > 0 ? n : 1; }
+      uint16_t GetDecimation() { return decimation; }
+      void SetPreTrigger(uint16_t samples) { preTrigger = samples; }
+      uint16_t GetPreTrigger() { return preTrigger; }
+      bool SetTrigger(Trigger mode, Param::PARAM_NUM param = Param::PARAM_INVALID, s32fp threshold = 0);
+      Trigger GetTriggerMode() { return triggerMode; }
+      Param::PARAM_NUM GetTriggerParam() { return triggerParam; }
+      s32fp GetThreshold() { return threshold; }
+      bool Arm();
+      void Stop() { state = STATE_IDLE; }
+      void ForceTrigger() { forceTrigger = true; }
+      State GetState() { return state; }
+      uint32_t GetCapacity();
+      void Sample();
+      void Rewind() override { pos = 0; }
+      int Read(uint8_t* buf, int len) override;
+      uint32_t GetSize() override;
+
+   private:
+      Param::Store* store;
+      s32fp* buffer;
+      uint32_t bufSize;
+      Param::PARAM_NUM channels[RECORDER_MAX_CHANNELS];
+      uint8_t numChannels;
+      uint16_t decimation;
+      uint16_t decimationCount;
+      uint16_t preTrigger;
+      Trigger triggerMode;
+      Param::PARAM_NUM triggerParam;
+      s32fp threshold;
+      s32fp lastTriggerValue;
+      uint32_t errorCount;
+      volatile State state;
+      volatile bool forceTrigger;
+      uint32_t capacity;
+      uint32_t writeIdx;
+      uint32_t recorded;
+      uint32_t remaining;
+      uint32_t pos;
+
+      bool IsTriggered();
+      uint8_t GetHeaderByte(uint32_t offset);
+};
+
+#endif // PARAMRECORDER_H
@@ -23,11 +23,23 @@
 #include "param_prj.h"
 #include "my_fp.h"
 
+#ifndef PARAM_MAX_OBSERVERS
+#define PARAM_MAX_OBSERVERS 16
+#endif // PARAM_MAX_OBSERVERS
+
+#ifndef PARAM_SNAPSHOT_TRIES
+#define PARAM_SNAPSHOT_TRIES 4
+#endif // PARAM_SNAPSHOT_TRIES
+
+#ifndef PARAM_JOURNAL_SIZE
+#define PARAM_JOURNAL_SIZE 32
+#endif // PARAM_JOURNAL_SIZE
+
 namespace Param
 {
-   #define PARAM_ENTRY(category, name, unit, min, max, def, id) name,
-   #define TESTP_ENTRY(category, name, unit, min, max, def, id) name,
-   #define VALUE_ENTRY(name, unit, id) name,
+   #define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) name,
+   #define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) name,
+   #define VALUE_ENTRY(name, unit, id, ...) name,
    typedef enum
    {
        PARAM_LIST
@@ -44,6 +56,17 @@ namespace Param
       FLAG_HIDDEN = 1
    } PARAM_FLAG;
 
+   /** Native storage of a value, given as optional last argument of a PARAM_LIST entry.
+    * The fixed point view of Get()/Set() converts, GetInt()/GetFloat() of a matching type don't.
+    * s32fp only holds integer parts up to FIXED_INT_MAX, larger native values saturate in the
+    * fixed point view. Conversions to int round down like FP_TOINT() does. */
+   typedef enum
+   {
+      STORAGE_FIXED, //s32fp, the default
+      STORAGE_INT,   //int32_t, also for enums and bit fields
+      STORAGE_FLOAT  //float
+   } PARAM_STORAGE;
+
    typedef enum
    {
       TYPE_PARAM,
@@ -51,6 +74,8 @@ namespace Param
       TYPE_SPOTVALUE,
    } PARAM_TYPE;
 
+   typedef void (*ChangeObserver)(PARAM_NUM param);
+
    typedef struct
    {
       char const *category;
@@ -63,6 +88,227 @@ namespace Param
       uint16_t type;
    } Attributes;
 
+   /** \brief A value in its native storage, fixed point values use the integer member */
+   union NativeValue
+   {
+      constexpr NativeValue(int32_t value) : integer(value) {}
+      constexpr NativeValue(float value) : real(value) {}
+
+      int32_t integer;
+      float real;
+   };
+
+   /** Returns the storage given in a PARAM_LIST entry, STORAGE_FIXED if there is none */
+   constexpr PARAM_STORAGE StorageOf(PARAM_STORAGE storage = STORAGE_FIXED)
+   {
+      return storage;
+   }
+
+   //Compile time tables for the templated accessors below
+   #define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) StorageOf(__VA_ARGS__),
+   #define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) StorageOf(__VA_ARGS__),
+   #define VALUE_ENTRY(name, unit, id, ...) StorageOf(__VA_ARGS__),
+   static constexpr PARAM_STORAGE nativeStorage[] = { PARAM_LIST };
+   #undef PARAM_ENTRY
+   #undef TESTP_ENTRY
+   #undef VALUE_ENTRY
+
+   #define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) FP_FROMFLT(min),
+   #define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) FP_FROMFLT(min),
+   #define VALUE_ENTRY(name, unit, id, ...) 0,
+   static constexpr s32fp minValues[] = { PARAM_LIST };
+   #undef PARAM_ENTRY
+   #undef TESTP_ENTRY
+   #undef VALUE_ENTRY
+
+   #define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) FP_FROMFLT(max),
+   #define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) FP_FROMFLT(max),
+   #define VALUE_ENTRY(name, unit, id, ...) 0,
+   static constexpr s32fp maxValues[] = { PARAM_LIST };
+   #undef PARAM_ENTRY
+   #undef TESTP_ENTRY
+   #undef VALUE_ENTRY
+
+   //Largest integer part an s32fp can hold
+   static constexpr int32_t FIXED_INT_MAX = 0x7FFFFFFF >> CST_DIGITS;
+
+   /** Rounds down like FP_TOINT() does, casting would round towards zero */
+   constexpr int FloorToInt(float v)
+   {
+      return (float)(int)v > v ? (int)v - 1 : (int)v;
+   }
+
+   /** \brief Conversion between a native storage and the fixed point, int and float views */
+   template <PARAM_STORAGE storage> struct Native;
+
+   template <> struct Native<STORAGE_FIXED>
+   {
+      static s32fp ToFixed(NativeValue v) { return v.integer; }
+      static int ToInt(NativeValue v) { return FP_TOINT(v.integer); }
+      static float ToFloat(NativeValue v) { return FP_TOFLOAT(v.integer); }
+      static NativeValue FromFixed(s32fp v) { return NativeValue(v); }
+      static NativeValue FromInt(int v) { return NativeValue((int32_t)FP_FROMINT(v)); }
+      static NativeValue FromFloat(float v) { return NativeValue((int32_t)FP_FROMFLT(v)); }
+   };
+
+   template <> struct Native<STORAGE_INT>
+   {
+      static s32fp ToFixed(NativeValue v)
+      {
+         return FP_FROMINT(v.integer > FIXED_INT_MAX ? FIXED_INT_MAX : v.integer < -FIXED_INT_MAX - 1 ? -FIXED_INT_MAX - 1 : v.integer);
+      }
+      static int ToInt(NativeValue v) { return v.integer; }
+      static float ToFloat(NativeValue v) { return v.integer; }
+      static NativeValue FromFixed(s32fp v) { return NativeValue((int32_t)FP_TOINT(v)); }
+      static NativeValue FromInt(int v) { return NativeValue((int32_t)v); }
+      static NativeValue FromFloat(float v) { return NativeValue((int32_t)FloorToInt(v)); }
+   };
+
+   template <> struct Native<STORAGE_FLOAT>
+   {
+      static s32fp ToFixed(NativeValue v)
+      {
+         float fixed = v.real * FRAC_FAC;
+         return fixed >= 2147483648.0f ? 0x7FFFFFFF : fixed < -2147483648.0f ? (s32fp)0x80000000 : (s32fp)fixed;
+      }
+      static int ToInt(NativeValue v) { return FloorToInt(v.real); }
+      static float ToFloat(NativeValue v) { return v.real; }
+      static NativeValue FromFixed(s32fp v) { return NativeValue(FP_TOFLOAT(v)); }
+      static NativeValue FromInt(int v) { return NativeValue((float)v); }
+      static NativeValue FromFloat(float v) { return NativeValue(v); }
+   };
+
+   /** Converts a default value given in PARAM_LIST to its native storage */
+   constexpr NativeValue DefaultValue(PARAM_STORAGE storage, float def)
+   {
+      return storage == STORAGE_FLOAT ? NativeValue(def) :
+             storage == STORAGE_INT ? NativeValue((int32_t)def) : NativeValue((int32_t)FP_FROMFLT(def));
+   }
+
+   PARAM_NUM NumFromString(const char *name);
+   PARAM_NUM NumFromId(uint32_t id);
+   const Attributes *GetAttrib(PARAM_NUM ParamNum);
+   PARAM_TYPE GetType(PARAM_NUM param);
+   PARAM_STORAGE GetStorage(PARAM_NUM param);
+   uint32_t GetIdSum();
+
+   /** \brief Values, flags, change tracking and observers of one node.
+    *
+    * All stores share the attributes of PARAM_LIST, so several nodes of the same
+    * firmware can run in one process, e.g. in a simulation. The Param:: functions
+    * operate on defaultStore, which is what the firmware uses.
+    * A store is constant initialized with the default values, so it is usable
+    * before any constructor has run.
+    */
+   class Store
+   {
+      public:
+         #define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) DefaultValue(StorageOf(__VA_ARGS__), def),
+         #define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) DefaultValue(StorageOf(__VA_ARGS__), def),
+         #define VALUE_ENTRY(name, unit, id, ...) DefaultValue(StorageOf(__VA_ARGS__), 0),
+         constexpr Store()
+            : values{ PARAM_LIST }, flags{}, changeSeq{}, lastChangeSeq(0), dirty{}, journal{},
+              observerOf{}, observers{}, numObservers(0), pendingChanges{}, writeSeq(0)
+         {}
+         #undef PARAM_ENTRY
+         #undef TESTP_ENTRY
+         #undef VALUE_ENTRY
+
+         int    Set(PARAM_NUM ParamNum, s32fp ParamVal);
+         s32fp  Get(PARAM_NUM ParamNum);
+         int    GetInt(PARAM_NUM ParamNum);
+         float  GetFloat(PARAM_NUM ParamNum);
+         bool   GetBool(PARAM_NUM ParamNum);
+         void   SetInt(PARAM_NUM ParamNum, int ParamVal);
+         void   SetFixed(PARAM_NUM ParamNum, s32fp ParamVal);
+         void   SetFloat(PARAM_NUM ParamNum, float ParamVal);
+         void LoadDefaults();
+         void SetFlagsRaw(PARAM_NUM param, uint8_t rawFlags);
+         void SetFlag(PARAM_NUM param, PARAM_FLAG flag);
+         void ClearFlag(PARAM_NUM param, PARAM_FLAG flag);
+         PARAM_FLAG GetFlag(PARAM_NUM param);
+         uint32_t GetChangeSeq();
+         uint32_t GetChangeSeq(PARAM_NUM param);
+         bool ChangedSince(PARAM_NUM param, uint32_t seq);
+         uint32_t ReadBegin();
+         bool ReadRetry(uint32_t seq);
+         bool Snapshot(const PARAM_NUM* params, s32fp* out, int count);
+         PARAM_NUM NextChange(uint32_t& seq);
+         bool IsDirty(PARAM_NUM param);
+         PARAM_NUM NextDirty(int start);
+         void ClearDirty(PARAM_NUM param);
+         void ClearDirty();
+         bool AddObserver(PARAM_NUM param, ChangeObserver observer, bool deferred = false);
+         int AddObserver(const char* category, ChangeObserver observer, bool deferred = false);
+         void DeliverChanges();
+         void StoreNative(PARAM_NUM param, NativeValue value, bool notify);
+
+         /** \brief Accessors for parameters known at compile time, e.g. store.GetFloat<Param::ocurlim>().
+          * Getters inline to a load of the native value with the conversion chosen at compile time.
+          * Setters inline the conversion and the change compare, only an actual change calls
+          * out of line to update the seqlock, change journal and dirty bits.
+          */
+         template <PARAM_NUM param> s32fp Get() { return Native<nativeStorage[param]>::ToFixed(values[param]); }
+         template <PARAM_NUM param> int GetInt() { return Native<nativeStorage[param]>::ToInt(values[param]); }
+         template <PARAM_NUM param> float GetFloat() { return Native<nativeStorage[param]>::ToFloat(values[param]); }
+         template <PARAM_NUM param> bool GetBool() { return GetInt<param>() == 1; }
+         template <PARAM_NUM param> void SetFixed(s32fp value) { StoreIfChanged<param>(Native<nativeStorage[param]>::FromFixed(value)); }
+         template <PARAM_NUM param> void SetInt(int value) { StoreIfChanged<param>(Native<nativeStorage[param]>::FromInt(value)); }
+         template <PARAM_NUM param> void SetFloat(float value) { StoreIfChanged<param>(Native<nativeStorage[param]>::FromFloat(value)); }
+
+         /** \brief Set with range check and change notification, like Set(PARAM_NUM, s32fp) */
+         template <PARAM_NUM param> int Set(s32fp value)
+         {
+            if (value < minValues[param] || value > maxValues[param]) return -1;
+            StoreNative(param, Native<nativeStorage[param]>::FromFixed(value), true);
+            return 0;
+         }
+
+         /** \brief Set a constant value, the range is checked at compile time */
+         template <PARAM_NUM param, s32fp value> void Set()
+         {
+            static_assert(value >= minValues[param] && value <= maxValues[param], "Value outside of parameter range");
+            StoreNative(param, Native<nativeStorage[param]>::FromFixed(value), true);
+         }
+
+      private:
+         struct Observer
+         {
+            ChangeObserver func;
+            bool deferred;
+         };
+
+         NativeValue values[PARAM_LAST];
+         uint8_t flags[PARAM_LAST];
+         //Sequence number of the last change of each parameter
+         uint32_t changeSeq[PARAM_LAST];
+         uint32_t lastChangeSeq;
+         //One bit per parameter, set on every value change until cleared by the consumer
+         uint32_t dirty[(PARAM_LAST + 31) / 32];
+         //Ring buffer of the most recent changes. Every change gets the next sequence number,
+         //so the entry of sequence number n is stored at n % PARAM_JOURNAL_SIZE
+         uint16_t journal[PARAM_JOURNAL_SIZE];
+         //Observer of each parameter as index into observers[] plus one, 0 for none
+         uint8_t observerOf[PARAM_LAST];
+         Observer observers[PARAM_MAX_OBSERVERS];
+         int numObservers;
+         //Parameters with a pending deferred change notification
+         uint32_t pendingChanges[(PARAM_LAST + 31) / 32];
+         //Seqlock over the values, odd while a value is being written
+         uint32_t writeSeq;
+
+         void StoreValue(PARAM_NUM ParamNum, NativeValue ParamVal);
+         template <PARAM_NUM param> void StoreIfChanged(NativeValue value)
+         {
+            if (values[param].integer != value.integer) StoreValue(param, value);
+         }
+         void Notify(PARAM_NUM ParamNum);
+         uint8_t ObserverIndex(ChangeObserver observer, bool deferred);
+   };
+
+   //The store of this node
+   extern Store defaultStore;
+
    int    Set(PARAM_NUM ParamNum, s32fp ParamVal);
    s32fp  Get(PARAM_NUM ParamNum);
    int    GetInt(PARAM_NUM ParamNum);
@@ -71,18 +317,38 @@ namespace Param
    void   SetInt(PARAM_NUM ParamNum, int ParamVal);
    void   SetFixed(PARAM_NUM ParamNum, s32fp ParamVal);
    void   SetFloat(PARAM_NUM ParamNum, float ParamVal);
-   PARAM_NUM NumFromString(const char *name);
-   PARAM_NUM NumFromId(uint32_t id);
-   const Attributes *GetAttrib(PARAM_NUM ParamNum);
    void LoadDefaults();
    void SetFlagsRaw(PARAM_NUM param, uint8_t rawFlags);
    void SetFlag(PARAM_NUM param, PARAM_FLAG flag);
    void ClearFlag(PARAM_NUM param, PARAM_FLAG flag);
    PARAM_FLAG GetFlag(PARAM_NUM param);
-   PARAM_TYPE GetType(PARAM_NUM param);
-   uint32_t GetIdSum();
+   uint32_t GetChangeSeq();
+   uint32_t GetChangeSeq(PARAM_NUM param);
+   bool ChangedSince(PARAM_NUM param, uint32_t seq);
+   uint32_t ReadBegin();
+   bool ReadRetry(uint32_t seq);
+   bool Snapshot(const PARAM_NUM* params, s32fp* out, int count);
+   PARAM_NUM NextChange(uint32_t& seq);
+   bool IsDirty(PARAM_NUM param);
+   PARAM_NUM NextDirty(int start);
+   void ClearDirty(PARAM_NUM param);
+   void ClearDirty();
+   bool AddObserver(PARAM_NUM param, ChangeObserver observer, bool deferred = false);
+   int AddObserver(const char* category, ChangeObserver observer, bool deferred = false);
+   void DeliverChanges();
+
+   /** \brief Accessors of the default store for parameters known at compile time, e.g. Param::GetFloat<Param::ocurlim>() */
+   template <PARAM_NUM param> s32fp Get() { return defaultStore.Get<param>(); }
+   template <PARAM_NUM param> int GetInt() { return defaultStore.GetInt<param>(); }
+   template <PARAM_NUM param> float GetFloat() { return defaultStore.GetFloat<param>(); }
+   template <PARAM_NUM param> bool GetBool() { return defaultStore.GetBool<param>(); }
+   template <PARAM_NUM param> void SetFixed(s32fp value) { defaultStore.SetFixed<param>(value); }
+   template <PARAM_NUM param> void SetInt(int value) { defaultStore.SetInt<param>(value); }
+   template <PARAM_NUM param> void SetFloat(float value) { defaultStore.SetFloat<param>(value); }
+   template <PARAM_NUM param> int Set(s32fp value) { return defaultStore.Set<param>(value); }
+   template <PARAM_NUM param, s32fp value> void Set() { defaultStore.Set<param, value>(); }
 
-   //User defined callback
+   //User defined callback, called by Set() of the default store for parameters without observer
    void Change(Param::PARAM_NUM ParamNum);
 }
 
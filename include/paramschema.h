@@ -0,0 +1,46 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMSCHEMA_H
+#define PARAMSCHEMA_H
+
+#include "streamsource.h"
+
+/** \brief Static part of the parameter JSON, built at compile time.
+ * Contains name, unit, id, limits, default, category and index of every
+ * parameter in the same layout as the regular JSON, but no values, CAN
+ * mapping or serial number. The document is a string constant in flash and
+ * streamed without formatting. Clients cache it by GetHash() and fetch the
+ * live values through the values-only SDO object.
+ * Minimum, maximum and default in PARAM_LIST must be plain numbers for this.
+ */
+class ParamSchema: public IStreamSource
+{
+   public:
+      ParamSchema();
+      void Rewind() override;
+      int Read(uint8_t* buf, int len) override;
+      uint32_t GetSize() override;
+      static uint32_t GetHash();
+
+   private:
+      uint8_t piece;
+      const char* current;
+};
+
+#endif // PARAMSCHEMA_H
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMVALUES_H
+#define PARAMVALUES_H
+
+#include "streamsource.h"
+#include "params.h"
+
+/** \brief Binary stream of raw parameter values.
+ * Every value is transferred as a little endian 32-bit s32fp, in the order of
+ * the given list of parameter indexes. Reading streams the current values.
+ * Writing range checks every value like a single SDO write would and collects
+ * them in the staging buffer. They are only applied once all of them arrived
+ * and passed, so a failed write changes nothing.
+ */
+class ParamValues: public IStreamSource, public IStreamSink
+{
+   public:
+      ParamValues();
+      void SetStore(Param::Store* s) { store = s; }
+      /** \brief Buffer for one value per list entry, required for writing */
+      void SetStaging(s32fp* buffer) { staging = buffer; }
+      void SetList(const uint16_t* params, int count);
+      void Rewind() override;
+      int Read(uint8_t* buf, int len) override;
+      uint32_t GetSize() override { return count * sizeof(s32fp); }
+      uint32_t Begin(uint32_t size) override;
+      uint32_t Write(const uint8_t* buf, int len) override;
+      uint32_t End() override;
+
+   private:
+      Param::Store* store;
+      const uint16_t* list;
+      s32fp* staging;
+      int count;
+      uint32_t pos;
+      uint32_t value; //value currently being transferred
+
+      Param::PARAM_NUM GetParam(int item) { return (Param::PARAM_NUM)(0 != list ? list[item] : item); }
+};
+
+#endif // PARAMVALUES_H
@@ -0,0 +1,72 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef REMOTEMAP_H
+#define REMOTEMAP_H
+
+#include "cansdo.h"
+
+//Requests a batch keeps in the SDO client queue. One pending plus one
+//queued is enough to send the next request straight from the reply.
+#ifndef REMOTEMAP_MAX_QUEUED
+#define REMOTEMAP_MAX_QUEUED 2
+#endif
+
+/** \brief Provisions a list of CAN mappings on a remote node.
+ * By default every mapping is added with the same three SDO writes that
+ * CanSdo::RemoteMap() uses, but the writes are queued back to back instead of
+ * being driven one by one. Alternatively the entire list is sent as one
+ * block download to SDO_INDEX_MAP_LIST, which takes a few round trips in total.
+ * Use one instance per remote node, several batches can run at the same time.
+ */
+class RemoteMapBatch: public SdoClientCallback, public IStreamSource
+{
+   public:
+      struct Item
+      {
+         uint32_t cobId;
+         CanMap::CANPOS mapping; //mapParam holds the parameter UID on the remote node
+         bool rx;
+         uint32_t result; //0 when added, SDO abort code otherwise
+      };
+
+      explicit RemoteMapBatch(CanSdo* sdo);
+      bool Start(uint8_t nodeId, Item* items, int count, bool asDownload = false);
+      bool IsDone() { return done; }
+      int GetFailures();
+      void SdoComplete(uint8_t nodeId, uint16_t index, uint8_t subIndex, bool success, uint32_t data) override;
+      void SdoAcknowledged(uint8_t, uint16_t, uint8_t, uint32_t bytes) override { acknowledged = bytes; }
+      void Rewind() override { readPos = 0; }
+      int Read(uint8_t* buf, int len) override;
+      uint32_t GetSize() override { return count * CANMAP_RECORD_SIZE; }
+
+   private:
+      CanSdo* canSdo;
+      Item* items;
+      int count;
+      int queued; //number of writes queued so far
+      int completed; //number of writes completed so far
+      uint32_t readPos;
+      uint32_t acknowledged; //bytes of the download the server confirmed
+      uint8_t nodeId;
+      volatile bool done;
+
+      void QueueWrites(int maxQueued);
+};
+
+#endif // REMOTEMAP_H
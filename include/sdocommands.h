@@ -23,6 +23,16 @@
 
 #define SDO_INDEX_COMMANDS    0x5002
 
+//Sub indexes of SDO_INDEX_COMMANDS
+#define SDO_CMD_SAVE          0
+#define SDO_CMD_LOAD          1
+#define SDO_CMD_RESET         2
+#define SDO_CMD_DEFAULTS      3
+#define SDO_CMD_START         4
+#define SDO_CMD_STOP          5
+#define SDO_CMD_CLEAR_CAN     6
+#define SDO_CMD_CLEAR_ERRLOG  7
+
 class SdoCommands
 {
    public:
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STREAMSOURCE_H
+#define STREAMSOURCE_H
+
+#include <stdint.h>
+
+/** \brief Produces a byte stream on demand, piece by piece.
+ * This is the pull counterpart of IPutChar. The consumer decides when and how many
+ * bytes it wants, so the producer never has to wait for it.
+ */
+class IStreamSource
+{
+public:
+   /** \brief Restart the stream from the beginning */
+   virtual void Rewind() = 0;
+
+   /** \brief Copy the next bytes of the stream
+    *
+    * \param buf destination buffer
+    * \param len maximum number of bytes to copy
+    * \return number of bytes copied, less than len only at the end of the stream
+    */
+   virtual int Read(uint8_t* buf, int len) = 0;
+
+   /** \brief Total size of the stream
+    * \return size in bytes or 0 if not known in advance
+    */
+   virtual uint32_t GetSize() { return 0; }
+};
+
+/** \brief Consumes a byte stream piece by piece, e.g. an SDO download.
+ * All methods return 0 on success or a CANopen SDO abort code that cancels the transfer.
+ */
+class IStreamSink
+{
+public:
+   /** \brief Start a new stream
+    * \param size announced size in bytes or 0 if not known
+    */
+   virtual uint32_t Begin(uint32_t size) = 0;
+
+   /** \brief Consume the next bytes of the stream */
+   virtual uint32_t Write(const uint8_t* buf, int len) = 0;
+
+   /** \brief Stream is complete */
+   virtual uint32_t End() = 0;
+};
+
+#endif // STREAMSOURCE_H
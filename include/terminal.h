@@ -21,6 +21,10 @@
 #include <stdint.h>
 #include "printf.h"
 
+#ifndef TERM_MAX_COMMANDS
+#define TERM_MAX_COMMANDS 32
+#endif // TERM_MAX_COMMANDS
+
 class Terminal;
 
 typedef struct
@@ -70,6 +74,8 @@ private:
    uint32_t usart;
    bool remap;
    const TERM_CMD* termCmds;
+   uint16_t cmdHashes[TERM_MAX_COMMANDS]; //my_strhash() of the first TERM_MAX_COMMANDS commands
+   uint8_t numHashes;
    uint8_t nodeId;
    bool enabled;
    bool txDmaEnabled;
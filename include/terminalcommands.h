@@ -19,6 +19,8 @@
 #ifndef TERMINALCOMMANDS_H
 #define TERMINALCOMMANDS_H
 #include "canmap.h"
+#include "paramrecorder.h"
+#include "streamsource.h"
 
 class TerminalCommands
 {
@@ -30,11 +32,18 @@ class TerminalCommands
       static void ParamStreamBinary(Terminal* term, char *arg);
       static void PrintParamsJson(IPutChar* term, char *arg);
       static void PrintParamsJson(Terminal* term, char *arg) { PrintParamsJson((IPutChar*)term, arg); }
+      static void PrintParamSchema(Terminal* term, char *arg);
+      static void PrintParamsBinary(Terminal* term, char *arg);
+      static void PrintChangedValues(Terminal* term, char *arg);
+      static void SendRecording(Terminal* term, char *arg);
       static void MapCan(Terminal* term, char *arg);
       static void SaveParameters(Terminal* term, char *arg);
       static void LoadParameters(Terminal* term, char *arg);
       static void Reset(Terminal* term, char *arg);
+      static void PrintErrorLog(Terminal* term, char *arg);
       static void SetCanMap(CanMap* m) { canMap = m; }
+      static void SetRecorder(ParamRecorder* r) { recorder = r; }
+      static void SetParamStore(Param::Store* s) { paramStore = s; }
       static void EnableSaving() { saveEnabled = true; }
       static void DisableSaving() { saveEnabled = false; }
 
@@ -42,8 +51,11 @@ class TerminalCommands
 
    private:
       static void PrintCanMap(Param::PARAM_NUM param, uint32_t canid, uint8_t offsetBits, int8_t length, float gain, int8_t offset, bool rx);
+      static void SendStream(Terminal* term, IStreamSource* source);
       static int ParamNamesToIndexes(char* names, Param::PARAM_NUM* indexes, uint32_t maxIndexes);
       static CanMap* canMap;
+      static ParamRecorder* recorder;
+      static Param::Store* paramStore;
       static bool saveEnabled;
 };
 
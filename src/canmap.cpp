@@ -16,9 +16,6 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include <libopencm3/stm32/flash.h>
-#include <libopencm3/stm32/crc.h>
-#include <libopencm3/stm32/desig.h>
 #include "canmap.h"
 #include "hwdefs.h"
 #include "my_string.h"
@@ -28,6 +25,7 @@
 #define RECVMAP_ADDRESS(b)    (b + sizeof(canSendMap))
 #define POSMAP_ADDRESS(b)     (b + sizeof(canSendMap) + sizeof(canRecvMap))
 #define CRC_ADDRESS(b)        (b + sizeof(canSendMap) + sizeof(canRecvMap) + sizeof(canPosMap))
+#define CANMAP_VERSION        1
 #define SENDMAP_WORDS         (sizeof(canSendMap) / (sizeof(uint32_t)))
 #define RECVMAP_WORDS         (sizeof(canRecvMap) / (sizeof(uint32_t)))
 #define POSMAP_WORDS          ((sizeof(CANPOS) * MAX_ITEMS) / (sizeof(uint32_t)))
@@ -49,23 +47,37 @@
 #define IDMAPSIZE 4
 #define SHIFT_FORCE_FLAG(f) (f << 11)
 #endif // CAN_EXT
-#if (MAX_ITEMS * 12 + 2 * MAX_MESSAGES * IDMAPSIZE + 4) > FLASH_PAGE_SIZE
+#if (MAX_ITEMS * 12 + 2 * MAX_MESSAGES * IDMAPSIZE + FLASHSTORE_FOOTER_WORDS * 4) > FLASH_PAGE_SIZE
 #error CANMAP will not fit in one flash page
 #endif
 
-volatile bool CanMap::isSaving = false;
+uint32_t CanMap::saveImage[];
 
 CanMap::CanMap(CanHardware* hw, bool loadFromFlash)
- : canHardware(hw)
+ : canHardware(hw), paramStore(&Param::defaultStore)
 {
    canHardware->AddCallback(this);
 
+   storeClient.version = CANMAP_VERSION;
+   storeClient.serialize = SerializeSection;
+   storeClient.load = LoadSection;
+   storeClient.migrate = MigrateSection;
+   storeClient.context = this;
+   storeClient.image = saveImage;
+   storeClient.imageWords = sizeof(saveImage) / sizeof(uint32_t);
+
    ClearMap(canSendMap);
    ClearMap(canRecvMap);
    if (loadFromFlash) LoadFromFlash();
    HandleClear();
 }
 
+CanMap::~CanMap()
+{
+   //FlashStore must not serialize a map that no longer exists
+   FlashStore::Unregister(FlashStore::SECTION_CANMAP, &storeClient);
+}
+
 //Somebody (perhaps us) has cleared all user messages. Register them again
 void CanMap::HandleClear()
 {
@@ -78,8 +90,6 @@ void CanMap::HandleClear()
 
 void CanMap::HandleRx(uint32_t canId, uint32_t data[2], uint8_t)
 {
-   if (isSaving) return; //Only handle mapped messages when not currently saving to flash
-
    CANIDMAP *recvMap = FindById(canRecvMap, canId);
 
    if (0 != recvMap)
@@ -159,9 +169,9 @@ void CanMap::HandleRx(uint32_t canId, uint32_t data[2], uint8_t)
          val *= curPos->gain;
 
          if (Param::GetType((Param::PARAM_NUM)curPos->mapParam) == Param::TYPE_PARAM || Param::GetType((Param::PARAM_NUM)curPos->mapParam) == Param::TYPE_TESTPARAM)
-            Param::Set((Param::PARAM_NUM)curPos->mapParam, FP_FROMFLT(val));
+            paramStore->Set((Param::PARAM_NUM)curPos->mapParam, FP_FROMFLT(val));
          else
-            Param::SetFloat((Param::PARAM_NUM)curPos->mapParam, val);
+            paramStore->SetFloat((Param::PARAM_NUM)curPos->mapParam, val);
       }
    }
 }
@@ -349,40 +359,17 @@ int CanMap::Remove(bool rx, uint8_t messageIdx, uint8_t itemidx)
 }
 
 /** \brief Save CAN mapping to flash
+ *
+ * The mapping is committed as section of FlashStore, together with all other
+ * changed sections. FlashWriter writes it, so sending and receiving continue meanwhile.
+ *
+ * \return true if committed, false if the previous commit is still being written
  */
-void CanMap::Save()
+bool CanMap::Save()
 {
-   uint32_t crc;
-   uint32_t check = 0xFFFFFFFF;
-   uint32_t baseAddress = GetFlashAddress();
-   uint32_t *checkAddress = (uint32_t*)baseAddress;
-
-   isSaving = true;
-
-   for (int i = 0; i < FLASH_PAGE_SIZE / 4; i++, checkAddress++)
-      check &= *checkAddress;
-
-   crc_reset();
-
-   flash_unlock();
-   flash_set_ws(2);
-
-   if (check != 0xFFFFFFFF) //Only erase when needed
-      flash_erase_page(baseAddress);
-
-   ReplaceParamEnumByUid(canSendMap);
-   ReplaceParamEnumByUid(canRecvMap);
-
-   SaveToFlash(SENDMAP_ADDRESS(baseAddress), (uint32_t *)canSendMap, SENDMAP_WORDS);
-   crc = SaveToFlash(RECVMAP_ADDRESS(baseAddress), (uint32_t *)canRecvMap, RECVMAP_WORDS);
-   crc = SaveToFlash(POSMAP_ADDRESS(baseAddress), (uint32_t *)canPosMap, POSMAP_WORDS);
-   SaveToFlash(CRC_ADDRESS(baseAddress), &crc, 1);
-   flash_lock();
-
-   ReplaceParamUidByEnum(canSendMap);
-   ReplaceParamUidByEnum(canRecvMap);
-
-   isSaving = false;
+   //The map of the instance that was saved last is the one in flash
+   FlashStore::Register(FlashStore::SECTION_CANMAP, &storeClient);
+   return FlashStore::Commit() >= 0;
 }
 
 
@@ -478,65 +465,73 @@ void CanMap::IterateCanMap(void (*callback)(Param::PARAM_NUM, uint32_t, uint8_t,
 
 bool CanMap::Send(CANIDMAP *map)
 {
-   uint32_t data[2] = { 0 }; //Had an issue with uint64_t, otherwise would have used that
-   uint8_t maxBit = 0;
+   uint32_t data[2]; //Had an issue with uint64_t, otherwise would have used that
+   uint8_t maxBit;
+   uint32_t seq;
+   int tries = 0;
 
-   forEachPosMap(curPos, map)
+   //Pack all values from one consistent state, retry if a parameter changed meanwhile
+   do
    {
-      if (isSaving) return false; //Only send mapped messages when not currently saving to flash
+      data[0] = data[1] = 0;
+      maxBit = 0;
+      seq = paramStore->ReadBegin();
 
-      float val = Param::GetFloat((Param::PARAM_NUM)curPos->mapParam);
-
-      val *= curPos->gain;
-      val += curPos->offset;
-      // convert to a signed integer value before storing in an unsigned to
-      // avoid sign-extension problems when we start shifting and masking
-      uint32_t ival = (int32_t)val;
-      uint8_t numBits = ABS(curPos->numBits);
-      ival &= (1UL << numBits) - 1;
-
-      if (curPos->numBits < 0) // big-endian
+      forEachPosMap(curPos, map)
       {
-         //Swap byte order
-         const uint8_t* bptr = (uint8_t*)&ival;
-         ival = (bptr[0] << 24) | (bptr[1] << 16) | (bptr[2] << 8) | bptr[3];
+         float val = paramStore->GetFloat((Param::PARAM_NUM)curPos->mapParam);
 
-         if (curPos->offsetBits < 32) //all data in first word
-         {
-            data[0] |= ival >> (31 - curPos->offsetBits);
-         }
-         else if ((curPos->offsetBits + curPos->numBits) >= 31) //all data in second word
-         {
-            data[1] |= ival >> (63 - curPos->offsetBits);
-         }
-         else //data spans across both words
-         {
-            data[0] |= ival << (curPos->offsetBits - 31);
-            data[1] |= ival >> (63 - curPos->offsetBits);
-         }
-         maxBit = MAX(maxBit, curPos->offsetBits);
-      }
-      else // little-endian
-      {
-         if (curPos->offsetBits > 31)
-         {
-            // data entirely in the second word
-            data[1] |= ival << (curPos->offsetBits - 32);
-         }
-         else if ((curPos->offsetBits + curPos->numBits) <= 32)
+         val *= curPos->gain;
+         val += curPos->offset;
+         // convert to a signed integer value before storing in an unsigned to
+         // avoid sign-extension problems when we start shifting and masking
+         uint32_t ival = (int32_t)val;
+         uint8_t numBits = ABS(curPos->numBits);
+         ival &= (1UL << numBits) - 1;
+
+         if (curPos->numBits < 0) // big-endian
          {
-            // data entirely in the first word
-            data[0] |= ival << curPos->offsetBits;
+            //Swap byte order
+            const uint8_t* bptr = (uint8_t*)&ival;
+            ival = (bptr[0] << 24) | (bptr[1] << 16) | (bptr[2] << 8) | bptr[3];
+
+            if (curPos->offsetBits < 32) //all data in first word
+            {
+               data[0] |= ival >> (31 - curPos->offsetBits);
+            }
+            else if ((curPos->offsetBits + curPos->numBits) >= 31) //all data in second word
+            {
+               data[1] |= ival >> (63 - curPos->offsetBits);
+            }
+            else //data spans across both words
+            {
+               data[0] |= ival << (curPos->offsetBits - 31);
+               data[1] |= ival >> (63 - curPos->offsetBits);
+            }
+            maxBit = MAX(maxBit, curPos->offsetBits);
          }
-         else
+         else // little-endian
          {
-            // data spans both words
-            data[0] |= ival << curPos->offsetBits;
-            data[1] |= ival >> (32 - curPos->offsetBits);
+            if (curPos->offsetBits > 31)
+            {
+               // data entirely in the second word
+               data[1] |= ival << (curPos->offsetBits - 32);
+            }
+            else if ((curPos->offsetBits + curPos->numBits) <= 32)
+            {
+               // data entirely in the first word
+               data[0] |= ival << curPos->offsetBits;
+            }
+            else
+            {
+               // data spans both words
+               data[0] |= ival << curPos->offsetBits;
+               data[1] |= ival >> (32 - curPos->offsetBits);
+            }
+            maxBit = MAX(maxBit, curPos->offsetBits + curPos->numBits);
          }
-         maxBit = MAX(maxBit, curPos->offsetBits + curPos->numBits);
       }
-   }
+   } while (paramStore->ReadRetry(seq) && ++tries < PARAM_SNAPSHOT_TRIES);
 
    uint8_t numBytes = (maxBit + 7) / 8;
 
@@ -558,9 +553,14 @@ void CanMap::ClearMap(CANIDMAP *canMap)
    }
 }
 
-int CanMap::Add(CANIDMAP *canMap, Param::PARAM_NUM param, uint32_t canId, uint8_t offsetBits, int8_t length, float gain, int8_t offset)
+/** \brief Check whether an item position fits into a CAN message
+ *
+ * \param offsetBits bit offset within the 64 message bits
+ * \param length number of bits, negative for big endian
+ * \return 0 if valid, CAN_ERR_INVALID_LEN or CAN_ERR_INVALID_OFS otherwise
+ */
+int CanMap::CheckPosition(uint8_t offsetBits, int8_t length)
 {
-   //if (canId > MAX_COB_ID) return CAN_ERR_INVALID_ID;
    if (length == 0 || ABS(length) > 32) return CAN_ERR_INVALID_LEN;
    if (length > 0)
    {
@@ -573,6 +573,15 @@ int CanMap::Add(CANIDMAP *canMap, Param::PARAM_NUM param, uint32_t canId, uint8_
       if (offsetBits > 63) return CAN_ERR_INVALID_OFS;
       if (static_cast<int8_t>(offsetBits) + length + 1 < 0) return CAN_ERR_INVALID_OFS;
    }
+   return 0;
+}
+
+int CanMap::Add(CANIDMAP *canMap, Param::PARAM_NUM param, uint32_t canId, uint8_t offsetBits, int8_t length, float gain, int8_t offset)
+{
+   //if (canId > MAX_COB_ID) return CAN_ERR_INVALID_ID;
+   int err = CheckPosition(offsetBits, length);
+
+   if (err != 0) return err;
 
    CANIDMAP *existingMap = FindById(canMap, canId);
 
@@ -630,38 +639,70 @@ int CanMap::Add(CANIDMAP *canMap, Param::PARAM_NUM param, uint32_t canId, uint8_
    return count;
 }
 
-uint32_t CanMap::SaveToFlash(uint32_t baseAddress, uint32_t* data, int len)
+/** \brief Loads message definitions from flash
+ *
+ * \return 1 for success, 0 for CRC error
+ *
+ */
+int CanMap::LoadFromFlash()
+{
+   FlashStore::Register(FlashStore::SECTION_CANMAP, &storeClient);
+   return FlashStore::Load(FlashStore::SECTION_CANMAP);
+}
+
+/** \brief Copy the mapping with parameter UIDs to image */
+uint32_t CanMap::SerializeSection(void* context, uint32_t* image, uint32_t maxWords)
 {
-   uint32_t crc = 0;
+   CanMap* canMap = (CanMap*)context;
+   CANPOS *posMap = (CANPOS*)&image[SENDMAP_WORDS + RECVMAP_WORDS];
 
-   for (int idx = 0; idx < len; idx++)
-   {
-      crc = crc_calculate(*data);
-      flash_program_word(baseAddress + idx * sizeof(uint32_t), *data);
-      data++;
-   }
+   maxWords = maxWords; //Checked at compile time
+
+   memcpy32((int*)image, (int*)canMap->canSendMap, SENDMAP_WORDS);
+   memcpy32((int*)&image[SENDMAP_WORDS], (int*)canMap->canRecvMap, RECVMAP_WORDS);
+   memcpy32((int*)posMap, (int*)canMap->canPosMap, POSMAP_WORDS);
 
-   return crc;
+   canMap->ReplaceParamEnumByUid(canMap->canSendMap, posMap);
+   canMap->ReplaceParamEnumByUid(canMap->canRecvMap, posMap);
+
+   return SENDMAP_WORDS + RECVMAP_WORDS + POSMAP_WORDS;
 }
 
+bool CanMap::LoadSection(void* context, uint16_t version, const uint32_t* data, uint32_t words)
+{
+   CanMap* canMap = (CanMap*)context;
 
-/** \brief Loads message definitions from flash
+   //Future layouts are converted here
+   if (version != CANMAP_VERSION || words != SENDMAP_WORDS + RECVMAP_WORDS + POSMAP_WORDS)
+      return false;
+
+   memcpy32((int*)canMap->canSendMap, (int*)data, SENDMAP_WORDS);
+   memcpy32((int*)canMap->canRecvMap, (int*)&data[SENDMAP_WORDS], RECVMAP_WORDS);
+   memcpy32((int*)canMap->canPosMap, (int*)&data[SENDMAP_WORDS + RECVMAP_WORDS], POSMAP_WORDS);
+   canMap->ReplaceParamUidByEnum(canMap->canSendMap);
+   canMap->ReplaceParamUidByEnum(canMap->canRecvMap);
+   return true;
+}
+
+bool CanMap::MigrateSection(void* context, uint32_t address)
+{
+   return ((CanMap*)context)->LoadUnversioned(address) == 1;
+}
+
+/** \brief Loads message definitions written before FlashStore
  *
  * \return 1 for success, 0 for CRC error
- *
  */
-int CanMap::LoadFromFlash()
+int CanMap::LoadUnversioned(uint32_t baseAddress)
 {
-   uint32_t baseAddress = GetFlashAddress();
    uint32_t storedCrc = *(uint32_t*)CRC_ADDRESS(baseAddress);
    uint32_t crc;
 
-   crc_reset();
-   crc = crc_calculate_block((uint32_t*)baseAddress, SENDMAP_WORDS + RECVMAP_WORDS + POSMAP_WORDS);
+   crc = FlashStore::Crc((uint32_t*)(uintptr_t)baseAddress, SENDMAP_WORDS + RECVMAP_WORDS + POSMAP_WORDS);
 
    if (storedCrc == crc)
    {
-      memcpy32((int*)canSendMap, (int*)SENDMAP_ADDRESS(baseAddress), SENDMAP_WORDS);
+      memcpy32((int*)canSendMap, (int*)(uintptr_t)SENDMAP_ADDRESS(baseAddress), SENDMAP_WORDS);
       memcpy32((int*)canRecvMap, (int*)RECVMAP_ADDRESS(baseAddress), RECVMAP_WORDS);
       memcpy32((int*)canPosMap, (int*)POSMAP_ADDRESS(baseAddress), POSMAP_WORDS);
       ReplaceParamUidByEnum(canSendMap);
@@ -670,14 +711,14 @@ int CanMap::LoadFromFlash()
    }
    else
    {
-      return LegacyLoadFromFlash();
+      return LegacyLoadFromFlash(baseAddress);
    }
 }
 
 /** \brief Loads the old-style message definitions from flash
  * \return 1 for success, 0 for CRC error
  */
-int CanMap::LegacyLoadFromFlash()
+int CanMap::LegacyLoadFromFlash(uint32_t data)
 {
    const int MAX_ITEMS_PER_MESSAGE = 8;
    const int LEGACY_MAX_MESSAGES   = 10;
@@ -709,16 +750,14 @@ int CanMap::LegacyLoadFromFlash()
       }
    };
 
-   uint32_t data = GetFlashAddress();
    const int size = sizeof(LEGACY_CANIDMAP) * LEGACY_MAX_MESSAGES * 2;
-   uint32_t storedCrc = *(uint32_t*)(data + size);
+   uint32_t storedCrc = *(uint32_t*)(uintptr_t)(data + size);
 
-   crc_reset();
-   uint32_t crc = crc_calculate_block((uint32_t*)data, size / 4);
+   uint32_t crc = FlashStore::Crc((uint32_t*)(uintptr_t)data, size / 4);
 
    if (storedCrc == crc)
    {
-      convert((LEGACY_CANIDMAP*)data, canSendMap, false);
+      convert((LEGACY_CANIDMAP*)(uintptr_t)data, canSendMap, false);
       convert((LEGACY_CANIDMAP*)(data + sizeof(LEGACY_CANIDMAP) * LEGACY_MAX_MESSAGES), canRecvMap, true);
 
       return 1;
@@ -736,21 +775,15 @@ CanMap::CANIDMAP* CanMap::FindById(CANIDMAP *canMap, uint32_t canId)
    return 0;
 }
 
-uint32_t CanMap::GetFlashAddress()
-{
-   uint32_t flashSize = desig_get_flash_size();
-
-   return FLASH_BASE + flashSize * 1024 - FLASH_PAGE_SIZE * CAN1_BLKNUM;
-}
-
-void CanMap::ReplaceParamEnumByUid(CANIDMAP *canMap)
+/** \brief Store the UIDs of the parameters mapped in canMap in a copy of canPosMap */
+void CanMap::ReplaceParamEnumByUid(CANIDMAP *canMap, CANPOS *posMap)
 {
    forEachCanMap(curMap, canMap)
    {
       forEachPosMap(curPos, curMap)
       {
          const Param::Attributes* attr = Param::GetAttrib((Param::PARAM_NUM)curPos->mapParam);
-         curPos->mapParam = (uint16_t)attr->id;
+         posMap[curPos - canPosMap].mapParam = (uint16_t)attr->id;
       }
    }
 }
@@ -0,0 +1,123 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "canmapstream.h"
+#include "cansdo.h"
+
+CanMapStream::CanMapStream(CanMap* cm)
+ : canMap(cm), record{}, recordBytes(0)
+{
+}
+
+/** \brief Build a record from a mapping as the remote end expects it
+ *
+ * \param cobId CAN Id of the message
+ * \param rx true for a receive mapping
+ * \param mapping position and scaling, mapParam holds the parameter UID
+ * \param[out] record the three words to be transferred
+ *
+ */
+void CanMapStream::EncodeRecord(uint32_t cobId, bool rx, const CanMap::CANPOS& mapping, uint32_t record[3])
+{
+   record[0] = cobId | (rx ? CANMAP_RECORD_RX : 0);
+   record[1] = mapping.mapParam | (mapping.offsetBits << 16) | (mapping.numBits << 24);
+   record[2] = ((int32_t)(mapping.gain * 1000.0f) & 0xFFFFFF) | (mapping.offset << 24);
+}
+
+uint32_t CanMapStream::Begin(uint32_t size)
+{
+   recordBytes = 0;
+   return (size % CANMAP_RECORD_SIZE) == 0 ? 0 : SDO_ERR_LENGTH;
+}
+
+uint32_t CanMapStream::Write(const uint8_t* buf, int len)
+{
+   for (int i = 0; i < len; i++)
+   {
+      uint8_t word = recordBytes / 4;
+      uint8_t byteIdx = recordBytes & 3;
+
+      if (byteIdx == 0) record[word] = 0;
+      record[word] |= (uint32_t)buf[i] << (8 * byteIdx);
+      recordBytes++;
+
+      if (recordBytes == CANMAP_RECORD_SIZE)
+      {
+         uint32_t err = AddRecord();
+
+         if (err != 0) return err;
+         recordBytes = 0;
+      }
+   }
+   return 0;
+}
+
+uint32_t CanMapStream::End()
+{
+   return recordBytes == 0 ? 0 : SDO_ERR_LENGTH;
+}
+
+/** \brief Check a record without adding it
+ * Doesn't check whether the CanMap has room for it
+ * \return 0 if the record can be added, SDO abort code otherwise
+ */
+uint32_t CanMapStream::CheckRecord(const uint32_t record[3])
+{
+   bool rx = (record[0] & CANMAP_RECORD_RX) != 0;
+   uint32_t canId = record[0] & ~CANMAP_RECORD_RX;
+   Param::PARAM_NUM param = Param::NumFromId(record[1] & 0xFFFF);
+   uint8_t offsetBits = (record[1] >> 16) & 0x3F;
+   int8_t numBits = (int32_t)record[1] >> 24;
+
+   if (canId >= 0x20000000 && (canId & ~CAN_FORCE_EXTENDED) >= 0x800)
+      return SDO_ERR_INVIDX;
+   //Only receive mappings can force an extended filter
+   if ((rx ? canId & ~CAN_FORCE_EXTENDED : canId) > MAX_COB_ID)
+      return SDO_ERR_INVIDX;
+   if (param >= Param::PARAM_LAST)
+      return SDO_ERR_INVIDX;
+   if (CanMap::CheckPosition(offsetBits, numBits) != 0)
+      return SDO_ERR_INVIDX;
+
+   return 0;
+}
+
+uint32_t CanMapStream::AddRecord()
+{
+   bool rx = (record[0] & CANMAP_RECORD_RX) != 0;
+   uint32_t canId = record[0] & ~CANMAP_RECORD_RX;
+   Param::PARAM_NUM param = Param::NumFromId(record[1] & 0xFFFF);
+   uint8_t offsetBits = (record[1] >> 16) & 0x3F;
+   int8_t numBits = (int32_t)record[1] >> 24;
+   // sign extend the 24-bit integer to a 32-bit integer
+   int32_t gainFixedPoint = (int32_t)(record[2] << 8) >> 8;
+   float gain = gainFixedPoint / 1000.0f;
+   int8_t offset = record[2] >> 24;
+   int result;
+
+   uint32_t err = CheckRecord(record);
+
+   if (err != 0) return err;
+
+   if (rx)
+      result = canMap->AddRecv(param, canId, offsetBits, numBits, gain, offset);
+   else
+      result = canMap->AddSend(param, canId, offsetBits, numBits, gain, offset);
+
+   return result >= 0 ? 0 : SDO_ERR_INVIDX;
+}
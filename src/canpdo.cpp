@@ -0,0 +1,238 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "canpdo.h"
+
+#define STD_ID_MASK 0x7FF
+
+CanPdo::CanPdo(CanMap* cm)
+ : canMap(cm), canHardware(cm->GetHardware()), syncId(PDO_SYNC_ID), tpdos{}
+{
+   canHardware->AddCallback(this);
+   HandleClear();
+}
+
+//Somebody (perhaps us) has cleared all user messages. Register them again
+void CanPdo::HandleClear()
+{
+   if (syncId != 0)
+      canHardware->RegisterUserMessage(syncId);
+
+   for (int i = 0; i < PDO_MAX_TPDOS; i++)
+   {
+      //The mask filter lets remote frames pass, a list filter would only let data frames pass
+      if (tpdos[i].cobId != 0 && tpdos[i].type == PDO_TYPE_RTR)
+         canHardware->RegisterUserMessage(tpdos[i].cobId, STD_ID_MASK);
+   }
+}
+
+void CanPdo::HandleRx(uint32_t canId, uint32_t*, uint8_t)
+{
+   if (canId == syncId)
+   {
+      for (int i = 0; i < PDO_MAX_TPDOS; i++)
+      {
+         Tpdo* tpdo = &tpdos[i];
+
+         if (tpdo->cobId == 0 || tpdo->type > PDO_TYPE_SYNC_MAX) continue;
+
+         if (tpdo->type == PDO_TYPE_SYNC_ACYCLIC)
+         {
+            if (tpdo->event || MappedValueChanged(tpdo))
+               Send(tpdo);
+         }
+         else if (++tpdo->syncCount >= tpdo->type)
+         {
+            tpdo->syncCount = 0;
+            Send(tpdo);
+         }
+      }
+   }
+   else if (canId & CAN_RTR_FLAG)
+   {
+      Tpdo* tpdo = Find(canId & ~CAN_RTR_FLAG);
+
+      if (0 != tpdo && tpdo->type == PDO_TYPE_RTR)
+         Send(tpdo);
+   }
+}
+
+/** \brief Set the CAN id of the SYNC message
+ * \param id CAN id, 0 to disable SYNC reception
+ */
+void CanPdo::SetSyncId(uint32_t id)
+{
+   syncId = id;
+   canHardware->ClearUserMessages();
+}
+
+/** \brief Set the transmission type of a send message
+ *
+ * \param cobId CAN id of the message as added to the CanMap
+ * \param type PDO_TYPE_xx or 1..240 for every n-th SYNC
+ * \param inhibitTime minimum time between two event driven transmissions in 100us
+ * \param eventTimer maximum time between two event driven transmissions in ms, 0 to only send on change
+ * \return true on success, false if type is not supported or no more TPDOs can be configured
+ *
+ */
+bool CanPdo::Configure(uint32_t cobId, uint8_t type, uint16_t inhibitTime, uint16_t eventTimer)
+{
+   if (cobId == 0 || (type > PDO_TYPE_SYNC_MAX && type < PDO_TYPE_RTR)) return false;
+   //Remote frames are only filtered for standard ids
+   if (type == PDO_TYPE_RTR && cobId > STD_ID_MASK) return false;
+
+   Tpdo* tpdo = Find(cobId);
+
+   if (type == PDO_TYPE_CYCLIC)
+   {
+      if (0 != tpdo) tpdo->cobId = 0;
+      return true;
+   }
+
+   if (0 == tpdo)
+   {
+      tpdo = Find(0);
+      if (0 == tpdo) return false;
+   }
+
+   tpdo->type = type;
+   tpdo->inhibitTime = inhibitTime;
+   tpdo->eventTimer = eventTimer;
+   tpdo->inhibit = 0;
+   tpdo->eventTime = eventTimer;
+   tpdo->syncCount = 0;
+   tpdo->changeSeq = canMap->GetParamStore()->GetChangeSeq();
+   tpdo->event = false;
+   tpdo->cobId = cobId; //Set last, it activates the TPDO
+
+   if (type == PDO_TYPE_RTR)
+      canHardware->RegisterUserMessage(cobId, STD_ID_MASK);
+
+   return true;
+}
+
+/** \brief Get the transmission type of a send message, PDO_TYPE_CYCLIC if not configured */
+void CanPdo::GetConfig(uint32_t cobId, uint8_t& type, uint16_t& inhibitTime, uint16_t& eventTimer)
+{
+   Tpdo* tpdo = Find(cobId);
+
+   type = 0 != tpdo ? tpdo->type : PDO_TYPE_CYCLIC;
+   inhibitTime = 0 != tpdo ? tpdo->inhibitTime : 0;
+   eventTimer = 0 != tpdo ? tpdo->eventTimer : 0;
+}
+
+/** \brief Signal an application specific event, the message is sent on the next Tick() or SYNC
+ * Changes of mapped parameter values are detected automatically.
+ */
+void CanPdo::TriggerEvent(uint32_t cobId)
+{
+   Tpdo* tpdo = Find(cobId);
+
+   if (0 != tpdo)
+      tpdo->event = true;
+}
+
+/** \brief Send all messages that are not sent by SYNC, events or remote requests.
+ * Call this instead of CanMap::SendAll() from the periodic task.
+ */
+void CanPdo::SendAll()
+{
+   uint32_t canId;
+
+   for (int i = 0; i < MAX_MESSAGES && 0 != canMap->GetMap(false, i, 0, canId); i++)
+   {
+      if (0 == Find(canId))
+         canMap->SendByIndex(i);
+   }
+}
+
+/** \brief Run inhibit and event timers of event driven messages
+ *
+ * \param callingFrequency calling period in ms
+ */
+void CanPdo::Tick(int callingFrequency)
+{
+   for (int i = 0; i < PDO_MAX_TPDOS; i++)
+   {
+      Tpdo* tpdo = &tpdos[i];
+
+      if (tpdo->cobId == 0 || tpdo->type != PDO_TYPE_EVENT) continue;
+
+      if (tpdo->inhibit > 0)
+         tpdo->inhibit -= callingFrequency * 10;
+
+      if (tpdo->eventTimer > 0)
+         tpdo->eventTime -= callingFrequency;
+
+      if (tpdo->eventTimer > 0 && tpdo->eventTime <= 0)
+         Send(tpdo);
+      else if (tpdo->inhibit <= 0 && (tpdo->event || MappedValueChanged(tpdo)))
+         Send(tpdo);
+   }
+}
+
+CanPdo::Tpdo* CanPdo::Find(uint32_t cobId)
+{
+   for (int i = 0; i < PDO_MAX_TPDOS; i++)
+   {
+      if (tpdos[i].cobId == cobId)
+         return &tpdos[i];
+   }
+   return 0;
+}
+
+/** \brief Get the CanMap send message index of a CAN id, -1 if not mapped */
+int CanPdo::FindMessage(uint32_t cobId)
+{
+   uint32_t canId;
+
+   for (int i = 0; i < MAX_MESSAGES && 0 != canMap->GetMap(false, i, 0, canId); i++)
+   {
+      if (canId == cobId)
+         return i;
+   }
+   return -1;
+}
+
+bool CanPdo::MappedValueChanged(Tpdo* tpdo)
+{
+   int ididx = FindMessage(tpdo->cobId);
+   const CanMap::CANPOS* pos;
+   uint32_t canId;
+
+   for (int item = 0; ididx >= 0 && 0 != (pos = canMap->GetMap(false, ididx, item, canId)); item++)
+   {
+      if (canMap->GetParamStore()->ChangedSince((Param::PARAM_NUM)pos->mapParam, tpdo->changeSeq))
+         return true;
+   }
+   return false;
+}
+
+void CanPdo::Send(Tpdo* tpdo)
+{
+   int ididx = FindMessage(tpdo->cobId);
+
+   //Take the sequence number before sampling, so we never miss a change
+   tpdo->changeSeq = canMap->GetParamStore()->GetChangeSeq();
+   tpdo->event = false;
+   tpdo->inhibit = tpdo->inhibitTime;
+   tpdo->eventTime = tpdo->eventTimer;
+
+   if (ididx >= 0)
+      canMap->SendByIndex(ididx);
+}
@@ -16,6 +16,7 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <libopencm3/cm3/cortex.h>
 #include "cansdo.h"
 #include "my_math.h"
 #include "errormessage.h"
@@ -23,22 +24,44 @@
 
 #define SDO_REQ_ID_BASE       0x600U
 #define SDO_REP_ID_BASE       0x580U
+#define SDO_REP_ID_MASK       0x780U //matches replies from all 127 nodes
 
+#define SDO_INDEX_SYNC_ID     0x1005
+#define SDO_INDEX_TPDO_COMM   0x1800
 #define SDO_INDEX_PARAMS      0x2000
 #define SDO_INDEX_PARAM_UID   0x2100
 #define SDO_INDEX_PARAM_FLAGS 0x2200
-#define SDO_INDEX_MAP_TX      0x3000
-#define SDO_INDEX_MAP_RX      0x3001
+#define SDO_INDEX_BULK_LIST   0x2300
+#define SDO_INDEX_BULK_VALUES 0x2301
+#define SDO_INDEX_ALL_VALUES  0x2302
+#define SDO_INDEX_DELTA_VALUES 0x2303
+#define SDO_INDEX_RECORDER    0x2304
 #define SDO_INDEX_MAP_RD      0x3100
 #define SDO_INDEX_STRINGS     0x5001
 #define SDO_INDEX_ERROR_NUM   0x5003
 #define SDO_INDEX_ERROR_TIME  0x5004
+#define SDO_INDEX_ERROR_COUNT 0x5006 //Sub index is the error number
+#define SDO_INDEX_ERROR_FIRST 0x5007
+#define SDO_INDEX_ERROR_LAST  0x5008
 
 
 #define PRINT_BUF_ENQUEUE(c)  printBuffer[(printByteIn++) & (sizeof(printBuffer) - 1)] = c
 #define PRINT_BUF_DEQUEUE()   printBuffer[(printByteOut++) & (sizeof(printBuffer) - 1)]
 #define PRINT_BUF_EMPTY()     ((printByteOut - printByteIn) == sizeof(printBuffer))
 #define PRINT_TIMEOUT         1000
+#define BYTES_PER_SEGMENT     7
+#define BLOCK_DOWNLOAD_TIMEOUT 1000
+
+//CRC-16-CCITT as used by SDO block transfers, polynomial 0x1021, start value 0
+static uint16_t Crc16(uint16_t crc, uint8_t data)
+{
+   crc ^= (uint16_t)data << 8;
+
+   for (int i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+
+   return crc;
+}
 
 /** \brief
  *
@@ -47,10 +70,19 @@
  *
  */
 CanSdo::CanSdo(CanHardware* hw, CanMap* cm)
- : canHardware(hw), canMap(cm), nodeId(1), remoteNodeId(255), printRequest(-1),
+ : canHardware(hw), canMap(cm), canPdo(0), recorder(0), paramStore(&Param::defaultStore), paramBinary(0), nodeId(1), remoteNodeId(255), printRequest(-1),
    printByteIn(0), printByteOut(sizeof(printBuffer)), printTimeout(PRINT_TIMEOUT),
-   mapParam(Param::PARAM_INVALID), mapId(0xFFFFFFFF), mapInfo{}, sdoReplyValid(false), sdoReplyData(0)
+   mapParam(Param::PARAM_INVALID), mapId(0xFFFFFFFF), mapInfo{}, sdoReplyValid(false), sdoReplyData(0),
+   sdoRequestIndex(0), sdoRequestSubIndex(0), clientFilterActive(false), clientSeq(0), clientRequests{},
+   blockState(BLOCK_IDLE), blockIdle(0), blockBytes(0), blockBytesSent(0), blockCrc(0), blockSize(0),
+   blockUnusedBytes(0), blockCrcEnabled(false), blockLast(false), stringSources{}, activeSource(0),
+   activeSink(0), sinkIndex(0), sinkSubIndex(0), sinkToggle(0),
+   dlBlockState(BLOCK_IDLE), dlSeq(0), dlCrc(0), dlCrcEnabled(false), dlTimeout(0), dlLastSegment{}, bulkParams{}, bulkCount(0), bulkStaging{},
+   mapStream(cm), paramImport(cm), printArgs{}, printArgsSink(printArgs, sizeof(printArgs)), printArgsFresh(false)
 {
+   allValues.SetList(0, Param::PARAM_LAST);
+   bulkValues.SetStaging(bulkStaging);
+   stringSources[SDO_STRINGS_SCHEMA] = &schema;
    canHardware->AddCallback(this);
    HandleClear();
    SdoCommands::SetCanMap(cm);
@@ -61,8 +93,8 @@ void CanSdo::HandleClear()
 {
    canHardware->RegisterUserMessage(SDO_REQ_ID_BASE + nodeId);
 
-   if (remoteNodeId < 64)
-      canHardware->RegisterUserMessage(SDO_REP_ID_BASE + remoteNodeId);
+   if (clientFilterActive)
+      canHardware->RegisterUserMessage(SDO_REP_ID_BASE, SDO_REP_ID_MASK);
 }
 
 void CanSdo::HandleRx(uint32_t canId, uint32_t data[2], uint8_t)
@@ -71,14 +103,29 @@ void CanSdo::HandleRx(uint32_t canId, uint32_t data[2], uint8_t)
    {
       SdoFrame *sdo = (SdoFrame*)data;
 
-      if (ProcessUserSpaceSdo(sdo))
+      //Block download segments have no command specifier, only an abort may interrupt them
+      if (dlBlockState == BLOCK_READY && sdo->cmd != SDO_ABORT)
+      {
+         if (ProcessBlockDownloadSegment(data))
+            SendSdoReply(sdo);
+      }
+      else if (ProcessUserSpaceSdo(sdo))
          SendSdoReply(sdo);
       else
          ProcessSDO(data);
    }
-   else if (canId == (SDO_REP_ID_BASE + remoteNodeId))
+   else if (canId > SDO_REP_ID_BASE && canId < (SDO_REP_ID_BASE + 128) && clientFilterActive)
    {
       SdoFrame* sdoFrame = (SdoFrame*)data;
+
+      if (ProcessClientReply(canId - SDO_REP_ID_BASE, sdoFrame))
+         return;
+
+      //Ignore stray replies that don't belong to the last synchronous request
+      if (canId != (SDO_REP_ID_BASE + remoteNodeId) ||
+          sdoFrame->index != sdoRequestIndex || sdoFrame->subIndex != sdoRequestSubIndex)
+         return;
+
       if (sdoFrame->index == SDO_INDEX_MAP_RX || sdoFrame->index == SDO_INDEX_MAP_TX)
       {
          if (sdoFrame->subIndex == 0)
@@ -88,7 +135,6 @@ void CanSdo::HandleRx(uint32_t canId, uint32_t data[2], uint8_t)
       }
       sdoReplyValid = sdoFrame->cmd != SDO_ABORT;
       sdoReplyData = sdoFrame->data;
-      //TODO: check indexes against request in case there are stray SDO replies
    }
 }
 
@@ -108,6 +154,68 @@ bool CanSdo::SDOReadReply(uint32_t& data)
    return sdoReplyValid;
 }
 
+/** \brief Queue a write request to a remote node
+ * Requests to the same node are sent one after the other, requests to different
+ * nodes are in flight at the same time.
+ *
+ * \param nodeId node to send the request to
+ * \param index object index
+ * \param subIndex object sub index
+ * \param data value to write
+ * \param cb receives the outcome, may be 0
+ * \param timeout time in ms to wait for the reply once the request has been sent
+ * \return true if queued, false if the queue is full
+ *
+ */
+bool CanSdo::SDOWriteAsync(uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data, SdoClientCallback* cb, int timeout)
+{
+   return QueueRequest(SDO_WRITE, nodeId, index, subIndex, data, cb, timeout);
+}
+
+/** \brief Queue an expedited read request to a remote node
+ * \see SDOWriteAsync
+ */
+bool CanSdo::SDOReadAsync(uint8_t nodeId, uint16_t index, uint8_t subIndex, SdoClientCallback* cb, int timeout)
+{
+   return QueueRequest(SDO_READ, nodeId, index, subIndex, 0, cb, timeout);
+}
+
+/** \brief Queue a segmented download of a stream to a remote node
+ * \see SDOWriteAsync
+ *
+ * \param source data to download, its size must be known in advance
+ *
+ */
+bool CanSdo::SDODownloadAsync(uint8_t nodeId, uint16_t index, uint8_t subIndex, IStreamSource* source, SdoClientCallback* cb, int timeout)
+{
+   source->Rewind();
+   return QueueRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, nodeId, index, subIndex, source->GetSize(), cb, timeout, source);
+}
+
+/** \brief Queue a block download of a stream to a remote node
+ * Sends the stream in blocks of segments that the server acknowledges as a
+ * whole, which takes far fewer round trips than a segmented download.
+ * Servers that ask for blocks larger than SDO_BLOCK_SIZE are refused.
+ * \see SDODownloadAsync
+ */
+bool CanSdo::SDOBlockDownloadAsync(uint8_t nodeId, uint16_t index, uint8_t subIndex, IStreamSource* source, SdoClientCallback* cb, int timeout)
+{
+   source->Rewind();
+   return QueueRequest(SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_CRC | SDO_BLOCK_SIZE_IND, nodeId, index, subIndex, source->GetSize(), cb, timeout, source);
+}
+
+/** \brief Get number of asynchronous requests that are queued or waiting for a reply
+ */
+int CanSdo::GetPendingRequests()
+{
+   int count = 0;
+
+   for (int i = 0; i < SDO_CLIENT_QUEUE_LEN; i++)
+      count += clientRequests[i].state != CLIENT_FREE;
+
+   return count;
+}
+
 void CanSdo::RemoteMap(uint8_t nodeId, bool rx, uint32_t cobId, CanMap::CANPOS mapping)
 {
    mapInfo = mapping;
@@ -115,31 +223,403 @@ void CanSdo::RemoteMap(uint8_t nodeId, bool rx, uint32_t cobId, CanMap::CANPOS m
    InitiateSDOTransfer(SDO_WRITE, nodeId, rx ? SDO_INDEX_MAP_RX : SDO_INDEX_MAP_TX, 0, cobId);
 }
 
+/** \brief Serve a sub index of the string object from a stream source.
+ * The stream is read directly from the SDO handler, one segment or block at a time.
+ * Sub indexes without a source are announced via GetPrintRequest() and must be
+ * printed by the main loop using PutChar().
+ *
+ * \param subIndex sub index of SDO_INDEX_STRINGS
+ * \param source stream to serve or 0 to revert to print requests
+ *
+ */
+void CanSdo::SetStringSource(uint8_t subIndex, IStreamSource* source)
+{
+   if (subIndex < SDO_MAX_STRING_SOURCES)
+      stringSources[subIndex] = source;
+}
+
+/** \brief Serve the binary parameter table and optionally a compressed copy of it
+ * The table lists the values of the store given to SetParamStore()
+ *
+ * \param binary table served on SDO_STRINGS_BINARY
+ * \param compressed stream served on SDO_STRINGS_BINARY_LZ, usually an LzStream reading binary
+ */
+void CanSdo::SetBinarySource(ParamBinary* binary, IStreamSource* compressed)
+{
+   paramBinary = binary;
+   if (0 != binary) binary->SetStore(paramStore);
+   SetStringSource(SDO_STRINGS_BINARY, binary);
+   SetStringSource(SDO_STRINGS_BINARY_LZ, compressed);
+}
+
 void CanSdo::SetNodeId(uint8_t id)
 {
    nodeId = id;
    canHardware->ClearUserMessages();
 }
 
+/** \brief Serve parameter reads, writes, bulk transfers and the binary parameter
+ * table from the given store instead of the default store. Save, load and defaults
+ * commands still work on the default store. The JSON printed on print requests
+ * comes from TerminalCommands, give it the same store with its SetParamStore().
+ *
+ * \param store parameter store of this node
+ */
+void CanSdo::SetParamStore(Param::Store* store)
+{
+   paramStore = store;
+   bulkValues.SetStore(store);
+   allValues.SetStore(store);
+   deltaValues.SetStore(store);
+   paramImport.SetStore(store);
+   if (0 != paramBinary) paramBinary->SetStore(store);
+}
+
 void CanSdo::InitiateSDOTransfer(uint8_t req, uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data)
+{
+   remoteNodeId = nodeId;
+   sdoRequestIndex = index;
+   sdoRequestSubIndex = subIndex;
+   EnableClientFilter();
+
+   sdoReplyValid = false;
+   SendClientFrame(req, nodeId, index, subIndex, data);
+}
+
+/** \brief Register one filter for the replies of all nodes, so switching between nodes doesn't rebuild the filters
+ */
+void CanSdo::EnableClientFilter()
+{
+   if (!clientFilterActive)
+   {
+      clientFilterActive = true;
+      canHardware->RegisterUserMessage(SDO_REP_ID_BASE, SDO_REP_ID_MASK);
+   }
+}
+
+bool CanSdo::QueueRequest(uint8_t req, uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data, SdoClientCallback* cb, int timeout, IStreamSource* source)
+{
+   ClientRequest* request = 0;
+   bool nodeBusy = false;
+
+   //Completions in the receive interrupt and callbacks from other interrupts change
+   //the queue. Claiming the slot and deciding who sends it must not be interleaved with them
+   uint32_t irqState = cm_mask_interrupts(1);
+
+   for (int i = 0; i < SDO_CLIENT_QUEUE_LEN; i++)
+   {
+      if (0 == request && clientRequests[i].state == CLIENT_FREE)
+         request = &clientRequests[i];
+      else if (clientRequests[i].state == CLIENT_PENDING && clientRequests[i].nodeId == nodeId)
+         nodeBusy = true;
+   }
+
+   if (0 == request)
+   {
+      cm_mask_interrupts(irqState);
+      return false;
+   }
+
+   request->callback = cb;
+   request->source = source;
+   request->data = data;
+   request->seq = clientSeq++;
+   request->timeout = timeout;
+   request->timeoutReload = timeout;
+   request->index = index;
+   request->subIndex = subIndex;
+   request->nodeId = nodeId;
+   request->cmd = req;
+   request->toggle = 0;
+   request->offset = 0;
+   request->blockStart = 0;
+   request->blockSize = 0;
+   request->blockSegments = 0;
+   request->crc = 0;
+   request->crcEnabled = false;
+   request->segmented = false;
+   //If a request to this node is pending its completion will send ours
+   request->state = nodeBusy ? CLIENT_QUEUED : CLIENT_PENDING;
+
+   cm_mask_interrupts(irqState);
+
+   EnableClientFilter();
+
+   if (!nodeBusy)
+      SendClientFrame(request->cmd, request->nodeId, request->index, request->subIndex, request->data);
+
+   return true;
+}
+
+/** \brief Match a server reply against the pending request to that node
+ *
+ * \param nodeId node that sent the reply
+ * \param sdoFrame reply
+ * \return true if the reply belongs to an asynchronous request
+ *
+ */
+bool CanSdo::ProcessClientReply(uint8_t nodeId, SdoFrame* sdoFrame)
+{
+   for (int i = 0; i < SDO_CLIENT_QUEUE_LEN; i++)
+   {
+      ClientRequest* request = &clientRequests[i];
+
+      if (request->state != CLIENT_PENDING || request->nodeId != nodeId) continue;
+
+      bool block = (request->cmd & 0xE0) == SDO_REQUEST_BLOCK_DOWNLOAD;
+      //Download segment replies, block acknowledges and block end replies don't carry index and sub index
+      bool segmentReply = request->segmented && !block && (sdoFrame->cmd & ~SDO_TOGGLE_BIT) == SDO_RESPONSE_DOWNLOAD_SEGMENT;
+      bool blockAck = request->segmented && block && sdoFrame->cmd == (SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK);
+      bool blockEnd = request->segmented && block && sdoFrame->cmd == (SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_END);
+
+      //Reply to some other request, e.g. after a timeout. Ignore it
+      if (!segmentReply && !blockAck && !blockEnd && (request->index != sdoFrame->index || request->subIndex != sdoFrame->subIndex)) return false;
+
+      if (sdoFrame->cmd == SDO_ABORT)
+      {
+         CompleteRequest(request, false, sdoFrame->data);
+      }
+      else if (blockAck)
+      {
+         uint8_t* bytes = (uint8_t*)sdoFrame;
+         ProcessBlockAck(request, bytes[1], bytes[2]);
+      }
+      else if (blockEnd)
+      {
+         CompleteRequest(request, true, 0);
+      }
+      else if (block && !request->segmented && (sdoFrame->cmd & ~SDO_BLOCK_CRC) == SDO_RESPONSE_BLOCK_DOWNLOAD)
+      {
+         request->blockSize = sdoFrame->data & 0xFF;
+         request->crcEnabled = (sdoFrame->cmd & SDO_BLOCK_CRC) != 0;
+         request->segmented = true;
+
+         if (request->blockSize == 0 || request->blockSize > SDO_BLOCK_SIZE)
+         {
+            SendAbort(nodeId, request->index, request->subIndex, SDO_ERR_BLKSIZE);
+            CompleteRequest(request, false, SDO_ERR_BLKSIZE);
+         }
+         else
+         {
+            SendDownloadBlock(request);
+         }
+      }
+      else if (segmentReply && (sdoFrame->cmd & SDO_TOGGLE_BIT) != request->toggle)
+      {
+         SendAbort(nodeId, request->index, request->subIndex, SDO_ERR_TOGGLE);
+         CompleteRequest(request, false, SDO_ERR_TOGGLE);
+      }
+      else if (segmentReply)
+      {
+         request->toggle ^= SDO_TOGGLE_BIT;
+
+         if (0 != request->callback)
+            request->callback->SdoAcknowledged(nodeId, request->index, request->subIndex, request->source->GetSize() - request->data);
+
+         if (request->data == 0)
+            CompleteRequest(request, true, 0);
+         else
+            SendSegment(request);
+      }
+      else if (0 != request->source && !block && !request->segmented && sdoFrame->cmd == SDO_WRITE_REPLY)
+      {
+         request->segmented = true;
+         SendSegment(request);
+      }
+      else if (request->cmd == SDO_WRITE && sdoFrame->cmd == SDO_WRITE_REPLY)
+      {
+         CompleteRequest(request, true, 0);
+      }
+      else if (request->cmd == SDO_READ && (sdoFrame->cmd & ~(3 << 2)) == SDO_READ_REPLY)
+      {
+         //Size bits specify how many bytes do NOT contain data
+         uint32_t mask = 0xFFFFFFFF >> (8 * ((sdoFrame->cmd >> 2) & 3));
+         CompleteRequest(request, true, sdoFrame->data & mask);
+      }
+      else
+      {
+         //We only do expedited transfers, tell the server to give up
+         SendAbort(nodeId, request->index, request->subIndex, SDO_ERR_CMD);
+         CompleteRequest(request, false, SDO_ERR_CMD);
+      }
+      return true;
+   }
+   return false;
+}
+
+void CanSdo::CompleteRequest(ClientRequest* request, bool success, uint32_t data)
+{
+   ClientRequest done = *request;
+
+   request->state = CLIENT_FREE;
+   //Send the next request before calling back, so that requests
+   //queued by the callback line up behind it
+   SendNextRequest(done.nodeId);
+
+   if (0 != done.callback)
+      done.callback->SdoComplete(done.nodeId, done.index, done.subIndex, success, data);
+}
+
+void CanSdo::SendNextRequest(uint8_t nodeId)
+{
+   ClientRequest* next = 0;
+
+   for (int i = 0; i < SDO_CLIENT_QUEUE_LEN; i++)
+   {
+      ClientRequest* request = &clientRequests[i];
+
+      if (request->state == CLIENT_QUEUED && request->nodeId == nodeId &&
+          (0 == next || (int32_t)(request->seq - next->seq) < 0))
+         next = request;
+   }
+
+   if (0 != next)
+      SendRequest(next);
+}
+
+void CanSdo::SendRequest(ClientRequest* request)
+{
+   request->state = CLIENT_PENDING;
+   SendClientFrame(request->cmd, request->nodeId, request->index, request->subIndex, request->data);
+}
+
+/** \brief Send next segment of a download, request->data counts down the remaining bytes
+ */
+void CanSdo::SendSegment(ClientRequest* request)
+{
+   uint32_t d[2] = { 0, 0 };
+   uint8_t *bytes = (uint8_t*)d;
+   int len = request->source->Read(&bytes[1], MIN(request->data, BYTES_PER_SEGMENT));
+
+   request->data -= len;
+   request->timeout = request->timeoutReload;
+   //Size bits specify how many bytes do NOT contain data
+   bytes[0] = request->toggle | ((BYTES_PER_SEGMENT - len) << 1);
+
+   //Source may end early, then we end the transfer early and the server complains
+   if (request->data == 0 || len < BYTES_PER_SEGMENT)
+   {
+      bytes[0] |= SDO_LAST_SEGMENT;
+      request->data = 0;
+   }
+
+   canHardware->Send(SDO_REQ_ID_BASE + request->nodeId, d);
+}
+
+/** \brief Send the next block of a block download
+ * The entire block is queued at once, the server acknowledges it as a whole
+ */
+void CanSdo::SendDownloadBlock(ClientRequest* request)
+{
+   request->blockStart = request->offset;
+   request->blockSegments = 0;
+   request->timeout = request->timeoutReload;
+
+   for (uint8_t seq = 1; seq <= request->blockSize; seq++)
+   {
+      uint32_t d[2] = { 0, 0 };
+      uint8_t *bytes = (uint8_t*)d;
+      int len = request->source->Read(&bytes[1], MIN(request->data - request->offset, BYTES_PER_SEGMENT));
+
+      for (int i = 0; i < len; i++)
+         request->crc = Crc16(request->crc, bytes[i + 1]);
+
+      request->offset += len;
+      request->blockSegments = seq;
+      bytes[0] = seq;
+
+      //Source may end early, then the end command tells the server
+      if (request->offset == request->data || len < BYTES_PER_SEGMENT)
+      {
+         bytes[0] |= SDO_BLOCK_LAST_SEG;
+         request->data = request->offset;
+      }
+
+      canHardware->Send(SDO_REQ_ID_BASE + request->nodeId, d);
+
+      if (bytes[0] & SDO_BLOCK_LAST_SEG) break;
+   }
+}
+
+/** \brief Continue a block download after the server acknowledged a block
+ * Segments after the acknowledged one are sent again with the next block
+ *
+ * \param ackSeq last segment the server received in order
+ * \param blockSize segments per block for the next block
+ */
+void CanSdo::ProcessBlockAck(ClientRequest* request, uint8_t ackSeq, uint8_t blockSize)
+{
+   if (ackSeq < request->blockSegments)
+      SeekSource(request, request->blockStart + ackSeq * BYTES_PER_SEGMENT);
+
+   if (0 != request->callback)
+      request->callback->SdoAcknowledged(request->nodeId, request->index, request->subIndex, request->offset);
+
+   if (request->offset == request->data && ackSeq >= request->blockSegments)
+   {
+      uint32_t d[2] = { 0, 0 };
+      uint8_t *bytes = (uint8_t*)d;
+      //Size bits specify how many bytes of the last segment do NOT contain data
+      uint8_t unused = request->data == 0 ? BYTES_PER_SEGMENT : (BYTES_PER_SEGMENT - request->data % BYTES_PER_SEGMENT) % BYTES_PER_SEGMENT;
+
+      bytes[0] = SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_END | (unused << 2);
+      bytes[1] = request->crcEnabled ? request->crc & 0xFF : 0;
+      bytes[2] = request->crcEnabled ? request->crc >> 8 : 0;
+      request->timeout = request->timeoutReload;
+      canHardware->Send(SDO_REQ_ID_BASE + request->nodeId, d);
+   }
+   else if (blockSize == 0 || blockSize > SDO_BLOCK_SIZE)
+   {
+      SendAbort(request->nodeId, request->index, request->subIndex, SDO_ERR_BLKSIZE);
+      CompleteRequest(request, false, SDO_ERR_BLKSIZE);
+   }
+   else
+   {
+      request->blockSize = blockSize;
+      SendDownloadBlock(request);
+   }
+}
+
+/** \brief Restart reading a block download source at the given offset
+ * Sources can only be rewound, so the bytes before offset are read again.
+ * That also recomputes the CRC over them.
+ */
+void CanSdo::SeekSource(ClientRequest* request, uint32_t offset)
+{
+   uint8_t skip[BYTES_PER_SEGMENT];
+
+   request->source->Rewind();
+   request->crc = 0;
+   request->offset = 0;
+
+   while (request->offset < offset)
+   {
+      int len = request->source->Read(skip, MIN(offset - request->offset, BYTES_PER_SEGMENT));
+
+      for (int i = 0; i < len; i++)
+         request->crc = Crc16(request->crc, skip[i]);
+
+      request->offset += len;
+      if (len == 0) break;
+   }
+}
+
+void CanSdo::SendAbort(uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t err)
+{
+   SendClientFrame(SDO_ABORT, nodeId, index, subIndex, err);
+}
+
+void CanSdo::SendClientFrame(uint8_t cmd, uint8_t nodeId, uint16_t index, uint8_t subIndex, uint32_t data)
 {
    uint32_t d[2];
    SdoFrame *sdo = (SdoFrame*)d;
 
-   sdo->cmd = req;
+   sdo->cmd = cmd;
    sdo->index = index;
    sdo->subIndex = subIndex;
    sdo->data = data;
 
-   if (nodeId != remoteNodeId)
-   {
-      remoteNodeId = nodeId;
-      //This registers the reply message
-      canHardware->ClearUserMessages();
-   }
-
-   sdoReplyValid = false;
-   canHardware->Send(SDO_REQ_ID_BASE + remoteNodeId, d);
+   canHardware->Send(SDO_REQ_ID_BASE + nodeId, d);
 }
 
 //http://www.byteme.org.uk/canopenparent/canopen/sdo-service-data-objects-canopen/
@@ -147,18 +627,50 @@ void CanSdo::ProcessSDO(uint32_t* data)
 {
    SdoFrame *sdo = (SdoFrame*)data;
 
-   if ((sdo->cmd & SDO_REQUEST_SEGMENT) == SDO_REQUEST_SEGMENT)
+   if (sdo->cmd == SDO_ABORT)
+   {
+      //Client gave up, stop feeding any pending upload. Aborts are not answered
+      blockState = BLOCK_IDLE;
+      dlBlockState = BLOCK_IDLE;
+      printTimeout = 0;
+      activeSink = 0;
+      return;
+   }
+   else if ((sdo->cmd & 0xE0) == SDO_REQUEST_BLOCK_UPLOAD)
+   {
+      if (!ProcessBlockUpload(data)) return; //not all block commands are answered
+   }
+   else if ((sdo->cmd & 0xE0) == SDO_REQUEST_BLOCK_DOWNLOAD)
+   {
+      ProcessBlockDownload(data);
+   }
+   else if ((sdo->cmd & 0xE0) == SDO_REQUEST_DOWNLOAD_SEGMENT)
+   {
+      ProcessDownloadSegment(data);
+   }
+   else if ((sdo->cmd & SDO_REQUEST_SEGMENT) == SDO_REQUEST_SEGMENT)
    {
       const int bytesPerMessage = 7;
       uint8_t *bytes = (uint8_t*)data;
       int i = 1;
 
+      bool done;
+
       sdo->cmd = sdo->cmd & SDO_TOGGLE_BIT;
 
-      for (; i <= bytesPerMessage && !PRINT_BUF_EMPTY(); i++)
-         bytes[i] = PRINT_BUF_DEQUEUE();
+      if (0 != activeSource)
+      {
+         i += activeSource->Read(&bytes[1], bytesPerMessage);
+         done = i <= bytesPerMessage;
+      }
+      else
+      {
+         for (; i <= bytesPerMessage && !PRINT_BUF_EMPTY(); i++)
+            bytes[i] = PRINT_BUF_DEQUEUE();
+         done = PRINT_BUF_EMPTY();
+      }
 
-      if (PRINT_BUF_EMPTY())
+      if (done)
       {
          sdo->cmd |= SDO_SIZE_SPECIFIED;
          sdo->cmd |= (bytesPerMessage - i + 1) << 1; //specify how many bytes do NOT contain data
@@ -177,7 +689,7 @@ void CanSdo::ProcessSDO(uint32_t* data)
       {
          if (sdo->cmd == SDO_WRITE)
          {
-            if (Param::Set(paramIdx, sdo->data) == 0)
+            if (paramStore->Set(paramIdx, sdo->data) == 0)
             {
                sdo->cmd = SDO_WRITE_REPLY;
             }
@@ -189,7 +701,7 @@ void CanSdo::ProcessSDO(uint32_t* data)
          }
          else if (sdo->cmd == SDO_READ)
          {
-            sdo->data = Param::Get(paramIdx);
+            sdo->data = paramStore->Get(paramIdx);
             sdo->cmd = SDO_READ_REPLY;
          }
       }
@@ -207,12 +719,12 @@ void CanSdo::ProcessSDO(uint32_t* data)
       {
          if (sdo->cmd == SDO_WRITE)
          {
-            Param::SetFlagsRaw(paramIdx, (uint8_t)sdo->data);
+            paramStore->SetFlagsRaw(paramIdx, (uint8_t)sdo->data);
             sdo->cmd = SDO_WRITE_REPLY;
          }
          else if (sdo->cmd == SDO_READ)
          {
-            sdo->data = (uint32_t)Param::GetFlag(paramIdx);
+            sdo->data = (uint32_t)paramStore->GetFlag(paramIdx);
             sdo->cmd = SDO_READ_REPLY;
          }
       }
@@ -222,6 +734,81 @@ void CanSdo::ProcessSDO(uint32_t* data)
          sdo->data = SDO_ERR_INVIDX;
       }
    }
+   else if (sdo->index == SDO_INDEX_BULK_LIST)
+   {
+      ProcessBulkList(sdo);
+   }
+   else if (0 != GetValuesObject(sdo))
+   {
+      ParamValues* values = GetValuesObject(sdo);
+
+      if (sdo->cmd == SDO_READ)
+      {
+         //Always segmented, even if the values would fit an expedited transfer
+         activeSource = values;
+         activeSource->Rewind();
+         blockState = BLOCK_IDLE;
+         sdo->cmd = SDO_RESPONSE_UPLOAD | SDO_SIZE_SPECIFIED;
+         sdo->data = activeSource->GetSize();
+      }
+      else if (values == &bulkValues)
+      {
+         ProcessDownload(sdo, values);
+      }
+      else
+      {
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_READONLY;
+      }
+   }
+   else if (sdo->index == SDO_INDEX_DELTA_VALUES && sdo->subIndex == 0)
+   {
+      if (sdo->cmd == SDO_READ)
+      {
+         //Size depends on what changes while we transfer, so we don't indicate it
+         activeSource = &deltaValues;
+         activeSource->Rewind();
+         blockState = BLOCK_IDLE;
+         sdo->cmd = SDO_RESPONSE_UPLOAD;
+         sdo->data = 0;
+      }
+      else if (sdo->cmd == SDO_WRITE)
+      {
+         deltaValues.SetSince(sdo->data);
+         sdo->cmd = SDO_WRITE_REPLY;
+      }
+      else
+      {
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_LENGTH;
+      }
+   }
+   else if (0 != canPdo && sdo->index == SDO_INDEX_SYNC_ID && sdo->subIndex == 0)
+   {
+      if (sdo->cmd == SDO_READ)
+      {
+         sdo->data = canPdo->GetSyncId();
+         sdo->cmd = SDO_READ_REPLY;
+      }
+      else if (sdo->data <= MAX_COB_ID)
+      {
+         canPdo->SetSyncId(sdo->data);
+         sdo->cmd = SDO_WRITE_REPLY;
+      }
+      else
+      {
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_RANGE;
+      }
+   }
+   else if (0 != canPdo && sdo->index >= SDO_INDEX_TPDO_COMM && sdo->index < (SDO_INDEX_TPDO_COMM + MAX_MESSAGES))
+   {
+      ProcessPdoConfig(sdo);
+   }
+   else if (0 != recorder && sdo->index == SDO_INDEX_RECORDER)
+   {
+      ProcessRecorder(sdo);
+   }
    else if (0 != canMap && sdo->index == SDO_INDEX_MAP_TX)
    {
       AddCanMap(sdo, false);
@@ -230,6 +817,10 @@ void CanSdo::ProcessSDO(uint32_t* data)
    {
       AddCanMap(sdo, true);
    }
+   else if (0 != canMap && sdo->index == SDO_INDEX_MAP_LIST && sdo->subIndex == 0)
+   {
+      ProcessDownload(sdo, &mapStream);
+   }
    else if (0 != canMap && (sdo->index & 0xFF00) == SDO_INDEX_MAP_RD)
    {
       ReadOrDeleteCanMap(sdo);
@@ -260,16 +851,56 @@ void CanSdo::ProcessSDO(uint32_t* data)
          sdo->data = SDO_ERR_INVIDX;
       }
    }
-   else if (sdo->index == SDO_INDEX_STRINGS)
+   else if (sdo->index >= SDO_INDEX_ERROR_COUNT && sdo->index <= SDO_INDEX_ERROR_LAST)
    {
-      if (sdo->cmd == SDO_READ)
+      ERROR_MESSAGE_NUM err = (ERROR_MESSAGE_NUM)sdo->subIndex;
+
+      if (sdo->cmd == SDO_READ && err < ERROR_MESSAGE_LAST)
       {
-         sdo->data = 65535; //this should be the size of JSON but we don't know this in advance. Hmm.
-         sdo->cmd = SDO_RESPONSE_UPLOAD | SDO_SIZE_SPECIFIED;
-         printTimeout = PRINT_TIMEOUT;
+         if (sdo->index == SDO_INDEX_ERROR_COUNT)
+            sdo->data = ErrorMessage::GetCount(err);
+         else if (sdo->index == SDO_INDEX_ERROR_FIRST)
+            sdo->data = ErrorMessage::GetFirstTime(err);
+         else
+            sdo->data = ErrorMessage::GetLastTime(err);
+         sdo->cmd = SDO_READ_REPLY;
+      }
+      else
+      {
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_INVIDX;
+      }
+   }
+   else if (sdo->index == SDO_INDEX_IMPORT && sdo->subIndex == 0 && paramImport.HasBuffer())
+   {
+      if (sdo->cmd == SDO_READ)
+      {
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_WRITEONLY;
+      }
+      else
+      {
+         ProcessDownload(sdo, &paramImport);
+      }
+   }
+   else if (sdo->index == SDO_INDEX_STRINGS)
+   {
+      if (sdo->cmd == SDO_READ)
+      {
+         sdo->cmd = SDO_RESPONSE_UPLOAD | SDO_SIZE_SPECIFIED;
          printByteIn = 0;
          printByteOut = sizeof(printBuffer); //both point to the beginning of the physical buffer but virtually they are 64 bytes apart
-         printRequest = sdo->subIndex;
+         blockState = BLOCK_IDLE;
+         StartStringUpload(sdo->subIndex);
+         sdo->data = 0 != activeSource ? activeSource->GetSize() : 0;
+         //Printed strings have unknown size, 65535 has always been sent for them
+         if (sdo->data == 0) sdo->data = 65535;
+      }
+      else
+      {
+         //Arguments for the next print request, e.g. a filter for the parameter list
+         ProcessDownload(sdo, &printArgsSink);
+         printArgsFresh = sdo->cmd != SDO_ABORT;
       }
    }
    else
@@ -279,7 +910,7 @@ void CanSdo::ProcessSDO(uint32_t* data)
    canHardware->Send(0x580 + nodeId, data);
 }
 
-/** \brief count down PutChar character send timeout
+/** \brief count down PutChar character send timeout and client request timeouts
  *
  * \param callingFrequency in ms. This is subtracted from the remaining wait time
  * \return void
@@ -295,6 +926,46 @@ void CanSdo::TriggerTimeout(int callingFrequency)
    {
       printTimeout = 0;
    }
+
+   if (dlBlockState != BLOCK_IDLE)
+   {
+      dlTimeout -= callingFrequency;
+
+      if (dlTimeout <= 0)
+      {
+         SdoFrame abort = { SDO_ABORT, sinkIndex, sinkSubIndex, SDO_ERR_TIMEOUT };
+
+         dlBlockState = BLOCK_IDLE;
+         activeSink = 0;
+         SendSdoReply(&abort);
+      }
+   }
+
+   for (int i = 0; i < SDO_CLIENT_QUEUE_LEN; i++)
+   {
+      ClientRequest* request = &clientRequests[i];
+
+      if (request->state == CLIENT_PENDING)
+      {
+         request->timeout -= callingFrequency;
+
+         if (request->timeout <= 0)
+         {
+            SendAbort(request->nodeId, request->index, request->subIndex, SDO_ERR_TIMEOUT);
+            CompleteRequest(request, false, SDO_ERR_TIMEOUT);
+         }
+      }
+   }
+
+   //During block upload there is nothing like an empty buffer request to tell us
+   //that the producer is done. So once it has started and stayed silent for an
+   //entire calling period we send the remaining data as the last block.
+   if (blockState == BLOCK_READY && printRequest < 0 && 0 == activeSource)
+   {
+      if (blockIdle > 0)
+         SendBlock(true);
+      blockIdle = 1;
+   }
 }
 
 void CanSdo::PutChar(char c)
@@ -302,10 +973,33 @@ void CanSdo::PutChar(char c)
    if (printTimeout == 0) return; //last call to PutChar resulted in a timeout. Do not recover until the next burst
 
    printTimeout = PRINT_TIMEOUT;
-   //When print buffer is full, wait
-   while (printByteIn == printByteOut && printTimeout > 0);
 
-   PRINT_BUF_ENQUEUE(c);
+   if (blockState != BLOCK_IDLE)
+   {
+      //When the block is full and we have more data, send it as soon as the client is ready.
+      //Then wait for the acknowledge to free up the buffer
+      while (blockBytes >= (blockSize * BYTES_PER_SEGMENT) && printTimeout > 0 && blockState != BLOCK_DONE)
+      {
+         blockIdle = 0;
+
+         if (blockState == BLOCK_READY)
+            SendBlock(false);
+      }
+
+      if (printTimeout == 0 || blockState == BLOCK_DONE) return;
+
+      blockBuffer[blockBytes] = c;
+      blockBytes = blockBytes + 1;
+      blockCrc = Crc16(blockCrc, c);
+      blockIdle = 0;
+   }
+   else
+   {
+      //When print buffer is full, wait
+      while (printByteIn == printByteOut && printTimeout > 0);
+
+      PRINT_BUF_ENQUEUE(c);
+   }
    printRequest = -1; //We can clear the print start trigger as we've obviously started printing
 }
 
@@ -314,6 +1008,694 @@ void CanSdo::SendSdoReply(SdoFrame* sdoFrame)
    canHardware->Send(0x580 + nodeId, (uint32_t*)sdoFrame);
 }
 
+/** \brief Handle client side commands of an SDO block upload
+ *
+ * \param data frame received from client, is turned into the reply
+ * \return true when data contains a reply to be sent, false otherwise
+ *
+ */
+bool CanSdo::ProcessBlockUpload(uint32_t* data)
+{
+   SdoFrame *sdo = (SdoFrame*)data;
+   uint8_t *bytes = (uint8_t*)data;
+
+   switch (sdo->cmd & SDO_BLOCK_SUBCMD_MASK)
+   {
+   case SDO_BLOCK_INITIATE:
+      //We only offer streamed objects for block transfer
+      if (sdo->index != SDO_INDEX_STRINGS && 0 == GetStreamObject(sdo))
+      {
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_INVIDX;
+      }
+      else if (bytes[4] == 0 || bytes[4] > SDO_BLOCK_SIZE)
+      {
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_BLKSIZE;
+      }
+      else
+      {
+         blockCrcEnabled = (sdo->cmd & SDO_BLOCK_CRC) != 0;
+         blockSize = bytes[4];
+         blockBytes = 0;
+         blockCrc = 0;
+         blockLast = false;
+         blockState = BLOCK_INITIATED;
+
+         if (sdo->index == SDO_INDEX_STRINGS)
+         {
+            StartStringUpload(sdo->subIndex);
+         }
+         else
+         {
+            activeSource = GetStreamObject(sdo);
+            activeSource->Rewind();
+         }
+
+         //We support CRC, the size is only indicated when the source knows it in advance
+         sdo->cmd = SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_INITIATE | (sdo->cmd & SDO_BLOCK_CRC);
+         sdo->data = 0 != activeSource ? activeSource->GetSize() : 0;
+         if (sdo->data > 0) sdo->cmd |= SDO_BLOCK_SIZE_IND;
+      }
+      return true;
+   case SDO_BLOCK_START:
+      if (blockState == BLOCK_INITIATED)
+      {
+         blockState = BLOCK_READY;
+         if (0 != activeSource) SendSourceBlock();
+      }
+      return false;
+   case SDO_BLOCK_ACK:
+      if (blockState == BLOCK_SENT)
+      {
+         uint16_t ackedBytes = MIN(bytes[1] * BYTES_PER_SEGMENT, blockBytesSent);
+
+         if (bytes[2] == 0 || bytes[2] > SDO_BLOCK_SIZE)
+         {
+            blockState = BLOCK_IDLE;
+            printTimeout = 0;
+            sdo->cmd = SDO_ABORT;
+            sdo->data = SDO_ERR_BLKSIZE;
+            return true;
+         }
+
+         //Segments following ackseq were lost, they open the next block
+         for (uint16_t i = ackedBytes; i < blockBytes; i++)
+            blockBuffer[i - ackedBytes] = blockBuffer[i];
+
+         blockSize = bytes[2];
+         blockBytes = blockBytes - ackedBytes;
+
+         if (blockLast && blockBytes == 0)
+         {
+            blockState = BLOCK_DONE;
+            sdo->cmd = SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_END | (blockUnusedBytes << 2);
+            bytes[1] = blockCrcEnabled ? blockCrc & 0xFF : 0;
+            bytes[2] = blockCrcEnabled ? blockCrc >> 8 : 0;
+            return true;
+         }
+         else if (blockLast)
+         {
+            SendBlock(true); //Producer is done, resend the remainder right away
+         }
+         else
+         {
+            blockState = BLOCK_READY;
+            if (0 != activeSource) SendSourceBlock();
+         }
+      }
+      return false;
+   case SDO_BLOCK_END:
+   default:
+      if (blockState == BLOCK_DONE)
+         blockState = BLOCK_IDLE;
+      return false;
+   }
+}
+
+/** \brief Handle download initiate request to a streamed object
+ * Expedited downloads are passed to the sink right away, segmented downloads
+ * are passed on segment by segment until the client sets the last segment flag.
+ *
+ * \param sdo initiate frame received from client, is turned into the reply
+ * \param sink receiver of the downloaded data
+ *
+ */
+void CanSdo::ProcessDownload(SdoFrame* sdo, IStreamSink* sink)
+{
+   uint8_t *bytes = (uint8_t*)sdo;
+   uint32_t err = SDO_ERR_CMD;
+
+   activeSink = 0;
+
+   if ((sdo->cmd & 0xE0) != SDO_REQUEST_DOWNLOAD)
+   {
+      err = SDO_ERR_CMD;
+   }
+   else if (sdo->cmd & SDO_EXPEDITED)
+   {
+      //Size bits specify how many bytes do NOT contain data
+      int len = (sdo->cmd & SDO_SIZE_SPECIFIED) ? 4 - ((sdo->cmd >> 2) & 3) : 4;
+
+      err = sink->Begin(len);
+      if (err == 0) err = sink->Write(&bytes[4], len);
+      if (err == 0) err = sink->End();
+   }
+   else
+   {
+      err = sink->Begin((sdo->cmd & SDO_SIZE_SPECIFIED) ? sdo->data : 0);
+
+      if (err == 0)
+      {
+         activeSink = sink;
+         sinkIndex = sdo->index;
+         sinkSubIndex = sdo->subIndex;
+         sinkToggle = 0;
+      }
+   }
+
+   if (err == 0)
+   {
+      sdo->cmd = SDO_WRITE_REPLY;
+      sdo->data = 0;
+   }
+   else
+   {
+      sdo->cmd = SDO_ABORT;
+      sdo->data = err;
+   }
+}
+
+/** \brief Handle a segment of an ongoing segmented download
+ *
+ * \param data frame received from client, is turned into the reply
+ *
+ */
+void CanSdo::ProcessDownloadSegment(uint32_t* data)
+{
+   SdoFrame *sdo = (SdoFrame*)data;
+   uint8_t *bytes = (uint8_t*)data;
+   uint32_t err = 0;
+
+   if (0 == activeSink)
+      err = SDO_ERR_CMD;
+   else if ((sdo->cmd & SDO_TOGGLE_BIT) != sinkToggle)
+      err = SDO_ERR_TOGGLE;
+   else
+      err = activeSink->Write(&bytes[1], BYTES_PER_SEGMENT - ((sdo->cmd >> 1) & 7));
+
+   if (err == 0 && (sdo->cmd & SDO_LAST_SEGMENT))
+   {
+      err = activeSink->End();
+      activeSink = 0;
+   }
+
+   if (err == 0)
+   {
+      sdo->cmd = SDO_RESPONSE_DOWNLOAD_SEGMENT | sinkToggle;
+      data[0] = sdo->cmd;
+      data[1] = 0;
+      sinkToggle ^= SDO_TOGGLE_BIT;
+   }
+   else
+   {
+      activeSink = 0;
+      sdo->cmd = SDO_ABORT;
+      sdo->index = sinkIndex;
+      sdo->subIndex = sinkSubIndex;
+      sdo->data = err;
+   }
+}
+
+/** \brief Handle initiate and end of an SDO block download
+ * The segments in between are handled by ProcessBlockDownloadSegment()
+ *
+ * \param data frame received from client, is turned into the reply
+ */
+void CanSdo::ProcessBlockDownload(uint32_t* data)
+{
+   SdoFrame *sdo = (SdoFrame*)data;
+   uint8_t *bytes = (uint8_t*)data;
+   uint32_t err = 0;
+
+   if ((sdo->cmd & SDO_BLOCK_END) == 0) //initiate
+   {
+      IStreamSink* sink = GetSinkObject(sdo);
+
+      err = 0 == sink ? SDO_ERR_INVIDX : sink->Begin((sdo->cmd & SDO_BLOCK_SIZE_IND) ? sdo->data : 0);
+
+      if (err == 0)
+      {
+         activeSink = sink;
+         sinkIndex = sdo->index;
+         sinkSubIndex = sdo->subIndex;
+         dlSeq = 0;
+         dlCrc = 0;
+         dlCrcEnabled = (sdo->cmd & SDO_BLOCK_CRC) != 0;
+         dlTimeout = BLOCK_DOWNLOAD_TIMEOUT;
+         dlBlockState = BLOCK_READY;
+
+         //We support CRC and always ask for the largest block we can handle
+         sdo->cmd = SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_CRC;
+         sdo->data = SDO_BLOCK_SIZE;
+         return;
+      }
+   }
+   else if (dlBlockState == BLOCK_DONE && 0 != activeSink)
+   {
+      //Size bits specify how many bytes of the last segment do NOT contain data
+      err = WriteBlockData(dlLastSegment, BYTES_PER_SEGMENT - ((sdo->cmd >> 2) & 7));
+
+      if (err == 0 && dlCrcEnabled && dlCrc != (bytes[1] | (bytes[2] << 8)))
+         err = SDO_ERR_CRC;
+      if (err == 0)
+         err = activeSink->End();
+
+      if (err == 0)
+      {
+         activeSink = 0;
+         dlBlockState = BLOCK_IDLE;
+         data[0] = SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_END;
+         data[1] = 0;
+         return;
+      }
+   }
+   else
+   {
+      err = SDO_ERR_CMD;
+   }
+
+   //The end command doesn't carry index and sub index
+   if (sdo->cmd & SDO_BLOCK_END)
+   {
+      sdo->index = sinkIndex;
+      sdo->subIndex = sinkSubIndex;
+   }
+
+   activeSink = 0;
+   dlBlockState = BLOCK_IDLE;
+   sdo->cmd = SDO_ABORT;
+   sdo->data = err;
+}
+
+/** \brief Handle a segment of an SDO block download
+ * Segments are consumed in order, out of order segments are dropped and
+ * requested again by acknowledging the last one received in order.
+ *
+ * \param data segment received from client, is turned into the reply
+ * \return true when data contains a reply to be sent, false otherwise
+ */
+bool CanSdo::ProcessBlockDownloadSegment(uint32_t* data)
+{
+   uint8_t *bytes = (uint8_t*)data;
+   uint8_t seq = bytes[0] & ~SDO_BLOCK_LAST_SEG;
+   bool last = (bytes[0] & SDO_BLOCK_LAST_SEG) != 0;
+
+   dlTimeout = BLOCK_DOWNLOAD_TIMEOUT;
+
+   if (seq == (dlSeq + 1))
+   {
+      if (last)
+      {
+         for (int i = 0; i < BYTES_PER_SEGMENT; i++)
+            dlLastSegment[i] = bytes[i + 1];
+      }
+      else
+      {
+         uint32_t err = WriteBlockData(&bytes[1], BYTES_PER_SEGMENT);
+
+         if (err != 0)
+         {
+            SdoFrame* sdo = (SdoFrame*)data;
+
+            activeSink = 0;
+            dlBlockState = BLOCK_IDLE;
+            sdo->cmd = SDO_ABORT;
+            sdo->index = sinkIndex;
+            sdo->subIndex = sinkSubIndex;
+            sdo->data = err;
+            return true;
+         }
+      }
+      dlSeq = seq;
+   }
+
+   if (seq < SDO_BLOCK_SIZE && !last) return false;
+
+   //End of block, the client continues after the segment we acknowledge
+   if (last && seq == dlSeq)
+      dlBlockState = BLOCK_DONE;
+
+   data[0] = SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK | (dlSeq << 8) | (SDO_BLOCK_SIZE << 16);
+   data[1] = 0;
+   dlSeq = 0;
+   return true;
+}
+
+uint32_t CanSdo::WriteBlockData(const uint8_t* data, int len)
+{
+   for (int i = 0; i < len; i++)
+      dlCrc = Crc16(dlCrc, data[i]);
+
+   return activeSink->Write(data, len);
+}
+
+/** \brief Get the sink that consumes a streamed download
+ * \return sink or 0 if the request doesn't address one
+ */
+IStreamSink* CanSdo::GetSinkObject(SdoFrame* sdo)
+{
+   if (sdo->subIndex != 0)
+      return 0;
+   else if (sdo->index == SDO_INDEX_BULK_VALUES)
+      return &bulkValues;
+   else if (0 != canMap && sdo->index == SDO_INDEX_MAP_LIST)
+      return &mapStream;
+   else if (sdo->index == SDO_INDEX_IMPORT && paramImport.HasBuffer())
+      return &paramImport;
+   return 0;
+}
+
+/** \brief Get the values stream addressed by an SDO request
+ * \return stream or 0 if the request doesn't address one
+ */
+ParamValues* CanSdo::GetValuesObject(SdoFrame* sdo)
+{
+   if (sdo->subIndex != 0)
+      return 0;
+   else if (sdo->index == SDO_INDEX_BULK_VALUES)
+      return &bulkValues;
+   else if (sdo->index == SDO_INDEX_ALL_VALUES)
+      return &allValues;
+   return 0;
+}
+
+/** \brief Read or write the TPDO communication parameters of CanMap send message n via index 0x1800+n
+ * Sub indexes as in CiA 301: 1 CAN id (read only), 2 transmission type, 3 inhibit time, 5 event timer
+ */
+void CanSdo::ProcessPdoConfig(SdoFrame* sdo)
+{
+   uint32_t cobId;
+   uint8_t type;
+   uint16_t inhibitTime, eventTimer;
+
+   if (0 == canPdo->GetCanMap()->GetMap(false, sdo->index - SDO_INDEX_TPDO_COMM, 0, cobId))
+   {
+      sdo->cmd = SDO_ABORT;
+      sdo->data = SDO_ERR_INVIDX;
+      return;
+   }
+
+   canPdo->GetConfig(cobId, type, inhibitTime, eventTimer);
+
+   if (sdo->cmd == SDO_READ)
+   {
+      switch (sdo->subIndex)
+      {
+      case 0: sdo->data = 5; break;
+      case 1: sdo->data = cobId; break;
+      case 2: sdo->data = type; break;
+      case 3: sdo->data = inhibitTime; break;
+      case 5: sdo->data = eventTimer; break;
+      default:
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_INVIDX;
+         return;
+      }
+      sdo->cmd = SDO_READ_REPLY;
+      return;
+   }
+
+   switch (sdo->subIndex)
+   {
+   case 2: type = sdo->data; break;
+   case 3: inhibitTime = sdo->data; break;
+   case 5: eventTimer = sdo->data; break;
+   default:
+      sdo->cmd = SDO_ABORT;
+      sdo->data = sdo->subIndex <= 1 ? SDO_ERR_READONLY : SDO_ERR_INVIDX;
+      return;
+   }
+
+   //Inhibit time and event timer are only kept for types that use them, so set the type first
+   if (sdo->data <= (sdo->subIndex == 2 ? 0xFFu : 0xFFFFu) && canPdo->Configure(cobId, type, inhibitTime, eventTimer))
+   {
+      sdo->cmd = SDO_WRITE_REPLY;
+   }
+   else
+   {
+      sdo->cmd = SDO_ABORT;
+      sdo->data = SDO_ERR_RANGE;
+   }
+}
+
+/** \brief Control the recorder and upload its capture via index 0x2304
+ * Sub indexes: 0 captured block (read only), 1 state (write 0 to stop, 1 to arm, 2 to force
+ * the trigger), 2 decimation, 3 pre-trigger samples, 4 trigger mode, 5 trigger parameter UID,
+ * 6 threshold, 7 number of channels (write to shorten), 8 samples per capture (read only),
+ * 0x10 + n UID of channel n (write the entry after the last one to add a channel)
+ */
+void CanSdo::ProcessRecorder(SdoFrame* sdo)
+{
+   int channel = sdo->subIndex - 0x10;
+   bool ok = true;
+
+   if (sdo->cmd == SDO_READ)
+   {
+      if (sdo->subIndex == 0)
+      {
+         activeSource = recorder;
+         activeSource->Rewind();
+         blockState = BLOCK_IDLE;
+         sdo->cmd = SDO_RESPONSE_UPLOAD | SDO_SIZE_SPECIFIED;
+         sdo->data = activeSource->GetSize();
+         return;
+      }
+
+      switch (sdo->subIndex)
+      {
+      case 1: sdo->data = recorder->GetState(); break;
+      case 2: sdo->data = recorder->GetDecimation(); break;
+      case 3: sdo->data = recorder->GetPreTrigger(); break;
+      case 4: sdo->data = recorder->GetTriggerMode(); break;
+      case 5:
+         sdo->data = recorder->GetTriggerParam() < Param::PARAM_LAST ? Param::GetAttrib(recorder->GetTriggerParam())->id : 0;
+         break;
+      case 6: sdo->data = recorder->GetThreshold(); break;
+      case 7: sdo->data = recorder->GetChannelCount(); break;
+      case 8: sdo->data = recorder->GetCapacity(); break;
+      default:
+         if (channel >= 0 && channel < recorder->GetChannelCount())
+         {
+            sdo->data = Param::GetAttrib(recorder->GetChannel(channel))->id;
+            break;
+         }
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_INVIDX;
+         return;
+      }
+      sdo->cmd = SDO_READ_REPLY;
+      return;
+   }
+
+   switch (sdo->subIndex)
+   {
+   case 0:
+   case 8:
+      sdo->cmd = SDO_ABORT;
+      sdo->data = SDO_ERR_READONLY;
+      return;
+   case 1:
+      if (sdo->data == 0) recorder->Stop();
+      else if (sdo->data == 1) ok = recorder->Arm();
+      else if (sdo->data == 2) recorder->ForceTrigger();
+      else ok = false;
+      break;
+   case 2:
+      ok = sdo->data <= 0xFFFF;
+      if (ok) recorder->SetDecimation(sdo->data);
+      break;
+   case 3:
+      ok = sdo->data <= 0xFFFF;
+      if (ok) recorder->SetPreTrigger(sdo->data);
+      break;
+   case 4:
+      ok = recorder->SetTrigger((ParamRecorder::Trigger)sdo->data, recorder->GetTriggerParam(), recorder->GetThreshold());
+      break;
+   case 5:
+      ok = recorder->SetTrigger(recorder->GetTriggerMode(), Param::NumFromId(sdo->data), recorder->GetThreshold());
+      break;
+   case 6:
+      recorder->SetTrigger(recorder->GetTriggerMode(), recorder->GetTriggerParam(), sdo->data);
+      break;
+   case 7:
+   {
+      Param::PARAM_NUM channels[RECORDER_MAX_CHANNELS];
+
+      ok = sdo->data <= (uint32_t)recorder->GetChannelCount();
+      for (int i = 0; ok && i < (int)sdo->data; i++)
+         channels[i] = recorder->GetChannel(i);
+      if (ok) recorder->SetChannels(channels, sdo->data);
+      break;
+   }
+   default:
+      if (channel < 0 || channel > recorder->GetChannelCount())
+      {
+         sdo->cmd = SDO_ABORT;
+         sdo->data = SDO_ERR_INVIDX;
+         return;
+      }
+      ok = recorder->SetChannel(channel, Param::NumFromId(sdo->data));
+      break;
+   }
+
+   if (ok)
+   {
+      sdo->cmd = SDO_WRITE_REPLY;
+   }
+   else
+   {
+      sdo->cmd = SDO_ABORT;
+      sdo->data = SDO_ERR_RANGE;
+   }
+}
+
+/** \brief Get the stream uploaded by an SDO request
+ * \return stream or 0 if the request doesn't address one
+ */
+IStreamSource* CanSdo::GetStreamObject(SdoFrame* sdo)
+{
+   if (sdo->index == SDO_INDEX_DELTA_VALUES && sdo->subIndex == 0)
+      return &deltaValues;
+   if (0 != recorder && sdo->index == SDO_INDEX_RECORDER && sdo->subIndex == 0)
+      return recorder;
+   return GetValuesObject(sdo);
+}
+
+/** \brief Read or write the list of parameters transferred via SDO_INDEX_BULK_VALUES
+ * Sub index 0 holds the number of entries, it can be written to shorten the list.
+ * Sub index n holds the UID of the n-th parameter, the list can be extended by writing
+ * the entry right after the last one.
+ *
+ * \param sdo frame received from client, is turned into the reply
+ *
+ */
+void CanSdo::ProcessBulkList(SdoFrame* sdo)
+{
+   uint32_t err = 0;
+
+   if (sdo->cmd == SDO_READ)
+   {
+      if (sdo->subIndex == 0)
+         sdo->data = bulkCount;
+      else if (sdo->subIndex <= bulkCount)
+         sdo->data = Param::GetAttrib((Param::PARAM_NUM)bulkParams[sdo->subIndex - 1])->id;
+      else
+         err = SDO_ERR_INVIDX;
+   }
+   else if (sdo->cmd == SDO_WRITE)
+   {
+      if (sdo->subIndex == 0)
+      {
+         if (sdo->data <= bulkCount)
+            bulkCount = sdo->data;
+         else
+            err = SDO_ERR_RANGE;
+      }
+      else if (sdo->subIndex <= (bulkCount + 1) && sdo->subIndex <= SDO_MAX_BULK_PARAMS)
+      {
+         //Look up the UID once here rather than with every transfer
+         Param::PARAM_NUM paramIdx = Param::NumFromId(sdo->data);
+
+         if (paramIdx < Param::PARAM_LAST)
+         {
+            bulkParams[sdo->subIndex - 1] = paramIdx;
+            bulkCount = MAX(bulkCount, sdo->subIndex);
+         }
+         else
+         {
+            err = SDO_ERR_RANGE;
+         }
+      }
+      else
+      {
+         err = SDO_ERR_INVIDX;
+      }
+      bulkValues.SetList(bulkParams, bulkCount);
+   }
+   else
+   {
+      err = SDO_ERR_CMD;
+   }
+
+   if (err != 0)
+   {
+      sdo->cmd = SDO_ABORT;
+      sdo->data = err;
+   }
+   else
+   {
+      sdo->cmd = sdo->cmd == SDO_READ ? SDO_READ_REPLY : SDO_WRITE_REPLY;
+   }
+}
+
+/** \brief Fill up blockBuffer from the active stream source and send it
+ */
+void CanSdo::SendSourceBlock()
+{
+   uint16_t capacity = blockSize * BYTES_PER_SEGMENT;
+
+   //Read one byte beyond the block to find out whether this is the last one
+   if (blockBytes <= capacity)
+   {
+      int len = activeSource->Read(&blockBuffer[blockBytes], capacity + 1 - blockBytes);
+
+      for (int i = 0; i < len; i++)
+         blockCrc = Crc16(blockCrc, blockBuffer[blockBytes + i]);
+
+      blockBytes = blockBytes + len;
+   }
+
+   SendBlock(blockBytes <= capacity);
+}
+
+void CanSdo::StartStringUpload(uint8_t subIndex)
+{
+   //Arguments only apply to the read that directly follows their complete download
+   if (!printArgsFresh || !printArgsSink.IsComplete()) printArgs[0] = 0;
+   printArgsFresh = false;
+
+   activeSource = subIndex < SDO_MAX_STRING_SOURCES ? stringSources[subIndex] : 0;
+
+   if (0 != activeSource)
+   {
+      activeSource->Rewind();
+   }
+   else
+   {
+      printTimeout = PRINT_TIMEOUT;
+      printRequest = subIndex;
+   }
+}
+
+/** \brief Send up to blockSize segments from blockBuffer
+ *
+ * \param last true if the producer is done, the last segment is then flagged as such
+ *
+ */
+void CanSdo::SendBlock(bool last)
+{
+   uint32_t d[2];
+   uint8_t *bytes = (uint8_t*)d;
+   uint16_t len = MIN(blockBytes, blockSize * BYTES_PER_SEGMENT);
+   uint16_t pos = 0;
+
+   blockLast = last && len == blockBytes;
+   blockBytesSent = len;
+   blockState = BLOCK_SENT;
+
+   for (uint8_t seqNo = 1; pos < len; seqNo++)
+   {
+      int i = 1;
+
+      bytes[0] = seqNo;
+
+      for (; i <= BYTES_PER_SEGMENT && pos < len; i++, pos++)
+         bytes[i] = blockBuffer[pos];
+
+      for (int j = i; j <= BYTES_PER_SEGMENT; j++)
+         bytes[j] = 0;
+
+      if (blockLast && pos == len)
+      {
+         bytes[0] |= SDO_BLOCK_LAST_SEG;
+         blockUnusedBytes = BYTES_PER_SEGMENT - i + 1;
+      }
+
+      canHardware->Send(SDO_REP_ID_BASE + nodeId, d);
+   }
+}
+
 void CanSdo::ReadOrDeleteCanMap(SdoFrame* sdo)
 {
    bool rx = (sdo->index & 0x80) != 0;
@@ -16,10 +16,31 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <libopencm3/cm3/cortex.h>
 #include "errormessage.h"
+#include "hwdefs.h"
 #include "printf.h"
 #include "my_string.h"
 
+//SaveLog() runs often and likely while power fails, never rewrite the only copy
+static_assert(ERRLOG_BLKNUM == 0 || (ERRLOG_BACKUP_BLKNUM != 0 && ERRLOG_JOURNAL_BLKNUM != 0),
+              "The error log needs ERRLOG_BACKUP_BLKNUM and ERRLOG_JOURNAL_BLKNUM");
+
+#define ERRLOG_VERSION 1
+//Number of entries, journal id and first journal record that is newer than the log,
+//followed by count, first and last time of each error
+#define ERRLOG_HEADER_WORDS 3
+#define ERRLOG_WORDS (ERRLOG_HEADER_WORDS + 3 * ERROR_MESSAGE_LAST)
+
+//The journal page starts with magic and id of the log it continues. Every record
+//holds error number, count, first and last time and the CRC of those, it is only
+//valid once the CRC was programmed
+#define JOURNAL_MAGIC 0x4E524A45 //"EJRN"
+#define JOURNAL_HEADER_WORDS 2
+#define JOURNAL_RECORD_WORDS 5
+//Marks a journal page that doesn't continue the log in flash
+#define JOURNAL_STALE (ERRLOG_JOURNAL_RECORDS + 1)
+
 struct ErrorDescriptor
 {
    const char* msg;
@@ -57,8 +78,23 @@ struct BufferEntry errorBuffer[ERROR_BUF_SIZE] = { { ERROR_MESSAGE_LAST, 0 } };
 uint32_t ErrorMessage::timeTick = 0;
 uint32_t ErrorMessage::currentBufIdx = 0;
 uint32_t ErrorMessage::lastPrintIdx = 0;
+uint32_t ErrorMessage::postCount = 0;
 ERROR_MESSAGE_NUM ErrorMessage::lastError = ERROR_NONE;
-bool ErrorMessage::posted[ERROR_MESSAGE_LAST] = { false };
+uint32_t ErrorMessage::posted[] = { 0 };
+uint32_t ErrorMessage::logDirty[] = { 0 };
+ErrorMessage::LogEntry ErrorMessage::log[];
+volatile bool ErrorMessage::logChanged = false;
+
+static uint32_t logImage[ERRLOG_WORDS];
+static uint32_t journalId = 0;
+static uint32_t journalStart = 0; //as loaded with the log
+static uint32_t journalUsed = JOURNAL_STALE;
+static FlashWriter::Job journalJob;
+static uint32_t journalImage[JOURNAL_HEADER_WORDS + ERRLOG_JOURNAL_BATCH * JOURNAL_RECORD_WORDS];
+const FlashStore::Client ErrorMessage::logClient =
+{
+   ERRLOG_VERSION, SerializeLog, LoadLogSection, 0, 0, logImage, ERRLOG_WORDS
+};
 
 /** Set timestamp for error message
 * @param time Current timestamp, will be displayed as is in message */
@@ -73,13 +109,25 @@ void ErrorMessage::SetTime(uint32_t time)
  @param msg message number */
 void ErrorMessage::Post(ERROR_MESSAGE_NUM msg)
 {
-   if (!posted[msg] && timeTick > 0)
+   uint32_t bit = 1u << (msg % 32);
+
+   //Posted from interrupts of different priorities, the bit is shared with other messages
+   if (timeTick > 0 && (__atomic_fetch_or(&posted[msg / 32], bit, __ATOMIC_RELAXED) & bit) == 0)
    {
+      uint32_t irqState = cm_mask_interrupts(1);
       lastError = msg;
       errorBuffer[currentBufIdx].msg = msg;
       errorBuffer[currentBufIdx].time = timeTick;
-      posted[msg] = true;
       currentBufIdx = (currentBufIdx + 1) % ERROR_BUF_SIZE;
+      postCount++;
+
+      if (log[msg].count == 0)
+         log[msg].firstTime = timeTick;
+      log[msg].lastTime = timeTick;
+      log[msg].count++;
+      logDirty[msg / 32] |= bit;
+      logChanged = true;
+      cm_mask_interrupts(irqState);
    }
 }
 
@@ -87,8 +135,8 @@ void ErrorMessage::Post(ERROR_MESSAGE_NUM msg)
  Does not reset the error buffer */
 void ErrorMessage::UnpostAll()
 {
-   for (uint32_t i = 0; i < ERROR_MESSAGE_LAST; i++)
-      posted[i] = false;
+   for (uint32_t i = 0; i < sizeof(posted) / sizeof(posted[0]); i++)
+      __atomic_store_n(&posted[i], 0, __ATOMIC_RELAXED);
 }
 
 /** Print errors that have been posted since last print */
@@ -127,6 +175,274 @@ uint32_t ErrorMessage::GetErrorTime(uint8_t index)
    return 0;
 }
 
+const char* ErrorMessage::GetName(ERROR_MESSAGE_NUM err)
+{
+   return err < ERROR_MESSAGE_LAST ? errorDescriptors[err].msg : "";
+}
+
+/** Number of posts of an error, including those before the last reset when the log was loaded */
+uint32_t ErrorMessage::GetCount(ERROR_MESSAGE_NUM err)
+{
+   return err < ERROR_MESSAGE_LAST ? log[err].count : 0;
+}
+
+uint32_t ErrorMessage::GetFirstTime(ERROR_MESSAGE_NUM err)
+{
+   return err < ERROR_MESSAGE_LAST ? log[err].firstTime : 0;
+}
+
+uint32_t ErrorMessage::GetLastTime(ERROR_MESSAGE_NUM err)
+{
+   return err < ERROR_MESSAGE_LAST ? log[err].lastTime : 0;
+}
+
+static const uint32_t* GetJournal()
+{
+   return (const uint32_t*)(uintptr_t)FlashStore::GetBlockAddress(ERRLOG_JOURNAL_BLKNUM, FLASH_PAGE_SIZE);
+}
+
+static const uint32_t* GetJournalRecord(uint32_t index)
+{
+   return GetJournal() + JOURNAL_HEADER_WORDS + index * JOURNAL_RECORD_WORDS;
+}
+
+static uint32_t GetRecordCrc(const uint32_t* record)
+{
+   uint32_t crc = 0xFFFFFFFF;
+
+   for (int i = 0; i < JOURNAL_RECORD_WORDS - 1; i++)
+      crc = FlashStore::CrcWord(crc, record[i]);
+
+   return crc;
+}
+
+/** Load the error log from flash, call this before posting the first error
+ * @return true if a log was found */
+bool ErrorMessage::LoadLog()
+{
+   FlashStore::Register(FlashStore::SECTION_ERRORLOG, &logClient);
+   journalUsed = JOURNAL_STALE;
+
+   if (!FlashStore::Load(FlashStore::SECTION_ERRORLOG))
+      return false;
+
+   ReplayJournal();
+
+   //Only later posts need to be saved
+   uint32_t irqState = cm_mask_interrupts(1);
+   for (uint32_t i = 0; i < sizeof(logDirty) / sizeof(logDirty[0]); i++)
+      logDirty[i] = 0;
+   logChanged = false;
+   cm_mask_interrupts(irqState);
+
+   return true;
+}
+
+/** Write the errors posted since the last call to flash.
+ The changed errors are appended to the journal. When they don't fit, the complete
+ log is committed and the journal is erased after it. The flash is written by FlashWriter,
+ see the class description for when this blocks.
+ @return 1 if a save was queued, 0 if nothing changed, -1 if the previous save is still in progress */
+int ErrorMessage::SaveLog()
+{
+   if (!logChanged || 0 == ERRLOG_BLKNUM) return 0;
+   if (FlashWriter::STATUS_QUEUED == journalJob.status) return -1;
+
+   //The journal may miss records
+   if (FlashWriter::STATUS_ERROR == journalJob.status)
+      journalUsed = JOURNAL_STALE;
+
+   uint32_t changed = 0;
+
+   for (uint32_t i = 0; i < sizeof(logDirty) / sizeof(logDirty[0]); i++)
+      changed += __builtin_popcount(logDirty[i]);
+
+   return journalUsed + changed > ERRLOG_JOURNAL_RECORDS ? CompactLog() : AppendLog();
+}
+
+/** Reset counters and times of all errors, the next SaveLog() clears them in flash */
+void ErrorMessage::ClearLog()
+{
+   uint32_t irqState = cm_mask_interrupts(1);
+   for (uint32_t i = 0; i < ERROR_MESSAGE_LAST; i++)
+   {
+      log[i].count = 0;
+      log[i].firstTime = 0;
+      log[i].lastTime = 0;
+      logDirty[i / 32] |= 1u << (i % 32);
+   }
+   logChanged = true;
+   cm_mask_interrupts(irqState);
+}
+
+/** Append up to ERRLOG_JOURNAL_BATCH changed errors to the journal */
+int ErrorMessage::AppendLog()
+{
+   uint32_t* records = journalImage + JOURNAL_HEADER_WORDS;
+   uint32_t count = 0;
+   uint32_t index;
+
+   //Errors are posted from interrupts, copy a consistent state. A commit that
+   //serializes the log meanwhile must see the records as part of the journal
+   uint32_t irqState = cm_mask_interrupts(1);
+   for (uint32_t i = 0; i < ERROR_MESSAGE_LAST && count < ERRLOG_JOURNAL_BATCH; i++)
+   {
+      uint32_t bit = 1u << (i % 32);
+      uint32_t* record = records + count * JOURNAL_RECORD_WORDS;
+
+      if ((logDirty[i / 32] & bit) == 0) continue;
+
+      logDirty[i / 32] &= ~bit;
+      record[0] = i;
+      record[1] = log[i].count;
+      record[2] = log[i].firstTime;
+      record[3] = log[i].lastTime;
+      count++;
+   }
+
+   index = journalUsed;
+   journalUsed += count;
+   logChanged = false;
+
+   for (uint32_t i = 0; i < sizeof(logDirty) / sizeof(logDirty[0]); i++)
+      logChanged = logChanged || logDirty[i] != 0;
+   cm_mask_interrupts(irqState);
+
+   for (uint32_t i = 0; i < count; i++)
+      records[i * JOURNAL_RECORD_WORDS + 4] = GetRecordCrc(records + i * JOURNAL_RECORD_WORDS);
+
+   //The CRC of each record is programmed last
+   if (FlashWriter::Queue(&journalJob, (uint32_t)(uintptr_t)GetJournalRecord(index), records, count * JOURNAL_RECORD_WORDS))
+      return 1;
+
+   //Their place stays empty, the next save writes them
+   irqState = cm_mask_interrupts(1);
+   for (uint32_t i = 0; i < count; i++)
+   {
+      uint32_t err = records[i * JOURNAL_RECORD_WORDS];
+      logDirty[err / 32] |= 1u << (err % 32);
+   }
+   logChanged = true;
+   cm_mask_interrupts(irqState);
+
+   return -1;
+}
+
+/** Commit the complete log with a new journal id, then start the journal over */
+int ErrorMessage::CompactLog()
+{
+   const uint32_t dirtyWords = sizeof(logDirty) / sizeof(logDirty[0]);
+   uint32_t dirty[dirtyWords];
+
+   //Posts from now on are part of the next save. The log refers to
+   //the new journal, the old one never matches it
+   uint32_t irqState = cm_mask_interrupts(1);
+   for (uint32_t i = 0; i < dirtyWords; i++)
+   {
+      dirty[i] = logDirty[i];
+      logDirty[i] = 0;
+   }
+   logChanged = false;
+   journalId++;
+   journalUsed = 0;
+   cm_mask_interrupts(irqState);
+
+   FlashStore::Register(FlashStore::SECTION_ERRORLOG, &logClient);
+
+   if (FlashStore::Commit(1 << FlashStore::SECTION_ERRORLOG) < 0)
+   {
+      //The journal in flash belongs to the previous id, never append to it
+      irqState = cm_mask_interrupts(1);
+      for (uint32_t i = 0; i < dirtyWords; i++)
+         logDirty[i] |= dirty[i];
+      logChanged = true;
+      journalUsed = JOURNAL_STALE;
+      cm_mask_interrupts(irqState);
+      return -1;
+   }
+
+   journalImage[0] = JOURNAL_MAGIC;
+   journalImage[1] = journalId;
+
+   //Queued after the log. A reset in between leaves the old journal that doesn't match
+   if (!FlashWriter::Queue(&journalJob, (uint32_t)(uintptr_t)GetJournal(), journalImage, JOURNAL_HEADER_WORDS, FLASH_PAGE_SIZE))
+      journalUsed = JOURNAL_STALE;
+
+   return 1;
+}
+
+/** Apply the journal records that were written after the loaded log */
+void ErrorMessage::ReplayJournal()
+{
+   const uint32_t* journal = GetJournal();
+
+   if (journal[0] != JOURNAL_MAGIC || journal[1] != journalId || journalStart > ERRLOG_JOURNAL_RECORDS)
+      return;
+
+   journalUsed = journalStart;
+
+   //Torn and corrupted records are skipped, their place is not used again
+   for (uint32_t i = journalStart; i < ERRLOG_JOURNAL_RECORDS; i++)
+   {
+      const uint32_t* record = GetJournalRecord(i);
+
+      if (!FlashStore::IsErased((uint32_t)(uintptr_t)record, JOURNAL_RECORD_WORDS * 4))
+         journalUsed = i + 1;
+
+      if (record[4] == GetRecordCrc(record) && record[0] < ERROR_MESSAGE_LAST)
+      {
+         log[record[0]].count = record[1];
+         log[record[0]].firstTime = record[2];
+         log[record[0]].lastTime = record[3];
+      }
+   }
+}
+
+uint32_t ErrorMessage::SerializeLog(void* context, uint32_t* image, uint32_t maxWords)
+{
+   static_assert(ERRLOG_WORDS <= FLASH_PAGE_SIZE / 4 - FLASHSTORE_FOOTER_WORDS, "Error log does not fit into one flash page");
+   static_assert(ERRLOG_JOURNAL_RECORDS == (FLASH_PAGE_SIZE / 4 - JOURNAL_HEADER_WORDS) / JOURNAL_RECORD_WORDS, "Journal layout mismatch");
+   context = context;
+   maxWords = maxWords;
+
+   image[0] = ERROR_MESSAGE_LAST;
+
+   //Errors are posted from interrupts, copy a consistent state
+   uint32_t irqState = cm_mask_interrupts(1);
+   image[1] = journalId;
+   image[2] = journalUsed;
+
+   for (uint32_t i = 0; i < ERROR_MESSAGE_LAST; i++)
+   {
+      image[ERRLOG_HEADER_WORDS + 3 * i] = log[i].count;
+      image[ERRLOG_HEADER_WORDS + 1 + 3 * i] = log[i].firstTime;
+      image[ERRLOG_HEADER_WORDS + 2 + 3 * i] = log[i].lastTime;
+   }
+   cm_mask_interrupts(irqState);
+
+   return ERRLOG_WORDS;
+}
+
+bool ErrorMessage::LoadLogSection(void* context, uint16_t version, const uint32_t* data, uint32_t words)
+{
+   context = context;
+
+   if (version != ERRLOG_VERSION || words < ERRLOG_HEADER_WORDS || words != ERRLOG_HEADER_WORDS + 3 * data[0])
+      return false;
+
+   journalId = data[1];
+   journalStart = data[2];
+
+   //New errors are added to the end of ERROR_MESSAGE_LIST, so the known ones keep their place
+   for (uint32_t i = 0; i < ERROR_MESSAGE_LAST && i < data[0]; i++)
+   {
+      log[i].count = data[ERRLOG_HEADER_WORDS + 3 * i];
+      log[i].firstTime = data[ERRLOG_HEADER_WORDS + 1 + 3 * i];
+      log[i].lastTime = data[ERRLOG_HEADER_WORDS + 2 + 3 * i];
+   }
+   return true;
+}
+
 /** Print all errors currently in error memory */
 void ErrorMessage::PrintAllErrors()
 {
@@ -0,0 +1,391 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/stm32/crc.h>
+#include <libopencm3/stm32/desig.h>
+#include <libopencm3/cm3/cortex.h>
+#include "flashstore.h"
+#include "hwdefs.h"
+#include "my_math.h"
+
+#define FOOTER_MAGIC 0x4F545346 //"FSTO"
+#define NUM_COPIES 2
+
+static const uint32_t blockNums[FlashStore::SECTION_LAST][NUM_COPIES] =
+{
+   { CAN1_BLKNUM, CAN1_BACKUP_BLKNUM },
+   { USER_BLKNUM, USER_BACKUP_BLKNUM },
+   { ERRLOG_BLKNUM, ERRLOG_BACKUP_BLKNUM },
+};
+
+const FlashStore::Client* FlashStore::clients[];
+FlashWriter::Job FlashStore::dataJobs[];
+FlashWriter::Job FlashStore::footerJobs[];
+FlashStore::Footer FlashStore::footers[];
+volatile bool FlashStore::committing = false;
+
+/** \brief Set the client that serializes and loads a section
+ *
+ * \param section section to serve
+ * \param client client that must stay valid, 0 to remove the client
+ */
+void FlashStore::Register(Section section, const Client* client)
+{
+   clients[section] = client;
+}
+
+/** \brief Remove a client that is about to be destroyed, unless another one replaced it */
+void FlashStore::Unregister(Section section, const Client* client)
+{
+   if (clients[section] == client)
+      clients[section] = 0;
+}
+
+/** \brief Load a section from the last complete commit it was part of
+ *
+ * When no copy of the section is complete the migrate function of the client
+ * is called, so it can read data written before this engine existed. It must
+ * check the format itself, the page may hold a copy of an incomplete commit.
+ *
+ * \param section section to load
+ * \return true if the client loaded data
+ */
+bool FlashStore::Load(Section section)
+{
+   const Client* client = clients[section];
+
+   if (0 == client || 0 == blockNums[section][0]) return false;
+
+   int copy = FindCopy(section);
+
+   if (copy >= 0)
+   {
+      const Footer* footer = GetValidFooter(section, copy);
+      return client->load(client->context, footer->version, (const uint32_t*)(uintptr_t)GetCopyAddress(section, copy), footer->words);
+   }
+
+   if (0 != client->migrate)
+      return client->migrate(client->context, GetCopyAddress(section, 0));
+
+   return false;
+}
+
+/** \brief Write all registered sections whose data changed
+ *
+ * The sections are written by FlashWriter, see GetStatus() for the outcome.
+ * Commit() may be called from different interrupts, a call that overlaps
+ * another one fails.
+ *
+ * \param sections bit mask of the sections to consider, all by default
+ * \return number of sections that are written, -1 if another commit is still in
+ *         progress or FlashWriter has no room for it. Then nothing was queued.
+ */
+int FlashStore::Commit(uint32_t sections)
+{
+   //footers[] and the jobs are shared by all callers
+   if (__atomic_test_and_set(&committing, __ATOMIC_ACQUIRE)) return -1;
+
+   int count = IsBusy() ? -1 : QueueCommit(sections);
+
+   __atomic_clear(&committing, __ATOMIC_RELEASE);
+   return count;
+}
+
+/** \brief Serialize the changed sections and queue all of their writes at once */
+int FlashStore::QueueCommit(uint32_t sections)
+{
+   static_assert(sizeof(Footer) == FLASHSTORE_FOOTER_WORDS * sizeof(uint32_t), "Footer size mismatch");
+   const Footer* state = GetCommittedState();
+   uint32_t generation = 0, mask = 0, backedUp = 0;
+   uint32_t words[SECTION_LAST];
+   uint32_t gens[SECTION_LAST];
+   int active[SECTION_LAST];
+   FlashWriter::Job* jobs[2 * SECTION_LAST];
+   bool found = false;
+   int count = 0;
+
+   //The new generation must also follow incomplete commits, 0 means no copy
+   for (int section = 0; section < SECTION_LAST; section++)
+   {
+      gens[section] = 0 != state ? state->gens[section] : 0;
+
+      for (int copy = 0; copy < NUM_COPIES; copy++)
+      {
+         const Footer* footer = GetValidFooter(section, copy);
+
+         if (0 != footer && (!found || (int32_t)(footer->generation - generation) >= 0))
+         {
+            generation = footer->generation + 1;
+            found = true;
+         }
+      }
+   }
+
+   if (0 == generation) generation = 1;
+
+   for (int section = 0; section < SECTION_LAST; section++)
+   {
+      const Client* client = clients[section];
+
+      if (0 == client || 0 == blockNums[section][0] || (sections & (1 << section)) == 0) continue;
+
+      active[section] = FindCopy(section);
+      words[section] = client->serialize(client->context, client->image, MIN(client->imageWords, GetMaxWords()));
+
+      bool unchanged = active[section] >= 0;
+
+      if (unchanged)
+      {
+         const Footer* footer = GetValidFooter(section, active[section]);
+         const uint32_t* data = (const uint32_t*)(uintptr_t)GetCopyAddress(section, active[section]);
+
+         unchanged = footer->version == client->version && footer->words == words[section];
+
+         for (uint32_t i = 0; unchanged && i < words[section]; i++)
+            unchanged = data[i] == client->image[i];
+      }
+
+      if (!unchanged)
+         mask |= 1 << section;
+   }
+
+   for (int section = 0; section < SECTION_LAST; section++)
+   {
+      if (0 != blockNums[section][1])
+         backedUp |= 1 << section;
+      if ((mask & (1 << section)) != 0)
+         gens[section] = generation;
+   }
+
+   flash_set_ws(2);
+
+   for (int section = 0; section < SECTION_LAST; section++)
+   {
+      if ((mask & (1 << section)) == 0) continue;
+
+      const Client* client = clients[section];
+      Footer& footer = footers[section];
+      //Keep the copy in use when there is another one
+      int copy = active[section] == 0 && 0 != blockNums[section][1] ? 1 : 0;
+      uint32_t address = GetCopyAddress(section, copy);
+
+      footer.magic = FOOTER_MAGIC;
+      footer.type = section;
+      footer.version = client->version;
+      footer.generation = generation;
+      //A section without backup loses its previous copy while it is written, the
+      //sections with backup don't wait for it. It still needs all of them to be valid
+      footer.mask = 0 != blockNums[section][1] ? mask & backedUp : mask;
+      footer.words = words[section];
+
+      for (int other = 0; other < SECTION_LAST; other++)
+         footer.gens[other] = gens[other];
+
+      footer.crc = GetCrc((const uint32_t*)client->image, &footer);
+
+      FlashWriter::Prepare(&dataJobs[section], address, client->image, words[section], IsErased(address, FLASH_PAGE_SIZE) ? 0 : FLASH_PAGE_SIZE);
+      FlashWriter::Prepare(&footerJobs[section], address + FLASH_PAGE_SIZE - sizeof(Footer), (const uint32_t*)&footer, FLASHSTORE_FOOTER_WORDS);
+      jobs[2 * count] = &dataJobs[section];
+      jobs[2 * count + 1] = &footerJobs[section];
+      count++;
+   }
+
+   //A partly queued commit would erase pages without writing their footer
+   if (count > 0 && !FlashWriter::Queue(jobs, 2 * count))
+      return -1;
+
+   return count;
+}
+
+/** \brief Whether the last commit is still being written */
+bool FlashStore::IsBusy()
+{
+   return GetStatus() > 0;
+}
+
+/** \brief Get the outcome of the last commit
+ *
+ * \retval 0 Written and verified, or nothing to write
+ * \retval 1 Still being written
+ * \retval -1 Flash content does not match
+ */
+int FlashStore::GetStatus()
+{
+   int status = 0;
+
+   for (int section = 0; section < SECTION_LAST; section++)
+   {
+      if (dataJobs[section].status == FlashWriter::STATUS_QUEUED || footerJobs[section].status == FlashWriter::STATUS_QUEUED)
+         return 1;
+      if (dataJobs[section].status == FlashWriter::STATUS_ERROR || footerJobs[section].status == FlashWriter::STATUS_ERROR)
+         status = -1;
+   }
+   return status;
+}
+
+/** \brief Maximum number of data words of a section */
+uint32_t FlashStore::GetMaxWords()
+{
+   return FLASH_PAGE_SIZE / sizeof(uint32_t) - FLASHSTORE_FOOTER_WORDS;
+}
+
+/** \brief Address of a block counted from the end of flash
+ *
+ * \param blockNum 1 for the last block
+ * \param blockSize size of a block in bytes
+ */
+uint32_t FlashStore::GetBlockAddress(uint32_t blockNum, uint32_t blockSize)
+{
+   uint32_t flashSize = desig_get_flash_size();
+
+   return FLASH_BASE + flashSize * 1024 - blockNum * blockSize;
+}
+
+/** \brief Calculate the CRC of data with the CRC unit
+ *
+ * Interrupts are masked to prevent concurrent access of the CRC unit,
+ * so keep data short. The interrupt state of the caller is restored.
+ */
+uint32_t FlashStore::Crc(const uint32_t* data, uint32_t words)
+{
+   uint32_t irqState = cm_mask_interrupts(1);
+   crc_reset();
+   uint32_t crc = crc_calculate_block((uint32_t*)data, words);
+   cm_mask_interrupts(irqState);
+
+   return crc;
+}
+
+/** \brief Add one word to a CRC in software, gives the same result as the CRC unit
+ *
+ * \param crc result of the previous call, 0xFFFFFFFF to start
+ * \param data word to add
+ * \return CRC including data
+ */
+uint32_t FlashStore::CrcWord(uint32_t crc, uint32_t data)
+{
+   crc ^= data;
+
+   for (int bit = 0; bit < 32; bit++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+
+   return crc;
+}
+
+/** \brief Check whether flash needs to be erased before programming it */
+bool FlashStore::IsErased(uint32_t address, uint32_t bytes)
+{
+   const uint32_t* data = (const uint32_t*)(uintptr_t)address;
+   uint32_t check = 0xFFFFFFFF;
+
+   for (uint32_t i = 0; i < bytes / sizeof(uint32_t); i++)
+      check &= data[i];
+
+   return check == 0xFFFFFFFF;
+}
+
+uint32_t FlashStore::GetCopyAddress(int section, int copy)
+{
+   return GetBlockAddress(blockNums[section][copy], FLASH_PAGE_SIZE);
+}
+
+/** \brief Footer of a copy that is completely written, 0 if there is none */
+const FlashStore::Footer* FlashStore::GetValidFooter(int section, int copy)
+{
+   if (0 == blockNums[section][copy]) return 0;
+
+   uint32_t address = GetCopyAddress(section, copy);
+   const Footer* footer = (const Footer*)(address + FLASH_PAGE_SIZE - sizeof(Footer));
+
+   if (footer->magic != FOOTER_MAGIC || footer->type != section || footer->words > GetMaxWords())
+      return 0;
+
+   if (GetCrc((const uint32_t*)(uintptr_t)address, footer) != footer->crc)
+      return 0;
+
+   return footer;
+}
+
+/** \brief CRC over the data and all footer words before the CRC */
+uint32_t FlashStore::GetCrc(const uint32_t* data, const Footer* footer)
+{
+   uint32_t crc = Crc(data, footer->words);
+
+   for (uint32_t i = 0; i < FLASHSTORE_FOOTER_WORDS - 1; i++)
+      crc = CrcWord(crc, ((const uint32_t*)footer)[i]);
+
+   return crc;
+}
+
+/** \brief Whether all sections written by the commit of footer have a valid copy of it */
+bool FlashStore::IsComplete(const Footer* footer)
+{
+   for (int section = 0; section < SECTION_LAST; section++)
+   {
+      if ((footer->mask & (1 << section)) == 0) continue;
+
+      const Footer* first = GetValidFooter(section, 0);
+      const Footer* second = GetValidFooter(section, 1);
+
+      if ((0 == first || first->generation != footer->generation) && (0 == second || second->generation != footer->generation))
+         return false;
+   }
+   return true;
+}
+
+/** \brief Footer of the newest complete commit, 0 if there is none
+ *
+ * Its gens[] name the copy of every section at that commit, which may have been
+ * written by an older commit. Later commits of other sections can overwrite the
+ * copies of older commits, so only the newest complete one is followed.
+ */
+const FlashStore::Footer* FlashStore::GetCommittedState()
+{
+   const Footer* newest = 0;
+
+   for (int section = 0; section < SECTION_LAST; section++)
+   {
+      for (int copy = 0; copy < NUM_COPIES; copy++)
+      {
+         const Footer* footer = GetValidFooter(section, copy);
+
+         //Signed differences keep working when the generation wraps around
+         if (0 != footer && (0 == newest || (int32_t)(footer->generation - newest->generation) > 0) && IsComplete(footer))
+            newest = footer;
+      }
+   }
+   return newest;
+}
+
+/** \brief Copy of a section that belongs to the last complete commit, -1 if there is none */
+int FlashStore::FindCopy(int section)
+{
+   const Footer* state = GetCommittedState();
+
+   if (0 == state || 0 == state->gens[section]) return -1;
+
+   for (int copy = 0; copy < NUM_COPIES; copy++)
+   {
+      const Footer* footer = GetValidFooter(section, copy);
+
+      if (0 != footer && footer->generation == state->gens[section])
+         return copy;
+   }
+   return -1;
+}
@@ -0,0 +1,153 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/cm3/cortex.h>
+#include "flashwriter.h"
+#include "hwdefs.h"
+#include "my_math.h"
+
+FlashWriter::Job* FlashWriter::queue[FLASH_WRITER_QUEUE_LEN];
+volatile uint8_t FlashWriter::head = 0;
+volatile uint8_t FlashWriter::tail = 0;
+volatile bool FlashWriter::running = false;
+bool FlashWriter::background = false;
+
+/** \brief Queue a flash write
+ *
+ * \param job job to fill in, must stay valid until it is done
+ * \param address flash address to start at
+ * \param data words to program
+ * \param words number of words in data
+ * \param eraseBytes number of bytes to erase from address first, 0 to not erase
+ * \return true if queued, false if the queue is full or job is still queued
+ */
+bool FlashWriter::Queue(Job* job, uint32_t address, const uint32_t* data, uint32_t words, uint32_t eraseBytes)
+{
+   if (job->status == STATUS_QUEUED) return false;
+
+   Prepare(job, address, data, words, eraseBytes);
+   return Queue(&job, 1);
+}
+
+/** \brief Fill in a job for Queue(Job* const*, int), parameters like Queue() */
+void FlashWriter::Prepare(Job* job, uint32_t address, const uint32_t* data, uint32_t words, uint32_t eraseBytes)
+{
+   job->address = address;
+   job->data = data;
+   job->words = words;
+   job->eraseBytes = eraseBytes;
+   job->erased = 0;
+   job->written = 0;
+}
+
+/** \brief Queue several prepared jobs, either all of them or none
+ *
+ * \param jobs jobs filled in with Prepare(), must stay valid until they are done
+ * \param count number of jobs
+ * \return true if queued, false if the queue has no room for all of them or one is still queued
+ */
+bool FlashWriter::Queue(Job* const* jobs, int count)
+{
+   bool queued = false;
+
+   //Callers may run in different interrupts
+   uint32_t irqState = cm_mask_interrupts(1);
+   if ((uint8_t)(tail - head) + count <= FLASH_WRITER_QUEUE_LEN)
+   {
+      queued = true;
+
+      for (int i = 0; i < count; i++)
+         queued = queued && jobs[i]->status != STATUS_QUEUED;
+
+      for (int i = 0; queued && i < count; i++)
+      {
+         jobs[i]->status = STATUS_QUEUED;
+         queue[tail % FLASH_WRITER_QUEUE_LEN] = jobs[i];
+         tail = tail + 1;
+      }
+   }
+   cm_mask_interrupts(irqState);
+
+   if (queued && !background)
+      Flush();
+
+   return queued;
+}
+
+/** \brief Do one step of the oldest job, call this from a low priority task
+ *
+ * \return true if there is more work, false if there is none or another call
+ *         that was interrupted is already working on it
+ */
+bool FlashWriter::Run()
+{
+   bool idle;
+
+   uint32_t irqState = cm_mask_interrupts(1);
+   idle = running || head == tail;
+   if (!idle) running = true;
+   cm_mask_interrupts(irqState);
+
+   if (idle) return false;
+
+   Job* job = queue[head % FLASH_WRITER_QUEUE_LEN];
+
+   flash_unlock();
+
+   if (job->erased < job->eraseBytes)
+   {
+      flash_erase_page(job->address + job->erased);
+      job->erased += FLASH_PAGE_SIZE;
+   }
+   else
+   {
+      uint32_t start = job->written;
+      uint32_t end = MIN(start + FLASH_WRITER_CHUNK_WORDS, job->words);
+      const uint32_t* flash = (const uint32_t*)(uintptr_t)job->address;
+
+      for (uint32_t i = start; i < end; i++)
+         flash_program_word(job->address + i * sizeof(uint32_t), job->data[i]);
+
+      for (uint32_t i = start; i < end; i++)
+      {
+         if (flash[i] != job->data[i])
+            job->status = STATUS_ERROR;
+      }
+
+      job->written = end;
+   }
+
+   flash_lock();
+
+   if (job->status == STATUS_ERROR || (job->erased >= job->eraseBytes && job->written >= job->words))
+   {
+      if (job->status != STATUS_ERROR)
+         job->status = STATUS_DONE;
+      head = head + 1;
+   }
+
+   running = false;
+   return head != tail;
+}
+
+/** \brief Write all queued jobs now, returns early when called from an interrupt of Run() */
+void FlashWriter::Flush()
+{
+   while (Run());
+}
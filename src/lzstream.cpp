@@ -0,0 +1,151 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lzstream.h"
+
+LzStream::LzStream(IStreamSource* src)
+ : source(src)
+{
+   Rewind();
+}
+
+void LzStream::Rewind()
+{
+   source->Rewind();
+   historyLen = 0;
+   windowPos = 0;
+   aheadLen = 0;
+   outLen = 0;
+   outPos = 0;
+   sourceEnd = false;
+}
+
+int LzStream::Read(uint8_t* buf, int len)
+{
+   int count = 0;
+
+   while (count < len)
+   {
+      if (outPos == outLen)
+      {
+         CompressGroup();
+         if (outLen == 0) break;
+      }
+      else
+      {
+         buf[count++] = out[outPos++];
+      }
+   }
+   return count;
+}
+
+/** \brief Compress the next up to 8 items into out */
+void LzStream::CompressGroup()
+{
+   outLen = 1;
+   outPos = 0;
+   out[0] = 0;
+
+   for (int item = 0; item < 8; item++)
+   {
+      if (!sourceEnd && aheadLen < LZ_MAX_MATCH)
+      {
+         int len = source->Read(&ahead[aheadLen], LZ_MAX_MATCH - aheadLen);
+         sourceEnd = aheadLen + len < LZ_MAX_MATCH;
+         aheadLen += len;
+      }
+
+      if (aheadLen == 0) break;
+
+      int distance;
+      int matchLen = FindMatch(distance);
+
+      if (matchLen >= LZ_MIN_MATCH)
+      {
+         out[0] |= 1 << item;
+         out[outLen++] = distance - 1;
+         out[outLen++] = matchLen - LZ_MIN_MATCH;
+         Consume(matchLen);
+      }
+      else
+      {
+         out[outLen++] = ahead[0];
+         Consume(1);
+      }
+   }
+
+   if (outLen == 1) outLen = 0; //nothing left
+}
+
+/** \brief Find the longest match for the lookahead in the history
+ * Only the nearest LZ_MAX_CANDIDATES positions are compared in full
+ * \param[out] distance how far back the match starts
+ * \return length of the match
+ */
+int LzStream::FindMatch(int& distance)
+{
+   int bestLen = 0;
+   int candidates = 0;
+   int maxDistance = historyLen < LZ_WINDOW_SIZE ? historyLen : LZ_WINDOW_SIZE;
+
+   for (int d = 1; d <= maxDistance && bestLen < aheadLen && candidates < LZ_MAX_CANDIDATES; d++)
+   {
+      int len = 0;
+
+      if (HistoryByte(d, 0) != ahead[0]) continue;
+
+      candidates++;
+
+      while (len < aheadLen && HistoryByte(d, len) == ahead[len])
+         len++;
+
+      if (len > bestLen)
+      {
+         bestLen = len;
+         distance = d;
+      }
+   }
+   return bestLen;
+}
+
+/** \brief Get the byte that a match at distance would copy at offset.
+ * Beyond distance the match overlaps the data it produces.
+ */
+uint8_t LzStream::HistoryByte(int distance, int offset)
+{
+   if (offset < distance)
+      return window[(windowPos - distance + offset) & (LZ_WINDOW_SIZE - 1)];
+   else
+      return ahead[offset - distance];
+}
+
+/** \brief Move len bytes from the lookahead into the history */
+void LzStream::Consume(int len)
+{
+   for (int i = 0; i < len; i++)
+   {
+      window[windowPos] = ahead[i];
+      windowPos = (windowPos + 1) & (LZ_WINDOW_SIZE - 1);
+   }
+
+   for (int i = len; i < aheadLen; i++)
+      ahead[i - len] = ahead[i];
+
+   aheadLen -= len;
+   historyLen += len;
+}
@@ -55,6 +55,18 @@ int my_strlen(const char *str)
    return len;
 }
 
+/** FNV-1a hash of a string folded to 16 bits. Param::NumFromString() relies on
+ * this matching the compile time HashName() in params.cpp */
+uint16_t my_strhash(const char *str)
+{
+   uint32_t hash = 2166136261u;
+
+   for (; *str != 0; str++)
+      hash = (hash ^ (unsigned char)*str) * 16777619u;
+
+   return (hash >> 16) ^ (hash & 0xFFFF);
+}
+
 const char *my_strchr(const char *str, const char c)
 {
    for (; *str > 0 && *str != c; str++);
@@ -115,6 +127,19 @@ int my_atoi(const char *str)
    return sign * Res;
 }
 
+unsigned my_atou(const char *str)
+{
+   unsigned Res = 0;
+
+   for (; *str >= '0' && *str <= '9'; str++)
+   {
+      Res *= 10;
+      Res += *str - '0';
+   }
+
+   return Res;
+}
+
 char *my_trim(char *str)
 {
   char *end;
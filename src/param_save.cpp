@@ -18,15 +18,49 @@
  */
 
 #include <libopencm3/stm32/flash.h>
-#include <libopencm3/stm32/desig.h>
-#include <libopencm3/stm32/crc.h>
 #include "params.h"
 #include "param_save.h"
 #include "hwdefs.h"
 #include "my_string.h"
+#include "crc8.h"
+#include "flashstore.h"
 
+//Number of PARAM_BLKSIZE blocks the record log rotates through. They are located
+//at PARAM_BLKNUM, PARAM_BLKNUM + 1, ... blocks from the end of flash.
+//With only one block a full page is rewritten without a backup, like before.
+//That is not power fail safe, see param_save.h
+#ifndef PARAM_LOG_PAGES
+#define PARAM_LOG_PAGES 1
+#endif // PARAM_LOG_PAGES
+
+//PARAM_BLKSIZE may span several flash pages
+#ifndef FLASH_PAGE_SIZE
+#define FLASH_PAGE_SIZE PARAM_BLKSIZE
+#endif // FLASH_PAGE_SIZE
+
+//Whether the FlashStore page at blkNum shares flash with the record log.
+//Both are counted from the end of flash, compare their byte ranges
+static constexpr bool OverlapsLog(uint32_t blkNum)
+{
+   return blkNum != 0 &&
+          (blkNum - 1) * FLASH_PAGE_SIZE < (PARAM_BLKNUM + PARAM_LOG_PAGES - 1) * PARAM_BLKSIZE &&
+          (PARAM_BLKNUM - 1) * PARAM_BLKSIZE < blkNum * FLASH_PAGE_SIZE;
+}
+
+static_assert(!OverlapsLog(CAN1_BLKNUM) && !OverlapsLog(CAN1_BACKUP_BLKNUM) &&
+              !OverlapsLog(USER_BLKNUM) && !OverlapsLog(USER_BACKUP_BLKNUM) &&
+              !OverlapsLog(ERRLOG_BLKNUM) && !OverlapsLog(ERRLOG_BACKUP_BLKNUM) &&
+              !OverlapsLog(ERRLOG_JOURNAL_BLKNUM),
+              "PARAM_BLKNUM to PARAM_BLKNUM + PARAM_LOG_PAGES - 1 overlaps another *_BLKNUM");
+
+#define LOG_MAGIC 0x474F4C50 //"PLOG"
+#define NUM_RECORDS ((PARAM_BLKSIZE - sizeof(LOG_HEADER)) / sizeof(LOG_RECORD))
+#define KEY_SNAPSHOT_END 0 //Record following the snapshot at the start of every block, value is the record count
+#define KEY_ERASED 0xFFFF
+#define WORD_ERASED 0xFFFFFFFF
+
+//Format before the record log, only read to migrate it
 #define NUM_PARAMS ((PARAM_BLKSIZE - 8) / sizeof(PARAM_ENTRY))
-#define PARAM_WORDS (PARAM_BLKSIZE / 4)
 
 typedef struct
 {
@@ -43,73 +77,333 @@ typedef struct
    uint32_t padding;
 } PARAM_PAGE;
 
-static uint32_t GetFlashAddress()
+/* Every block starts with a header and a snapshot of all parameters, terminated by
+ * a KEY_SNAPSHOT_END record. Further saves append one record per changed parameter.
+ * When a block is full, the next one is erased and gets a new snapshot.
+ * The newest block with a complete snapshot is the valid one, so a save that is
+ * interrupted by a reset leaves the previous state readable.
+ */
+typedef struct
+{
+   uint32_t magic;
+   uint32_t seq; //Incremented for every new block
+   uint32_t layout; //GetLayoutHash() of the firmware that wrote the snapshot
+} LOG_HEADER;
+
+//The second word carries the CRC and is programmed after the value,
+//so a record is only valid when it was completely written
+typedef struct
+{
+   uint32_t value;
+   uint16_t key; //Parameter UID
+   uint8_t flags;
+   uint8_t crc;
+} LOG_RECORD;
+
+typedef struct
+{
+   LOG_HEADER header;
+   LOG_RECORD records[NUM_RECORDS];
+} LOG_PAGE;
+
+//Number of parameters saved by a snapshot
+#define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) + (id > 0)
+#define TESTP_ENTRY(category, name, unit, min, max, def, id, ...)
+#define VALUE_ENTRY(name, unit, id, ...)
+static const uint32_t NUM_SAVED = 0 PARAM_LIST;
+static_assert(NUM_SAVED < NUM_RECORDS, "Parameter snapshot does not fit into PARAM_BLKSIZE");
+#undef PARAM_ENTRY
+#undef TESTP_ENTRY
+#undef VALUE_ENTRY
+
+static uint32_t GetFlashAddress(int block)
+{
+   //Always save parameters to last flash pages
+   return FlashStore::GetBlockAddress(PARAM_BLKNUM + block, PARAM_BLKSIZE);
+}
+
+static LOG_PAGE* GetLogPage(int block)
+{
+   return (LOG_PAGE*)(uintptr_t)GetFlashAddress(block);
+}
+
+static bool IsSaved(Param::PARAM_NUM idx)
+{
+   return Param::GetType(idx) == Param::TYPE_PARAM && Param::GetAttrib(idx)->id > 0;
+}
+
+/** Hash over the ids of all saved parameters in declaration order */
+static uint32_t GetLayoutHash()
 {
-   uint32_t flashSize = desig_get_flash_size();
+   uint32_t hash = Param::GetIdSum();
 
-   //Always save parameters to last flash page
-   return FLASH_BASE + flashSize * 1024 - PARAM_BLKNUM * PARAM_BLKSIZE;
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      if (IsSaved((Param::PARAM_NUM)idx))
+         hash = (hash * 31) ^ Param::GetAttrib((Param::PARAM_NUM)idx)->id;
+   }
+   return hash;
+}
+
+/** Position of the next snapshot record in declaration order, -1 when unknown */
+static int GetSnapshotCursor(const LOG_PAGE* page)
+{
+   return page->header.layout == GetLayoutHash() ? 0 : -1;
+}
+
+/**
+* Find the parameter a record belongs to
+*
+* A snapshot written by the running firmware lists the saved parameters in
+* declaration order, so its records are assigned without searching the id table.
+* Once a record does not match, e.g. at the end of the snapshot, the cursor is
+* set to -1 and the id is looked up.
+*
+* @param record Record to look up
+* @param[in,out] cursor From GetSnapshotCursor(), advanced for every record
+* @return Parameter index, PARAM_INVALID if the parameter no longer exists
+*/
+static Param::PARAM_NUM ParamOfRecord(const LOG_RECORD* record, int& cursor)
+{
+   if (cursor >= 0)
+   {
+      while (cursor < Param::PARAM_LAST && !IsSaved((Param::PARAM_NUM)cursor))
+         cursor++;
+
+      if (cursor < Param::PARAM_LAST && Param::GetAttrib((Param::PARAM_NUM)cursor)->id == record->key)
+         return (Param::PARAM_NUM)cursor++;
+
+      cursor = -1;
+   }
+   return Param::NumFromId(record->key);
+}
+
+static uint32_t GetRecordWord(uint16_t key, uint8_t flags, uint32_t value)
+{
+   uint8_t data[7] = { (uint8_t)key, (uint8_t)(key >> 8), flags,
+                       (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+   uint8_t crc = crc8(data, sizeof(data), 0);
+
+   return key | (flags << 16) | ((uint32_t)crc << 24);
+}
+
+static bool IsValid(const LOG_RECORD* record)
+{
+   return record->key != KEY_ERASED && ((const uint32_t*)record)[1] == GetRecordWord(record->key, record->flags, record->value);
+}
+
+static bool IsErased(const LOG_RECORD* record)
+{
+   const uint32_t* words = (const uint32_t*)record;
+   return words[0] == WORD_ERASED && words[1] == WORD_ERASED;
+}
+
+/** Number of used record slots, including torn ones */
+static int GetUsedRecords(const LOG_PAGE* page)
+{
+   int used = NUM_RECORDS;
+
+   while (used > 0 && IsErased(&page->records[used - 1]))
+      used--;
+
+   return used;
+}
+
+static bool IsSnapshotComplete(const LOG_PAGE* page)
+{
+   if (page->header.magic != LOG_MAGIC) return false;
+
+   for (unsigned int i = 0; i < NUM_RECORDS && !IsErased(&page->records[i]); i++)
+   {
+      if (page->records[i].key == KEY_SNAPSHOT_END && IsValid(&page->records[i]))
+         return true;
+   }
+   return false;
+}
+
+/** Index of the newest block with a complete snapshot, -1 if there is none */
+static int FindActiveBlock()
+{
+   int active = -1;
+
+   for (int block = 0; block < PARAM_LOG_PAGES; block++)
+   {
+      const LOG_PAGE* page = GetLogPage(block);
+
+      //Signed difference keeps working when the sequence number wraps around
+      if (IsSnapshotComplete(page) && (active < 0 || (int32_t)(page->header.seq - GetLogPage(active)->header.seq) > 0))
+         active = block;
+   }
+   return active;
+}
+
+//Image of the records to write, flash is programmed from here in the background.
+//The largest write is a snapshot: header, one record per saved parameter and the end marker
+static uint32_t saveImage[(sizeof(LOG_HEADER) + (NUM_SAVED + 1) * sizeof(LOG_RECORD)) / 4];
+static FlashWriter::Job saveJob;
+
+/** Append a record to saveImage, returns the next free word */
+static int StageRecord(int word, uint16_t key, uint8_t flags, uint32_t value)
+{
+   saveImage[word] = value;
+   saveImage[word + 1] = GetRecordWord(key, flags, value);
+   return word + 2;
+}
+
+/** Queue a snapshot of all parameters to the block following the active one */
+static void QueueSnapshot(int active)
+{
+   int block = (active + 1) % PARAM_LOG_PAGES;
+   uint32_t seq = active >= 0 ? GetLogPage(active)->header.seq + 1 : 0;
+   uint32_t count = 0;
+   int word = sizeof(LOG_HEADER) / 4;
+
+   //An incomplete snapshot may have left a higher sequence number behind
+   for (int i = 0; i < PARAM_LOG_PAGES; i++)
+   {
+      const LOG_PAGE* page = GetLogPage(i);
+
+      if (page->header.magic == LOG_MAGIC && (int32_t)(page->header.seq - seq) >= 0)
+         seq = page->header.seq + 1;
+   }
+
+   saveImage[0] = LOG_MAGIC;
+   saveImage[1] = seq;
+   saveImage[2] = GetLayoutHash();
+
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      if (IsSaved((Param::PARAM_NUM)idx))
+      {
+         word = StageRecord(word, Param::GetAttrib((Param::PARAM_NUM)idx)->id,
+                            Param::GetFlag((Param::PARAM_NUM)idx), Param::Get((Param::PARAM_NUM)idx));
+         count++;
+      }
+   }
+
+   //Programmed last, so the snapshot is only used when it is complete
+   word = StageRecord(word, KEY_SNAPSHOT_END, 0, count);
+
+   FlashWriter::Queue(&saveJob, GetFlashAddress(block), saveImage, word, FlashStore::IsErased(GetFlashAddress(block), PARAM_BLKSIZE) ? 0 : PARAM_BLKSIZE);
+}
+
+/** CRC that the single page format stored for the current values, users know it from "save".
+ * It is calculated in software, masking interrupts for the CRC unit would block them for a
+ * time that grows with the number of parameters */
+static uint32_t GetLegacyCrc()
+{
+   uint32_t crc = 0xFFFFFFFF;
+
+   //Entries are indexed by parameter number, unused ones stay erased
+   for (unsigned int idx = 0; idx < NUM_PARAMS; idx++)
+   {
+      uint32_t keyWord = WORD_ERASED, value = WORD_ERASED;
+
+      if (idx < Param::PARAM_LAST && Param::GetType((Param::PARAM_NUM)idx) == Param::TYPE_PARAM)
+      {
+         keyWord = Param::GetAttrib((Param::PARAM_NUM)idx)->id | 0xFF0000 | ((uint32_t)Param::GetFlag((Param::PARAM_NUM)idx) << 24);
+         value = Param::Get((Param::PARAM_NUM)idx);
+      }
+
+      crc = FlashStore::CrcWord(crc, keyWord);
+      crc = FlashStore::CrcWord(crc, value);
+   }
+
+   return crc;
 }
 
 /**
 * Save parameters to flash
 *
-* @return CRC of parameter flash page
+* Only parameters that differ from their last saved value are appended to the
+* record log. A new snapshot is written when the active block is full.
+* The flash is written by FlashWriter, see parm_save_status() for the outcome.
+*
+* @return CRC of the parameters in the single page format used before the record log,
+*         PARM_SAVE_BUSY if the previous save is still being written
 */
 uint32_t parm_save()
 {
-   PARAM_PAGE parmPage;
-   uint32_t idx;
-   uint32_t paramAddress = GetFlashAddress();
-   uint32_t check = 0xFFFFFFFF;
-   uint32_t* baseAddress = (uint32_t*)paramAddress;
+   uint32_t upToDate[(Param::PARAM_LAST + 31) / 32] = { 0 };
+   int active, used = 0, word = 0;
+   bool fits = true;
 
-   for (int i = 0; i < PARAM_WORDS; i++, baseAddress++)
-      check &= *baseAddress;
+   //saveImage and the flash content are only consistent when the last save is done
+   if (saveJob.status == FlashWriter::STATUS_QUEUED) return PARM_SAVE_BUSY;
 
-   crc_reset();
-   memset32((int*)&parmPage, 0xFFFFFFFF, PARAM_WORDS);
+   active = FindActiveBlock();
 
-   //Copy parameter values and keys to block structure
-   for (idx = 0; idx < NUM_PARAMS && idx < Param::PARAM_LAST; idx++)
+   if (active >= 0)
    {
-      if (Param::GetType((Param::PARAM_NUM)idx) == Param::TYPE_PARAM)
+      const LOG_PAGE* page = GetLogPage(active);
+
+      int cursor = GetSnapshotCursor(page);
+
+      used = GetUsedRecords(page);
+
+      //Replay the log, the newest record of a parameter decides whether it is up to date
+      for (int i = 0; i < used; i++)
       {
-         const Param::Attributes *pAtr = Param::GetAttrib((Param::PARAM_NUM)idx);
-         parmPage.data[idx].flags = (uint8_t)Param::GetFlag((Param::PARAM_NUM)idx);
-         parmPage.data[idx].key = pAtr->id;
-         parmPage.data[idx].value = Param::Get((Param::PARAM_NUM)idx);
+         const LOG_RECORD* record = &page->records[i];
+         Param::PARAM_NUM idx = ParamOfRecord(record, cursor);
+
+         if (record->key == KEY_SNAPSHOT_END || idx == Param::PARAM_INVALID || !IsValid(record)) continue;
+
+         if (record->value == (uint32_t)Param::Get(idx) && record->flags == (uint8_t)Param::GetFlag(idx))
+            upToDate[idx / 32] |= 1u << (idx % 32);
+         else
+            upToDate[idx / 32] &= ~(1u << (idx % 32));
       }
    }
 
-   parmPage.crc = crc_calculate_block(((uint32_t*)&parmPage), (2 * NUM_PARAMS));
-   flash_unlock();
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      if (IsSaved((Param::PARAM_NUM)idx))
+      {
+         uint16_t key = Param::GetAttrib((Param::PARAM_NUM)idx)->id;
+         uint8_t flags = (uint8_t)Param::GetFlag((Param::PARAM_NUM)idx);
+         uint32_t value = Param::Get((Param::PARAM_NUM)idx);
 
-   if (check != 0xFFFFFFFF)
-      flash_erase_page(paramAddress);
+         bool changed = (upToDate[idx / 32] & (1u << (idx % 32))) == 0;
 
-   for (idx = 0; idx < PARAM_WORDS; idx++)
-   {
-      uint32_t* pData = ((uint32_t*)&parmPage) + idx;
-      flash_program_word(paramAddress + idx * sizeof(uint32_t), *pData);
+         if (changed && used + word / 2 < (int)NUM_RECORDS)
+            word = StageRecord(word, key, flags, value);
+         else if (changed)
+            fits = false;
+      }
    }
-   flash_lock();
-   return parmPage.crc;
+
+   if (active < 0 || !fits)
+      QueueSnapshot(active);
+   else if (word > 0)
+      FlashWriter::Queue(&saveJob, GetFlashAddress(active) + sizeof(LOG_HEADER) + used * sizeof(LOG_RECORD), saveImage, word);
+
+   return GetLegacyCrc();
 }
 
 /**
-* Load parameters from flash
+* Get the outcome of the last parm_save()
 *
-* @retval 0 Parameters loaded successfully
-* @retval -1 CRC error, parameters not loaded
+* @retval 0 Written and verified, or nothing to write
+* @retval 1 Still being written
+* @retval -1 Flash content does not match
 */
-int parm_load()
+int parm_save_status()
 {
-   uint32_t paramAddress = GetFlashAddress();
-   PARAM_PAGE *parmPage = (PARAM_PAGE *)paramAddress;
+   switch (saveJob.status)
+   {
+   case FlashWriter::STATUS_QUEUED: return 1;
+   case FlashWriter::STATUS_ERROR: return -1;
+   default: return 0;
+   }
+}
 
-   crc_reset();
-   uint32_t crc = crc_calculate_block(((uint32_t*)parmPage), (2 * NUM_PARAMS));
+/** Load the page format used before the record log */
+static int LegacyLoad()
+{
+   PARAM_PAGE *parmPage = (PARAM_PAGE *)(uintptr_t)GetFlashAddress(0);
+
+   uint32_t crc = FlashStore::Crc((uint32_t*)parmPage, 2 * NUM_PARAMS);
 
    if (crc == parmPage->crc)
    {
@@ -127,3 +421,37 @@ int parm_load()
 
    return -1;
 }
+
+/**
+* Load parameters from flash
+*
+* @retval 0 Parameters loaded successfully
+* @retval -1 CRC error, parameters not loaded
+*/
+int parm_load()
+{
+   int active = FindActiveBlock();
+
+   if (active < 0)
+      return LegacyLoad();
+
+   const LOG_PAGE* page = GetLogPage(active);
+   int used = GetUsedRecords(page);
+   int cursor = GetSnapshotCursor(page);
+
+   for (int i = 0; i < used; i++)
+   {
+      const LOG_RECORD* record = &page->records[i];
+      Param::PARAM_NUM idx = ParamOfRecord(record, cursor);
+
+      //Torn records and parameters that no longer exist are skipped
+      if (record->key != KEY_SNAPSHOT_END && idx != Param::PARAM_INVALID &&
+          Param::GetType(idx) == Param::TYPE_PARAM && IsValid(record))
+      {
+         Param::SetFixed(idx, record->value);
+         Param::SetFlagsRaw(idx, record->flags);
+      }
+   }
+
+   return 0;
+}
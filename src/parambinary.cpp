@@ -0,0 +1,189 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "parambinary.h"
+#include "my_string.h"
+
+ParamBinary::ParamBinary(bool printHidden)
+ : store(&Param::defaultStore), printHidden(printHidden)
+{
+   Rewind();
+}
+
+void ParamBinary::Rewind()
+{
+   state = STATE_START;
+   numStrings = 0;
+   item = 0;
+   remaining = 0;
+}
+
+int ParamBinary::Read(uint8_t* buf, int len)
+{
+   int count = 0;
+
+   while (count < len)
+   {
+      if (remaining == 0)
+      {
+         if (!NextPiece()) break;
+      }
+      else
+      {
+         buf[count++] = *current++;
+         remaining--;
+      }
+   }
+   return count;
+}
+
+/** \brief Advance to the next piece of the document
+ * Names and inline strings are served from flash, everything else is encoded
+ * into formatBuf. Pieces may be empty.
+ * \return false when the document is complete
+ */
+bool ParamBinary::NextPiece()
+{
+   Param::PARAM_NUM param = (Param::PARAM_NUM)item;
+   const Param::Attributes *pAtr = Param::GetAttrib(param);
+   Param::PARAM_TYPE type = Param::GetType(param);
+
+   current = formatBuf;
+   remaining = 0;
+
+   switch (state)
+   {
+   case STATE_START:
+   {
+      int entries = 0;
+
+      for (int i = 0; i < Param::PARAM_LAST; i++)
+         entries += IsVisible(i);
+
+      formatBuf[0] = 'O';
+      formatBuf[1] = 'B';
+      formatBuf[2] = PARAMBINARY_VERSION;
+      remaining = 3;
+      AddVarint(entries);
+      NextEntry(0);
+      break;
+   }
+   case STATE_ENTRY:
+      AddVarint(item);
+      AddVarint(pAtr->id);
+      formatBuf[remaining++] = type | ((store->GetFlag(param) & Param::FLAG_HIDDEN) << 2);
+      AddVarint(my_strlen(pAtr->name));
+      state = STATE_NAME;
+      break;
+   case STATE_NAME:
+      current = (const uint8_t*)pAtr->name;
+      remaining = my_strlen(pAtr->name);
+      state = STATE_UNITREF;
+      break;
+   case STATE_UNITREF:
+      AddString(pAtr->unit);
+      state = STATE_UNIT;
+      break;
+   case STATE_CATEGORYREF:
+      AddString(pAtr->category);
+      state = STATE_CATEGORY;
+      break;
+   case STATE_UNIT:
+   case STATE_CATEGORY:
+      if (0 != inlineString)
+      {
+         current = (const uint8_t*)inlineString;
+         remaining = my_strlen(inlineString);
+      }
+      state = state == STATE_UNIT && type != Param::TYPE_SPOTVALUE ? STATE_CATEGORYREF : STATE_VALUES;
+      break;
+   case STATE_VALUES:
+      if (type != Param::TYPE_SPOTVALUE)
+      {
+         AddFixed(pAtr->min);
+         AddFixed(pAtr->max);
+         AddFixed(pAtr->def);
+      }
+      AddFixed(store->Get(param));
+      NextEntry(item + 1);
+      break;
+   default:
+      return false;
+   }
+
+   return true;
+}
+
+/** \brief Find the next parameter to be sent, starting at index start */
+void ParamBinary::NextEntry(int start)
+{
+   for (item = start; item < Param::PARAM_LAST && !IsVisible(item); item++);
+
+   state = item < Param::PARAM_LAST ? STATE_ENTRY : STATE_DONE;
+}
+
+bool ParamBinary::IsVisible(int param)
+{
+   return (store->GetFlag((Param::PARAM_NUM)param) & Param::FLAG_HIDDEN) == 0 || printHidden;
+}
+
+void ParamBinary::AddVarint(uint32_t value)
+{
+   while (value >= 0x80)
+   {
+      formatBuf[remaining++] = (value & 0x7F) | 0x80;
+      value >>= 7;
+   }
+   formatBuf[remaining++] = value;
+}
+
+void ParamBinary::AddFixed(s32fp value)
+{
+   for (int i = 0; i < 4; i++)
+      formatBuf[remaining++] = (uint32_t)value >> (8 * i);
+}
+
+/** \brief Encode a string reference, inline strings are sent with the next piece
+ * \param str string to reference
+ */
+void ParamBinary::AddString(const char* str)
+{
+   inlineString = 0;
+
+   for (int i = 0; i < numStrings; i++)
+   {
+      //Identical literals are usually merged by the linker, so try the cheap test first
+      if (strings[i] == str || my_strcmp(strings[i], str) == 0)
+      {
+         AddVarint(i + 2);
+         return;
+      }
+   }
+
+   if (numStrings < PARAMBINARY_MAX_STRINGS)
+   {
+      strings[numStrings++] = str;
+      AddVarint(1);
+   }
+   else
+   {
+      AddVarint(0);
+   }
+   AddVarint(my_strlen(str));
+   inlineString = str;
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramdelta.h"
+
+ParamDelta::ParamDelta()
+ : store(&Param::defaultStore), since(0), nextParam(Param::PARAM_LAST), journalSeq(0), endSeq(0), useJournal(false), recordLen(0), recordPos(0)
+{
+}
+
+void ParamDelta::Rewind()
+{
+   //Header is the sequence number the client is up to date with after this transfer
+   endSeq = store->GetChangeSeq();
+   SetRecord(endSeq, 4);
+   nextParam = 0;
+   journalSeq = since;
+   useJournal = since != 0;
+}
+
+int ParamDelta::Read(uint8_t* buf, int len)
+{
+   int copied = 0;
+
+   while (copied < len)
+   {
+      if (recordPos < recordLen)
+      {
+         buf[copied++] = record[recordPos++];
+         continue;
+      }
+
+      int param = NextChanged();
+
+      if (param >= Param::PARAM_LAST) break;
+
+      //Sample the value once per record, so it can't tear
+      record[0] = param & 0xFF;
+      record[1] = param >> 8;
+      SetRecord(store->Get((Param::PARAM_NUM)param), 6);
+   }
+
+   return copied;
+}
+
+/** Index of the next parameter to send, PARAM_LAST when done */
+int ParamDelta::NextChanged()
+{
+   //Walk the change journal as long as it reaches back to "since", that avoids
+   //checking every parameter when only a few have changed
+   while (useJournal && journalSeq != endSeq)
+   {
+      Param::PARAM_NUM param = store->NextChange(journalSeq);
+
+      if (param == Param::PARAM_INVALID)
+      {
+         //Journal overran, parameters that were already sent may be sent again
+         useJournal = false;
+      }
+      else if (store->GetChangeSeq(param) == journalSeq)
+      {
+         //Only the latest change of a parameter is sent, later ones are picked up by the next poll
+         return param;
+      }
+   }
+
+   if (useJournal) return Param::PARAM_LAST;
+
+   while (nextParam < Param::PARAM_LAST && since != 0 && !store->ChangedSince((Param::PARAM_NUM)nextParam, since))
+      nextParam++;
+
+   return nextParam < Param::PARAM_LAST ? nextParam++ : Param::PARAM_LAST;
+}
+
+void ParamDelta::SetRecord(uint32_t value, int len)
+{
+   int start = len - 4;
+
+   for (int i = 0; i < 4; i++)
+      record[start + i] = value >> (8 * i);
+
+   recordLen = len;
+   recordPos = 0;
+}
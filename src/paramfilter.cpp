@@ -0,0 +1,160 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramfilter.h"
+#include "my_string.h"
+
+//Compare a zero terminated string with a string of given length
+static bool Equals(const char* str, const char* token, int len)
+{
+   for (int i = 0; i < len; i++, str++)
+   {
+      if (*str != token[i]) return false;
+   }
+   return *str == 0;
+}
+
+//Check that only spaces are left up to the end of an option
+static bool IsOptionEnd(const char* str, const char* end)
+{
+   for (; str < end && *str == ' '; str++);
+   return str == end;
+}
+
+ParamFilter::ParamFilter()
+{
+   Clear();
+}
+
+/** \brief Reset to match all visible parameters */
+void ParamFilter::Clear()
+{
+   category = 0;
+   minId = 0;
+   maxId = 0xFFFF;
+   start = 0;
+   pageSize = 0;
+   types = 0;
+   changedOnly = false;
+   hidden = false;
+   noCategory = false;
+}
+
+/** \brief Set up filter from text options
+ *
+ * \param args comma separated options, see class description
+ * \return false if an option is unknown, the filter is cleared then
+ *
+ */
+bool ParamFilter::Parse(const char* args)
+{
+   Clear();
+
+   while (*args != 0)
+   {
+      const char* end = my_strchr(args, ',');
+
+      for (; *args == ' '; args++);
+
+      if (args[0] == 'h' && IsOptionEnd(args + 1, end))
+      {
+         hidden = true;
+      }
+      else if (args[0] == 'd' && IsOptionEnd(args + 1, end))
+      {
+         changedOnly = true;
+      }
+      else if (args[1] != '=')
+      {
+         Clear();
+         return false;
+      }
+      else if (args[0] == 'c')
+      {
+         const char* value = args + 2;
+         int valueLen = end - value;
+         noCategory = true;
+
+         //Point to the category string of the attribute table so we need not copy the text
+         for (int i = 0; i < Param::PARAM_LAST; i++)
+         {
+            const Param::Attributes* pAtr = Param::GetAttrib((Param::PARAM_NUM)i);
+
+            if (Param::GetType((Param::PARAM_NUM)i) != Param::TYPE_SPOTVALUE && Equals(pAtr->category, value, valueLen))
+            {
+               category = pAtr->category;
+               noCategory = false;
+               break;
+            }
+         }
+      }
+      else if (args[0] == 't' && args[2] == 'p' && IsOptionEnd(args + 3, end))
+      {
+         types |= 1 << Param::TYPE_PARAM;
+      }
+      else if (args[0] == 't' && args[2] == 't' && IsOptionEnd(args + 3, end))
+      {
+         types |= 1 << Param::TYPE_TESTPARAM;
+      }
+      else if (args[0] == 't' && args[2] == 'v' && IsOptionEnd(args + 3, end))
+      {
+         types |= 1 << Param::TYPE_SPOTVALUE;
+      }
+      else if (args[0] == 'u')
+      {
+         const char* dash = my_strchr(args + 2, '-');
+
+         minId = my_atoi(args + 2);
+         maxId = dash < end ? my_atoi(dash + 1) : minId;
+      }
+      else if (args[0] == 's')
+      {
+         start = my_atoi(args + 2);
+      }
+      else if (args[0] == 'n')
+      {
+         pageSize = my_atoi(args + 2);
+      }
+      else
+      {
+         Clear();
+         return false;
+      }
+
+      args = *end == ',' ? end + 1 : end;
+   }
+   return true;
+}
+
+/** \brief Check whether a parameter passes all options except the page limit
+ * Hidden flags are left to the caller, see IncludeHidden()
+ * \param store store that holds the value compared with the default
+ */
+bool ParamFilter::Matches(Param::PARAM_NUM param, Param::Store* store) const
+{
+   const Param::Attributes* pAtr = Param::GetAttrib(param);
+   Param::PARAM_TYPE type = Param::GetType(param);
+
+   if (param < start) return false;
+   if (noCategory) return false;
+   if (types != 0 && (types & (1 << type)) == 0) return false;
+   if (pAtr->id < minId || pAtr->id > maxId) return false;
+   if (0 != category && (type == Param::TYPE_SPOTVALUE || my_strcmp(pAtr->category, category) != 0)) return false;
+   if (changedOnly && store->Get(param) == pAtr->def) return false;
+   return true;
+}
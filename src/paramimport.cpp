@@ -0,0 +1,217 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <libopencm3/cm3/cortex.h>
+#include "paramimport.h"
+#include "cansdo.h"
+#include "sdocommands.h"
+
+ParamImport::ParamImport(CanMap* cm)
+ : canMap(cm), store(&Param::defaultStore), mapStream(cm), buffer(0), bufSize(0), pos(0)
+{
+}
+
+/** \brief Supply the memory that collects the blob
+ *
+ * \param buf buffer, must stay valid for the lifetime of this object. 0 to disable the import
+ * \param size size of buf, this is the maximum blob size
+ *
+ */
+void ParamImport::SetBuffer(uint8_t* buf, uint32_t size)
+{
+   buffer = buf;
+   bufSize = size;
+   pos = 0;
+}
+
+uint32_t ParamImport::Begin(uint32_t size)
+{
+   pos = 0;
+
+   if (0 == buffer) return SDO_ERR_GENERAL;
+   return size <= bufSize ? 0 : SDO_ERR_LENGTH;
+}
+
+uint32_t ParamImport::Write(const uint8_t* buf, int len)
+{
+   if ((pos + len) > bufSize) return SDO_ERR_LENGTH;
+
+   for (int i = 0; i < len; i++)
+      buffer[pos++] = buf[i];
+
+   return 0;
+}
+
+uint32_t ParamImport::End()
+{
+   uint16_t paramCount, mapCount;
+   uint32_t err = Validate(paramCount, mapCount);
+
+   if (err != 0) return err;
+
+   err = Apply(paramCount, mapCount);
+
+   if (err != 0) return err;
+
+   if (buffer[3] & PARAMIMPORT_SAVE)
+      return Save();
+
+   return 0;
+}
+
+/** \brief Calculate CRC-32 with the same parameters as zlib
+ *
+ * \param crc result of the previous call, 0 to start
+ * \param data data to be added
+ * \param len number of bytes in data
+ * \return CRC-32
+ */
+uint32_t ParamImport::Crc32(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+   crc = ~crc;
+
+   for (uint32_t i = 0; i < len; i++)
+   {
+      crc ^= data[i];
+
+      for (int bit = 0; bit < 8; bit++)
+         crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+   }
+
+   return ~crc;
+}
+
+uint32_t ParamImport::Validate(uint16_t& paramCount, uint16_t& mapCount)
+{
+   if (pos < (PARAMIMPORT_HEADER_SIZE + PARAMIMPORT_CRC_SIZE))
+      return SDO_ERR_LENGTH;
+
+   if (buffer[0] != PARAMIMPORT_MAGIC0 || buffer[1] != PARAMIMPORT_MAGIC1 || buffer[2] != PARAMIMPORT_VERSION)
+      return SDO_ERR_GENERAL;
+
+   uint8_t flags = buffer[3];
+   paramCount = GetHalfWord(&buffer[4]);
+   mapCount = GetHalfWord(&buffer[6]);
+   uint32_t mapStart = PARAMIMPORT_HEADER_SIZE + paramCount * PARAMIMPORT_PARAM_SIZE;
+   uint32_t crcStart = mapStart + mapCount * CANMAP_RECORD_SIZE;
+
+   if (pos != (crcStart + PARAMIMPORT_CRC_SIZE))
+      return SDO_ERR_LENGTH;
+   if (GetWord(&buffer[crcStart]) != Crc32(0, buffer, crcStart))
+      return SDO_ERR_CRC;
+
+   for (uint32_t i = 0; i < paramCount; i++)
+   {
+      const uint8_t* entry = &buffer[PARAMIMPORT_HEADER_SIZE + i * PARAMIMPORT_PARAM_SIZE];
+      Param::PARAM_NUM param = Param::NumFromId(GetHalfWord(entry));
+      s32fp value = (s32fp)GetWord(&entry[2]);
+
+      if (param >= Param::PARAM_LAST || Param::GetType(param) == Param::TYPE_SPOTVALUE)
+         return SDO_ERR_INVIDX;
+
+      const Param::Attributes* attr = Param::GetAttrib(param);
+
+      if (value < attr->min || value > attr->max)
+         return SDO_ERR_RANGE;
+   }
+
+   if (flags & PARAMIMPORT_CANMAP)
+   {
+      if (0 == canMap) return SDO_ERR_INVIDX;
+      return ValidateMap(&buffer[mapStart], mapCount);
+   }
+
+   //Mappings without replacing the map could only be applied partially
+   return mapCount == 0 ? 0 : SDO_ERR_GENERAL;
+}
+
+/** \brief Check that every record is valid and that all of them fit into an empty CanMap */
+uint32_t ParamImport::ValidateMap(const uint8_t* records, uint16_t count)
+{
+   int messages[2] = { 0, 0 };
+
+   if (count > MAX_ITEMS) return SDO_ERR_RANGE;
+
+   for (int i = 0; i < count; i++)
+   {
+      uint32_t record[3];
+      bool newMessage = true;
+
+      for (int word = 0; word < 3; word++)
+         record[word] = GetWord(&records[i * CANMAP_RECORD_SIZE + word * 4]);
+
+      uint32_t err = CanMapStream::CheckRecord(record);
+
+      if (err != 0) return err;
+
+      for (int j = 0; j < i && newMessage; j++)
+         newMessage = GetWord(&records[j * CANMAP_RECORD_SIZE]) != record[0];
+
+      if (newMessage)
+      {
+         int rx = (record[0] & CANMAP_RECORD_RX) != 0;
+
+         if (++messages[rx] > MAX_MESSAGES) return SDO_ERR_RANGE;
+      }
+   }
+   return 0;
+}
+
+/** \brief Set the parameters and replace the CAN map
+ * \return 0 on success, SDO abort code if the CAN map refused a record
+ */
+uint32_t ParamImport::Apply(uint16_t paramCount, uint16_t mapCount)
+{
+   uint32_t err = 0;
+
+   for (uint32_t i = 0; i < paramCount; i++)
+   {
+      const uint8_t* entry = &buffer[PARAMIMPORT_HEADER_SIZE + i * PARAMIMPORT_PARAM_SIZE];
+
+      store->Set(Param::NumFromId(GetHalfWord(entry)), (s32fp)GetWord(&entry[2]));
+   }
+
+   if (buffer[3] & PARAMIMPORT_CANMAP)
+   {
+      uint32_t mapSize = mapCount * CANMAP_RECORD_SIZE;
+      //Interrupts that receive or send with the CAN map must not see it half built
+      uint32_t irqState = cm_mask_interrupts(1);
+
+      canMap->Clear();
+      err = mapStream.Begin(mapSize);
+      if (err == 0) err = mapStream.Write(&buffer[PARAMIMPORT_HEADER_SIZE + paramCount * PARAMIMPORT_PARAM_SIZE], mapSize);
+      if (err == 0) err = mapStream.End();
+
+      cm_mask_interrupts(irqState);
+   }
+   return err;
+}
+
+uint32_t ParamImport::Save()
+{
+   CanSdo::SdoFrame frame = { SDO_WRITE, SDO_INDEX_COMMANDS, SDO_CMD_SAVE, 0 };
+
+   SdoCommands::ProcessStandardCommands(&frame);
+
+   return frame.cmd == SDO_ABORT ? frame.data : 0;
+}
+
+uint32_t ParamImport::GetWord(const uint8_t* data)
+{
+   return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
@@ -0,0 +1,180 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <libopencm3/stm32/desig.h>
+#include "paramjson.h"
+#include "printf.h"
+
+ParamJson::ParamJson(CanMap* cm, bool printHidden)
+ : canMap(cm), store(&Param::defaultStore), filter(0), printHidden(printHidden)
+{
+   Rewind();
+}
+
+void ParamJson::Rewind()
+{
+   state = STATE_START;
+   comma = ' ';
+   item = 0;
+   listed = 0;
+   current = "";
+}
+
+int ParamJson::Read(uint8_t* buf, int len)
+{
+   int count = 0;
+
+   while (count < len)
+   {
+      if (*current == 0)
+      {
+         if (!NextPiece()) break;
+      }
+      else
+      {
+         buf[count++] = *current++;
+      }
+   }
+   return count;
+}
+
+/** \brief Advance to the next piece of the document
+ * Strings from the attribute table are served in place, everything else is
+ * formatted into formatBuf. Pieces may be empty.
+ * \return false when the document is complete
+ */
+bool ParamJson::NextPiece()
+{
+   Param::PARAM_NUM param = (Param::PARAM_NUM)item;
+   const Param::Attributes *pAtr = Param::GetAttrib(param);
+   uint32_t canId;
+   uint8_t canStart;
+   int8_t canLength, offset;
+   float canGain;
+
+   current = formatBuf;
+
+   switch (state)
+   {
+   case STATE_START:
+      current = "{";
+      NextEntry(0);
+      break;
+   case STATE_ENTRY:
+      sprintf(formatBuf, "%c\r\n   \"", comma);
+      comma = ',';
+      state = STATE_NAME;
+      break;
+   case STATE_NAME:
+      current = pAtr->name;
+      state = STATE_UNITKEY;
+      break;
+   case STATE_UNITKEY:
+      current = "\": {\"unit\":\"";
+      state = STATE_UNIT;
+      break;
+   case STATE_UNIT:
+      current = pAtr->unit;
+      state = STATE_VALUE;
+      break;
+   case STATE_VALUE:
+      sprintf(formatBuf, "\",\"id\":%d,\"value\":%f,", pAtr->id, store->Get(param));
+      state = STATE_CANMAP;
+      break;
+   case STATE_CANMAP:
+      if (0 != canMap && canMap->FindMap(param, canId, canStart, canLength, canGain, offset, canRx))
+      {
+         sprintf(formatBuf, "\"canid\":%d,\"canoffset\":%d,\"canlength\":%d,\"cangain\":%f,\"canadd\":%d,\"isrx\":",
+                 canId, canStart, canLength, FP_FROMFLT(canGain), offset);
+         state = STATE_CANRX;
+      }
+      else
+      {
+         current = "";
+         state = STATE_TYPE;
+      }
+      break;
+   case STATE_CANRX:
+      current = canRx ? "true," : "false,";
+      state = STATE_TYPE;
+      break;
+   case STATE_TYPE:
+      if (Param::GetType(param) == Param::TYPE_PARAM || Param::GetType(param) == Param::TYPE_TESTPARAM)
+      {
+         sprintf(formatBuf, "\"isparam\":true,\"minimum\":%f,\"maximum\":%f,\"default\":%f,\"category\":\"",
+                 pAtr->min, pAtr->max, pAtr->def);
+         state = STATE_CATEGORY;
+      }
+      else
+      {
+         current = "\"isparam\":false}";
+         NextEntry(item + 1);
+      }
+      break;
+   case STATE_CATEGORY:
+      current = pAtr->category;
+      state = STATE_INDEX;
+      break;
+   case STATE_INDEX:
+      sprintf(formatBuf, "\",\"i\":%d}", item);
+      NextEntry(item + 1);
+      break;
+   case STATE_NEXT:
+      //Page is full, tell the client where to continue
+      sprintf(formatBuf, ",\r\n   \"next\": {\"unit\":\"\",\"value\":%d,\"isparam\":false}", item);
+      state = STATE_SERIAL;
+      break;
+   case STATE_SERIAL:
+   {
+      uint32_t uid[3];
+      desig_get_unique_id(uid);
+      sprintf(formatBuf, ",\r\n   \"serial\": {\"unit\":\"\",\"value\":\"%08X\",\"isparam\":false}", uid[0]);
+      state = STATE_END;
+      break;
+   }
+   case STATE_END:
+      current = "\r\n}\r\n";
+      state = STATE_DONE;
+      break;
+   default:
+      current = "";
+      return false;
+   }
+
+   return true;
+}
+
+/** \brief Find the next parameter to be printed, starting at index start */
+void ParamJson::NextEntry(int start)
+{
+   for (item = start; item < Param::PARAM_LAST; item++)
+   {
+      if (((store->GetFlag((Param::PARAM_NUM)item) & Param::FLAG_HIDDEN) == 0 || printHidden) &&
+          (0 == filter || filter->Matches((Param::PARAM_NUM)item, store)))
+         break;
+   }
+
+   if (item >= Param::PARAM_LAST)
+      state = STATE_SERIAL;
+   else if (0 != filter && filter->GetPageSize() > 0 && listed >= filter->GetPageSize())
+      state = STATE_NEXT;
+   else
+      state = STATE_ENTRY;
+
+   listed++;
+}
@@ -0,0 +1,218 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramrecorder.h"
+#include "errormessage.h"
+
+ParamRecorder::ParamRecorder()
+ : store(&Param::defaultStore), buffer(0), bufSize(0), numChannels(0), decimation(1), decimationCount(0), preTrigger(0),
+   triggerMode(TRIG_NONE), triggerParam(Param::PARAM_INVALID), threshold(0), lastTriggerValue(0),
+   errorCount(0), state(STATE_IDLE), forceTrigger(false), capacity(0), writeIdx(0), recorded(0),
+   remaining(0), pos(0)
+{
+}
+
+/** \brief Supply the memory that holds the samples, this stops a running capture
+ *
+ * \param buf buffer, must stay valid for the lifetime of this object
+ * \param size number of values buf can hold, i.e. samples times channels
+ *
+ */
+void ParamRecorder::SetBuffer(s32fp* buf, uint32_t size)
+{
+   state = STATE_IDLE;
+   buffer = buf;
+   bufSize = size;
+}
+
+/** \brief Select the recorded parameters, this stops a running capture
+ * \return false if count exceeds RECORDER_MAX_CHANNELS or a parameter doesn't exist
+ */
+bool ParamRecorder::SetChannels(const Param::PARAM_NUM* params, int count)
+{
+   if (count > RECORDER_MAX_CHANNELS) return false;
+
+   for (int i = 0; i < count; i++)
+   {
+      if (params[i] >= Param::PARAM_LAST) return false;
+   }
+
+   state = STATE_IDLE;
+
+   for (int i = 0; i < count; i++)
+      channels[i] = params[i];
+
+   numChannels = count;
+   return true;
+}
+
+/** \brief Replace a channel or add one after the last, this stops a running capture
+ * \return false if the channel or parameter doesn't exist
+ */
+bool ParamRecorder::SetChannel(int channel, Param::PARAM_NUM param)
+{
+   if (channel > numChannels || channel >= RECORDER_MAX_CHANNELS || param >= Param::PARAM_LAST)
+      return false;
+
+   state = STATE_IDLE;
+   channels[channel] = param;
+   if (channel == numChannels) numChannels++;
+   return true;
+}
+
+/** \brief Set the trigger condition of the next capture
+ *
+ * \param mode trigger mode
+ * \param param parameter compared to threshold, only needed by the threshold and edge modes
+ * \param threshold threshold in fixed point
+ * \return false if mode is unknown or needs a parameter and param doesn't exist
+ *
+ */
+bool ParamRecorder::SetTrigger(Trigger mode, Param::PARAM_NUM param, s32fp threshold)
+{
+   bool needsParam = mode != TRIG_NONE && mode != TRIG_ERROR;
+
+   if (mode >= TRIG_LAST || (needsParam && param >= Param::PARAM_LAST))
+      return false;
+
+   triggerMode = mode;
+   triggerParam = param;
+   this->threshold = threshold;
+   return true;
+}
+
+/** \brief Number of samples per capture with the current buffer and channels */
+uint32_t ParamRecorder::GetCapacity()
+{
+   return numChannels > 0 ? bufSize / numChannels : 0;
+}
+
+/** \brief Start a new capture
+ * \return false if there is no buffer or channel or the pre-trigger depth doesn't fit
+ */
+bool ParamRecorder::Arm()
+{
+   state = STATE_IDLE;
+   capacity = GetCapacity();
+
+   if (0 == buffer || capacity == 0 || preTrigger >= capacity)
+      return false;
+
+   writeIdx = 0;
+   recorded = 0;
+   decimationCount = 0;
+   forceTrigger = false;
+   errorCount = ErrorMessage::GetPostCount();
+   lastTriggerValue = triggerParam < Param::PARAM_LAST ? store->Get(triggerParam) : 0;
+   state = STATE_ARMED;
+   return true;
+}
+
+/** \brief Record a sample if armed or triggered, call at a fixed rate */
+void ParamRecorder::Sample()
+{
+   if (state != STATE_ARMED && state != STATE_TRIGGERED) return;
+   if (++decimationCount < decimation) return;
+
+   decimationCount = 0;
+
+   //Snapshot() keeps the channels of one sample consistent
+   store->Snapshot(channels, &buffer[writeIdx * numChannels], numChannels);
+   writeIdx = (writeIdx + 1) < capacity ? writeIdx + 1 : 0;
+   if (recorded < capacity) recorded++;
+
+   if (state == STATE_ARMED)
+   {
+      //The sample just recorded is the trigger sample, so it needs preTrigger samples before it
+      if (IsTriggered() && recorded > preTrigger)
+      {
+         forceTrigger = false;
+         remaining = capacity - preTrigger - 1;
+         state = remaining > 0 ? STATE_TRIGGERED : STATE_DONE;
+      }
+   }
+   else if (--remaining == 0)
+   {
+      state = STATE_DONE;
+   }
+}
+
+int ParamRecorder::Read(uint8_t* buf, int len)
+{
+   uint32_t size = GetSize();
+   uint32_t headerSize = RECORDER_HEADER_SIZE + 2 * numChannels;
+   int copied = 0;
+
+   for (; copied < len && pos < size; copied++, pos++)
+   {
+      if (pos < headerSize)
+      {
+         buf[copied] = GetHeaderByte(pos);
+      }
+      else
+      {
+         uint32_t valueIdx = (pos - headerSize) / 4;
+         uint32_t ringIdx = (writeIdx + valueIdx / numChannels) % capacity;
+
+         buf[copied] = buffer[ringIdx * numChannels + valueIdx % numChannels] >> (8 * ((pos - headerSize) % 4));
+      }
+   }
+   return copied;
+}
+
+uint32_t ParamRecorder::GetSize()
+{
+   uint32_t samples = state == STATE_DONE ? capacity : 0;
+   return RECORDER_HEADER_SIZE + 2 * numChannels + 4 * samples * numChannels;
+}
+
+uint8_t ParamRecorder::GetHeaderByte(uint32_t offset)
+{
+   uint16_t field;
+
+   switch (offset / 2)
+   {
+   case 0: field = numChannels; break;
+   case 1: field = state == STATE_DONE ? capacity : 0; break;
+   case 2: field = preTrigger; break;
+   case 3: field = decimation; break;
+   default: field = Param::GetAttrib(channels[offset / 2 - 4])->id; break;
+   }
+
+   return offset & 1 ? field >> 8 : field & 0xFF;
+}
+
+bool ParamRecorder::IsTriggered()
+{
+   s32fp value = triggerParam < Param::PARAM_LAST ? store->Get(triggerParam) : 0;
+   bool triggered = forceTrigger;
+
+   switch (triggerMode)
+   {
+   case TRIG_NONE: triggered = true; break;
+   case TRIG_ABOVE: triggered |= value > threshold; break;
+   case TRIG_BELOW: triggered |= value < threshold; break;
+   case TRIG_RISING: triggered |= lastTriggerValue < threshold && value >= threshold; break;
+   case TRIG_FALLING: triggered |= lastTriggerValue > threshold && value <= threshold; break;
+   case TRIG_ERROR: triggered |= ErrorMessage::GetPostCount() != errorCount; break;
+   default: break;
+   }
+
+   lastTriggerValue = value;
+   return triggered;
+}
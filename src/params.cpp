@@ -23,9 +23,9 @@
 namespace Param
 {
 
-#define PARAM_ENTRY(category, name, unit, min, max, def, id) { category, #name, unit, FP_FROMFLT(min), FP_FROMFLT(max), FP_FROMFLT(def), id, TYPE_PARAM },
-#define TESTP_ENTRY(category, name, unit, min, max, def, id) { category, #name, unit, FP_FROMFLT(min), FP_FROMFLT(max), FP_FROMFLT(def), id, TYPE_TESTPARAM },
-#define VALUE_ENTRY(name, unit, id) { 0, #name, unit, 0, 0, 0, id, TYPE_SPOTVALUE },
+#define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) { category, #name, unit, FP_FROMFLT(min), FP_FROMFLT(max), FP_FROMFLT(def), id, TYPE_PARAM },
+#define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) { category, #name, unit, FP_FROMFLT(min), FP_FROMFLT(max), FP_FROMFLT(def), id, TYPE_TESTPARAM },
+#define VALUE_ENTRY(name, unit, id, ...) { 0, #name, unit, 0, 0, 0, id, TYPE_SPOTVALUE },
 static const Attributes attribs[] =
 {
     PARAM_LIST
@@ -34,10 +34,11 @@ static const Attributes attribs[] =
 #undef TESTP_ENTRY
 #undef VALUE_ENTRY
 
-#define PARAM_ENTRY(category, name, unit, min, max, def, id) FP_FROMFLT(def),
-#define TESTP_ENTRY(category, name, unit, min, max, def, id) FP_FROMFLT(def),
-#define VALUE_ENTRY(name, unit, id) 0,
-static s32fp values[] =
+//Duplicate ID check
+#define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) ITEM_##id,
+#define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) ITEM_##id,
+#define VALUE_ENTRY(name, unit, id, ...) ITEM_##id,
+enum _dupes
 {
     PARAM_LIST
 };
@@ -45,10 +46,11 @@ static s32fp values[] =
 #undef TESTP_ENTRY
 #undef VALUE_ENTRY
 
-#define PARAM_ENTRY(category, name, unit, min, max, def, id) FLAG_NONE,
-#define TESTP_ENTRY(category, name, unit, min, max, def, id) FLAG_NONE,
-#define VALUE_ENTRY(name, unit, id) FLAG_NONE,
-static uint8_t flags[] =
+//Parameter ids in index order, only used at compile time
+#define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) id,
+#define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) id,
+#define VALUE_ENTRY(name, unit, id, ...) id,
+static constexpr uint16_t ids[] =
 {
     PARAM_LIST
 };
@@ -56,11 +58,17 @@ static uint8_t flags[] =
 #undef TESTP_ENTRY
 #undef VALUE_ENTRY
 
-//Duplicate ID check
-#define PARAM_ENTRY(category, name, unit, min, max, def, id) ITEM_##id,
-#define TESTP_ENTRY(category, name, unit, min, max, def, id) ITEM_##id,
-#define VALUE_ENTRY(name, unit, id) ITEM_##id,
-enum _dupes
+/** Compile time version of my_strhash() */
+static constexpr uint16_t HashName(const char* name, uint32_t hash = 2166136261u)
+{
+   return *name == 0 ? (hash >> 16) ^ (hash & 0xFFFF) : HashName(name + 1, (hash ^ (unsigned char)*name) * 16777619u);
+}
+
+//Name hashes in index order
+#define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) HashName(#name),
+#define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) HashName(#name),
+#define VALUE_ENTRY(name, unit, id, ...) HashName(#name),
+static constexpr uint16_t nameHashes[] =
 {
     PARAM_LIST
 };
@@ -68,6 +76,248 @@ enum _dupes
 #undef TESTP_ENTRY
 #undef VALUE_ENTRY
 
+struct OrderById
+{
+   static constexpr bool Less(int a, int b) { return ids[a] < ids[b]; }
+};
+
+//Hashes may collide, the index makes the order strict
+struct OrderByHash
+{
+   static constexpr bool Less(int a, int b) { return nameHashes[a] < nameHashes[b] || (nameHashes[a] == nameHashes[b] && a < b); }
+};
+
+/** Index of the next parameter after "after" in the given order, -1 if there is none.
+ * -1 as "after" returns the first parameter.
+ */
+template <typename Order>
+static constexpr int NextIndex(int after, int i = 0, int best = -1)
+{
+   return i == PARAM_LAST ? best :
+          NextIndex<Order>(after, i + 1, ((after < 0 || Order::Less(after, i)) && (best < 0 || Order::Less(i, best))) ? i : best);
+}
+
+/** Collects the parameter indexes in the given order at compile time.
+ * Every step appends the index of the next parameter, so this is a
+ * selection sort that the compiler runs once per build.
+ */
+template <typename Order, int Remaining, int Last, uint16_t... Sorted>
+struct SortedIndex
+{
+   typedef typename SortedIndex<Order, Remaining - 1, NextIndex<Order>(Last), Sorted..., NextIndex<Order>(Last)>::Result Result;
+};
+
+template <typename Order, int Last, uint16_t... Sorted>
+struct SortedIndex<Order, 0, Last, Sorted...>
+{
+   typedef SortedIndex Result;
+   static const uint16_t indexes[sizeof...(Sorted)];
+};
+
+template <typename Order, int Last, uint16_t... Sorted>
+const uint16_t SortedIndex<Order, 0, Last, Sorted...>::indexes[] = { Sorted... };
+
+typedef SortedIndex<OrderById, PARAM_LAST - 1, NextIndex<OrderById>(-1), NextIndex<OrderById>(-1)>::Result ParamsById;
+typedef SortedIndex<OrderByHash, PARAM_LAST - 1, NextIndex<OrderByHash>(-1), NextIndex<OrderByHash>(-1)>::Result ParamsByHash;
+
+static s32fp ToFixed(PARAM_NUM ParamNum, NativeValue value)
+{
+   switch (nativeStorage[ParamNum])
+   {
+   case STORAGE_INT: return Native<STORAGE_INT>::ToFixed(value);
+   case STORAGE_FLOAT: return Native<STORAGE_FLOAT>::ToFixed(value);
+   default: return Native<STORAGE_FIXED>::ToFixed(value);
+   }
+}
+
+static NativeValue FromFixed(PARAM_NUM ParamNum, s32fp value)
+{
+   switch (nativeStorage[ParamNum])
+   {
+   case STORAGE_INT: return Native<STORAGE_INT>::FromFixed(value);
+   case STORAGE_FLOAT: return Native<STORAGE_FLOAT>::FromFixed(value);
+   default: return Native<STORAGE_FIXED>::FromFixed(value);
+   }
+}
+
+
+Store defaultStore;
+
+/**
+* Get the paramater index from a parameter name
+*
+* @param[in] name Parameters name
+* @return Parameter index if found, PARAM_INVALID otherwise
+*/
+PARAM_NUM NumFromString(const char *name)
+{
+    uint16_t hash = my_strhash(name);
+    int low = 0, high = PARAM_LAST;
+
+    //Find the first entry with this hash in the hash sorted index table
+    while (low < high)
+    {
+         int mid = (low + high) / 2;
+
+         if (nameHashes[ParamsByHash::indexes[mid]] < hash)
+             low = mid + 1;
+         else
+             high = mid;
+    }
+
+    //Then compare the names of all entries with the same hash
+    for (; low < PARAM_LAST && nameHashes[ParamsByHash::indexes[low]] == hash; low++)
+    {
+         uint16_t paramNum = ParamsByHash::indexes[low];
+
+         if (0 == my_strcmp(attribs[paramNum].name, name))
+             return (PARAM_NUM)paramNum;
+    }
+    return PARAM_INVALID;
+}
+
+/**
+* Get the paramater index from a parameters unique id
+*
+* @param[in] id Parameters unique id
+* @return Parameter index if found, PARAM_INVALID otherwise
+*/
+PARAM_NUM NumFromId(uint32_t id)
+{
+    int low = 0, high = PARAM_LAST - 1;
+
+    //Binary search in the id sorted index table
+    while (low <= high)
+    {
+         int mid = (low + high) / 2;
+         uint16_t paramNum = ParamsById::indexes[mid];
+
+         if (attribs[paramNum].id == id)
+             return (PARAM_NUM)paramNum;
+         else if (attribs[paramNum].id < id)
+             low = mid + 1;
+         else
+             high = mid - 1;
+    }
+    return PARAM_INVALID;
+}
+
+/**
+* Get the parameter attributes
+*
+* @param[in] ParamNum Parameter index
+* @return Parameter attributes
+*/
+const Attributes *GetAttrib(PARAM_NUM ParamNum)
+{
+    return &attribs[ParamNum];
+}
+
+PARAM_TYPE GetType(PARAM_NUM param)
+{
+   return (PARAM_TYPE)attribs[param].type;
+}
+
+PARAM_STORAGE GetStorage(PARAM_NUM param)
+{
+   return nativeStorage[param];
+}
+
+uint32_t GetIdSum()
+{
+#ifndef PARAM_ID_SUM_START_OFFSET
+#define PARAM_ID_SUM_START_OFFSET 0
+#endif // PARAM_ID_SUM_START_OFFSET
+#define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) id +
+#define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) id +
+#define VALUE_ENTRY(name, unit, id, ...) id +
+   return PARAM_LIST PARAM_ID_SUM_START_OFFSET;
+#undef PARAM_ENTRY
+#undef TESTP_ENTRY
+#undef VALUE_ENTRY
+}
+
+//The value functions operate on the default store, see Store for documentation
+int Set(PARAM_NUM ParamNum, s32fp ParamVal) { return defaultStore.Set(ParamNum, ParamVal); }
+s32fp Get(PARAM_NUM ParamNum) { return defaultStore.Get(ParamNum); }
+int GetInt(PARAM_NUM ParamNum) { return defaultStore.GetInt(ParamNum); }
+float GetFloat(PARAM_NUM ParamNum) { return defaultStore.GetFloat(ParamNum); }
+bool GetBool(PARAM_NUM ParamNum) { return defaultStore.GetBool(ParamNum); }
+void SetInt(PARAM_NUM ParamNum, int ParamVal) { defaultStore.SetInt(ParamNum, ParamVal); }
+void SetFixed(PARAM_NUM ParamNum, s32fp ParamVal) { defaultStore.SetFixed(ParamNum, ParamVal); }
+void SetFloat(PARAM_NUM ParamNum, float ParamVal) { defaultStore.SetFloat(ParamNum, ParamVal); }
+void LoadDefaults() { defaultStore.LoadDefaults(); }
+void SetFlagsRaw(PARAM_NUM param, uint8_t rawFlags) { defaultStore.SetFlagsRaw(param, rawFlags); }
+void SetFlag(PARAM_NUM param, PARAM_FLAG flag) { defaultStore.SetFlag(param, flag); }
+void ClearFlag(PARAM_NUM param, PARAM_FLAG flag) { defaultStore.ClearFlag(param, flag); }
+PARAM_FLAG GetFlag(PARAM_NUM param) { return defaultStore.GetFlag(param); }
+uint32_t GetChangeSeq() { return defaultStore.GetChangeSeq(); }
+uint32_t GetChangeSeq(PARAM_NUM param) { return defaultStore.GetChangeSeq(param); }
+bool ChangedSince(PARAM_NUM param, uint32_t seq) { return defaultStore.ChangedSince(param, seq); }
+uint32_t ReadBegin() { return defaultStore.ReadBegin(); }
+bool ReadRetry(uint32_t seq) { return defaultStore.ReadRetry(seq); }
+bool Snapshot(const PARAM_NUM* params, s32fp* out, int count) { return defaultStore.Snapshot(params, out, count); }
+PARAM_NUM NextChange(uint32_t& seq) { return defaultStore.NextChange(seq); }
+bool IsDirty(PARAM_NUM param) { return defaultStore.IsDirty(param); }
+PARAM_NUM NextDirty(int start) { return defaultStore.NextDirty(start); }
+void ClearDirty(PARAM_NUM param) { defaultStore.ClearDirty(param); }
+void ClearDirty() { defaultStore.ClearDirty(); }
+bool AddObserver(PARAM_NUM param, ChangeObserver observer, bool deferred) { return defaultStore.AddObserver(param, observer, deferred); }
+int AddObserver(const char* category, ChangeObserver observer, bool deferred) { return defaultStore.AddObserver(category, observer, deferred); }
+void DeliverChanges() { defaultStore.DeliverChanges(); }
+
+/** Store a value and stamp it with a new sequence number if it actually changed */
+void Store::StoreValue(PARAM_NUM ParamNum, NativeValue ParamVal)
+{
+   if (values[ParamNum].integer != ParamVal.integer)
+   {
+      //A setter in an interrupt may nest in this one, a plain increment would lose its count
+      __atomic_fetch_add(&writeSeq, 1, __ATOMIC_RELAXED);
+      __sync_synchronize();
+      values[ParamNum] = ParamVal;
+      __sync_synchronize();
+      __atomic_fetch_add(&writeSeq, 1, __ATOMIC_RELAXED);
+      //Setters may run in interrupts as well, each change must get its own number
+      uint32_t seq = __atomic_add_fetch(&lastChangeSeq, 1, __ATOMIC_RELAXED);
+      changeSeq[ParamNum] = seq;
+      __atomic_fetch_or(&dirty[ParamNum / 32], 1u << (ParamNum % 32), __ATOMIC_RELAXED);
+      journal[seq % PARAM_JOURNAL_SIZE] = ParamNum;
+   }
+}
+
+/** Call the parameters observer. Without one the default store calls Change(),
+ * the other stores don't notify at all. */
+void Store::Notify(PARAM_NUM ParamNum)
+{
+   uint8_t observer = observerOf[ParamNum];
+
+   if (0 == observer)
+   {
+      if (this == &defaultStore)
+         Change(ParamNum);
+   }
+   else if (observers[observer - 1].deferred)
+      __atomic_fetch_or(&pendingChanges[ParamNum / 32], 1u << (ParamNum % 32), __ATOMIC_RELAXED);
+   else
+      observers[observer - 1].func(ParamNum);
+}
+
+/** Index of the observer in observers[] plus one, 0 if the table is full */
+uint8_t Store::ObserverIndex(ChangeObserver observer, bool deferred)
+{
+   for (int i = 0; i < numObservers; i++)
+   {
+      if (observers[i].func == observer && observers[i].deferred == deferred)
+         return i + 1;
+   }
+
+   if (numObservers >= PARAM_MAX_OBSERVERS)
+      return 0;
+
+   observers[numObservers].func = observer;
+   observers[numObservers].deferred = deferred;
+   return ++numObservers;
+}
 
 /**
 * Set a parameter
@@ -76,14 +326,14 @@ enum _dupes
 * @param[in] ParamVal New value of parameter
 * @return 0 if set ok, -1 if ParamVal outside of allowed range
 */
-int Set(PARAM_NUM ParamNum, s32fp ParamVal)
+int Store::Set(PARAM_NUM ParamNum, s32fp ParamVal)
 {
     char res = -1;
 
     if (ParamVal >= attribs[ParamNum].min && ParamVal <= attribs[ParamNum].max)
     {
-        values[ParamNum] = ParamVal;
-        Change(ParamNum);
+        StoreValue(ParamNum, FromFixed(ParamNum, ParamVal));
+        Notify(ParamNum);
         res = 0;
     }
     return res;
@@ -95,9 +345,9 @@ int Set(PARAM_NUM ParamNum, s32fp ParamVal)
 * @param[in] ParamNum Parameter index
 * @return Parameters value
 */
-s32fp Get(PARAM_NUM ParamNum)
+s32fp Store::Get(PARAM_NUM ParamNum)
 {
-    return values[ParamNum];
+    return ToFixed(ParamNum, values[ParamNum]);
 }
 
 /**
@@ -106,9 +356,14 @@ s32fp Get(PARAM_NUM ParamNum)
 * @param[in] ParamNum Parameter index
 * @return Parameters value
 */
-int GetInt(PARAM_NUM ParamNum)
+int Store::GetInt(PARAM_NUM ParamNum)
 {
-    return FP_TOINT(values[ParamNum]);
+    switch (nativeStorage[ParamNum])
+    {
+    case STORAGE_INT: return Native<STORAGE_INT>::ToInt(values[ParamNum]);
+    case STORAGE_FLOAT: return Native<STORAGE_FLOAT>::ToInt(values[ParamNum]);
+    default: return Native<STORAGE_FIXED>::ToInt(values[ParamNum]);
+    }
 }
 
 /**
@@ -117,9 +372,14 @@ int GetInt(PARAM_NUM ParamNum)
 * @param[in] ParamNum Parameter index
 * @return Parameters value
 */
-float GetFloat(PARAM_NUM ParamNum)
+float Store::GetFloat(PARAM_NUM ParamNum)
 {
-    return FP_TOFLOAT(values[ParamNum]);
+    switch (nativeStorage[ParamNum])
+    {
+    case STORAGE_INT: return Native<STORAGE_INT>::ToFloat(values[ParamNum]);
+    case STORAGE_FLOAT: return Native<STORAGE_FLOAT>::ToFloat(values[ParamNum]);
+    default: return Native<STORAGE_FIXED>::ToFloat(values[ParamNum]);
+    }
 }
 
 /**
@@ -128,9 +388,9 @@ float GetFloat(PARAM_NUM ParamNum)
 * @param[in] ParamNum Parameter index
 * @return Parameters value
 */
-bool GetBool(PARAM_NUM ParamNum)
+bool Store::GetBool(PARAM_NUM ParamNum)
 {
-    return FP_TOINT(values[ParamNum]) == 1;
+    return GetInt(ParamNum) == 1;
 }
 
 /**
@@ -139,9 +399,14 @@ bool GetBool(PARAM_NUM ParamNum)
 * @param[in] ParamNum Parameter index
 * @param[in] ParamVal New value of parameter
 */
-void SetInt(PARAM_NUM ParamNum, int ParamVal)
+void Store::SetInt(PARAM_NUM ParamNum, int ParamVal)
 {
-   values[ParamNum] = FP_FROMINT(ParamVal);
+   switch (nativeStorage[ParamNum])
+   {
+   case STORAGE_INT: StoreValue(ParamNum, Native<STORAGE_INT>::FromInt(ParamVal)); break;
+   case STORAGE_FLOAT: StoreValue(ParamNum, Native<STORAGE_FLOAT>::FromInt(ParamVal)); break;
+   default: StoreValue(ParamNum, Native<STORAGE_FIXED>::FromInt(ParamVal)); break;
+   }
 }
 
 /**
@@ -150,9 +415,9 @@ void SetInt(PARAM_NUM ParamNum, int ParamVal)
 * @param[in] ParamNum Parameter index
 * @param[in] ParamVal New value of parameter
 */
-void SetFixed(PARAM_NUM ParamNum, s32fp ParamVal)
+void Store::SetFixed(PARAM_NUM ParamNum, s32fp ParamVal)
 {
-   values[ParamNum] = ParamVal;
+   StoreValue(ParamNum, FromFixed(ParamNum, ParamVal));
 }
 
 /**
@@ -161,115 +426,286 @@ void SetFixed(PARAM_NUM ParamNum, s32fp ParamVal)
 * @param[in] ParamNum Parameter index
 * @param[in] ParamVal New value of parameter
 */
-void SetFloat(PARAM_NUM ParamNum, float ParamVal)
+void Store::SetFloat(PARAM_NUM ParamNum, float ParamVal)
+{
+   switch (nativeStorage[ParamNum])
+   {
+   case STORAGE_INT: StoreValue(ParamNum, Native<STORAGE_INT>::FromFloat(ParamVal)); break;
+   case STORAGE_FLOAT: StoreValue(ParamNum, Native<STORAGE_FLOAT>::FromFloat(ParamVal)); break;
+   default: StoreValue(ParamNum, Native<STORAGE_FIXED>::FromFloat(ParamVal)); break;
+   }
+}
+
+/** Load default values for all parameters */
+void Store::LoadDefaults()
+{
+   const Attributes *curAtr = attribs;
+
+   for (int idx = 0; idx < PARAM_LAST; idx++, curAtr++)
+   {
+      if (curAtr->id > 0)
+         SetFixed((PARAM_NUM)idx, curAtr->def);
+   }
+}
+
+void Store::SetFlagsRaw(PARAM_NUM param, uint8_t rawFlags)
+{
+   flags[param] = rawFlags;
+}
+
+void Store::SetFlag(PARAM_NUM param, PARAM_FLAG flag)
+{
+   flags[param] |= (uint8_t)flag;
+}
+
+void Store::ClearFlag(PARAM_NUM param, PARAM_FLAG flag)
+{
+   flags[param] &= (uint8_t)~flag;
+}
+
+PARAM_FLAG Store::GetFlag(PARAM_NUM param)
+{
+   return (PARAM_FLAG)flags[param];
+}
+
+/**
+* Get the sequence number of the most recent value change of any parameter
+*
+* @return Sequence number, incremented on every change and wrapping around at 2^32
+*/
+uint32_t Store::GetChangeSeq()
 {
-   values[ParamNum] = FP_FROMFLT(ParamVal);
+   return lastChangeSeq;
 }
 
 /**
-* Get the paramater index from a parameter name
+* Get the sequence number of the most recent value change of a parameter
 *
-* @param[in] name Parameters name
-* @return Parameter index if found, PARAM_INVALID otherwise
+* @param[in] param Parameter index
+* @return Sequence number, 0 if the parameter never changed
 */
-PARAM_NUM NumFromString(const char *name)
+uint32_t Store::GetChangeSeq(PARAM_NUM param)
 {
-    PARAM_NUM paramNum = PARAM_INVALID;
-    const Attributes *pCurAtr = attribs;
+   return changeSeq[param];
+}
 
-    for (int i = 0; i < PARAM_LAST; i++, pCurAtr++)
-    {
-         if (0 == my_strcmp(pCurAtr->name, name))
-         {
-             paramNum = (PARAM_NUM)i;
-             break;
-         }
-    }
-    return paramNum;
+/**
+* Check whether a parameter has changed since a given sequence number
+*
+* @param[in] param Parameter index
+* @param[in] seq Sequence number as returned by GetChangeSeq() earlier
+* @return true if the parameter changed after seq was obtained
+*/
+bool Store::ChangedSince(PARAM_NUM param, uint32_t seq)
+{
+   //Signed difference keeps working when the counter wraps around
+   return (int32_t)(changeSeq[param] - seq) > 0;
 }
 
 /**
-* Get the paramater index from a parameters unique id
+* Start reading a consistent set of values
 *
-* @param[in] id Parameters unique id
-* @return Parameter index if found, PARAM_INVALID otherwise
+* @return Value to pass to ReadRetry() after reading
 */
-PARAM_NUM NumFromId(uint32_t id)
+uint32_t Store::ReadBegin()
 {
-    PARAM_NUM paramNum = PARAM_INVALID;
-    const Attributes *pCurAtr = attribs;
+   uint32_t seq = __atomic_load_n(&writeSeq, __ATOMIC_RELAXED);
+   __sync_synchronize();
+   return seq;
+}
 
-    for (int i = 0; i < PARAM_LAST; i++, pCurAtr++)
-    {
-         if (pCurAtr->id == id)
-         {
-             paramNum = (PARAM_NUM)i;
-             break;
-         }
-    }
-    return paramNum;
+/**
+* Check whether values were written since ReadBegin()
+*
+* A reader that interrupted a writer will always be told to retry, so
+* readers running in interrupts must limit the number of retries.
+*
+* @param[in] seq Value returned by ReadBegin()
+* @return true if the values read may be inconsistent and must be read again
+*/
+bool Store::ReadRetry(uint32_t seq)
+{
+   __sync_synchronize();
+   return (seq & 1) != 0 || seq != __atomic_load_n(&writeSeq, __ATOMIC_RELAXED);
 }
 
 /**
-* Get the parameter attributes
+* Read several values that were all valid at the same time without disabling interrupts
 *
-* @param[in] ParamNum Parameter index
-* @return Parameter attributes
+* @param[in] params Parameter indexes to read
+* @param[out] out Receives the values in the order of params
+* @param[in] count Number of parameters
+* @return true if the values are consistent, false if writes kept interfering
+*         for PARAM_SNAPSHOT_TRIES attempts. out holds the last attempt then.
 */
-const Attributes *GetAttrib(PARAM_NUM ParamNum)
+bool Store::Snapshot(const PARAM_NUM* params, s32fp* out, int count)
 {
-    return &attribs[ParamNum];
+   bool consistent = false;
+
+   for (int tries = 0; tries < PARAM_SNAPSHOT_TRIES && !consistent; tries++)
+   {
+      uint32_t seq = ReadBegin();
+
+      //Copy the raw values, they are converted outside of the read section
+      for (int i = 0; i < count; i++)
+         out[i] = values[params[i]].integer;
+
+      consistent = !ReadRetry(seq);
+   }
+
+   for (int i = 0; i < count; i++)
+      out[i] = ToFixed(params[i], NativeValue((int32_t)out[i]));
+
+   return consistent;
 }
 
-/** Load default values for all parameters */
-void LoadDefaults()
+/**
+* Get the next entry of the change journal
+*
+* @param[in,out] seq Sequence number of the last entry seen, start with GetChangeSeq().
+*                    Advanced to the returned entry.
+* @return Parameter that changed with sequence number seq + 1,
+*         PARAM_LAST if there is no newer change,
+*         PARAM_INVALID if the entry has already been overwritten. The caller has
+*         to fall back to ChangedSince() on all parameters then.
+*/
+PARAM_NUM Store::NextChange(uint32_t& seq)
 {
-   const Attributes *curAtr = attribs;
+   uint32_t next = seq + 1;
 
-   for (int idx = 0; idx < PARAM_LAST; idx++, curAtr++)
+   if (seq == lastChangeSeq)
+      return PARAM_LAST;
+   if ((lastChangeSeq - next) >= PARAM_JOURNAL_SIZE)
+      return PARAM_INVALID;
+
+   seq = next;
+   return (PARAM_NUM)journal[next % PARAM_JOURNAL_SIZE];
+}
+
+bool Store::IsDirty(PARAM_NUM param)
+{
+   return (dirty[param / 32] & (1u << (param % 32))) != 0;
+}
+
+/**
+* Find the next dirty parameter
+*
+* @param[in] start Parameter index to start searching at
+* @return Index of the first dirty parameter at or after start, PARAM_LAST if there is none
+*/
+PARAM_NUM Store::NextDirty(int start)
+{
+   for (int word = start / 32; word < (PARAM_LAST + 31) / 32; word++)
    {
-      if (curAtr->id > 0)
-         SetFixed((PARAM_NUM)idx, curAtr->def);
+      //Mask off the parameters before start in the first word
+      uint32_t bits = dirty[word] & (~0u << (word == start / 32 ? start % 32 : 0));
+
+      if (bits != 0)
+      {
+         int param = word * 32 + __builtin_ctz(bits);
+         return param < PARAM_LAST ? (PARAM_NUM)param : PARAM_LAST;
+      }
    }
+   return PARAM_LAST;
 }
 
-void SetFlagsRaw(PARAM_NUM param, uint8_t rawFlags)
+void Store::ClearDirty(PARAM_NUM param)
 {
-   flags[param] = rawFlags;
+   //Other bits of the word may be set from an interrupt at the same time
+   __atomic_fetch_and(&dirty[param / 32], ~(1u << (param % 32)), __ATOMIC_RELAXED);
 }
 
-void SetFlag(PARAM_NUM param, PARAM_FLAG flag)
+void Store::ClearDirty()
 {
-   flags[param] |= (uint8_t)flag;
+   for (int word = 0; word < (PARAM_LAST + 31) / 32; word++)
+      __atomic_store_n(&dirty[word], 0, __ATOMIC_RELAXED);
 }
 
-void ClearFlag(PARAM_NUM param, PARAM_FLAG flag)
+/**
+* Store a native value, used by the templated setters in params.h
+*
+* @param[in] param Parameter index
+* @param[in] value Value in the native storage of param
+* @param[in] notify true to call the observer or Change() like Set() does
+*/
+void Store::StoreNative(PARAM_NUM param, NativeValue value, bool notify)
 {
-   flags[param] &= (uint8_t)~flag;
+   StoreValue(param, value);
+   if (notify) Notify(param);
 }
 
-PARAM_FLAG GetFlag(PARAM_NUM param)
+/**
+* Call a function instead of Change() when the parameter is set with Set()
+*
+* @param[in] param Parameter index
+* @param[in] observer Function to call, 0 to go back to Change()
+* @param[in] deferred false: call observer from within Set(), true: only record the
+*            change and call observer once from the next DeliverChanges()
+* @return true if registered, false if PARAM_MAX_OBSERVERS different observers exist
+*/
+bool Store::AddObserver(PARAM_NUM param, ChangeObserver observer, bool deferred)
 {
-   return (PARAM_FLAG)flags[param];
+   uint8_t index = 0;
+
+   if (0 != observer)
+   {
+      index = ObserverIndex(observer, deferred);
+      if (0 == index) return false;
+   }
+
+   observerOf[param] = index;
+   return true;
 }
 
-PARAM_TYPE GetType(PARAM_NUM param)
+/**
+* Register an observer for all parameters of a category
+*
+* @param[in] category Category name as given in PARAM_LIST
+* @param[in] observer Function to call, 0 to go back to Change()
+* @param[in] deferred See AddObserver(PARAM_NUM, ChangeObserver, bool)
+* @return Number of parameters in category, -1 if PARAM_MAX_OBSERVERS different observers exist
+*/
+int Store::AddObserver(const char* category, ChangeObserver observer, bool deferred)
 {
-   return (PARAM_TYPE)attribs[param].type;
+   int count = 0;
+
+   for (int i = 0; i < PARAM_LAST; i++)
+   {
+      if (0 != attribs[i].category && 0 == my_strcmp(attribs[i].category, category))
+      {
+         if (!AddObserver((PARAM_NUM)i, observer, deferred))
+            return -1;
+         count++;
+      }
+   }
+   return count;
 }
 
-uint32_t GetIdSum()
+/**
+* Call the deferred observers of all parameters that were set since the last call.
+* A parameter that was set several times is only delivered once.
+* Call this from a task, not from an interrupt.
+*/
+void Store::DeliverChanges()
 {
-#ifndef PARAM_ID_SUM_START_OFFSET
-#define PARAM_ID_SUM_START_OFFSET 0
-#endif // PARAM_ID_SUM_START_OFFSET
-#define PARAM_ENTRY(category, name, unit, min, max, def, id) id +
-#define TESTP_ENTRY(category, name, unit, min, max, def, id) id +
-#define VALUE_ENTRY(name, unit, id) id +
-   return PARAM_LIST PARAM_ID_SUM_START_OFFSET;
-#undef PARAM_ENTRY
-#undef TESTP_ENTRY
-#undef VALUE_ENTRY
+   for (int word = 0; word < (PARAM_LAST + 31) / 32; word++)
+   {
+      //Take all pending bits of this word at once, so none set by an interrupt is lost
+      uint32_t bits = __atomic_exchange_n(&pendingChanges[word], 0, __ATOMIC_RELAXED);
+
+      while (bits != 0)
+      {
+         int bit = __builtin_ctz(bits);
+         PARAM_NUM param = (PARAM_NUM)(word * 32 + bit);
+         uint8_t observer = observerOf[param];
+
+         bits &= bits - 1;
+
+         //The observer may have been removed since
+         if (0 != observer)
+            observers[observer - 1].func(param);
+      }
+   }
 }
 
 }
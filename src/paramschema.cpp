@@ -0,0 +1,98 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramschema.h"
+#include "params.h"
+#include "my_string.h"
+
+//Every entry starts with a comma, the first one is skipped when streaming.
+//__COUNTER__ provides the index of the entry, see static_assert below
+#define PARAM_ENTRY(category, name, unit, min, max, def, id, ...) \
+   ",\r\n   \"" #name "\": {\"unit\":\"" unit "\",\"id\":" #id ",\"isparam\":true,\"minimum\":" STRINGIFY(min) \
+   ",\"maximum\":" STRINGIFY(max) ",\"default\":" STRINGIFY(def) ",\"category\":\"" category "\",\"i\":" STRINGIFY(__COUNTER__) "}"
+#define TESTP_ENTRY(category, name, unit, min, max, def, id, ...) PARAM_ENTRY(category, name, unit, min, max, def, id)
+#define VALUE_ENTRY(name, unit, id, ...) \
+   ",\r\n   \"" #name "\": {\"unit\":\"" unit "\",\"id\":" #id ",\"isparam\":false,\"i\":" STRINGIFY(__COUNTER__) "}"
+static const char schema[] = PARAM_LIST;
+#undef PARAM_ENTRY
+#undef TESTP_ENTRY
+#undef VALUE_ENTRY
+
+static_assert(__COUNTER__ == Param::PARAM_LAST, "__COUNTER__ must not be used before the schema");
+
+static const char schemaStart[] = "{";
+static const char schemaEnd[] = "\r\n}\r\n";
+//Leave out the leading comma
+static const char* const pieces[] = { schemaStart, schema + (sizeof(schema) > 1), schemaEnd };
+#define NUM_PIECES (sizeof(pieces) / sizeof(pieces[0]))
+
+ParamSchema::ParamSchema()
+{
+   Rewind();
+}
+
+void ParamSchema::Rewind()
+{
+   piece = 0;
+   current = pieces[0];
+}
+
+int ParamSchema::Read(uint8_t* buf, int len)
+{
+   int count = 0;
+
+   while (count < len && piece < NUM_PIECES)
+   {
+      if (*current == 0)
+      {
+         piece++;
+         if (piece < NUM_PIECES) current = pieces[piece];
+      }
+      else
+      {
+         buf[count++] = *current++;
+      }
+   }
+   return count;
+}
+
+uint32_t ParamSchema::GetSize()
+{
+   return sizeof(schemaStart) - 1 + sizeof(schema) - 1 - (sizeof(schema) > 1) + sizeof(schemaEnd) - 1;
+}
+
+/** \brief Get content hash of the schema
+ * This is the parameter id sum hashed together with the document, so it
+ * changes when parameters are added, removed or have their attributes modified.
+ * \return 32-bit FNV-1a hash
+ */
+uint32_t ParamSchema::GetHash()
+{
+   static uint32_t hash = 0;
+
+   if (0 == hash)
+   {
+      uint32_t h = 2166136261U ^ Param::GetIdSum();
+
+      for (const char* c = schema; *c != 0; c++)
+         h = (h ^ (uint8_t)*c) * 16777619U;
+
+      hash = h;
+   }
+   return hash;
+}
@@ -0,0 +1,107 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramvalues.h"
+#include "cansdo.h"
+
+ParamValues::ParamValues()
+ : store(&Param::defaultStore), list(0), staging(0), count(0), pos(0), value(0)
+{
+}
+
+/** \brief Select the parameters to be transferred
+ *
+ * \param params list of parameter indexes, must stay valid while streaming. 0 to transfer the first count parameters in index order
+ * \param count number of entries in params
+ *
+ */
+void ParamValues::SetList(const uint16_t* params, int count)
+{
+   list = params;
+   this->count = count;
+   Rewind();
+}
+
+void ParamValues::Rewind()
+{
+   pos = 0;
+}
+
+int ParamValues::Read(uint8_t* buf, int len)
+{
+   int copied = 0;
+
+   for (; copied < len && pos < GetSize(); copied++, pos++)
+   {
+      uint8_t byteIdx = pos & 3;
+
+      //Sample the value once when we start sending it, so it can't tear
+      if (byteIdx == 0)
+         value = store->Get(GetParam(pos / 4));
+
+      buf[copied] = value >> (8 * byteIdx);
+   }
+
+   return copied;
+}
+
+uint32_t ParamValues::Begin(uint32_t size)
+{
+   pos = 0;
+   value = 0;
+
+   if (0 == staging) return SDO_ERR_READONLY;
+
+   return (size == 0 || size == GetSize()) ? 0 : SDO_ERR_LENGTH;
+}
+
+uint32_t ParamValues::Write(const uint8_t* buf, int len)
+{
+   for (int i = 0; i < len; i++, pos++)
+   {
+      uint8_t byteIdx = pos & 3;
+
+      if (pos >= GetSize())
+         return SDO_ERR_LENGTH;
+
+      value |= (uint32_t)buf[i] << (8 * byteIdx);
+
+      if (byteIdx == 3)
+      {
+         const Param::Attributes* attr = Param::GetAttrib(GetParam(pos / 4));
+
+         if ((s32fp)value < attr->min || (s32fp)value > attr->max)
+            return SDO_ERR_RANGE;
+         staging[pos / 4] = value;
+         value = 0;
+      }
+   }
+
+   return 0;
+}
+
+uint32_t ParamValues::End()
+{
+   if (pos != GetSize()) return SDO_ERR_LENGTH;
+
+   //All values are in range, apply them together
+   for (int i = 0; i < count; i++)
+      store->Set(GetParam(i), staging[i]);
+
+   return 0;
+}
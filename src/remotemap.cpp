@@ -0,0 +1,159 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "remotemap.h"
+
+#define WRITES_PER_ITEM 3
+
+RemoteMapBatch::RemoteMapBatch(CanSdo* sdo)
+ : canSdo(sdo), items(0), count(0), queued(0), completed(0), readPos(0), acknowledged(0), nodeId(0), done(true)
+{
+}
+
+/** \brief Start provisioning mappings on a remote node
+ *
+ * \param nodeId node to add the mappings to
+ * \param items mappings to add, result is filled in as they complete. Must stay valid until IsDone()
+ * \param count number of items
+ * \param asDownload true to send all items as one block download. This stops at the first failing item.
+ * \return true if started, false if a batch is still running or the SDO client queue is full
+ *
+ */
+bool RemoteMapBatch::Start(uint8_t nodeId, Item* items, int count, bool asDownload)
+{
+   if (!done) return false;
+
+   this->nodeId = nodeId;
+   this->items = items;
+   this->count = count;
+   queued = 0;
+   completed = 0;
+   acknowledged = 0;
+   done = false;
+
+   for (int i = 0; i < count; i++)
+      items[i].result = 0;
+
+   if (count == 0)
+   {
+      done = true;
+      return true;
+   }
+   else if (asDownload)
+   {
+      if (canSdo->SDOBlockDownloadAsync(nodeId, SDO_INDEX_MAP_LIST, 0, this, this))
+         return true;
+   }
+   else
+   {
+      //Only queue the first write here, the reply handler takes it from there.
+      //That way the queue is only ever refilled from one context.
+      QueueWrites(1);
+      if (queued > 0)
+         return true;
+   }
+
+   done = true;
+   return false;
+}
+
+/** \brief Get number of items that could not be added, only valid once IsDone()
+ */
+int RemoteMapBatch::GetFailures()
+{
+   int failures = 0;
+
+   for (int i = 0; i < count; i++)
+      failures += items[i].result != 0;
+
+   return failures;
+}
+
+void RemoteMapBatch::SdoComplete(uint8_t, uint16_t index, uint8_t, bool success, uint32_t data)
+{
+   if (index == SDO_INDEX_MAP_LIST)
+   {
+      if (!success)
+      {
+         //Records the server acknowledged have been added, it stopped at one of the
+         //others. Blocks are only acknowledged as a whole, so we report the abort for
+         //the first unacknowledged item. Items of the same block before the failing
+         //one were added nonetheless, later ones were not tried
+         int failed = acknowledged / CANMAP_RECORD_SIZE;
+
+         for (int i = failed; i < count; i++)
+            items[i].result = i == failed ? data : SDO_ERR_GENERAL;
+      }
+      done = true;
+   }
+   else
+   {
+      Item& item = items[completed / WRITES_PER_ITEM];
+
+      //Keep the first error, subsequent writes of the item fail as a consequence
+      if (!success && item.result == 0)
+         item.result = data;
+
+      completed++;
+      QueueWrites(REMOTEMAP_MAX_QUEUED);
+
+      //Nothing in flight means the client queue is occupied by somebody else, give up
+      for (int i = queued / WRITES_PER_ITEM; queued == completed && i < count; i++)
+         items[i].result = SDO_ERR_GENERAL;
+
+      done = queued == completed;
+   }
+}
+
+int RemoteMapBatch::Read(uint8_t* buf, int len)
+{
+   int copied = 0;
+
+   for (; copied < len && readPos < GetSize(); copied++, readPos++)
+   {
+      const Item& item = items[readPos / CANMAP_RECORD_SIZE];
+      uint32_t record[3];
+
+      CanMapStream::EncodeRecord(item.cobId, item.rx, item.mapping, record);
+      buf[copied] = ((uint8_t*)record)[readPos % CANMAP_RECORD_SIZE];
+   }
+
+   return copied;
+}
+
+void RemoteMapBatch::QueueWrites(int maxQueued)
+{
+   while (queued < (count * WRITES_PER_ITEM) && (queued - completed) < maxQueued)
+   {
+      const Item& item = items[queued / WRITES_PER_ITEM];
+      uint8_t subIndex = queued % WRITES_PER_ITEM;
+      uint32_t record[3];
+
+      //The three words of a record are just what the three SDO writes expect
+      CanMapStream::EncodeRecord(item.cobId, false, item.mapping, record);
+
+      //Count it first, the reply might come in before SDOWriteAsync() returns
+      queued++;
+
+      if (!canSdo->SDOWriteAsync(nodeId, item.rx ? SDO_INDEX_MAP_RX : SDO_INDEX_MAP_TX, subIndex, record[subIndex], this))
+      {
+         queued--;
+         break;
+      }
+   }
+}
@@ -20,6 +20,8 @@
 #include <libopencm3/cm3/scb.h>
 #include "sdocommands.h"
 #include "param_save.h"
+#include "errormessage.h"
+#include "paramschema.h"
 
 //Some functions use the "register" keyword which C++ doesn't like
 //We can safely ignore that as we don't even use those functions
@@ -30,13 +32,6 @@
 
 #define SDO_INDEX_SERIAL      0x5000
 #define SDO_INDEX_STRINGS     0x5001
-#define SDO_CMD_SAVE          0
-#define SDO_CMD_LOAD          1
-#define SDO_CMD_RESET         2
-#define SDO_CMD_DEFAULTS      3
-#define SDO_CMD_START         4
-#define SDO_CMD_STOP          5
-#define SDO_CMD_CLEAR_CAN     6
 
 bool SdoCommands::saveEnabled = true;
 CanMap* SdoCommands::canMap;
@@ -60,6 +55,9 @@ void SdoCommands::ProcessStandardCommands(CanSdo::SdoFrame* sdoFrame)
       case 3:
          sdoFrame->data = Param::GetIdSum();
          break;
+      case 4:
+         sdoFrame->data = ParamSchema::GetHash();
+         break;
       default:
          sdoFrame->cmd = SDO_ABORT;
          sdoFrame->data = SDO_ERR_INVIDX;
@@ -72,12 +70,11 @@ void SdoCommands::ProcessStandardCommands(CanSdo::SdoFrame* sdoFrame)
       switch (sdoFrame->subIndex)
       {
       case SDO_CMD_SAVE:
-         if (saveEnabled)
+         //The flash is written by FlashWriter, reject saving while the last save is still in progress
+         if (saveEnabled && !FlashWriter::IsBusy())
          {
-            cm_disable_interrupts();
             if (0 != canMap) canMap->Save();
             parm_save();
-            cm_enable_interrupts();
          }
          else
          {
@@ -102,6 +99,10 @@ void SdoCommands::ProcessStandardCommands(CanSdo::SdoFrame* sdoFrame)
       case SDO_CMD_CLEAR_CAN:
          if (0 != canMap) canMap->Clear();
          break;
+      case SDO_CMD_CLEAR_ERRLOG:
+         //Written to flash by the next ErrorMessage::SaveLog()
+         ErrorMessage::ClearLog();
+         break;
       default:
          sdoFrame->cmd = SDO_ABORT;
          sdoFrame->data = SDO_ERR_INVIDX;
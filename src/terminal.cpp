@@ -45,6 +45,7 @@ Terminal::Terminal(uint32_t usart, const TERM_CMD* commands, bool remap, bool ec
 :  usart(usart),
    remap(remap),
    termCmds(commands),
+   numHashes(0),
    nodeId(1),
    enabled(true),
    txDmaEnabled(true),
@@ -64,6 +65,10 @@ Terminal::Terminal(uint32_t usart, const TERM_CMD* commands, bool remap, bool ec
       hw++;
    }
 
+   //Hash the command names once so a lookup only compares strings on a hash match
+   for (const TERM_CMD *pCmd = termCmds; NULL != pCmd->cmd && numHashes < TERM_MAX_COMMANDS; pCmd++)
+      cmdHashes[numHashes++] = my_strhash(pCmd->cmd);
+
    defaultTerminal = this;
 
    gpio_set_mode(remap ? hw->port_re : hw->port, GPIO_MODE_OUTPUT_50_MHZ,
@@ -322,21 +327,27 @@ void Terminal::Echo(char* arg)
 const TERM_CMD* Terminal::CmdLookup(char *buf)
 {
    const TERM_CMD *pCmd = termCmds;
+   uint16_t hash = my_strhash(buf);
 
    if (!enabled) return NULL;
 
-   for (; NULL != pCmd->cmd; pCmd++)
+   for (uint8_t i = 0; i < numHashes; i++, pCmd++)
    {
-      if (0 == my_strcmp(buf, pCmd->cmd))
+      if (cmdHashes[i] == hash && 0 == my_strcmp(buf, pCmd->cmd))
       {
-         break;
+         return pCmd;
       }
    }
-   if (NULL == pCmd->cmd)
+
+   //Commands that did not fit into the hash table
+   for (; NULL != pCmd->cmd; pCmd++)
    {
-      pCmd = NULL;
+      if (0 == my_strcmp(buf, pCmd->cmd))
+      {
+         return pCmd;
+      }
    }
-   return pCmd;
+   return NULL;
 }
 
 void Terminal::Send(const char *str)
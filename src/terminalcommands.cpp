@@ -17,7 +17,6 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <libopencm3/cm3/scb.h>
-#include <libopencm3/stm32/desig.h>
 #include "hwdefs.h"
 #include "terminal.h"
 #include "params.h"
@@ -26,7 +25,13 @@
 #include "printf.h"
 #include "param_save.h"
 #include "canmap.h"
+#include "paramjson.h"
+#include "paramschema.h"
+#include "parambinary.h"
+#include "lzstream.h"
+#include "paramrecorder.h"
 #include "terminalcommands.h"
+#include "errormessage.h"
 
 //Some functions use the "register" keyword which C++ doesn't like
 //We can safely ignore that as we don't even use those functions
@@ -38,6 +43,8 @@
 static Terminal* curTerm = NULL;
 
 CanMap* TerminalCommands::canMap;
+ParamRecorder* TerminalCommands::recorder;
+Param::Store* TerminalCommands::paramStore = &Param::defaultStore;
 bool TerminalCommands::saveEnabled = true;
 
 void TerminalCommands::ParamSet(Terminal* term, char* arg)
@@ -63,7 +70,7 @@ void TerminalCommands::ParamSet(Terminal* term, char* arg)
 
    if (Param::PARAM_INVALID != idx)
    {
-       if (0 == Param::Set(idx, val))
+       if (0 == paramStore->Set(idx, val))
        {
           fprintf(term, "Set OK\r\n");
        }
@@ -97,7 +104,7 @@ void TerminalCommands::ParamGet(Terminal* term, char* arg)
 
       if (Param::PARAM_INVALID != idx)
       {
-         val = Param::Get(idx);
+         val = paramStore->Get(idx);
          fprintf(term, "%f\r\n", val);
       }
       else
@@ -149,11 +156,11 @@ void TerminalCommands::ParamFlag(Terminal* term, char *arg)
       {
          if (clearFlag)
          {
-            Param::ClearFlag(idx, flag);
+            paramStore->ClearFlag(idx, flag);
          }
          else
          {
-            Param::SetFlag(idx, flag);
+            paramStore->SetFlag(idx, flag);
          }
          fprintf(term, "Flag change OK\r\n");
       }
@@ -195,7 +202,7 @@ void TerminalCommands::ParamStream(Terminal* term, char *arg)
       comma = (char*)"";
       for (curIndex = 0; curIndex < maxIndex; curIndex++)
       {
-         s32fp val = Param::Get(indexes[curIndex]);
+         s32fp val = paramStore->Get(indexes[curIndex]);
          fprintf(term, "%s%f", comma, val);
          comma = (char*)",";
       }
@@ -231,7 +238,7 @@ void TerminalCommands::ParamStreamBinary(Terminal* term, char *arg)
    {
       for (curIndex = 0; curIndex < maxIndex; curIndex++)
       {
-         s32fp val = Param::Get(indexes[curIndex]);
+         s32fp val = paramStore->Get(indexes[curIndex]);
          buf[curIndex] = (uint32_t)val;
       }
 
@@ -244,46 +251,118 @@ void TerminalCommands::ParamStreamBinary(Terminal* term, char *arg)
 
 void TerminalCommands::PrintParamsJson(IPutChar* term, char *arg)
 {
+   ParamFilter filter;
    arg = my_trim(arg);
+   filter.Parse(arg); //Unknown options list everything
 
-   const Param::Attributes *pAtr;
-   char comma = ' ';
-   bool printHidden = arg[0] == 'h';
+   ParamJson json(canMap, filter.IncludeHidden());
+   uint8_t buf[16];
 
-   fprintf(term, "{");
-   for (uint32_t idx = 0; idx < Param::PARAM_LAST; idx++)
+   json.SetFilter(&filter);
+   json.SetStore(paramStore);
+   int len;
+
+   while ((len = json.Read(buf, sizeof(buf))) > 0)
+   {
+      for (int i = 0; i < len; i++)
+         term->PutChar(buf[i]);
+   }
+}
+
+//schema [hash]
+void TerminalCommands::PrintParamSchema(Terminal* term, char *arg)
+{
+   arg = my_trim(arg);
+
+   if (arg[0] == 'h')
+   {
+      fprintf(term, "%08X\r\n", ParamSchema::GetHash());
+   }
+   else
    {
-      uint32_t canId;
-      uint8_t canStart;
-      int8_t canLength, offset;
-      bool isRx;
-      float canGain;
-      pAtr = Param::GetAttrib((Param::PARAM_NUM)idx);
+      ParamSchema schema;
+      uint8_t buf[16];
+      int len;
 
-      if ((Param::GetFlag((Param::PARAM_NUM)idx) & Param::FLAG_HIDDEN) == 0 || printHidden)
+      while ((len = schema.Read(buf, sizeof(buf))) > 0)
       {
-         fprintf(term, "%c\r\n   \"%s\": {\"unit\":\"%s\",\"id\":%d,\"value\":%f,",comma, pAtr->name, pAtr->unit, pAtr->id, Param::Get((Param::PARAM_NUM)idx));
+         for (int i = 0; i < len; i++)
+            term->PutChar(buf[i]);
+      }
+   }
+}
 
-         if (canMap->FindMap((Param::PARAM_NUM)idx, canId, canStart, canLength, canGain, offset, isRx))
-         {
-            fprintf(term, "\"canid\":%d,\"canoffset\":%d,\"canlength\":%d,\"cangain\":%f,\"canadd\":%d,\"isrx\":%s,",
-                   canId, canStart, canLength, FP_FROMFLT(canGain), offset, isRx ? "true" : "false");
-         }
+//binjson [h][z]
+void TerminalCommands::PrintParamsBinary(Terminal* term, char *arg)
+{
+   ParamBinary binary;
 
-         if (Param::GetType((Param::PARAM_NUM)idx) == Param::TYPE_PARAM || Param::GetType((Param::PARAM_NUM)idx) == Param::TYPE_TESTPARAM)
-         {
-            fprintf(term, "\"isparam\":true,\"minimum\":%f,\"maximum\":%f,\"default\":%f,\"category\":\"%s\",\"i\":%d}",
-                   pAtr->min, pAtr->max, pAtr->def, pAtr->category, idx);
-         }
-         else
-         {
-            fprintf(term, "\"isparam\":false}");
-         }
-         comma = ',';
+   arg = my_trim(arg);
+   binary.SetPrintHidden(my_strchr(arg, 'h')[0] == 'h');
+   binary.SetStore(paramStore);
+
+   if (my_strchr(arg, 'z')[0] == 'z')
+   {
+      //Only takes up stack when compression was asked for
+      LzStream lz(&binary);
+      SendStream(term, &lz);
+   }
+   else
+   {
+      SendStream(term, &binary);
+   }
+}
+
+void TerminalCommands::SendStream(Terminal* term, IStreamSource* source)
+{
+   uint8_t buf[16];
+   int len;
+
+   source->Rewind();
+
+   while ((len = source->Read(buf, sizeof(buf))) > 0)
+      term->SendBinary(buf, len);
+}
+
+/** \brief Print the values that changed since a sequence number as JSON
+ * Argument is the "seq" value returned by the previous call, omit or pass 0 to get all values.
+ */
+void TerminalCommands::PrintChangedValues(Terminal* term, char *arg)
+{
+   uint32_t since = my_atou(my_trim(arg));
+   uint32_t seq = paramStore->GetChangeSeq();
+   const char* comma = "";
+
+   fprintf(term, "{\"seq\":%u,\"values\":{", seq);
+
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      Param::PARAM_NUM paramNum = (Param::PARAM_NUM)idx;
+
+      if (since == 0 || paramStore->ChangedSince(paramNum, since))
+      {
+         fprintf(term, "%s\"%s\":%f", comma, Param::GetAttrib(paramNum)->name, paramStore->Get(paramNum));
+         comma = ",";
       }
    }
-   fprintf(term, ",\r\n   \"serial\": {\"unit\":\"\",\"value\":\"%08X\",\"isparam\":false}", DESIG_UNIQUE_ID2);
-   fprintf(term, "\r\n}\r\n");
+   fprintf(term, "}}\r\n");
+}
+
+/** \brief Send the block captured by the recorder in binary, see ParamRecorder for the layout
+ * The sample count in the header is 0 while the capture is not complete.
+ */
+void TerminalCommands::SendRecording(Terminal* term, char *arg)
+{
+   uint8_t buf[16];
+   int len;
+   arg = arg;
+
+   if (0 == recorder) return;
+
+   recorder->Rewind();
+
+   while ((len = recorder->Read(buf, sizeof(buf))) > 0)
+      term->SendBinary(buf, len);
 }
 
 //cantx param id offset len gain
@@ -412,14 +491,20 @@ void TerminalCommands::SaveParameters(Terminal* term, char *arg)
 {
    arg = arg;
 
-   if (saveEnabled)
+   if (saveEnabled && FlashWriter::IsBusy())
+   {
+      fprintf(term, "Previous save still in progress, try again\r\n");
+   }
+   else if (saveEnabled)
    {
-      cm_disable_interrupts();
       canMap->Save();
       fprintf(term, "CANMAP stored\r\n");
       uint32_t crc = parm_save();
-      cm_enable_interrupts();
-      fprintf(term, "Parameters stored, CRC=%x\r\n", crc);
+
+      if (crc == PARM_SAVE_BUSY)
+         fprintf(term, "Previous save still in progress, try again\r\n");
+      else
+         fprintf(term, "Parameters stored, CRC=%x\r\n", crc);
    }
    else
    {
@@ -446,6 +531,36 @@ void TerminalCommands::LoadParameters(Terminal* term, char *arg)
    }
 }
 
+/** \brief Print count, first and last time of every error posted so far, "errlog clear" resets the log */
+void TerminalCommands::PrintErrorLog(Terminal* term, char *arg)
+{
+   bool empty = true;
+
+   arg = my_trim(arg);
+
+   if (my_strcmp("clear", arg) == 0)
+   {
+      ErrorMessage::ClearLog();
+      fprintf(term, "Error log cleared\r\n");
+      return;
+   }
+
+   for (int i = ERROR_NONE + 1; i < ERROR_MESSAGE_LAST; i++)
+   {
+      ERROR_MESSAGE_NUM err = (ERROR_MESSAGE_NUM)i;
+
+      if (ErrorMessage::GetCount(err) > 0)
+      {
+         fprintf(term, "%s: %u times, first [%u], last [%u]\r\n", ErrorMessage::GetName(err),
+                 ErrorMessage::GetCount(err), ErrorMessage::GetFirstTime(err), ErrorMessage::GetLastTime(err));
+         empty = false;
+      }
+   }
+
+   if (empty)
+      fprintf(term, "No Errors\r\n");
+}
+
 void TerminalCommands::Reset(Terminal* term, char *arg)
 {
    term = term;
@@ -0,0 +1,35 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2024 David J. Fiddes <D.J@fiddes.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Large parameter list to benchmark parameter lookups, 290 parameters and 10 values
+#define BENCH_P(n) PARAM_ENTRY("bench", benchparam##n, "", 0, 1000, 0, n)
+#define BENCH_V(n) VALUE_ENTRY(benchvalue##n, "", 20##n)
+#define BENCH_P10(t) BENCH_P(t##0) BENCH_P(t##1) BENCH_P(t##2) BENCH_P(t##3) BENCH_P(t##4) \
+                     BENCH_P(t##5) BENCH_P(t##6) BENCH_P(t##7) BENCH_P(t##8) BENCH_P(t##9)
+#define BENCH_P100(h) BENCH_P10(h##0) BENCH_P10(h##1) BENCH_P10(h##2) BENCH_P10(h##3) BENCH_P10(h##4) \
+                      BENCH_P10(h##5) BENCH_P10(h##6) BENCH_P10(h##7) BENCH_P10(h##8) BENCH_P10(h##9)
+
+#define PARAM_LIST \
+    BENCH_P10(1) BENCH_P10(2) BENCH_P10(3) BENCH_P10(4) BENCH_P10(5) \
+    BENCH_P10(6) BENCH_P10(7) BENCH_P10(8) BENCH_P10(9) \
+    BENCH_P100(1) BENCH_P100(2) \
+    BENCH_V(00) BENCH_V(01) BENCH_V(02) BENCH_V(03) BENCH_V(04) \
+    BENCH_V(05) BENCH_V(06) BENCH_V(07) BENCH_V(08) BENCH_V(09)
+
+extern const char* errorListString;
@@ -0,0 +1,85 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <iostream>
+#include "params.h"
+#include "my_string.h"
+
+//Benchmark of Param::NumFromString() against the linear scan it replaced
+using namespace std;
+
+static const int ROUNDS = 2000;
+
+void Param::Change(Param::PARAM_NUM)
+{
+}
+
+static Param::PARAM_NUM LinearNumFromString(const char *name)
+{
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      if (0 == my_strcmp(Param::GetAttrib((Param::PARAM_NUM)i)->name, name))
+         return (Param::PARAM_NUM)i;
+   }
+   return Param::PARAM_INVALID;
+}
+
+template <typename Lookup>
+static double NsPerLookup(Lookup lookup, const char* const* names, int count)
+{
+   volatile int sink = 0;
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+   for (int r = 0; r < ROUNDS; r++)
+   {
+      for (int i = 0; i < count; i++)
+         sink = sink + lookup(names[i]);
+   }
+
+   chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+   return elapsed.count() / ((double)ROUNDS * count);
+}
+
+int main()
+{
+   static const char* names[Param::PARAM_LAST + 2];
+   int count = 0;
+
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+      names[count++] = Param::GetAttrib((Param::PARAM_NUM)i)->name;
+
+   //Misses are the worst case for the linear scan
+   names[count++] = "nosuchparam";
+   names[count++] = "benchparam";
+
+   for (int i = 0; i < count; i++)
+   {
+      if (Param::NumFromString(names[i]) != LinearNumFromString(names[i]))
+      {
+         cout << "Lookup mismatch for " << names[i] << endl;
+         return -1;
+      }
+   }
+
+   cout << Param::PARAM_LAST << " parameters" << endl;
+   cout << "Linear scan:   " << NsPerLookup(LinearNumFromString, names, count) << " ns/lookup" << endl;
+   cout << "Hashed lookup: " << NsPerLookup(Param::NumFromString, names, count) << " ns/lookup" << endl;
+
+   return 0;
+}
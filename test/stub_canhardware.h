@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <array>
+#include <vector>
 
 class CanStub: public CanHardware
 {
@@ -34,6 +35,7 @@ class CanStub: public CanHardware
       m_canId = canId;
       memcpy(&m_data[0], &data[0], sizeof(m_data));
       m_len = len;
+      m_frames.push_back(m_data);
    }
    virtual void ConfigureFilters() {}
 
@@ -41,6 +43,7 @@ public:
    std::array<uint8_t, 8>  m_data;
    uint8_t                 m_len;
    uint32_t                m_canId;
+   std::vector<std::array<uint8_t, 8>> m_frames; //all frames sent so far
 };
 
 extern CanCallback* vcuCan;
@@ -16,7 +16,43 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#define _DEFAULT_SOURCE //for MAP_ANONYMOUS with -std=c99
 #include "stdint.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <libopencm3/stm32/flash.h>
+#include "hwdefs.h"
+
+// Typical STM32F1 timing, programming a word takes two half word cycles
+#define FLASH_ERASE_US 20000
+#define FLASH_PROGRAM_US 105
+
+// Time the emulated flash kept the bus busy in microseconds
+static uint32_t flashTime = 0;
+
+// Interrupt mask of the stubbed libopencm3/cm3/cortex.h
+uint32_t stub_primask = 0;
+
+// Flash is emulated with RAM mapped at the address of the real flash, so code
+// that reads it through pointers works unchanged. Programming can only clear
+// bits and erasing sets a page to 0xFF, like on NOR flash.
+__attribute__((constructor)) static void flash_init(void)
+{
+    //Never replace a mapping that happens to be there already. Kernels that
+    //don't know the flag treat the address as a hint, so check it as well
+    void* flash = mmap((void*)FLASH_BASE, FLASH_SIZE_KB * 1024, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (flash != (void*)FLASH_BASE)
+    {
+        fprintf(stderr, "Cannot map emulated flash at 0x%x\n", FLASH_BASE);
+        abort();
+    }
+
+    memset(flash, 0xff, FLASH_SIZE_KB * 1024);
+}
 
 void flash_unlock(void)
 {
@@ -32,29 +68,58 @@ void flash_set_ws(uint32_t ws)
 
 void flash_program_word(uint32_t address, uint32_t data)
 {
+    *(volatile uint32_t*)(uintptr_t)address &= data;
+    flashTime += FLASH_PROGRAM_US;
 }
 
 void flash_erase_page(uint32_t page_address)
 {
+    page_address &= ~(FLASH_PAGE_SIZE - 1);
+    memset((void*)(uintptr_t)page_address, 0xff, FLASH_PAGE_SIZE);
+    flashTime += FLASH_ERASE_US;
+}
+
+uint32_t flash_sim_get_time(void)
+{
+    return flashTime;
 }
 
 uint16_t desig_get_flash_size(void)
 {
-    return 8;
+    return FLASH_SIZE_KB;
+}
+
+void desig_get_unique_id(uint32_t *result)
+{
+    result[0] = 0x12345678;
+    result[1] = 0;
+    result[2] = 0;
 }
 
+// CRC-32 like the STM32 CRC unit: polynomial 0x04C11DB7, words MSB first, no final XOR
+static uint32_t crcState = 0xFFFFFFFF;
+
 uint32_t crc_calculate(uint32_t data)
 {
-    return 0xaa55;
+    crcState ^= data;
+
+    for (int bit = 0; bit < 32; bit++)
+        crcState = (crcState & 0x80000000) ? (crcState << 1) ^ 0x04C11DB7 : crcState << 1;
+
+    return crcState;
 }
 
 uint32_t crc_calculate_block(uint32_t *datap, int size)
 {
-    return 0xaaaa5555;
+    for (int i = 0; i < size; i++)
+        crc_calculate(datap[i]);
+
+    return crcState;
 }
 
 void crc_reset(void)
 {
+    crcState = 0xFFFFFFFF;
 }
 
 void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios)
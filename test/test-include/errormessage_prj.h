@@ -18,5 +18,7 @@
  */
 
 // Minimal error message definitions for unit tests
-#define ERROR_MESSAGE_LIST
+#define ERROR_MESSAGE_LIST \
+   ERROR_MESSAGE_ENTRY(OVERCURRENT, ERROR_STOP) \
+   ERROR_MESSAGE_ENTRY(HITEMP, ERROR_DERATE)
 #define ERROR_BUF_SIZE 10
@@ -22,7 +22,19 @@
 // Minimal project hardware defines to test libopeninv
 
 #define FLASH_PAGE_SIZE 1024
+#define FLASH_SIZE_KB 16 // emulated flash, test_flashwriter uses the first page
 
 #define CAN1_BLKNUM 2 // second to last block of 1k
+#define CAN1_BACKUP_BLKNUM 1 // last block
+
+#define USER_BLKNUM 5 // no backup, overwritten in place
+
+#define ERRLOG_BLKNUM 7
+#define ERRLOG_BACKUP_BLKNUM 6
+#define ERRLOG_JOURNAL_BLKNUM 9
+
+#define PARAM_BLKNUM 3 // third and fourth to last block of 1k
+#define PARAM_BLKSIZE 1024
+#define PARAM_LOG_PAGES 2
 
 #endif
\ No newline at end of file
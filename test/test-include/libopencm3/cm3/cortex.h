@@ -0,0 +1,19 @@
+#pragma once
+#include <libopencm3/cm3/common.h>
+
+// Host stub that tracks PRIMASK, so nested interrupt masking can be tested
+
+BEGIN_DECLS
+extern uint32_t stub_primask;
+END_DECLS
+
+static inline void cm_disable_interrupts(void) { stub_primask = 1; }
+static inline void cm_enable_interrupts(void) { stub_primask = 0; }
+static inline bool cm_is_masked_interrupts(void) { return stub_primask != 0; }
+
+static inline uint32_t cm_mask_interrupts(uint32_t mask)
+{
+    uint32_t old = stub_primask;
+    stub_primask = mask;
+    return old;
+}
@@ -18,10 +18,10 @@
  */
 
 // Minimal project parameters to test libopeninv
-/*              category     name         unit       min     max     default id */
+/*              category     name         unit       min     max     default id  storage */
 #define PARAM_LIST \
-    VALUE_ENTRY(amp,            "dig",   2013 ) \
-    VALUE_ENTRY(pot,            "dig",   2015 ) \
+    VALUE_ENTRY(amp,            "dig",   2013, STORAGE_FLOAT ) \
+    VALUE_ENTRY(pot,            "dig",   2015, STORAGE_INT ) \
     PARAM_ENTRY("inverter",   ocurlim,     "A",       -65536, 65536,  100,    22  )
 
 extern const char* errorListString;
\ No newline at end of file
@@ -627,6 +627,26 @@ static void send_map_by_index_sends_only_selected_message()
     ASSERT(!canMap->SendByIndex(MAX_MESSAGES));
 }
 
+static void map_uses_param_store()
+{
+    Param::Store node;
+
+    canMap->SetParamStore(&node);
+    canMap->AddSend(Param::ocurlim, CanId, 0, 8, 1.0, 0);
+    canMap->AddRecv(Param::amp, CanId + 1, 0, 8, 1.0, 0);
+    node.SetFloat(Param::ocurlim, 0x33);
+    Param::SetFloat(Param::ocurlim, 0x44);
+
+    canMap->SendAll();
+    ASSERT(FrameMatches({ 0x33, 0, 0, 0, 0, 0, 0, 0 }, 1));
+
+    std::array<uint8_t, 8> frame = { 7, 0, 0, 0, 0, 0, 0, 0 };
+    Param::SetInt(Param::amp, 0);
+    canStub->HandleRx(CanId + 1, (uint32_t*)&frame[0], 8);
+    ASSERT(node.GetInt(Param::amp) == 7);
+    ASSERT(Param::GetInt(Param::amp) == 0);
+}
+
 static void create_and_delete_complex_map_once()
 {
     canMap->AddSend(Param::amp, 257, 24, 8, -1.00, 0);
@@ -1221,4 +1241,5 @@ REGISTER_TEST(
     get_map_at_max_messages_returns_null,
     remove_at_max_messages_is_safe,
     send_map_by_index_sends_only_selected_message,
+    map_uses_param_store,
     RECEIVE_TESTS);
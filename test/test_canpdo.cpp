@@ -0,0 +1,179 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "canpdo.h"
+#include "canmap.h"
+#include "params.h"
+#include "stub_canhardware.h"
+#include "test.h"
+
+#include <memory>
+
+class CanPdoTest : public UnitTest
+{
+public:
+    explicit CanPdoTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+static std::unique_ptr<CanStub> canStub;
+static std::unique_ptr<CanMap> canMap;
+static std::unique_ptr<CanPdo> canPdo;
+
+static const uint32_t CobId = 0x181;
+
+void CanPdoTest::TestCaseSetup()
+{
+    canStub = std::make_unique<CanStub>();
+    canMap = std::make_unique<CanMap>(canStub.get(), false);
+    canPdo = std::make_unique<CanPdo>(canMap.get());
+    Param::LoadDefaults();
+    canMap->AddSend(Param::pot, CobId, 0, 16, 1);
+    canMap->AddSend(Param::amp, 0x182, 0, 16, 1);
+}
+
+static void SendSync()
+{
+    uint32_t data[2] = { 0, 0 };
+    canStub->HandleRx(PDO_SYNC_ID, data, 0);
+}
+
+static int FramesSent()
+{
+    return canStub->m_frames.size();
+}
+
+static void pdo_unconfigured_messages_sent_by_send_all()
+{
+    canPdo->Configure(CobId, 1);
+    canPdo->SendAll();
+
+    ASSERT(FramesSent() == 1);
+    ASSERT(canStub->m_canId == 0x182);
+}
+
+static void pdo_sent_on_every_nth_sync()
+{
+    canPdo->Configure(CobId, 2);
+
+    SendSync();
+    ASSERT(FramesSent() == 0);
+    SendSync();
+    ASSERT(FramesSent() == 1);
+    ASSERT(canStub->m_canId == CobId);
+    SendSync();
+    SendSync();
+    ASSERT(FramesSent() == 2);
+}
+
+static void pdo_acyclic_sync_only_on_change()
+{
+    canPdo->Configure(CobId, PDO_TYPE_SYNC_ACYCLIC);
+
+    SendSync();
+    ASSERT(FramesSent() == 0);
+    Param::SetInt(Param::pot, 5);
+    SendSync();
+    ASSERT(FramesSent() == 1);
+    ASSERT(canStub->m_data[0] == 5);
+    SendSync();
+    ASSERT(FramesSent() == 1);
+    canPdo->TriggerEvent(CobId);
+    SendSync();
+    ASSERT(FramesSent() == 2);
+}
+
+static void pdo_event_driven_respects_inhibit_time()
+{
+    canPdo->Configure(CobId, PDO_TYPE_EVENT, 100); //10 ms
+
+    canPdo->Tick(1);
+    ASSERT(FramesSent() == 0);
+    Param::SetInt(Param::pot, 5);
+    canPdo->Tick(1);
+    ASSERT(FramesSent() == 1);
+    Param::SetInt(Param::pot, 6);
+    canPdo->Tick(5);
+    ASSERT(FramesSent() == 1);
+    canPdo->Tick(5);
+    ASSERT(FramesSent() == 2);
+    ASSERT(canStub->m_data[0] == 6);
+}
+
+static void pdo_event_timer_forces_transmission()
+{
+    canPdo->Configure(CobId, PDO_TYPE_EVENT, 0, 50);
+
+    for (int i = 0; i < 4; i++)
+        canPdo->Tick(10);
+    ASSERT(FramesSent() == 0);
+    canPdo->Tick(10);
+    ASSERT(FramesSent() == 1);
+}
+
+static void pdo_sent_on_remote_request()
+{
+    uint32_t data[2] = { 0, 0 };
+
+    ASSERT(canPdo->Configure(CobId, PDO_TYPE_RTR));
+    ASSERT(vcuCanId == CobId);
+
+    canStub->HandleRx(CobId, data, 0);
+    ASSERT(FramesSent() == 0);
+    canStub->HandleRx(CobId | CAN_RTR_FLAG, data, 0);
+    ASSERT(FramesSent() == 1);
+    SendSync();
+    ASSERT(FramesSent() == 1);
+}
+
+static void pdo_configure_rejects_invalid()
+{
+    ASSERT(!canPdo->Configure(CobId, 241));
+    ASSERT(!canPdo->Configure(0x800, PDO_TYPE_RTR));
+    ASSERT(!canPdo->Configure(0, PDO_TYPE_EVENT));
+
+    uint8_t type;
+    uint16_t inhibitTime, eventTimer;
+    canPdo->GetConfig(CobId, type, inhibitTime, eventTimer);
+    ASSERT(type == PDO_TYPE_CYCLIC);
+}
+
+static void pdo_sync_id_changeable()
+{
+    canPdo->Configure(CobId, 1);
+    canPdo->SetSyncId(0x90);
+
+    SendSync();
+    ASSERT(FramesSent() == 0);
+
+    uint32_t data[2] = { 0, 0 };
+    canStub->HandleRx(0x90, data, 0);
+    ASSERT(FramesSent() == 1);
+}
+
+REGISTER_TEST(
+    CanPdoTest,
+    pdo_unconfigured_messages_sent_by_send_all,
+    pdo_sent_on_every_nth_sync,
+    pdo_acyclic_sync_only_on_change,
+    pdo_event_driven_respects_inhibit_time,
+    pdo_event_timer_forces_transmission,
+    pdo_sent_on_remote_request,
+    pdo_configure_rejects_invalid,
+    pdo_sync_id_changeable
+);
@@ -26,6 +26,7 @@ class IPutChar { public: virtual void PutChar(char c) = 0; };
 
 #include "cansdo.h"
 #include "canmap.h"
+#include "errormessage.h"
 #include "params.h"
 #include "my_fp.h"
 #include "stub_canhardware.h"
@@ -34,6 +35,10 @@ class IPutChar { public: virtual void PutChar(char c) = 0; };
 
 #include <memory>
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <vector>
 
 
 class CanSdoTest : public UnitTest
@@ -70,11 +75,23 @@ public:
 
 static std::unique_ptr<CanStub> canStub;
 static std::unique_ptr<CanMap>  canMap;
+static std::unique_ptr<CanPdo>  canPdo;
 static std::unique_ptr<UserSpaceCanSdo>  canSdo;
 CanMap* SdoCommands::canMap;
 
+int sdoSaveRequests = 0;
+static uint8_t importBuffer[64];
+static s32fp recorderBuffer[4];
+static ParamRecorder recorder;
+
 void SdoCommands::ProcessStandardCommands(CanSdo::SdoFrame* sdoFrame)
 {
+   if (sdoFrame->index == SDO_INDEX_COMMANDS && sdoFrame->subIndex == SDO_CMD_SAVE && sdoFrame->cmd == SDO_WRITE)
+   {
+      sdoSaveRequests++;
+      sdoFrame->cmd = SDO_WRITE_REPLY;
+      return;
+   }
    sdoFrame->cmd = SDO_ABORT;
    sdoFrame->data = SDO_ERR_INVIDX;
 }
@@ -83,7 +100,13 @@ void CanSdoTest::TestCaseSetup()
 {
     canStub = std::make_unique<CanStub>();
     canMap  = std::make_unique<CanMap>(canStub.get(), false);
+    canPdo  = std::make_unique<CanPdo>(canMap.get());
     canSdo  = std::make_unique<UserSpaceCanSdo>(canStub.get(), canMap.get());
+    canSdo->SetCanPdo(canPdo.get());
+    canSdo->SetImportBuffer(importBuffer, sizeof(importBuffer));
+    recorder.SetBuffer(recorderBuffer, 4);
+    recorder.SetChannels(0, 0);
+    canSdo->SetRecorder(&recorder);
     Param::LoadDefaults();
 }
 
@@ -103,6 +126,14 @@ static void SendSdoRequest(uint8_t cmd, uint16_t index, uint8_t subIndex, uint32
     canStub->HandleRx(SdoReqId, frame, 8);
 }
 
+// Send a raw 8 byte request, used for block transfer commands that don't fit SdoFrame
+static void SendRawRequest(std::array<uint8_t, 8> bytes)
+{
+    uint32_t frame[2];
+    memcpy(frame, bytes.data(), sizeof(frame));
+    canStub->HandleRx(SdoReqId, frame, 8);
+}
+
 // Access the last CAN frame sent by CanSdo as an SdoFrame
 static CanSdo::SdoFrame* GetReply()
 {
@@ -133,6 +164,47 @@ static void sdo_write_param()
     ASSERT(Param::Get(Param::ocurlim) == newVal);
 }
 
+static void sdo_param_store()
+{
+    Param::Store node;
+
+    canSdo->SetParamStore(&node);
+    node.SetFloat(Param::ocurlim, 12.0f);
+    Param::SetFloat(Param::ocurlim, 13.0f);
+    SendSdoRequest(SDO_READ, 0x2000, Param::ocurlim, 0);
+    ASSERT(GetReply()->data == (uint32_t)FP_FROMINT(12));
+
+    SendSdoRequest(SDO_WRITE, 0x2000, Param::ocurlim, (uint32_t)FP_FROMINT(14));
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    ASSERT(node.GetInt(Param::ocurlim) == 14);
+    ASSERT(Param::GetInt(Param::ocurlim) == 13);
+    canSdo->SetParamStore(&Param::defaultStore);
+}
+
+static std::vector<uint8_t> ReadAll(IStreamSource& source)
+{
+    std::vector<uint8_t> result(1024);
+    source.Rewind();
+    result.resize(source.Read(result.data(), result.size()));
+    return result;
+}
+
+static void sdo_param_store_applies_to_binary_table()
+{
+    Param::Store node;
+    ParamBinary binary, reference;
+
+    node.SetInt(Param::pot, 400);
+    reference.SetStore(&node);
+    canSdo->SetBinarySource(&binary);
+    canSdo->SetParamStore(&node);
+    ASSERT(ReadAll(binary) == ReadAll(reference));
+
+    canSdo->SetParamStore(&Param::defaultStore);
+    ASSERT(ReadAll(binary) != ReadAll(reference));
+    canSdo->SetBinarySource(nullptr);
+}
+
 static void sdo_write_param_out_of_range()
 {
     // ocurlim max is 65536; use a value clearly above it
@@ -302,6 +374,63 @@ static void sdo_add_tx_can_map_unknown_uid()
 // CAN map read/delete via SDO index 0x31xx
 // ---------------------------------------------------------------------------
 
+static void DownloadRecords(const uint32_t* words, int count)
+{
+    const uint8_t* bytes = (const uint8_t*)words;
+    int size = count * 4;
+    uint8_t toggle = 0;
+
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x3002, 0, size);
+
+    for (int pos = 0; pos < size && GetReply()->cmd != SDO_ABORT; pos += 7, toggle ^= SDO_TOGGLE_BIT)
+    {
+        std::array<uint8_t, 8> frame{};
+        int len = std::min(7, size - pos);
+        frame[0] = toggle | ((7 - len) << 1) | (pos + len == size ? SDO_LAST_SEGMENT : 0);
+        memcpy(&frame[1], bytes + pos, len);
+        SendRawRequest(frame);
+    }
+}
+
+static void sdo_download_can_map_list()
+{
+    const uint32_t records[] = {
+        0x200, MakeMapStep1(22, 0, 8), MakeMapStep2(1000, 0),
+        0x300 | CANMAP_RECORD_RX, MakeMapStep1(22, 8, 8), MakeMapStep2(1000, 0)
+    };
+    uint32_t canId;
+
+    DownloadRecords(records, 6);
+
+    ASSERT(GetReply()->cmd == (SDO_RESPONSE_DOWNLOAD_SEGMENT | SDO_TOGGLE_BIT)); //4 segments
+    ASSERT(canMap->GetMap(false, 0, 0, canId) != nullptr && canId == 0x200);
+    ASSERT(canMap->GetMap(true, 0, 0, canId) != nullptr && canId == 0x300);
+}
+
+static void sdo_download_can_map_list_invalid_record()
+{
+    const uint32_t records[] = {
+        0x200, MakeMapStep1(22, 0, 8), MakeMapStep2(1000, 0),
+        0x300, MakeMapStep1(1234, 8, 8), MakeMapStep2(1000, 0)
+    };
+    uint32_t canId;
+
+    DownloadRecords(records, 6);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->index == 0x3002);
+    ASSERT(GetReply()->data == SDO_ERR_INVIDX);
+    ASSERT(canMap->GetMap(false, 0, 0, canId) != nullptr); //records before stay added
+}
+
+static void sdo_download_can_map_list_wrong_size()
+{
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x3002, 0, 13);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_LENGTH);
+}
+
 static void sdo_read_tx_can_map_cobid()
 {
     const uint32_t cobId = 0x123;
@@ -374,7 +503,7 @@ static void sdo_read_rx_can_map_cobid()
 }
 
 // ---------------------------------------------------------------------------
-// Error message SDO (index 0x5003 / 0x5004)
+// Error message SDO (index 0x5003, 0x5004 and 0x5006 - 0x5008)
 // ---------------------------------------------------------------------------
 
 static void sdo_read_error_num()
@@ -411,6 +540,29 @@ static void sdo_write_error_time_aborts()
     ASSERT(GetReply()->data == SDO_ERR_INVIDX);
 }
 
+static void sdo_read_error_log()
+{
+    ErrorMessage::ClearLog();
+    ErrorMessage::UnpostAll();
+    ErrorMessage::SetTime(50);
+    ErrorMessage::Post(ERR_HITEMP);
+
+    SendSdoRequest(SDO_READ, 0x5006, ERR_HITEMP, 0);
+    ASSERT(GetReply()->cmd == SDO_READ_REPLY);
+    ASSERT(GetReply()->data == 1);
+
+    SendSdoRequest(SDO_READ, 0x5007, ERR_HITEMP, 0);
+    ASSERT(GetReply()->data == 50);
+
+    SendSdoRequest(SDO_READ, 0x5008, ERR_OVERCURRENT, 0);
+    ASSERT(GetReply()->cmd == SDO_READ_REPLY);
+    ASSERT(GetReply()->data == 0);
+
+    SendSdoRequest(SDO_READ, 0x5006, ERROR_MESSAGE_LAST, 0);
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_INVIDX);
+}
+
 // ---------------------------------------------------------------------------
 // Unknown SDO index goes to user space
 // ---------------------------------------------------------------------------
@@ -496,6 +648,945 @@ static void sdo_read_strings_initiates_print_request()
     ASSERT(canSdo->GetPrintRequest() == 3);
 }
 
+static void sdo_download_print_args()
+{
+    const char args[] = "c=inverter,n=5";
+    uint8_t toggle = 0;
+
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x5001, 0, sizeof(args) - 1);
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+
+    for (size_t pos = 0; pos < sizeof(args) - 1; pos += 7, toggle ^= SDO_TOGGLE_BIT)
+    {
+        std::array<uint8_t, 8> frame{};
+        int len = std::min<int>(7, sizeof(args) - 1 - pos);
+        frame[0] = toggle | ((7 - len) << 1) | (pos + len == sizeof(args) - 1 ? SDO_LAST_SEGMENT : 0);
+        memcpy(&frame[1], args + pos, len);
+        SendRawRequest(frame);
+    }
+
+    SendSdoRequest(SDO_READ, 0x5001, 0, 0);
+    ASSERT(strcmp(canSdo->GetPrintArgs(), args) == 0);
+
+    //Only valid for one print
+    SendSdoRequest(SDO_READ, 0x5001, 0, 0);
+    ASSERT(canSdo->GetPrintArgs()[0] == 0);
+}
+
+static void sdo_download_print_args_aborted()
+{
+    SendSdoRequest(SDO_WRITE | (1 << 2), 0x5001, 0, 'n' | ('=' << 8) | ('5' << 16));
+    SendSdoRequest(SDO_READ, 0x5001, 0, 0);
+    ASSERT(strcmp(canSdo->GetPrintArgs(), "n=5") == 0);
+
+    //Arguments are only taken from a download that completes
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x5001, 0, 14);
+    SendRawRequest({ 0, 'c', '=', 'i', 'n', 'v', 'e', 'r' });
+    SendSdoRequest(SDO_ABORT, 0x5001, 0, SDO_ERR_GENERAL);
+    SendSdoRequest(SDO_READ, 0x5001, 0, 0);
+    ASSERT(canSdo->GetPrintArgs()[0] == 0);
+
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x5001, 0, SDO_PRINT_ARGS_LEN);
+    SendSdoRequest(SDO_READ, 0x5001, 0, 0);
+    ASSERT(canSdo->GetPrintArgs()[0] == 0);
+}
+
+static void sdo_download_print_args_too_long()
+{
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x5001, 0, SDO_PRINT_ARGS_LEN);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_LENGTH);
+}
+
+// ---------------------------------------------------------------------------
+// Block upload of strings (SDO_INDEX_STRINGS = 0x5001)
+// ---------------------------------------------------------------------------
+
+static void InitiateBlockUpload(uint8_t blksize)
+{
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_CRC, 0x01, 0x50, 0, blksize, 0, 0, 0 });
+}
+
+static void PutString(const char* str)
+{
+    for (; *str; str++)
+        canSdo->PutChar(*str);
+}
+
+static void sdo_block_upload_initiate()
+{
+    InitiateBlockUpload(4);
+
+    ASSERT(canStub->m_canId == SdoRepId);
+    ASSERT(GetReply()->cmd == (SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_CRC));
+    ASSERT(GetReply()->index == 0x5001);
+    ASSERT(canSdo->GetPrintRequest() == 0);
+}
+
+static void sdo_block_upload_invalid_blksize()
+{
+    InitiateBlockUpload(SDO_BLOCK_SIZE + 1);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_BLKSIZE);
+}
+
+static void sdo_block_upload_invalid_index()
+{
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD, 0x00, 0x20, 0, 4, 0, 0, 0 });
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_INVIDX);
+}
+
+static void sdo_block_upload_single_block()
+{
+    InitiateBlockUpload(4);
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_START, 0, 0, 0, 0, 0, 0, 0 });
+    canStub->m_frames.clear();
+
+    PutString("Hello World!");
+    ASSERT(canStub->m_frames.empty()); //block not full, producer might continue
+
+    canSdo->TriggerTimeout(10);
+    canSdo->TriggerTimeout(10); //Producer stayed silent for an entire period
+
+    ASSERT(canStub->m_frames.size() == 2);
+    const std::array<uint8_t, 8> seg1 = { 1, 'H', 'e', 'l', 'l', 'o', ' ', 'W' };
+    const std::array<uint8_t, 8> seg2 = { SDO_BLOCK_LAST_SEG | 2, 'o', 'r', 'l', 'd', '!', 0, 0 };
+    ASSERT(canStub->m_frames[0] == seg1);
+    ASSERT(canStub->m_frames[1] == seg2);
+
+    //Acknowledge both segments, server ends the transfer with 2 unused bytes and the CRC
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_ACK, 2, 4, 0, 0, 0, 0, 0 });
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_END | (2 << 2)));
+    ASSERT(canStub->m_data[1] == 0xD3);
+    ASSERT(canStub->m_data[2] == 0x0C);
+}
+
+static void sdo_block_upload_full_block_sent_on_more_data()
+{
+    InitiateBlockUpload(1);
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_START, 0, 0, 0, 0, 0, 0, 0 });
+    canStub->m_frames.clear();
+
+    PutString("1234567");
+    ASSERT(canStub->m_frames.empty()); //Full, but we don't know yet whether it is the last block
+
+    //Producer is silent, so this is the end
+    canSdo->TriggerTimeout(10);
+    canSdo->TriggerTimeout(10);
+    ASSERT(canStub->m_frames.size() == 1);
+    ASSERT(canStub->m_frames[0][0] == (SDO_BLOCK_LAST_SEG | 1));
+    ASSERT(canStub->m_frames[0][7] == '7');
+}
+
+static void sdo_block_upload_retransmits_lost_segments()
+{
+    InitiateBlockUpload(4);
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_START, 0, 0, 0, 0, 0, 0, 0 });
+    PutString("Hello World!");
+    canSdo->TriggerTimeout(10);
+    canSdo->TriggerTimeout(10);
+    canStub->m_frames.clear();
+
+    //Only first segment received, the second one must open the next block
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_ACK, 1, 4, 0, 0, 0, 0, 0 });
+    ASSERT(canStub->m_frames.size() == 1);
+    const std::array<uint8_t, 8> seg = { SDO_BLOCK_LAST_SEG | 1, 'o', 'r', 'l', 'd', '!', 0, 0 };
+    ASSERT(canStub->m_frames[0] == seg);
+
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_ACK, 1, 4, 0, 0, 0, 0, 0 });
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_END | (2 << 2)));
+}
+
+static void sdo_block_upload_abort_stops_producer()
+{
+    InitiateBlockUpload(4);
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_START, 0, 0, 0, 0, 0, 0, 0 });
+    canStub->m_frames.clear();
+
+    SendSdoRequest(SDO_ABORT, 0x5001, 0, SDO_ERR_GENERAL);
+    ASSERT(canStub->m_frames.empty()); //aborts are not answered
+
+    PutString("Hello World!");
+    canSdo->TriggerTimeout(10);
+    canSdo->TriggerTimeout(10);
+    ASSERT(canStub->m_frames.empty());
+}
+
+// ---------------------------------------------------------------------------
+// String upload from a stream source
+// ---------------------------------------------------------------------------
+
+class StringSource : public IStreamSource
+{
+public:
+    explicit StringSource(const std::string& s) : str(s), pos(0) {}
+    void Rewind() override { pos = 0; }
+    int Read(uint8_t* buf, int len) override
+    {
+        int n = std::min((int)(str.size() - pos), len);
+        memcpy(buf, str.data() + pos, n);
+        pos += n;
+        return n;
+    }
+
+private:
+    std::string str;
+    size_t pos;
+};
+
+static const std::string longString = "The quick brown fox jumps over the lazy dog, twice: "
+                                      "The quick brown fox jumps over the lazy dog";
+
+static void sdo_segmented_upload_from_source()
+{
+    StringSource source(longString);
+    std::string received;
+    uint8_t toggle = 0;
+
+    canSdo->SetStringSource(1, &source);
+    SendSdoRequest(SDO_READ, 0x5001, 1, 0);
+    ASSERT(canSdo->GetPrintRequest() == -1); //main loop is not involved
+
+    while (true)
+    {
+        SendRawRequest({ (uint8_t)(SDO_REQUEST_SEGMENT | toggle), 0, 0, 0, 0, 0, 0, 0 });
+        uint8_t cmd = canStub->m_data[0];
+        int unused = (cmd & SDO_SIZE_SPECIFIED) ? (cmd >> 1) & 7 : 0;
+        received.append((char*)&canStub->m_data[1], 7 - unused);
+        toggle ^= SDO_TOGGLE_BIT;
+        if (cmd & SDO_SIZE_SPECIFIED) break;
+    }
+
+    ASSERT(received == longString);
+}
+
+static void sdo_block_upload_from_source()
+{
+    StringSource source(longString);
+    std::string received;
+    std::array<uint8_t, 8> lastSeg;
+
+    canSdo->SetStringSource(1, &source);
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_CRC, 0x01, 0x50, 1, 4, 0, 0, 0 });
+    canStub->m_frames.clear();
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_START, 0, 0, 0, 0, 0, 0, 0 });
+
+    //Blocks go out right away, no main loop and no timeout needed
+    for (int block = 0; block < 10; block++)
+    {
+        int segments = canStub->m_frames.size();
+        ASSERT(segments > 0 && segments <= 4);
+
+        for (auto& frame: canStub->m_frames)
+        {
+            received.append((char*)&frame[1], 7);
+            lastSeg = frame;
+        }
+
+        canStub->m_frames.clear();
+        SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_ACK, (uint8_t)segments, 4, 0, 0, 0, 0, 0 });
+
+        if (lastSeg[0] & SDO_BLOCK_LAST_SEG) break;
+    }
+
+    uint8_t endCmd = canStub->m_data[0];
+    int unused = (endCmd >> 2) & 7;
+    received.resize(received.size() - unused);
+    ASSERT((endCmd & ~(7 << 2)) == (SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_END));
+    ASSERT(received == longString);
+
+    uint16_t crc = 0;
+    for (char c: longString)
+    {
+        crc ^= (uint8_t)c << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    ASSERT(canStub->m_data[1] == (crc & 0xFF));
+    ASSERT(canStub->m_data[2] == (crc >> 8));
+}
+
+static void sdo_block_upload_source_ends_on_block_boundary()
+{
+    StringSource source("12345671234567"); //exactly one block of 2 segments
+
+    canSdo->SetStringSource(1, &source);
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD, 0x01, 0x50, 1, 2, 0, 0, 0 });
+    canStub->m_frames.clear();
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_START, 0, 0, 0, 0, 0, 0, 0 });
+
+    ASSERT(canStub->m_frames.size() == 2);
+    ASSERT(canStub->m_frames[1][0] == (SDO_BLOCK_LAST_SEG | 2));
+
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_ACK, 2, 2, 0, 0, 0, 0, 0 });
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_END));
+}
+
+// ---------------------------------------------------------------------------
+// Bulk parameter transfer (SDO_INDEX_BULK_LIST = 0x2300, SDO_INDEX_BULK_VALUES = 0x2301)
+// ---------------------------------------------------------------------------
+
+static void SetBulkList(std::initializer_list<uint16_t> uids)
+{
+    uint8_t subIndex = 1;
+
+    SendSdoRequest(SDO_WRITE, 0x2300, 0, 0);
+    for (uint16_t uid: uids)
+        SendSdoRequest(SDO_WRITE, 0x2300, subIndex++, uid);
+}
+
+// Run a segmented upload of the bulk values, return the received bytes
+static std::string SegmentedUpload(uint32_t& size, uint16_t index = 0x2301)
+{
+    std::string received;
+    uint8_t toggle = 0;
+
+    SendSdoRequest(SDO_READ, index, 0, 0);
+    size = GetReply()->data;
+
+    while (true)
+    {
+        SendRawRequest({ (uint8_t)(SDO_REQUEST_SEGMENT | toggle), 0, 0, 0, 0, 0, 0, 0 });
+        uint8_t cmd = canStub->m_data[0];
+        int unused = (cmd & SDO_SIZE_SPECIFIED) ? (cmd >> 1) & 7 : 0;
+        received.append((char*)&canStub->m_data[1], 7 - unused);
+        toggle ^= SDO_TOGGLE_BIT;
+        if (cmd & SDO_SIZE_SPECIFIED) break;
+    }
+    return received;
+}
+
+static void sdo_bulk_list_write_and_read()
+{
+    SetBulkList({ 22, 2015 });
+
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    SendSdoRequest(SDO_READ, 0x2300, 0, 0);
+    ASSERT(GetReply()->data == 2);
+    SendSdoRequest(SDO_READ, 0x2300, 2, 0);
+    ASSERT(GetReply()->cmd == SDO_READ_REPLY);
+    ASSERT(GetReply()->data == 2015);
+    SendSdoRequest(SDO_READ, 0x2300, 3, 0);
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+}
+
+static void sdo_bulk_list_unknown_uid()
+{
+    SetBulkList({ 22, 1234 });
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_RANGE);
+    SendSdoRequest(SDO_READ, 0x2300, 0, 0);
+    ASSERT(GetReply()->data == 1);
+}
+
+static void sdo_bulk_list_must_be_contiguous()
+{
+    SendSdoRequest(SDO_WRITE, 0x2300, 2, 22);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_INVIDX);
+    SendSdoRequest(SDO_WRITE, 0x2300, 0, 1); //can only shorten the list
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+}
+
+static void sdo_bulk_segmented_upload()
+{
+    uint32_t size;
+    Param::SetFloat(Param::ocurlim, 42.0f);
+    Param::SetInt(Param::amp, 1234);
+    SetBulkList({ 22, 2013, 22 });
+
+    std::string received = SegmentedUpload(size);
+
+    ASSERT(size == 12);
+    ASSERT(received.size() == 12);
+    ASSERT(*(int32_t*)&received[0] == FP_FROMFLT(42.0f));
+    ASSERT(*(int32_t*)&received[4] == FP_FROMINT(1234));
+    ASSERT(*(int32_t*)&received[8] == FP_FROMFLT(42.0f));
+}
+
+static void sdo_bulk_block_upload_indicates_size()
+{
+    Param::SetFloat(Param::ocurlim, 42.0f);
+    SetBulkList({ 22, 2013 });
+
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD, 0x01, 0x23, 0, 4, 0, 0, 0 });
+    ASSERT(GetReply()->cmd == (SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_SIZE_IND));
+    ASSERT(GetReply()->data == 8);
+
+    canStub->m_frames.clear();
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_START, 0, 0, 0, 0, 0, 0, 0 });
+    ASSERT(canStub->m_frames.size() == 2);
+    ASSERT(canStub->m_frames[1][0] == (SDO_BLOCK_LAST_SEG | 2));
+    ASSERT(*(int32_t*)&canStub->m_frames[0][1] == FP_FROMFLT(42.0f));
+
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_ACK, 2, 4, 0, 0, 0, 0, 0 });
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_END | (6 << 2)));
+}
+
+static void sdo_bulk_expedited_download()
+{
+    SetBulkList({ 22 });
+
+    SendSdoRequest(SDO_WRITE, 0x2301, 0, FP_FROMFLT(12.5f));
+
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    ASSERT(Param::Get(Param::ocurlim) == FP_FROMFLT(12.5f));
+}
+
+static void DownloadSegment(uint8_t toggle, bool last, const uint8_t* data, int len)
+{
+    std::array<uint8_t, 8> frame{};
+    frame[0] = toggle | ((7 - len) << 1) | (last ? SDO_LAST_SEGMENT : 0);
+    memcpy(&frame[1], data, len);
+    SendRawRequest(frame);
+}
+
+static void sdo_bulk_segmented_download()
+{
+    int32_t values[] = { FP_FROMFLT(12.5f), 0, FP_FROMFLT(-3.0f) };
+    const uint8_t* bytes = (const uint8_t*)values;
+    SetBulkList({ 22, 2015, 22 });
+
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x2301, 0, sizeof(values));
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    ASSERT(GetReply()->index == 0x2301);
+
+    DownloadSegment(0, false, bytes, 7);
+    ASSERT(canStub->m_data[0] == SDO_RESPONSE_DOWNLOAD_SEGMENT);
+    ASSERT(Param::Get(Param::ocurlim) == FP_FROMINT(100)); //nothing is applied before the last segment
+    DownloadSegment(SDO_TOGGLE_BIT, true, bytes + 7, 5);
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_DOWNLOAD_SEGMENT | SDO_TOGGLE_BIT));
+    ASSERT(Param::Get(Param::ocurlim) == FP_FROMFLT(-3.0f));
+}
+
+static void sdo_bulk_download_wrong_size()
+{
+    SetBulkList({ 22, 2015 });
+
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x2301, 0, 12);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_LENGTH);
+}
+
+static void sdo_bulk_download_out_of_range()
+{
+    int32_t values[] = { FP_FROMFLT(12.5f), FP_FROMINT(5) };
+    SetBulkList({ 22, 2015 });
+
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x2301, 0, sizeof(values));
+    DownloadSegment(0, false, (uint8_t*)values, 7);
+    DownloadSegment(SDO_TOGGLE_BIT, true, (uint8_t*)values + 7, 1);
+
+    //spot values can't be set to anything but 0
+    ASSERT(canStub->m_data[0] == SDO_ABORT);
+    ASSERT(GetReply()->index == 0x2301);
+    ASSERT(GetReply()->data == SDO_ERR_RANGE);
+    //The valid first value is not applied either
+    ASSERT(Param::Get(Param::ocurlim) == FP_FROMINT(100));
+}
+
+static void sdo_bulk_download_toggle_error()
+{
+    int32_t values[] = { FP_FROMFLT(12.5f), 0 };
+    SetBulkList({ 22, 2015 });
+
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x2301, 0, sizeof(values));
+    DownloadSegment(SDO_TOGGLE_BIT, false, (uint8_t*)values, 7);
+
+    ASSERT(canStub->m_data[0] == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_TOGGLE);
+
+    //Transfer is gone
+    DownloadSegment(0, true, (uint8_t*)values, 1);
+    ASSERT(GetReply()->data == SDO_ERR_CMD);
+}
+
+static void sdo_read_all_values()
+{
+    Param::SetInt(Param::pot, 77);
+
+    SendSdoRequest(SDO_READ, 0x2302, 0, 0);
+    ASSERT(GetReply()->data == Param::PARAM_LAST * 4);
+
+    std::string received;
+    uint8_t toggle = 0;
+    while (true)
+    {
+        SendRawRequest({ (uint8_t)(SDO_REQUEST_SEGMENT | toggle), 0, 0, 0, 0, 0, 0, 0 });
+        uint8_t cmd = canStub->m_data[0];
+        received.append((char*)&canStub->m_data[1], 7 - ((cmd & SDO_SIZE_SPECIFIED) ? (cmd >> 1) & 7 : 0));
+        toggle ^= SDO_TOGGLE_BIT;
+        if (cmd & SDO_SIZE_SPECIFIED) break;
+    }
+
+    ASSERT(received.size() == Param::PARAM_LAST * 4);
+    ASSERT(*(int32_t*)&received[4 * Param::pot] == FP_FROMINT(77));
+    ASSERT(*(int32_t*)&received[4 * Param::ocurlim] == Param::Get(Param::ocurlim));
+}
+
+static void sdo_write_all_values_aborts()
+{
+    SendSdoRequest(SDO_WRITE, 0x2302, 0, 0);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_READONLY);
+}
+
+static void sdo_read_delta_values()
+{
+    uint32_t size;
+
+    SendSdoRequest(SDO_WRITE, 0x2303, 0, Param::GetChangeSeq());
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    Param::SetInt(Param::pot, Param::GetInt(Param::pot) + 1);
+
+    std::string received = SegmentedUpload(size, 0x2303);
+
+    ASSERT(size == 0);
+    ASSERT(received.size() == 4 + 6);
+    ASSERT(*(uint32_t*)&received[0] == Param::GetChangeSeq());
+    ASSERT(*(uint16_t*)&received[4] == Param::pot);
+    ASSERT(*(int32_t*)&received[6] == Param::Get(Param::pot));
+
+    //Nothing changed since the sequence number we just received
+    SendSdoRequest(SDO_WRITE, 0x2303, 0, *(uint32_t*)&received[0]);
+    received = SegmentedUpload(size, 0x2303);
+    ASSERT(received.size() == 4);
+}
+
+static void sdo_block_upload_delta_values()
+{
+    SendSdoRequest(SDO_WRITE, 0x2303, 0, 0);
+    SendRawRequest({ SDO_REQUEST_BLOCK_UPLOAD | SDO_BLOCK_INITIATE, 0x03, 0x23, 0, 16, 0, 0, 0 });
+
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_UPLOAD | SDO_BLOCK_INITIATE));
+}
+
+static void sdo_write_and_read_tpdo_config()
+{
+    canMap->AddSend(Param::pot, 0x123, 0, 16, 1);
+
+    SendSdoRequest(SDO_READ, 0x1800, 1, 0);
+    ASSERT(GetReply()->cmd == SDO_READ_REPLY);
+    ASSERT(GetReply()->data == 0x123);
+    SendSdoRequest(SDO_READ, 0x1800, 2, 0);
+    ASSERT(GetReply()->data == PDO_TYPE_CYCLIC);
+
+    SendSdoRequest(SDO_WRITE, 0x1800, 2, PDO_TYPE_EVENT);
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    SendSdoRequest(SDO_WRITE, 0x1800, 5, 100);
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+
+    uint8_t type;
+    uint16_t inhibitTime, eventTimer;
+    canPdo->GetConfig(0x123, type, inhibitTime, eventTimer);
+    ASSERT(type == PDO_TYPE_EVENT);
+    ASSERT(eventTimer == 100);
+}
+
+static void sdo_write_tpdo_config_errors()
+{
+    canMap->AddSend(Param::pot, 0x123, 0, 16, 1);
+
+    SendSdoRequest(SDO_WRITE, 0x1800, 2, 245);
+    ASSERT(GetReply()->data == SDO_ERR_RANGE);
+    SendSdoRequest(SDO_WRITE, 0x1800, 1, 0x124);
+    ASSERT(GetReply()->data == SDO_ERR_READONLY);
+    SendSdoRequest(SDO_READ, 0x1801, 2, 0);
+    ASSERT(GetReply()->data == SDO_ERR_INVIDX);
+}
+
+static void sdo_write_sync_id()
+{
+    SendSdoRequest(SDO_WRITE, 0x1005, 0, 0x81);
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    ASSERT(canPdo->GetSyncId() == 0x81);
+}
+
+// Parameter import blob that sets ocurlim, see ParamImport
+static std::vector<uint8_t> MakeImportBlob(s32fp value)
+{
+    std::vector<uint8_t> blob = { 'O', 'C', PARAMIMPORT_VERSION, 0, 1, 0, 0, 0, 22, 0 };
+
+    for (int i = 0; i < 4; i++)
+        blob.push_back((uint32_t)value >> (8 * i));
+    uint32_t crc = ParamImport::Crc32(0, blob.data(), blob.size());
+    for (int i = 0; i < 4; i++)
+        blob.push_back(crc >> (8 * i));
+    return blob;
+}
+
+static uint16_t BlockCrc(const std::vector<uint8_t>& data)
+{
+    uint16_t crc = 0;
+
+    for (uint8_t c: data)
+    {
+        crc ^= (uint16_t)c << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static void BlockDownloadSegment(uint8_t seq, bool last, const uint8_t* data, int len)
+{
+    std::array<uint8_t, 8> frame{};
+    frame[0] = seq | (last ? SDO_BLOCK_LAST_SEG : 0);
+    memcpy(&frame[1], data, len);
+    SendRawRequest(frame);
+}
+
+static void InitiateBlockDownload(uint32_t size)
+{
+    SendRawRequest({ SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_CRC | SDO_BLOCK_SIZE_IND, 0x05, 0x50, 0,
+                     (uint8_t)size, (uint8_t)(size >> 8), 0, 0 });
+}
+
+static void sdo_block_download_import()
+{
+    std::vector<uint8_t> blob = MakeImportBlob(FP_FROMINT(200));
+    uint16_t crc = BlockCrc(blob);
+
+    ASSERT(blob.size() == 18);
+    InitiateBlockDownload(blob.size());
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_CRC));
+    ASSERT(canStub->m_data[4] == SDO_BLOCK_SIZE);
+
+    size_t frames = canStub->m_frames.size();
+    BlockDownloadSegment(1, false, &blob[0], 7);
+    BlockDownloadSegment(2, false, &blob[7], 7);
+    ASSERT(canStub->m_frames.size() == frames); //segments within a block are not answered
+
+    BlockDownloadSegment(3, true, &blob[14], 4);
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK));
+    ASSERT(canStub->m_data[1] == 3);
+    ASSERT(Param::GetInt(Param::ocurlim) == 100); //applied only after the end command
+
+    SendRawRequest({ SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_END | (3 << 2), (uint8_t)crc, (uint8_t)(crc >> 8), 0, 0, 0, 0, 0 });
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_END));
+    ASSERT(Param::GetInt(Param::ocurlim) == 200);
+
+    //Back to regular requests
+    SendSdoRequest(SDO_READ, 0x2000, Param::ocurlim, 0);
+    ASSERT(GetReply()->cmd == SDO_READ_REPLY);
+}
+
+static void sdo_block_download_lost_segment()
+{
+    std::vector<uint8_t> blob = MakeImportBlob(FP_FROMINT(300));
+    uint16_t crc = BlockCrc(blob);
+
+    InitiateBlockDownload(blob.size());
+    BlockDownloadSegment(1, false, &blob[0], 7);
+    BlockDownloadSegment(3, true, &blob[14], 4); //segment 2 got lost
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK));
+    ASSERT(canStub->m_data[1] == 1);
+
+    //Client continues after the acknowledged segment, starting a new block
+    BlockDownloadSegment(1, false, &blob[7], 7);
+    BlockDownloadSegment(2, true, &blob[14], 4);
+    ASSERT(canStub->m_data[1] == 2);
+
+    SendRawRequest({ SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_END | (3 << 2), (uint8_t)crc, (uint8_t)(crc >> 8), 0, 0, 0, 0, 0 });
+    ASSERT(canStub->m_data[0] == (SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_END));
+    ASSERT(Param::GetInt(Param::ocurlim) == 300);
+}
+
+static void sdo_block_download_crc_error()
+{
+    std::vector<uint8_t> blob = MakeImportBlob(FP_FROMINT(200));
+    uint16_t crc = BlockCrc(blob) ^ 1;
+
+    InitiateBlockDownload(blob.size());
+    BlockDownloadSegment(1, false, &blob[0], 7);
+    BlockDownloadSegment(2, false, &blob[7], 7);
+    BlockDownloadSegment(3, true, &blob[14], 4);
+    SendRawRequest({ SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_END | (3 << 2), (uint8_t)crc, (uint8_t)(crc >> 8), 0, 0, 0, 0, 0 });
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->index == 0x5005);
+    ASSERT(GetReply()->data == SDO_ERR_CRC);
+    ASSERT(Param::GetInt(Param::ocurlim) == 100);
+}
+
+static void sdo_block_download_too_large()
+{
+    InitiateBlockDownload(sizeof(importBuffer) + 1);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_LENGTH);
+}
+
+static void sdo_block_download_times_out()
+{
+    InitiateBlockDownload(18);
+    canSdo->TriggerTimeout(1000);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_TIMEOUT);
+    SendSdoRequest(SDO_READ, 0x2000, Param::ocurlim, 0);
+    ASSERT(GetReply()->cmd == SDO_READ_REPLY);
+}
+
+static void sdo_segmented_download_import()
+{
+    std::vector<uint8_t> blob = MakeImportBlob(FP_FROMINT(250));
+
+    SendSdoRequest(SDO_REQUEST_DOWNLOAD | SDO_SIZE_SPECIFIED, 0x5005, 0, blob.size());
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    DownloadSegment(0, false, &blob[0], 7);
+    DownloadSegment(SDO_TOGGLE_BIT, false, &blob[7], 7);
+    DownloadSegment(0, true, &blob[14], 4);
+    ASSERT(canStub->m_data[0] == SDO_RESPONSE_DOWNLOAD_SEGMENT);
+    ASSERT(Param::GetInt(Param::ocurlim) == 250);
+}
+
+static void sdo_read_import_aborts()
+{
+    SendSdoRequest(SDO_READ, 0x5005, 0, 0);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(GetReply()->data == SDO_ERR_WRITEONLY);
+}
+
+static void sdo_read_schema()
+{
+    ParamSchema schema;
+    SendSdoRequest(SDO_READ, 0x5001, SDO_STRINGS_SCHEMA, 0);
+
+    ASSERT(GetReply()->data == schema.GetSize());
+    ASSERT(canSdo->GetPrintRequest() == -1); //served from flash
+    SendRawRequest({ SDO_REQUEST_SEGMENT, 0, 0, 0, 0, 0, 0, 0 });
+    ASSERT(memcmp(&canStub->m_data[1], "{\r\n   \"a", 7) == 0);
+}
+
+// ---------------------------------------------------------------------------
+// SDO client
+// ---------------------------------------------------------------------------
+
+class ClientCallback: public SdoClientCallback
+{
+public:
+    void SdoComplete(uint8_t nodeId, uint16_t index, uint8_t subIndex, bool success, uint32_t data) override
+    {
+        calls++;
+        lastNode = nodeId;
+        lastIndex = index;
+        lastSubIndex = subIndex;
+        lastSuccess = success;
+        lastData = data;
+    }
+
+    int calls = 0;
+    uint8_t lastNode = 0;
+    uint16_t lastIndex = 0;
+    uint8_t lastSubIndex = 0;
+    bool lastSuccess = false;
+    uint32_t lastData = 0;
+};
+
+// Simulate a reply from a remote server
+static void SendServerReply(uint8_t nodeId, uint8_t cmd, uint16_t index, uint8_t subIndex, uint32_t data)
+{
+    uint32_t frame[2];
+    CanSdo::SdoFrame* sdo = (CanSdo::SdoFrame*)frame;
+    sdo->cmd      = cmd;
+    sdo->index    = index;
+    sdo->subIndex = subIndex;
+    sdo->data     = data;
+    canStub->HandleRx(0x580 + nodeId, frame, 8);
+}
+
+static void sdo_client_requests_to_different_nodes_in_flight()
+{
+    ClientCallback cb;
+
+    ASSERT(canSdo->SDOWriteAsync(2, 0x2000, 1, 10, &cb));
+    ASSERT(canStub->m_canId == 0x602);
+    ASSERT(canSdo->SDOWriteAsync(3, 0x2000, 1, 20, &cb));
+    ASSERT(canStub->m_canId == 0x603);
+    ASSERT(GetReply()->data == 20);
+    ASSERT(vcuCanId == 0x580); //one filter for all nodes
+    ASSERT(canSdo->GetPendingRequests() == 2);
+
+    SendServerReply(3, SDO_WRITE_REPLY, 0x2000, 1, 0);
+    ASSERT(cb.calls == 1 && cb.lastNode == 3 && cb.lastSuccess);
+    SendServerReply(2, SDO_WRITE_REPLY, 0x2000, 1, 0);
+    ASSERT(cb.calls == 2 && cb.lastNode == 2 && cb.lastSuccess);
+    ASSERT(canSdo->GetPendingRequests() == 0);
+}
+
+static void sdo_client_requests_to_same_node_queued()
+{
+    ClientCallback cb;
+
+    canSdo->SDOWriteAsync(2, 0x2000, 1, 10, &cb);
+    canSdo->SDOReadAsync(2, 0x2000, 2, &cb);
+    ASSERT(canStub->m_frames.size() == 1);
+
+    SendServerReply(2, SDO_WRITE_REPLY, 0x2000, 1, 0);
+    ASSERT(canStub->m_frames.size() == 2);
+    ASSERT(GetReply()->cmd == SDO_READ && GetReply()->subIndex == 2);
+
+    SendServerReply(2, SDO_READ_REPLY | (2 << 2), 0x2000, 2, 0xAAAA1234); //2 byte reply
+    ASSERT(cb.calls == 2 && cb.lastSuccess);
+    ASSERT(cb.lastData == 0x1234);
+}
+
+static void sdo_client_rejects_stray_reply()
+{
+    ClientCallback cb;
+
+    canSdo->SDOReadAsync(2, 0x2000, 1, &cb);
+    SendServerReply(2, SDO_READ_REPLY, 0x2000, 5, 0);
+    SendServerReply(4, SDO_READ_REPLY, 0x2000, 1, 0);
+    ASSERT(cb.calls == 0);
+
+    SendServerReply(2, SDO_READ_REPLY, 0x2000, 1, 42);
+    ASSERT(cb.calls == 1 && cb.lastData == 42);
+}
+
+static void sdo_client_abort_reply()
+{
+    ClientCallback cb;
+
+    canSdo->SDOWriteAsync(2, 0x2000, 1, 10, &cb);
+    SendServerReply(2, SDO_ABORT, 0x2000, 1, SDO_ERR_RANGE);
+
+    ASSERT(cb.calls == 1 && !cb.lastSuccess);
+    ASSERT(cb.lastData == SDO_ERR_RANGE);
+}
+
+static void sdo_client_timeout()
+{
+    ClientCallback cb;
+
+    canSdo->SDOWriteAsync(2, 0x2000, 1, 10, &cb, 50);
+    canSdo->SDOWriteAsync(2, 0x2000, 2, 10, &cb, 50);
+    canSdo->TriggerTimeout(40);
+    ASSERT(cb.calls == 0);
+
+    canSdo->TriggerTimeout(10);
+    ASSERT(cb.calls == 1 && !cb.lastSuccess && cb.lastSubIndex == 1);
+    ASSERT(cb.lastData == SDO_ERR_TIMEOUT);
+    //Server is told to give up, then the next request goes out
+    ASSERT(canStub->m_frames.size() == 3);
+    ASSERT(canStub->m_frames[1][0] == SDO_ABORT);
+    ASSERT(GetReply()->cmd == SDO_WRITE && GetReply()->subIndex == 2);
+
+    //Late reply to the first request is ignored
+    SendServerReply(2, SDO_WRITE_REPLY, 0x2000, 1, 0);
+    ASSERT(cb.calls == 1);
+}
+
+static void sdo_client_queue_full()
+{
+    for (int i = 0; i < SDO_CLIENT_QUEUE_LEN; i++)
+        ASSERT(canSdo->SDOWriteAsync(2, 0x2000, i, 10, nullptr));
+
+    ASSERT(!canSdo->SDOWriteAsync(3, 0x2000, 1, 10, nullptr));
+}
+
+static void sdo_client_sync_read_rejects_stray_reply()
+{
+    uint32_t data;
+
+    canSdo->SDORead(2, 0x2000, 1);
+    SendServerReply(2, SDO_READ_REPLY, 0x2000, 3, 55);
+    ASSERT(!canSdo->SDOReadReply(data));
+
+    SendServerReply(2, SDO_READ_REPLY, 0x2000, 1, 42);
+    ASSERT(canSdo->SDOReadReply(data));
+    ASSERT(data == 42);
+}
+
+// Simulate a block download reply, those don't carry index and sub index
+static void SendServerBlockReply(uint8_t nodeId, uint8_t cmd, uint8_t ackSeq, uint8_t blockSize)
+{
+    uint32_t frame[2] = { (uint32_t)(cmd | (ackSeq << 8) | (blockSize << 16)), 0 };
+    canStub->HandleRx(0x580 + nodeId, frame, 8);
+}
+
+// Download sources must know their size
+class SizedSource : public StringSource
+{
+public:
+    explicit SizedSource(const std::string& s) : StringSource(s), size(s.size()) {}
+    uint32_t GetSize() override { return size; }
+
+private:
+    uint32_t size;
+};
+
+static void sdo_client_block_download()
+{
+    ClientCallback cb;
+    SizedSource source("0123456789ABCDEFGHIJ");
+    std::vector<uint8_t> data = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+                                  'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J' };
+    uint16_t crc = BlockCrc(data);
+
+    ASSERT(canSdo->SDOBlockDownloadAsync(2, 0x5005, 0, &source, &cb));
+    ASSERT(GetReply()->cmd == (SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_CRC | SDO_BLOCK_SIZE_IND));
+    ASSERT(GetReply()->index == 0x5005);
+    ASSERT(GetReply()->data == 20);
+
+    SendServerReply(2, SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_CRC, 0x5005, 0, 2);
+    ASSERT(canStub->m_frames.size() == 3);
+    ASSERT(canStub->m_frames[1][0] == 1 && canStub->m_frames[1][1] == '0');
+    ASSERT(canStub->m_frames[2][0] == 2 && canStub->m_frames[2][1] == '7');
+
+    SendServerBlockReply(2, SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK, 2, 2);
+    ASSERT(canStub->m_frames.size() == 4);
+    ASSERT(canStub->m_data[0] == (1 | SDO_BLOCK_LAST_SEG));
+    ASSERT(canStub->m_data[1] == 'E');
+
+    SendServerBlockReply(2, SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK, 1, 2);
+    ASSERT(canStub->m_data[0] == (SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_END | (1 << 2)));
+    ASSERT(canStub->m_data[1] == (crc & 0xFF));
+    ASSERT(canStub->m_data[2] == (crc >> 8));
+    ASSERT(cb.calls == 0);
+
+    SendServerBlockReply(2, SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_END, 0, 0);
+    ASSERT(cb.calls == 1 && cb.lastSuccess && cb.lastIndex == 0x5005);
+    ASSERT(canSdo->GetPendingRequests() == 0);
+}
+
+static void sdo_client_block_download_resends_lost_segments()
+{
+    ClientCallback cb;
+    SizedSource source("0123456789ABCDEFGHIJ");
+
+    canSdo->SDOBlockDownloadAsync(2, 0x5005, 0, &source, &cb);
+    SendServerReply(2, SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_CRC, 0x5005, 0, 2);
+
+    //Server only got the first segment, the next block starts with the second
+    SendServerBlockReply(2, SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK, 1, 3);
+    ASSERT(canStub->m_frames.size() == 5);
+    ASSERT(canStub->m_frames[3][0] == 1 && canStub->m_frames[3][1] == '7');
+    ASSERT(canStub->m_frames[4][0] == (2 | SDO_BLOCK_LAST_SEG) && canStub->m_frames[4][1] == 'E');
+}
+
+static void sdo_client_block_download_refuses_large_blocks()
+{
+    ClientCallback cb;
+    SizedSource source("0123456789");
+
+    canSdo->SDOBlockDownloadAsync(2, 0x5005, 0, &source, &cb);
+    SendServerReply(2, SDO_RESPONSE_BLOCK_DOWNLOAD, 0x5005, 0, SDO_BLOCK_SIZE + 1);
+
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    ASSERT(cb.calls == 1 && !cb.lastSuccess && cb.lastData == SDO_ERR_BLKSIZE);
+}
+
 // ---------------------------------------------------------------------------
 // Parameter flags via SDO index SDO_INDEX_PARAM_FLAGS (0x2200)
 // ---------------------------------------------------------------------------
@@ -558,10 +1649,69 @@ static void sdo_write_param_flags_invalid_index()
 // Test registration
 // ---------------------------------------------------------------------------
 
+static void sdo_recorder_configure_and_upload()
+{
+    SendSdoRequest(SDO_WRITE, 0x2304, 0x11, 2015);
+    ASSERT(GetReply()->cmd == SDO_ABORT);
+    SendSdoRequest(SDO_WRITE, 0x2304, 0x10, 2015);
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    SendSdoRequest(SDO_WRITE, 0x2304, 0x11, 22);
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    SendSdoRequest(SDO_READ, 0x2304, 7, 0);
+    ASSERT(GetReply()->data == 2);
+    SendSdoRequest(SDO_READ, 0x2304, 0x11, 0);
+    ASSERT(GetReply()->data == 22);
+    SendSdoRequest(SDO_READ, 0x2304, 8, 0);
+    ASSERT(GetReply()->data == 2);
+
+    SendSdoRequest(SDO_WRITE, 0x2304, 3, 1);
+    SendSdoRequest(SDO_WRITE, 0x2304, 5, 2015);
+    SendSdoRequest(SDO_WRITE, 0x2304, 6, FP_FROMINT(5));
+    SendSdoRequest(SDO_WRITE, 0x2304, 4, ParamRecorder::TRIG_ABOVE);
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    ASSERT(recorder.GetTriggerParam() == Param::pot);
+    SendSdoRequest(SDO_WRITE, 0x2304, 1, 1);
+    ASSERT(GetReply()->cmd == SDO_WRITE_REPLY);
+    SendSdoRequest(SDO_READ, 0x2304, 1, 0);
+    ASSERT(GetReply()->data == ParamRecorder::STATE_ARMED);
+
+    for (int i = 4; i <= 7; i++)
+    {
+        Param::SetInt(Param::pot, i);
+        recorder.Sample();
+    }
+    ASSERT(recorder.GetState() == ParamRecorder::STATE_DONE);
+
+    uint32_t size;
+    std::string received = SegmentedUpload(size, 0x2304);
+
+    ASSERT(size == RECORDER_HEADER_SIZE + 4 + 2 * 8);
+    ASSERT(received.size() == size);
+    ASSERT(*(uint16_t*)&received[2] == 2);
+    ASSERT(*(int32_t*)&received[12] == FP_FROMINT(5));
+    ASSERT(*(int32_t*)&received[20] == FP_FROMINT(6));
+}
+
+static void sdo_recorder_invalid_writes()
+{
+    SendSdoRequest(SDO_WRITE, 0x2304, 0, 0);
+    ASSERT(GetReply()->data == SDO_ERR_READONLY);
+    SendSdoRequest(SDO_WRITE, 0x2304, 1, 1);
+    ASSERT(GetReply()->data == SDO_ERR_RANGE);
+    SendSdoRequest(SDO_WRITE, 0x2304, 4, ParamRecorder::TRIG_LAST);
+    ASSERT(GetReply()->data == SDO_ERR_RANGE);
+    SendSdoRequest(SDO_WRITE, 0x2304, 0x10, 4444);
+    ASSERT(GetReply()->data == SDO_ERR_RANGE);
+    SendSdoRequest(SDO_READ, 0x2304, 0x10, 0);
+    ASSERT(GetReply()->data == SDO_ERR_INVIDX);
+}
+
 REGISTER_TEST(
     CanSdoTest,
     sdo_read_param,
     sdo_write_param,
+    sdo_param_store,
+    sdo_param_store_applies_to_binary_table,
     sdo_write_param_out_of_range,
     sdo_read_invalid_param_index,
     sdo_write_invalid_param_index,
@@ -572,6 +1722,9 @@ REGISTER_TEST(
     sdo_add_rx_can_map,
     sdo_add_tx_can_map_invalid_cobid,
     sdo_add_tx_can_map_unknown_uid,
+    sdo_download_can_map_list,
+    sdo_download_can_map_list_invalid_record,
+    sdo_download_can_map_list_wrong_size,
     sdo_read_tx_can_map_cobid,
     sdo_read_tx_can_map_item,
     sdo_read_tx_can_map_out_of_range,
@@ -581,14 +1734,65 @@ REGISTER_TEST(
     sdo_read_error_time,
     sdo_write_error_num_aborts,
     sdo_write_error_time_aborts,
+    sdo_read_error_log,
     sdo_unknown_index_goes_to_user_space,
     sdo_reply_sent_via_send_sdo_reply,
     sdo_request_ignored_for_wrong_node_id,
     sdo_request_processed_after_set_node_id,
     sdo_read_strings_initiates_print_request,
+    sdo_download_print_args,
+    sdo_download_print_args_aborted,
+    sdo_download_print_args_too_long,
+    sdo_block_upload_initiate,
+    sdo_block_upload_invalid_blksize,
+    sdo_block_upload_invalid_index,
+    sdo_block_upload_single_block,
+    sdo_block_upload_full_block_sent_on_more_data,
+    sdo_block_upload_retransmits_lost_segments,
+    sdo_block_upload_abort_stops_producer,
+    sdo_segmented_upload_from_source,
+    sdo_block_upload_from_source,
+    sdo_block_upload_source_ends_on_block_boundary,
+    sdo_bulk_list_write_and_read,
+    sdo_bulk_list_unknown_uid,
+    sdo_bulk_list_must_be_contiguous,
+    sdo_bulk_segmented_upload,
+    sdo_bulk_block_upload_indicates_size,
+    sdo_bulk_expedited_download,
+    sdo_bulk_segmented_download,
+    sdo_bulk_download_wrong_size,
+    sdo_bulk_download_out_of_range,
+    sdo_bulk_download_toggle_error,
+    sdo_read_all_values,
+    sdo_write_all_values_aborts,
+    sdo_read_schema,
+    sdo_client_requests_to_different_nodes_in_flight,
+    sdo_client_requests_to_same_node_queued,
+    sdo_client_rejects_stray_reply,
+    sdo_client_abort_reply,
+    sdo_client_timeout,
+    sdo_client_queue_full,
+    sdo_client_sync_read_rejects_stray_reply,
+    sdo_client_block_download,
+    sdo_client_block_download_resends_lost_segments,
+    sdo_client_block_download_refuses_large_blocks,
     sdo_read_param_flags_default,
     sdo_write_and_read_param_flags,
     sdo_write_param_flags_clear,
     sdo_read_param_flags_invalid_index,
-    sdo_write_param_flags_invalid_index
+    sdo_write_param_flags_invalid_index,
+    sdo_read_delta_values,
+    sdo_block_upload_delta_values,
+    sdo_write_and_read_tpdo_config,
+    sdo_write_tpdo_config_errors,
+    sdo_write_sync_id,
+    sdo_block_download_import,
+    sdo_block_download_lost_segment,
+    sdo_block_download_crc_error,
+    sdo_block_download_too_large,
+    sdo_block_download_times_out,
+    sdo_segmented_download_import,
+    sdo_read_import_aborts,
+    sdo_recorder_configure_and_upload,
+    sdo_recorder_invalid_writes
 );
@@ -0,0 +1,264 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdint>
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/cm3/cortex.h>
+#include "errormessage.h"
+#include "flashstore.h"
+#include "hwdefs.h"
+#include "test.h"
+
+extern "C" uint32_t flash_sim_get_time(void);
+
+static uint32_t BlockAddress(uint32_t blockNum)
+{
+    return FLASH_BASE + FLASH_SIZE_KB * 1024 - blockNum * FLASH_PAGE_SIZE;
+}
+
+class ErrorMessageTest : public UnitTest
+{
+public:
+    explicit ErrorMessageTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+void ErrorMessageTest::TestCaseSetup()
+{
+    FlashWriter::Flush();
+    FlashWriter::SetBackground(false);
+    flash_erase_page(BlockAddress(ERRLOG_BLKNUM));
+    flash_erase_page(BlockAddress(ERRLOG_BACKUP_BLKNUM));
+    flash_erase_page(BlockAddress(ERRLOG_JOURNAL_BLKNUM));
+    //Forget the journal of the previous test
+    ErrorMessage::LoadLog();
+    ErrorMessage::ClearLog();
+    ErrorMessage::UnpostAll();
+    ErrorMessage::SetTime(100);
+}
+
+static void post_counts_and_stamps()
+{
+    ErrorMessage::Post(ERR_OVERCURRENT);
+    ErrorMessage::SetTime(200);
+    ErrorMessage::Post(ERR_OVERCURRENT); //Still posted
+    ErrorMessage::UnpostAll();
+    ErrorMessage::Post(ERR_OVERCURRENT);
+
+    ASSERT(ErrorMessage::GetCount(ERR_OVERCURRENT) == 2);
+    ASSERT(ErrorMessage::GetFirstTime(ERR_OVERCURRENT) == 100);
+    ASSERT(ErrorMessage::GetLastTime(ERR_OVERCURRENT) == 200);
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 0);
+}
+
+static void errors_are_posted_independently()
+{
+    ErrorMessage::Post(ERR_HITEMP);
+    ErrorMessage::Post(ERR_OVERCURRENT);
+
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 1);
+    ASSERT(ErrorMessage::GetCount(ERR_OVERCURRENT) == 1);
+    ASSERT(ErrorMessage::GetLastError() == ERR_OVERCURRENT);
+}
+
+static void post_from_masked_section()
+{
+    //Like a control interrupt that already masked the others
+    cm_mask_interrupts(1);
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(stub_primask == 1);
+    cm_mask_interrupts(0);
+
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(stub_primask == 0);
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 1);
+    ASSERT(ErrorMessage::GetPostCount() > 0);
+}
+
+static void log_survives_reset()
+{
+    ErrorMessage::Post(ERR_HITEMP);
+    ErrorMessage::SetTime(300);
+    ErrorMessage::UnpostAll();
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+    //Nothing new to save
+    ASSERT(ErrorMessage::SaveLog() == 0);
+
+    ErrorMessage::ClearLog();
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 0);
+
+    ASSERT(ErrorMessage::LoadLog());
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 2);
+    ASSERT(ErrorMessage::GetFirstTime(ERR_HITEMP) == 100);
+    ASSERT(ErrorMessage::GetLastTime(ERR_HITEMP) == 300);
+}
+
+static void save_waits_for_previous_commit()
+{
+    FlashWriter::SetBackground(true);
+    ErrorMessage::Post(ERR_OVERCURRENT);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+
+    ErrorMessage::SetTime(200);
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(ErrorMessage::SaveLog() == -1);
+
+    FlashWriter::Flush();
+    ASSERT(ErrorMessage::SaveLog() == 1);
+    FlashWriter::Flush();
+    FlashWriter::SetBackground(false);
+
+    ErrorMessage::ClearLog();
+    ASSERT(ErrorMessage::LoadLog());
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 1);
+    ASSERT(ErrorMessage::GetCount(ERR_OVERCURRENT) == 1);
+}
+
+static void journal_append_does_not_erase()
+{
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+
+    uint32_t start = flash_sim_get_time();
+    ErrorMessage::SetTime(200);
+    ErrorMessage::Post(ERR_OVERCURRENT);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+    //Less than one page erase
+    ASSERT(flash_sim_get_time() - start < 20000);
+
+    ErrorMessage::ClearLog();
+    ASSERT(ErrorMessage::LoadLog());
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 1);
+    ASSERT(ErrorMessage::GetFirstTime(ERR_HITEMP) == 100);
+    ASSERT(ErrorMessage::GetCount(ERR_OVERCURRENT) == 1);
+    ASSERT(ErrorMessage::GetFirstTime(ERR_OVERCURRENT) == 200);
+    ASSERT(ErrorMessage::GetLastTime(ERR_OVERCURRENT) == 200);
+}
+
+static void full_journal_is_compacted()
+{
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+
+    int erasingSaves = 0;
+
+    for (uint32_t i = 0; i <= ERRLOG_JOURNAL_RECORDS; i++)
+    {
+        uint32_t start = flash_sim_get_time();
+        ErrorMessage::SetTime(200 + i);
+        ErrorMessage::UnpostAll();
+        ErrorMessage::Post(ERR_HITEMP);
+        ASSERT(ErrorMessage::SaveLog() == 1);
+
+        if (flash_sim_get_time() - start >= 20000)
+            erasingSaves++;
+    }
+
+    //Only the last save found the journal full
+    ASSERT(erasingSaves == 1);
+
+    ErrorMessage::ClearLog();
+    ASSERT(ErrorMessage::LoadLog());
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == ERRLOG_JOURNAL_RECORDS + 2);
+    ASSERT(ErrorMessage::GetFirstTime(ERR_HITEMP) == 100);
+    ASSERT(ErrorMessage::GetLastTime(ERR_HITEMP) == 200 + ERRLOG_JOURNAL_RECORDS);
+}
+
+static void corrupted_journal_record_is_ignored()
+{
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+    ErrorMessage::SetTime(200);
+    ErrorMessage::UnpostAll();
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+    ErrorMessage::Post(ERR_OVERCURRENT);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+
+    //Count of the second record, after the 2 word header and the first record of 5 words
+    flash_program_word(BlockAddress(ERRLOG_JOURNAL_BLKNUM) + (2 + 5 + 1) * 4, ~1u);
+
+    ErrorMessage::ClearLog();
+    ASSERT(ErrorMessage::LoadLog());
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 2);
+    ASSERT(ErrorMessage::GetLastTime(ERR_HITEMP) == 200);
+    ASSERT(ErrorMessage::GetCount(ERR_OVERCURRENT) == 0);
+
+    //The next record goes after the damaged one
+    ErrorMessage::UnpostAll();
+    ErrorMessage::Post(ERR_OVERCURRENT);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+
+    ErrorMessage::ClearLog();
+    ASSERT(ErrorMessage::LoadLog());
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 2);
+    ASSERT(ErrorMessage::GetCount(ERR_OVERCURRENT) == 1);
+}
+
+static void interrupted_compaction_keeps_previous_log()
+{
+    const uint32_t* journal = (const uint32_t*)(uintptr_t)BlockAddress(ERRLOG_JOURNAL_BLKNUM);
+
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+
+    for (uint32_t i = 0; i < ERRLOG_JOURNAL_RECORDS; i++)
+    {
+        ErrorMessage::UnpostAll();
+        ErrorMessage::Post(ERR_OVERCURRENT);
+        ASSERT(ErrorMessage::SaveLog() == 1);
+    }
+
+    //Reset while the log is committed
+    FlashWriter::SetBackground(true);
+    ErrorMessage::UnpostAll();
+    ErrorMessage::Post(ERR_HITEMP);
+    ASSERT(ErrorMessage::SaveLog() == 1);
+    FlashWriter::Run();
+
+    ErrorMessage::ClearLog();
+    ASSERT(ErrorMessage::LoadLog());
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 1);
+    ASSERT(ErrorMessage::GetCount(ERR_OVERCURRENT) == ERRLOG_JOURNAL_RECORDS);
+
+    //Reset after the journal was erased
+    while (journal[0] != 0xFFFFFFFF && FlashWriter::Run()) {}
+    ASSERT(journal[0] == 0xFFFFFFFF);
+
+    ErrorMessage::ClearLog();
+    ASSERT(ErrorMessage::LoadLog());
+    ASSERT(ErrorMessage::GetCount(ERR_HITEMP) == 2);
+    ASSERT(ErrorMessage::GetCount(ERR_OVERCURRENT) == ERRLOG_JOURNAL_RECORDS);
+
+    FlashWriter::Flush();
+    FlashWriter::SetBackground(false);
+}
+
+REGISTER_TEST(
+    ErrorMessageTest,
+    post_counts_and_stamps,
+    errors_are_posted_independently,
+    post_from_masked_section,
+    log_survives_reset,
+    save_waits_for_previous_commit,
+    journal_append_does_not_erase,
+    full_journal_is_compacted,
+    corrupted_journal_record_is_ignored,
+    interrupted_compaction_keeps_previous_log
+);
@@ -0,0 +1,452 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdint>
+#include <memory>
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/cm3/cortex.h>
+#include "flashstore.h"
+#include "canmap.h"
+#include "stub_canhardware.h"
+#include "hwdefs.h"
+#include "test.h"
+
+extern "C" uint32_t flash_sim_get_time(void);
+
+class FlashStoreTest : public UnitTest
+{
+public:
+    explicit FlashStoreTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+static const int DataWords = 8;
+
+//A section as the application would define it
+struct TestSection
+{
+    uint32_t data[DataWords];
+    uint32_t loaded[DataWords];
+    uint16_t loadedVersion;
+    int migrations;
+    uint32_t image[DataWords];
+};
+
+static TestSection user, other, log;
+
+static uint32_t Serialize(void* context, uint32_t* image, uint32_t maxWords)
+{
+    TestSection* section = (TestSection*)context;
+
+    for (int i = 0; i < DataWords && i < (int)maxWords; i++)
+        image[i] = section->data[i];
+    return DataWords;
+}
+
+static bool Load(void* context, uint16_t version, const uint32_t* data, uint32_t words)
+{
+    TestSection* section = (TestSection*)context;
+
+    section->loadedVersion = version;
+    for (int i = 0; i < DataWords && i < (int)words; i++)
+        section->loaded[i] = data[i];
+    return words == DataWords;
+}
+
+static bool Migrate(void* context, uint32_t)
+{
+    ((TestSection*)context)->migrations++;
+    return false;
+}
+
+static FlashStore::Client userClient = { 1, Serialize, Load, Migrate, &user, user.image, DataWords };
+//Takes the place of the CAN map, the store does not care about the content
+static FlashStore::Client otherClient = { 1, Serialize, Load, Migrate, &other, other.image, DataWords };
+//Takes the place of the error log
+static FlashStore::Client logClient = { 1, Serialize, Load, Migrate, &log, log.image, DataWords };
+
+static uint32_t BlockAddress(int blockNum)
+{
+    return FLASH_BASE + FLASH_SIZE_KB * 1024 - blockNum * FLASH_PAGE_SIZE;
+}
+
+static uint32_t* BlockData(int blockNum)
+{
+    return (uint32_t*)(uintptr_t)BlockAddress(blockNum);
+}
+
+static uint32_t FooterAddress(int blockNum)
+{
+    return BlockAddress(blockNum) + FLASH_PAGE_SIZE - FLASHSTORE_FOOTER_WORDS * 4;
+}
+
+void FlashStoreTest::TestCaseSetup()
+{
+    const int blocks[] = { CAN1_BLKNUM, CAN1_BACKUP_BLKNUM, USER_BLKNUM, ERRLOG_BLKNUM, ERRLOG_BACKUP_BLKNUM };
+
+    for (int blockNum : blocks)
+        flash_erase_page(BlockAddress(blockNum));
+
+    //Write right away, FlashWriter is tested on its own
+    FlashWriter::Flush();
+    FlashWriter::SetBackground(false);
+    user = TestSection();
+    other = TestSection();
+    log = TestSection();
+    userClient.version = 1;
+    FlashStore::Register(FlashStore::SECTION_USER, &userClient);
+    FlashStore::Register(FlashStore::SECTION_CANMAP, 0);
+    FlashStore::Register(FlashStore::SECTION_ERRORLOG, 0);
+}
+
+static void load_without_data_migrates()
+{
+    ASSERT(!FlashStore::Load(FlashStore::SECTION_USER));
+    ASSERT(user.migrations == 1);
+}
+
+static void commit_and_load()
+{
+    user.data[0] = 1234;
+    user.data[7] = 5678;
+
+    ASSERT(FlashStore::Commit() == 1);
+    ASSERT(FlashStore::GetStatus() == 0);
+    ASSERT(FlashStore::Load(FlashStore::SECTION_USER));
+    ASSERT(user.loaded[0] == 1234);
+    ASSERT(user.loaded[7] == 5678);
+    ASSERT(user.loadedVersion == 1);
+    ASSERT(user.migrations == 0);
+}
+
+static void unchanged_section_is_not_written()
+{
+    user.data[0] = 1;
+    FlashStore::Commit();
+
+    uint32_t start = flash_sim_get_time();
+
+    ASSERT(FlashStore::Commit() == 0);
+    ASSERT(flash_sim_get_time() == start);
+}
+
+static void commit_keeps_previous_copy()
+{
+    FlashStore::Register(FlashStore::SECTION_CANMAP, &otherClient);
+    other.data[0] = 1;
+    FlashStore::Commit();
+    other.data[0] = 2;
+    FlashStore::Commit();
+
+    ASSERT(BlockData(CAN1_BLKNUM)[0] == 1);
+    ASSERT(BlockData(CAN1_BACKUP_BLKNUM)[0] == 2);
+
+    //The older copy is overwritten next
+    other.data[0] = 3;
+    FlashStore::Commit();
+    ASSERT(BlockData(CAN1_BLKNUM)[0] == 3);
+    ASSERT(FlashStore::Load(FlashStore::SECTION_CANMAP));
+    ASSERT(other.loaded[0] == 3);
+}
+
+static void incomplete_commit_rolls_back_all_sections()
+{
+    FlashStore::Register(FlashStore::SECTION_USER, 0);
+    FlashStore::Register(FlashStore::SECTION_CANMAP, &otherClient);
+    FlashStore::Register(FlashStore::SECTION_ERRORLOG, &logClient);
+    other.data[0] = 10;
+    log.data[0] = 1;
+    ASSERT(FlashStore::Commit() == 2);
+
+    other.data[0] = 20;
+    log.data[0] = 2;
+    ASSERT(FlashStore::Commit() == 2);
+
+    //Reset before the footer of the second section was programmed
+    flash_program_word(FooterAddress(ERRLOG_BACKUP_BLKNUM), 0);
+
+    ASSERT(FlashStore::Load(FlashStore::SECTION_CANMAP));
+    ASSERT(FlashStore::Load(FlashStore::SECTION_ERRORLOG));
+    ASSERT(other.loaded[0] == 10);
+    ASSERT(log.loaded[0] == 1);
+
+    //The incomplete commit never becomes valid, data equal to the last complete one is not written
+    other.data[0] = 10;
+    log.data[0] = 1;
+    ASSERT(FlashStore::Commit() == 0);
+
+    //The next commit overwrites the copies of the incomplete one
+    other.data[0] = 30;
+    ASSERT(FlashStore::Commit() == 1);
+    ASSERT(BlockData(CAN1_BACKUP_BLKNUM)[0] == 30);
+    ASSERT(FlashStore::Load(FlashStore::SECTION_CANMAP));
+    ASSERT(FlashStore::Load(FlashStore::SECTION_ERRORLOG));
+    ASSERT(other.loaded[0] == 30);
+    ASSERT(log.loaded[0] == 1);
+}
+
+static void section_without_backup_keeps_others_loadable()
+{
+    FlashStore::Register(FlashStore::SECTION_ERRORLOG, &logClient);
+    user.data[0] = 1;
+    log.data[0] = 2;
+    ASSERT(FlashStore::Commit() == 2);
+
+    //Reset after the only copy of the user section was erased
+    FlashWriter::SetBackground(true);
+    user.data[0] = 3;
+    ASSERT(FlashStore::Commit(1 << FlashStore::SECTION_USER) == 1);
+    FlashWriter::Run();
+
+    ASSERT(FlashStore::Load(FlashStore::SECTION_ERRORLOG));
+    ASSERT(log.loaded[0] == 2);
+    ASSERT(!FlashStore::Load(FlashStore::SECTION_USER));
+    ASSERT(user.migrations == 1);
+
+    FlashWriter::Flush();
+    FlashWriter::SetBackground(false);
+    ASSERT(FlashStore::Load(FlashStore::SECTION_USER));
+    ASSERT(user.loaded[0] == 3);
+}
+
+static void full_writer_queue_fails_commit()
+{
+    FlashWriter::Job jobs[FLASH_WRITER_QUEUE_LEN - 1] = {};
+
+    user.data[0] = 10;
+    FlashStore::Commit();
+
+    //Leave room for the data but not for the footer
+    FlashWriter::SetBackground(true);
+    for (FlashWriter::Job& job : jobs)
+        ASSERT(FlashWriter::Queue(&job, BlockAddress(8), user.image, 0));
+
+    user.data[0] = 20;
+    ASSERT(FlashStore::Commit() == -1);
+
+    //Nothing was queued, the only copy of the user section is not erased
+    FlashWriter::Flush();
+    FlashWriter::SetBackground(false);
+    ASSERT(FlashStore::Load(FlashStore::SECTION_USER));
+    ASSERT(user.loaded[0] == 10);
+}
+
+static void other_sections_survive_overwritten_commit()
+{
+    FlashStore::Register(FlashStore::SECTION_USER, 0);
+    FlashStore::Register(FlashStore::SECTION_CANMAP, &otherClient);
+    FlashStore::Register(FlashStore::SECTION_ERRORLOG, &logClient);
+    other.data[0] = 10;
+    log.data[0] = 1;
+    ASSERT(FlashStore::Commit() == 2);
+
+    //Both copies of the error log are overwritten, none of them is of the first commit
+    log.data[0] = 2;
+    ASSERT(FlashStore::Commit(1 << FlashStore::SECTION_ERRORLOG) == 1);
+    log.data[0] = 3;
+    ASSERT(FlashStore::Commit(1 << FlashStore::SECTION_ERRORLOG) == 1);
+
+    ASSERT(FlashStore::Load(FlashStore::SECTION_CANMAP));
+    ASSERT(FlashStore::Load(FlashStore::SECTION_ERRORLOG));
+    ASSERT(other.loaded[0] == 10);
+    ASSERT(log.loaded[0] == 3);
+
+    //An interrupted commit of the error log goes back to the last one
+    FlashWriter::SetBackground(true);
+    log.data[0] = 4;
+    ASSERT(FlashStore::Commit(1 << FlashStore::SECTION_ERRORLOG) == 1);
+    FlashWriter::Run();
+    FlashWriter::Run();
+
+    ASSERT(FlashStore::Load(FlashStore::SECTION_CANMAP));
+    ASSERT(FlashStore::Load(FlashStore::SECTION_ERRORLOG));
+    ASSERT(other.loaded[0] == 10);
+    ASSERT(log.loaded[0] == 3);
+    FlashWriter::Flush();
+    FlashWriter::SetBackground(false);
+}
+
+static void incomplete_commit_is_not_revived()
+{
+    FlashStore::Register(FlashStore::SECTION_USER, 0);
+    FlashStore::Register(FlashStore::SECTION_CANMAP, &otherClient);
+    FlashStore::Register(FlashStore::SECTION_ERRORLOG, &logClient);
+    other.data[0] = 10;
+    log.data[0] = 1;
+    FlashStore::Commit();
+
+    other.data[0] = 20;
+    log.data[0] = 2;
+    FlashStore::Commit();
+    //Reset before the footer of the error log was programmed
+    flash_program_word(FooterAddress(ERRLOG_BACKUP_BLKNUM), 0);
+
+    //A later commit of the error log alone must not complete the CAN map copy of 20
+    log.data[0] = 3;
+    ASSERT(FlashStore::Commit(1 << FlashStore::SECTION_ERRORLOG) == 1);
+    ASSERT(FlashStore::Load(FlashStore::SECTION_CANMAP));
+    ASSERT(FlashStore::Load(FlashStore::SECTION_ERRORLOG));
+    ASSERT(other.loaded[0] == 10);
+    ASSERT(log.loaded[0] == 3);
+}
+
+static void corrupted_copy_falls_back_to_backup()
+{
+    FlashStore::Register(FlashStore::SECTION_CANMAP, &otherClient);
+    other.data[3] = 10;
+    FlashStore::Commit();
+    other.data[3] = 20;
+    FlashStore::Commit();
+
+    //Flip a bit in the data of the newer copy
+    flash_program_word(BlockAddress(CAN1_BACKUP_BLKNUM) + 3 * 4, 20 & ~4);
+
+    ASSERT(FlashStore::Load(FlashStore::SECTION_CANMAP));
+    ASSERT(other.loaded[3] == 10);
+}
+
+static void section_of_older_commit_stays_valid()
+{
+    FlashStore::Register(FlashStore::SECTION_CANMAP, &otherClient);
+    other.data[0] = 10;
+    FlashStore::Commit();
+
+    //Only the user section changes from here on
+    for (uint32_t i = 1; i < 5; i++)
+    {
+        user.data[0] = i;
+        ASSERT(FlashStore::Commit() == 1);
+    }
+
+    ASSERT(FlashStore::Load(FlashStore::SECTION_CANMAP));
+    ASSERT(FlashStore::Load(FlashStore::SECTION_USER));
+    ASSERT(other.loaded[0] == 10);
+    ASSERT(user.loaded[0] == 4);
+}
+
+static void version_is_passed_to_loader()
+{
+    FlashStore::Commit();
+    userClient.version = 2;
+    //A new schema version rewrites the section even if the data is the same
+    ASSERT(FlashStore::Commit() == 1);
+    ASSERT(FlashStore::Load(FlashStore::SECTION_USER));
+    ASSERT(user.loadedVersion == 2);
+}
+
+static void canmap_is_saved_and_loaded()
+{
+    CanStub canStub;
+    uint32_t canId;
+    uint8_t start;
+    int8_t length, offset;
+    float gain;
+    bool rx;
+
+    {
+        CanMap saved(&canStub, false);
+        saved.AddSend(Param::ocurlim, 0x123, 8, 16, 2.0f);
+        ASSERT(saved.Save());
+    }
+
+    CanMap loaded(&canStub, true);
+    ASSERT(loaded.FindMap(Param::ocurlim, canId, start, length, gain, offset, rx));
+    ASSERT(canId == 0x123 && start == 8 && length == 16 && gain == 2.0f && !rx);
+    FlashStore::Register(FlashStore::SECTION_CANMAP, 0);
+}
+
+static void canmap_without_footer_is_migrated()
+{
+    CanStub canStub;
+    uint32_t canId;
+    uint8_t start;
+    int8_t length, offset;
+    float gain;
+    bool rx;
+
+    {
+        CanMap saved(&canStub, false);
+        saved.AddRecv(Param::ocurlim, 0x321, 0, 8, 1.0f);
+        saved.Save();
+    }
+
+    //Turn it into the format before FlashStore: no footer, CRC after the maps
+    flash_program_word(FooterAddress(CAN1_BLKNUM), 0);
+    //The CRC covers the message maps and MAX_ITEMS positions, it follows the spare position
+    const uint32_t mapBytes = 2 * MAX_MESSAGES * 4 + MAX_ITEMS * sizeof(CanMap::CANPOS);
+    flash_program_word(BlockAddress(CAN1_BLKNUM) + mapBytes + sizeof(CanMap::CANPOS), FlashStore::Crc(BlockData(CAN1_BLKNUM), mapBytes / 4));
+
+    CanMap loaded(&canStub, true);
+    ASSERT(loaded.FindMap(Param::ocurlim, canId, start, length, gain, offset, rx));
+    ASSERT(canId == 0x321 && rx);
+    FlashStore::Register(FlashStore::SECTION_CANMAP, 0);
+}
+
+static void destroyed_canmap_is_unregistered()
+{
+    CanStub canStub;
+
+    {
+        CanMap saved(&canStub, false);
+        ASSERT(saved.Save());
+    }
+
+    //Only the user section is left to serialize
+    user.data[0] = 1;
+    ASSERT(FlashStore::Commit() == 1);
+}
+
+static void software_crc_matches_crc_unit()
+{
+    //Check value of the STM32 CRC unit for this word after reset
+    ASSERT(FlashStore::CrcWord(0xFFFFFFFF, 0x12345678) == 0xDF8A8A2B);
+}
+
+static void crc_restores_interrupt_mask()
+{
+    const uint32_t data[2] = { 1, 2 };
+
+    cm_mask_interrupts(1);
+    FlashStore::Crc(data, 2);
+    ASSERT(stub_primask == 1);
+
+    cm_mask_interrupts(0);
+    FlashStore::Crc(data, 2);
+    ASSERT(stub_primask == 0);
+}
+
+REGISTER_TEST(
+    FlashStoreTest,
+    load_without_data_migrates,
+    commit_and_load,
+    unchanged_section_is_not_written,
+    commit_keeps_previous_copy,
+    incomplete_commit_rolls_back_all_sections,
+    section_without_backup_keeps_others_loadable,
+    full_writer_queue_fails_commit,
+    other_sections_survive_overwritten_commit,
+    incomplete_commit_is_not_revived,
+    corrupted_copy_falls_back_to_backup,
+    section_of_older_commit_stays_valid,
+    version_is_passed_to_loader,
+    canmap_is_saved_and_loaded,
+    canmap_without_footer_is_migrated,
+    destroyed_canmap_is_unregistered,
+    software_crc_matches_crc_unit,
+    crc_restores_interrupt_mask
+);
@@ -0,0 +1,154 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdint>
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/cm3/cortex.h>
+#include "flashwriter.h"
+#include "hwdefs.h"
+#include "test.h"
+
+extern "C" uint32_t flash_sim_get_time(void);
+
+class FlashWriterTest : public UnitTest
+{
+public:
+    explicit FlashWriterTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+//A page that no other module uses
+static const uint32_t PageAddress = FLASH_BASE;
+static uint32_t source[300];
+
+static uint32_t* Flash()
+{
+    return (uint32_t*)(uintptr_t)PageAddress;
+}
+
+void FlashWriterTest::TestCaseSetup()
+{
+    for (int i = 0; i < 300; i++)
+        source[i] = 0x1000 + i;
+    flash_erase_page(PageAddress);
+    FlashWriter::SetBackground(true);
+}
+
+static void writes_right_away_without_background()
+{
+    FlashWriter::Job job = {};
+
+    FlashWriter::SetBackground(false);
+    ASSERT(FlashWriter::Queue(&job, PageAddress, source, 10));
+    ASSERT(job.status == FlashWriter::STATUS_DONE);
+    ASSERT(Flash()[9] == source[9]);
+    ASSERT(!FlashWriter::IsBusy());
+}
+
+static void writes_in_small_steps()
+{
+    FlashWriter::Job job = {};
+    int steps = 0;
+
+    Flash()[0] = 0; //Needs an erase first
+    ASSERT(FlashWriter::Queue(&job, PageAddress, source, 200, FLASH_PAGE_SIZE));
+    ASSERT(job.status == FlashWriter::STATUS_QUEUED);
+    ASSERT(Flash()[0] == 0);
+
+    while (FlashWriter::IsBusy())
+    {
+        uint32_t start = flash_sim_get_time();
+
+        FlashWriter::Run();
+        steps++;
+        //One erase or one chunk per step
+        ASSERT(flash_sim_get_time() - start <= 20000);
+        ASSERT(flash_sim_get_time() - start == 20000 || flash_sim_get_time() - start <= FLASH_WRITER_CHUNK_WORDS * 105);
+    }
+
+    ASSERT(steps == 1 + (200 + FLASH_WRITER_CHUNK_WORDS - 1) / FLASH_WRITER_CHUNK_WORDS);
+    ASSERT(job.status == FlashWriter::STATUS_DONE);
+
+    for (int i = 0; i < 200; i++)
+        ASSERT(Flash()[i] == source[i]);
+}
+
+static void jobs_run_in_order()
+{
+    FlashWriter::Job first = {}, second = {};
+
+    ASSERT(FlashWriter::Queue(&first, PageAddress, source, 4));
+    ASSERT(FlashWriter::Queue(&second, PageAddress + 16, &source[100], 4));
+    ASSERT(!FlashWriter::Queue(&first, PageAddress, source, 4));
+
+    FlashWriter::Run();
+    ASSERT(first.status == FlashWriter::STATUS_DONE);
+    ASSERT(second.status == FlashWriter::STATUS_QUEUED);
+    FlashWriter::Run();
+    ASSERT(second.status == FlashWriter::STATUS_DONE);
+    ASSERT(Flash()[4] == source[100]);
+}
+
+static void queue_full()
+{
+    FlashWriter::Job jobs[FLASH_WRITER_QUEUE_LEN + 1] = {};
+
+    for (int i = 0; i < FLASH_WRITER_QUEUE_LEN; i++)
+        ASSERT(FlashWriter::Queue(&jobs[i], PageAddress + i * 4, &source[i], 1));
+
+    ASSERT(!FlashWriter::Queue(&jobs[FLASH_WRITER_QUEUE_LEN], PageAddress + 64, source, 1));
+    ASSERT(jobs[FLASH_WRITER_QUEUE_LEN].status == FlashWriter::STATUS_IDLE);
+    //Jobs live on the stack, don't leave them queued
+    FlashWriter::Flush();
+    ASSERT(jobs[0].status == FlashWriter::STATUS_DONE);
+}
+
+static void mismatch_is_reported()
+{
+    FlashWriter::Job job = {};
+
+    //Programming can't set bits of a word that is not erased
+    Flash()[1] = 0;
+    ASSERT(FlashWriter::Queue(&job, PageAddress, source, 4));
+    FlashWriter::Flush();
+    ASSERT(job.status == FlashWriter::STATUS_ERROR);
+    ASSERT(!FlashWriter::IsBusy());
+}
+
+static void queue_keeps_interrupt_mask()
+{
+    FlashWriter::Job job = {};
+
+    FlashWriter::SetBackground(false);
+    //Called from code that already masked interrupts
+    cm_mask_interrupts(1);
+    ASSERT(FlashWriter::Queue(&job, PageAddress, source, 4));
+    ASSERT(stub_primask == 1);
+    cm_mask_interrupts(0);
+    ASSERT(job.status == FlashWriter::STATUS_DONE);
+}
+
+REGISTER_TEST(
+    FlashWriterTest,
+    writes_right_away_without_background,
+    writes_in_small_steps,
+    jobs_run_in_order,
+    queue_full,
+    mismatch_is_reported,
+    queue_keeps_interrupt_mask
+);
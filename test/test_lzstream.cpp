@@ -0,0 +1,143 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lzstream.h"
+#include "test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class LzStreamTest : public UnitTest
+{
+public:
+    explicit LzStreamTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+};
+
+class StringSource: public IStreamSource
+{
+public:
+    explicit StringSource(const std::string& s) : str(s), pos(0) {}
+    void Rewind() override { pos = 0; }
+    int Read(uint8_t* buf, int len) override
+    {
+        int n = std::min((size_t)len, str.size() - pos);
+        memcpy(buf, str.data() + pos, n);
+        pos += n;
+        return n;
+    }
+
+private:
+    std::string str;
+    size_t pos;
+};
+
+static std::vector<uint8_t> ReadAll(IStreamSource& source, int chunkSize)
+{
+    std::vector<uint8_t> result;
+    uint8_t buf[64];
+    int len;
+
+    while ((len = source.Read(buf, chunkSize)) > 0)
+        result.insert(result.end(), buf, buf + len);
+
+    return result;
+}
+
+// Decoder as documented in lzstream.h
+static std::string Decompress(const std::vector<uint8_t>& data)
+{
+    std::string out;
+    size_t i = 0;
+
+    while (i < data.size())
+    {
+        uint8_t flags = data[i++];
+
+        for (int bit = 0; bit < 8 && i < data.size(); bit++)
+        {
+            if (flags & (1 << bit))
+            {
+                int dist = data[i] + 1, n = data[i + 1] + LZ_MIN_MATCH;
+                i += 2;
+                for (int j = 0; j < n; j++)
+                    out.push_back(out[out.size() - dist]);
+            }
+            else
+            {
+                out.push_back(data[i++]);
+            }
+        }
+    }
+    return out;
+}
+
+static void RoundTrip(const std::string& input, size_t maxCompressed)
+{
+    StringSource source(input);
+    LzStream lz(&source);
+    std::vector<uint8_t> compressed = ReadAll(lz, 7);
+
+    ASSERT(Decompress(compressed) == input);
+    ASSERT(compressed.size() <= maxCompressed);
+}
+
+static void lz_empty()
+{
+    RoundTrip("", 0);
+}
+
+static void lz_no_repetition()
+{
+    RoundTrip("abcdefgh12345", 15);
+}
+
+static void lz_repeated_keys()
+{
+    std::string json;
+
+    for (int i = 0; i < 50; i++)
+        json += "\"param" + std::to_string(i) + "\": {\"unit\":\"A\",\"isparam\":true,\"minimum\":0,\"maximum\":100},\r\n";
+
+    RoundTrip(json, json.size() / 3);
+}
+
+static void lz_overlapping_match()
+{
+    RoundTrip(std::string(1000, 'x'), 1000 / 34 * 2 + 1000 / 34 / 8 + 8);
+}
+
+static void lz_rewind()
+{
+    StringSource source("hello hello hello hello");
+    LzStream lz(&source);
+    std::vector<uint8_t> first = ReadAll(lz, 64);
+
+    lz.Rewind();
+    ASSERT(ReadAll(lz, 3) == first);
+}
+
+REGISTER_TEST(
+    LzStreamTest,
+    lz_empty,
+    lz_no_repetition,
+    lz_repeated_keys,
+    lz_overlapping_match,
+    lz_rewind
+);
@@ -0,0 +1,274 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdint>
+#include <libopencm3/stm32/flash.h>
+#include "param_save.h"
+#include "flashstore.h"
+#include "flashwriter.h"
+#include "params.h"
+#include "hwdefs.h"
+#include "test.h"
+
+class ParamSaveTest : public UnitTest
+{
+public:
+    explicit ParamSaveTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+static const uint32_t LogMagic = 0x474F4C50;
+static const int HeaderWords = 3;
+static const int RecordSlots = (PARAM_BLKSIZE - HeaderWords * 4) / 8;
+//Entries of the single page format before the record log
+static const int LegacyEntries = (PARAM_BLKSIZE - 8) / 8;
+
+static uint32_t BlockAddress(int block)
+{
+    return FLASH_BASE + FLASH_SIZE_KB * 1024 - (PARAM_BLKNUM + block) * PARAM_BLKSIZE;
+}
+
+static uint32_t* BlockData(int block)
+{
+    return (uint32_t*)(uintptr_t)BlockAddress(block);
+}
+
+// Number of record slots in use, including torn records
+static int UsedSlots(int block)
+{
+    uint32_t* data = BlockData(block);
+    int used = 0;
+
+    for (int i = 0; i < RecordSlots; i++)
+    {
+        if (data[HeaderWords + 2 * i] != 0xFFFFFFFF || data[HeaderWords + 1 + 2 * i] != 0xFFFFFFFF)
+            used = i + 1;
+    }
+    return used;
+}
+
+void ParamSaveTest::TestCaseSetup()
+{
+    for (int block = 0; block < PARAM_LOG_PAGES; block++)
+        flash_erase_page(BlockAddress(block));
+    Param::LoadDefaults();
+    Param::SetFlagsRaw(Param::ocurlim, 0);
+}
+
+static void load_from_erased_flash_fails()
+{
+    ASSERT(parm_load() == -1);
+}
+
+static void save_and_load()
+{
+    Param::SetInt(Param::ocurlim, 55);
+    Param::SetFlag(Param::ocurlim, Param::FLAG_HIDDEN);
+    parm_save();
+
+    Param::SetInt(Param::ocurlim, 1);
+    Param::SetFlagsRaw(Param::ocurlim, 0);
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 55);
+    ASSERT(Param::GetFlag(Param::ocurlim) == Param::FLAG_HIDDEN);
+}
+
+static void save_appends_only_changed_values()
+{
+    parm_save();
+    //Snapshot of the only parameter plus its end marker
+    ASSERT(UsedSlots(0) == 2);
+
+    parm_save();
+    ASSERT(UsedSlots(0) == 2);
+
+    Param::SetInt(Param::ocurlim, 12);
+    parm_save();
+    ASSERT(UsedSlots(0) == 3);
+    ASSERT(UsedSlots(1) == 0);
+}
+
+static void full_block_continues_in_next_block()
+{
+    uint32_t firstSeq;
+
+    parm_save();
+    firstSeq = BlockData(0)[1];
+
+    //Fills the first block, then wraps around through both blocks
+    for (int i = 1; i <= 3 * RecordSlots; i++)
+    {
+        Param::SetInt(Param::ocurlim, i);
+        parm_save();
+    }
+
+    Param::SetInt(Param::ocurlim, 0);
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 3 * RecordSlots);
+    ASSERT(BlockData(0)[0] == LogMagic);
+    ASSERT(BlockData(1)[0] == LogMagic);
+    ASSERT(BlockData(0)[1] != firstSeq);
+    ASSERT(BlockData(1)[1] != firstSeq);
+}
+
+static void torn_record_is_ignored()
+{
+    Param::SetInt(Param::ocurlim, 10);
+    parm_save();
+
+    //Power loss after programming the value, before the committing word
+    uint32_t slot = BlockAddress(0) + HeaderWords * 4 + UsedSlots(0) * 8;
+    flash_program_word(slot, FP_FROMINT(20));
+
+    Param::SetInt(Param::ocurlim, 0);
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 10);
+
+    Param::SetInt(Param::ocurlim, 30);
+    parm_save();
+    Param::SetInt(Param::ocurlim, 0);
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 30);
+}
+
+static void incomplete_snapshot_keeps_previous_block()
+{
+    Param::SetInt(Param::ocurlim, 7);
+    parm_save();
+
+    //Power loss while writing the snapshot of a newer block: no end marker
+    flash_program_word(BlockAddress(1), LogMagic);
+    flash_program_word(BlockAddress(1) + 4, BlockData(0)[1] + 1);
+
+    Param::SetInt(Param::ocurlim, 0);
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 7);
+}
+
+static void snapshot_of_other_layout_is_loaded_by_id()
+{
+    Param::SetInt(Param::ocurlim, 44);
+    Param::SetFlag(Param::ocurlim, Param::FLAG_HIDDEN);
+    parm_save();
+
+    //Written by a firmware with a different parameter list
+    flash_program_word(BlockAddress(0) + 8, 0);
+
+    Param::SetInt(Param::ocurlim, 0);
+    Param::SetFlagsRaw(Param::ocurlim, 0);
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 44);
+    ASSERT(Param::GetFlag(Param::ocurlim) == Param::FLAG_HIDDEN);
+
+    //Unchanged values are still recognized
+    parm_save();
+    ASSERT(UsedSlots(0) == 2);
+}
+
+static void legacy_page_is_loaded()
+{
+    uint32_t address = BlockAddress(0);
+
+    //Single page format: key, flags and value per entry, CRC at the end
+    flash_program_word(address, 22 | (Param::FLAG_HIDDEN << 24));
+    flash_program_word(address + 4, FP_FROMINT(66));
+    flash_program_word(address + PARAM_BLKSIZE - 8, FlashStore::Crc(BlockData(0), 2 * LegacyEntries));
+
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 66);
+    ASSERT(Param::GetFlag(Param::ocurlim) == Param::FLAG_HIDDEN);
+
+    //The next save converts it
+    parm_save();
+    ASSERT(BlockData(0)[0] == LogMagic);
+    Param::SetInt(Param::ocurlim, 0);
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 66);
+}
+
+static void corrupted_record_is_ignored()
+{
+    Param::SetInt(Param::ocurlim, 10);
+    parm_save();
+    Param::SetInt(Param::ocurlim, 11);
+    parm_save();
+
+    //Flip a bit of the value of the newest record
+    uint32_t slot = BlockAddress(0) + HeaderWords * 4 + (UsedSlots(0) - 1) * 8;
+    flash_program_word(slot, FP_FROMINT(11) & ~0x100);
+
+    Param::SetInt(Param::ocurlim, 0);
+    ASSERT(parm_load() == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 10);
+}
+
+static void corrupted_legacy_page_is_rejected()
+{
+    uint32_t address = BlockAddress(0);
+
+    flash_program_word(address, 22);
+    flash_program_word(address + 4, FP_FROMINT(66));
+    flash_program_word(address + PARAM_BLKSIZE - 8, FlashStore::Crc(BlockData(0), 2 * LegacyEntries));
+    flash_program_word(address + 4, FP_FROMINT(66) & ~0x40);
+
+    ASSERT(parm_load() == -1);
+}
+
+static void save_returns_legacy_page_crc()
+{
+    uint32_t image[2 * LegacyEntries];
+
+    Param::SetInt(Param::ocurlim, 33);
+    Param::SetFlag(Param::ocurlim, Param::FLAG_HIDDEN);
+
+    //The page the single page format would write, ocurlim is the only saved parameter
+    for (int i = 0; i < 2 * LegacyEntries; i++)
+        image[i] = 0xFFFFFFFF;
+    image[2 * Param::ocurlim] = 22 | 0xFF0000 | (Param::FLAG_HIDDEN << 24);
+    image[2 * Param::ocurlim + 1] = FP_FROMINT(33);
+
+    ASSERT(parm_save() == FlashStore::Crc(image, 2 * LegacyEntries));
+}
+
+static void save_reports_busy()
+{
+    FlashWriter::SetBackground(true);
+    Param::SetInt(Param::ocurlim, 12);
+    ASSERT(parm_save() != PARM_SAVE_BUSY);
+    ASSERT(parm_save() == PARM_SAVE_BUSY);
+    ASSERT(parm_save_status() == 1);
+    FlashWriter::Flush();
+    FlashWriter::SetBackground(false);
+    ASSERT(parm_save_status() == 0);
+}
+
+REGISTER_TEST(
+    ParamSaveTest,
+    load_from_erased_flash_fails,
+    save_and_load,
+    save_appends_only_changed_values,
+    full_block_continues_in_next_block,
+    torn_record_is_ignored,
+    incomplete_snapshot_keeps_previous_block,
+    snapshot_of_other_layout_is_loaded_by_id,
+    legacy_page_is_loaded,
+    corrupted_record_is_ignored,
+    corrupted_legacy_page_is_rejected,
+    save_returns_legacy_page_crc,
+    save_reports_busy
+);
@@ -0,0 +1,208 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "parambinary.h"
+#include "paramjson.h"
+#include "params.h"
+#include "test.h"
+
+#include <string>
+#include <vector>
+
+class ParamBinaryTest : public UnitTest
+{
+public:
+    explicit ParamBinaryTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+void ParamBinaryTest::TestCaseSetup()
+{
+    Param::LoadDefaults();
+    Param::ClearFlag(Param::amp, Param::FLAG_HIDDEN);
+}
+
+static std::vector<uint8_t> ReadAll(IStreamSource& source, int chunkSize)
+{
+    std::vector<uint8_t> result;
+    uint8_t buf[64];
+    int len;
+
+    while ((len = source.Read(buf, chunkSize)) > 0)
+        result.insert(result.end(), buf, buf + len);
+
+    return result;
+}
+
+// Minimal decoder following the format description in parambinary.h
+class Decoder
+{
+public:
+    explicit Decoder(const std::vector<uint8_t>& d) : data(d), pos(0) {}
+
+    uint8_t Byte() { return data[pos++]; }
+
+    uint32_t Varint()
+    {
+        uint32_t value = 0;
+        int shift = 0;
+
+        while (data[pos] & 0x80)
+        {
+            value |= (data[pos++] & 0x7F) << shift;
+            shift += 7;
+        }
+        return value | (data[pos++] << shift);
+    }
+
+    int32_t Fixed()
+    {
+        int32_t value = data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16 | data[pos + 3] << 24;
+        pos += 4;
+        return value;
+    }
+
+    std::string Raw(int len)
+    {
+        std::string str((const char*)&data[pos], len);
+        pos += len;
+        return str;
+    }
+
+    std::string String()
+    {
+        uint32_t ref = Varint();
+
+        if (ref > 1) return strings[ref - 2];
+
+        std::string str = Raw(Varint());
+        if (ref == 1) strings.push_back(str);
+        return str;
+    }
+
+    bool AtEnd() { return pos == data.size(); }
+
+    std::vector<std::string> strings;
+
+private:
+    const std::vector<uint8_t>& data;
+    size_t pos;
+};
+
+static void binary_decodes()
+{
+    ParamBinary binary;
+    Param::SetInt(Param::pot, 300);
+    std::vector<uint8_t> data = ReadAll(binary, 64);
+    Decoder dec(data);
+
+    ASSERT(dec.Raw(2) == "OB");
+    ASSERT(dec.Byte() == PARAMBINARY_VERSION);
+    ASSERT(dec.Varint() == 3);
+
+    //amp
+    ASSERT(dec.Varint() == Param::amp);
+    ASSERT(dec.Varint() == 2013);
+    ASSERT(dec.Byte() == Param::TYPE_SPOTVALUE);
+    ASSERT(dec.Raw(dec.Varint()) == "amp");
+    ASSERT(dec.String() == "dig");
+    ASSERT(dec.Fixed() == 0);
+    //pot
+    ASSERT(dec.Varint() == Param::pot);
+    ASSERT(dec.Varint() == 2015);
+    ASSERT(dec.Byte() == Param::TYPE_SPOTVALUE);
+    ASSERT(dec.Raw(dec.Varint()) == "pot");
+    ASSERT(dec.String() == "dig");
+    ASSERT(dec.Fixed() == FP_FROMINT(300));
+    //ocurlim
+    ASSERT(dec.Varint() == Param::ocurlim);
+    ASSERT(dec.Varint() == 22);
+    ASSERT(dec.Byte() == Param::TYPE_PARAM);
+    ASSERT(dec.Raw(dec.Varint()) == "ocurlim");
+    ASSERT(dec.String() == "A");
+    ASSERT(dec.String() == "inverter");
+    ASSERT(dec.Fixed() == FP_FROMINT(-65536));
+    ASSERT(dec.Fixed() == FP_FROMINT(65536));
+    ASSERT(dec.Fixed() == FP_FROMINT(100));
+    ASSERT(dec.Fixed() == FP_FROMINT(100));
+
+    ASSERT(dec.AtEnd());
+    ASSERT(dec.strings.size() == 3); //"dig" was only sent once
+}
+
+static void binary_encodes_given_store()
+{
+    ParamBinary binary, reference;
+    Param::Store node;
+
+    node.SetInt(Param::pot, 400);
+    binary.SetStore(&node);
+    ASSERT(ReadAll(binary, 64) != ReadAll(reference, 64));
+
+    Param::SetInt(Param::pot, 400);
+    binary.Rewind();
+    reference.Rewind();
+    ASSERT(ReadAll(binary, 64) == ReadAll(reference, 64));
+}
+
+static void binary_independent_of_chunk_size()
+{
+    ParamBinary binary;
+    std::vector<uint8_t> reference = ReadAll(binary, 64);
+
+    for (int chunk = 1; chunk < 10; chunk++)
+    {
+        binary.Rewind();
+        ASSERT(ReadAll(binary, chunk) == reference);
+    }
+}
+
+static void binary_skips_hidden()
+{
+    ParamBinary binary;
+    Param::SetFlag(Param::pot, Param::FLAG_HIDDEN);
+    std::vector<uint8_t> data = ReadAll(binary, 64);
+    Decoder dec(data);
+
+    dec.Raw(3);
+    ASSERT(dec.Varint() == 2);
+
+    binary.SetPrintHidden(true);
+    binary.Rewind();
+    data = ReadAll(binary, 64);
+    Decoder decHidden(data);
+    decHidden.Raw(3);
+    ASSERT(decHidden.Varint() == 3);
+}
+
+static void binary_smaller_than_json()
+{
+    ParamBinary binary;
+    ParamJson json;
+
+    ASSERT(ReadAll(binary, 64).size() * 3 < ReadAll(json, 64).size());
+}
+
+REGISTER_TEST(
+    ParamBinaryTest,
+    binary_decodes,
+    binary_encodes_given_store,
+    binary_independent_of_chunk_size,
+    binary_skips_hidden,
+    binary_smaller_than_json
+);
@@ -0,0 +1,143 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramdelta.h"
+#include "params.h"
+#include "test.h"
+
+#include <string>
+
+class ParamDeltaTest : public UnitTest
+{
+public:
+    explicit ParamDeltaTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+};
+
+static std::string ReadAll(IStreamSource& source, int chunkSize)
+{
+    std::string result;
+    uint8_t buf[64];
+    int len;
+
+    source.Rewind();
+    while ((len = source.Read(buf, chunkSize)) > 0)
+        result.append((char*)buf, len);
+
+    return result;
+}
+
+static void delta_since_zero_sends_all_values()
+{
+    ParamDelta delta;
+
+    std::string result = ReadAll(delta, 64);
+
+    ASSERT(result.size() == 4 + 6 * Param::PARAM_LAST);
+    ASSERT(*(uint32_t*)&result[0] == Param::GetChangeSeq());
+    ASSERT(*(uint16_t*)&result[4 + 6 * Param::ocurlim] == Param::ocurlim);
+    ASSERT(*(int32_t*)&result[6 + 6 * Param::ocurlim] == Param::Get(Param::ocurlim));
+}
+
+static void delta_sends_only_changed_values()
+{
+    ParamDelta delta;
+
+    delta.SetSince(Param::GetChangeSeq());
+    Param::SetFloat(Param::amp, Param::GetFloat(Param::amp) + 1);
+
+    std::string result = ReadAll(delta, 64);
+
+    ASSERT(result.size() == 4 + 6);
+    ASSERT(*(uint32_t*)&result[0] == Param::GetChangeSeq());
+    ASSERT(*(uint16_t*)&result[4] == Param::amp);
+    ASSERT(*(int32_t*)&result[6] == Param::Get(Param::amp));
+}
+
+static void delta_ignores_writes_of_same_value()
+{
+    uint32_t seq = Param::GetChangeSeq();
+
+    Param::SetFixed(Param::pot, Param::Get(Param::pot));
+    Param::Set(Param::ocurlim, Param::Get(Param::ocurlim));
+    ASSERT(Param::GetChangeSeq() == seq);
+
+    Param::SetInt(Param::pot, Param::GetInt(Param::pot) + 1);
+    ASSERT(Param::GetChangeSeq() == seq + 1);
+    ASSERT(Param::GetChangeSeq(Param::pot) == seq + 1);
+    ASSERT(Param::ChangedSince(Param::pot, seq));
+    ASSERT(!Param::ChangedSince(Param::pot, seq + 1));
+}
+
+static void delta_independent_of_chunk_size()
+{
+    ParamDelta delta;
+
+    delta.SetSince(Param::GetChangeSeq());
+    Param::SetInt(Param::pot, Param::GetInt(Param::pot) + 1);
+    Param::Set(Param::ocurlim, Param::Get(Param::ocurlim) + FP_FROMINT(1));
+
+    std::string expected = ReadAll(delta, 64);
+    ASSERT(expected.size() == 4 + 2 * 6);
+
+    for (int chunk = 1; chunk < 10; chunk++)
+        ASSERT(ReadAll(delta, chunk) == expected);
+}
+
+static void delta_sends_repeated_changes_once()
+{
+    ParamDelta delta;
+
+    delta.SetSince(Param::GetChangeSeq());
+    for (int i = 0; i < 3; i++)
+        Param::SetInt(Param::amp, Param::GetInt(Param::amp) + 1);
+    Param::SetInt(Param::pot, Param::GetInt(Param::pot) + 1);
+
+    std::string result = ReadAll(delta, 64);
+
+    ASSERT(result.size() == 4 + 2 * 6);
+    ASSERT(*(uint16_t*)&result[4] == Param::amp);
+    ASSERT(*(int32_t*)&result[6] == Param::Get(Param::amp));
+    ASSERT(*(uint16_t*)&result[10] == Param::pot);
+}
+
+static void delta_falls_back_to_scan_on_journal_overrun()
+{
+    ParamDelta delta;
+
+    delta.SetSince(Param::GetChangeSeq());
+    for (int i = 0; i < 100; i++)
+        Param::SetInt(Param::pot, Param::GetInt(Param::pot) + 1);
+    Param::SetInt(Param::amp, Param::GetInt(Param::amp) + 1);
+
+    std::string result = ReadAll(delta, 64);
+
+    ASSERT(result.size() == 4 + 2 * 6);
+    ASSERT(*(uint16_t*)&result[4] == Param::amp);
+    ASSERT(*(uint16_t*)&result[10] == Param::pot);
+    ASSERT(*(int32_t*)&result[12] == Param::Get(Param::pot));
+}
+
+REGISTER_TEST(
+    ParamDeltaTest,
+    delta_since_zero_sends_all_values,
+    delta_sends_only_changed_values,
+    delta_ignores_writes_of_same_value,
+    delta_independent_of_chunk_size,
+    delta_sends_repeated_changes_once,
+    delta_falls_back_to_scan_on_journal_overrun
+);
@@ -0,0 +1,140 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramfilter.h"
+#include "params.h"
+#include "test.h"
+
+class ParamFilterTest : public UnitTest
+{
+public:
+    explicit ParamFilterTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+void ParamFilterTest::TestCaseSetup()
+{
+    Param::LoadDefaults();
+}
+
+static void filter_empty_matches_all()
+{
+    ParamFilter filter;
+
+    ASSERT(filter.Parse(""));
+    ASSERT(filter.Matches(Param::amp));
+    ASSERT(filter.Matches(Param::ocurlim));
+    ASSERT(!filter.IncludeHidden());
+}
+
+static void filter_by_category()
+{
+    ParamFilter filter;
+
+    ASSERT(filter.Parse("c=inverter"));
+    ASSERT(filter.Matches(Param::ocurlim));
+    ASSERT(!filter.Matches(Param::amp));
+
+    ASSERT(filter.Parse("c=invert"));
+    ASSERT(!filter.Matches(Param::ocurlim));
+}
+
+static void filter_by_type()
+{
+    ParamFilter filter;
+
+    ASSERT(filter.Parse("t=p"));
+    ASSERT(filter.Matches(Param::ocurlim));
+    ASSERT(!filter.Matches(Param::pot));
+
+    ASSERT(filter.Parse("t=v"));
+    ASSERT(!filter.Matches(Param::ocurlim));
+    ASSERT(filter.Matches(Param::pot));
+}
+
+static void filter_by_uid_range()
+{
+    ParamFilter filter;
+
+    ASSERT(filter.Parse("u=2000-2014"));
+    ASSERT(filter.Matches(Param::amp));
+    ASSERT(!filter.Matches(Param::pot));
+    ASSERT(!filter.Matches(Param::ocurlim));
+
+    ASSERT(filter.Parse("u=22"));
+    ASSERT(filter.Matches(Param::ocurlim));
+    ASSERT(!filter.Matches(Param::amp));
+}
+
+static void filter_changed_since_default()
+{
+    ParamFilter filter;
+
+    ASSERT(filter.Parse("d"));
+    ASSERT(!filter.Matches(Param::ocurlim));
+    ASSERT(!filter.Matches(Param::amp));
+
+    Param::SetInt(Param::ocurlim, 50);
+    Param::SetInt(Param::amp, 5);
+    ASSERT(filter.Matches(Param::ocurlim));
+    ASSERT(filter.Matches(Param::amp));
+}
+
+static void filter_combined_options()
+{
+    ParamFilter filter;
+
+    ASSERT(filter.Parse("h,t=v,s=1,n=5"));
+    ASSERT(filter.IncludeHidden());
+    ASSERT(filter.GetStart() == 1);
+    ASSERT(filter.GetPageSize() == 5);
+    ASSERT(!filter.Matches(Param::amp)); //before start
+    ASSERT(filter.Matches(Param::pot));
+    ASSERT(!filter.Matches(Param::ocurlim));
+}
+
+static void filter_unknown_option()
+{
+    ParamFilter filter;
+
+    ASSERT(!filter.Parse("t=v,x=1"));
+    ASSERT(filter.Matches(Param::ocurlim)); //cleared
+}
+
+static void filter_malformed_option()
+{
+    ParamFilter filter;
+
+    ASSERT(!filter.Parse("dx"));
+    ASSERT(!filter.Parse("h,hx"));
+    ASSERT(!filter.Parse("t=x"));
+    ASSERT(!filter.Parse("t=pv"));
+    ASSERT(filter.Parse("h , d"));
+}
+
+REGISTER_TEST(
+    ParamFilterTest,
+    filter_empty_matches_all,
+    filter_by_category,
+    filter_by_type,
+    filter_by_uid_range,
+    filter_changed_since_default,
+    filter_combined_options,
+    filter_unknown_option,
+    filter_malformed_option
+);
@@ -0,0 +1,225 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+// See test_cansdo.cpp for why IPutChar is declared here
+#include <cstdio>
+class IPutChar { public: virtual void PutChar(char c) = 0; };
+#define PRINTF_H_INCLUDED
+
+#include "paramimport.h"
+#include "cansdo.h"
+#include "canmap.h"
+#include "params.h"
+#include "stub_canhardware.h"
+#include <libopencm3/cm3/cortex.h>
+#include "test.h"
+
+#include <memory>
+#include <vector>
+#include <cstring>
+
+class ParamImportTest : public UnitTest
+{
+public:
+    explicit ParamImportTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+extern int sdoSaveRequests;
+
+static std::unique_ptr<CanStub> canStub;
+static std::unique_ptr<CanMap> canMap;
+static std::unique_ptr<ParamImport> paramImport;
+static uint8_t buffer[256];
+
+void ParamImportTest::TestCaseSetup()
+{
+    canStub = std::make_unique<CanStub>();
+    canMap = std::make_unique<CanMap>(canStub.get(), false);
+    paramImport = std::make_unique<ParamImport>(canMap.get());
+    paramImport->SetBuffer(buffer, sizeof(buffer));
+    Param::LoadDefaults();
+    sdoSaveRequests = 0;
+}
+
+static void Put16(std::vector<uint8_t>& blob, uint16_t value)
+{
+    blob.push_back(value & 0xFF);
+    blob.push_back(value >> 8);
+}
+
+static void Put32(std::vector<uint8_t>& blob, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        blob.push_back(value >> (8 * i));
+}
+
+struct Mapping { uint32_t cobId; uint16_t uid; uint8_t offset; int8_t len; };
+
+static std::vector<uint8_t> MakeBlob(uint8_t flags, std::vector<std::pair<uint16_t, s32fp>> params, std::vector<Mapping> maps)
+{
+    std::vector<uint8_t> blob = { 'O', 'C', PARAMIMPORT_VERSION, flags };
+
+    Put16(blob, params.size());
+    Put16(blob, maps.size());
+
+    for (auto& p: params)
+    {
+        Put16(blob, p.first);
+        Put32(blob, p.second);
+    }
+    for (auto& m: maps)
+    {
+        Put32(blob, m.cobId);
+        Put32(blob, m.uid | (m.offset << 16) | ((uint8_t)m.len << 24));
+        Put32(blob, 1000);
+    }
+    Put32(blob, ParamImport::Crc32(0, blob.data(), blob.size()));
+    return blob;
+}
+
+static uint32_t Import(const std::vector<uint8_t>& blob)
+{
+    uint32_t err = paramImport->Begin(blob.size());
+
+    //Feed it in uneven pieces like a segmented transfer would
+    for (size_t i = 0; i < blob.size() && err == 0; i += 7)
+        err = paramImport->Write(&blob[i], std::min<size_t>(7, blob.size() - i));
+
+    return err != 0 ? err : paramImport->End();
+}
+
+static void import_crc32_check_value()
+{
+    ASSERT(ParamImport::Crc32(0, (const uint8_t*)"123456789", 9) == 0xCBF43926);
+}
+
+static void import_applies_params_and_map()
+{
+    uint32_t canId;
+
+    canMap->AddSend(Param::ocurlim, 0x300, 0, 16, 1);
+
+    ASSERT(Import(MakeBlob(PARAMIMPORT_CANMAP, { { 22, FP_FROMINT(200) } }, { { 0x123, 2015, 8, 16 }, { 0x200 | CANMAP_RECORD_RX, 22, 0, 16 } })) == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 200);
+    ASSERT(canMap->GetMap(false, 0, 0, canId)->offsetBits == 8);
+    ASSERT(canId == 0x123);
+    ASSERT(canMap->GetMap(false, 1, 0, canId) == nullptr); //old map is replaced
+    ASSERT(canMap->GetMap(true, 0, 0, canId) != nullptr && canId == 0x200);
+    ASSERT(sdoSaveRequests == 0);
+}
+
+static void import_params_only_keeps_map()
+{
+    uint32_t canId;
+
+    canMap->AddSend(Param::ocurlim, 0x300, 0, 16, 1);
+
+    ASSERT(Import(MakeBlob(0, { { 22, FP_FROMINT(150) } }, {})) == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 150);
+    ASSERT(canMap->GetMap(false, 0, 0, canId) != nullptr && canId == 0x300);
+}
+
+static void import_crc_error_changes_nothing()
+{
+    std::vector<uint8_t> blob = MakeBlob(0, { { 22, FP_FROMINT(200) } }, {});
+    blob[9] ^= 1;
+
+    ASSERT(Import(blob) == SDO_ERR_CRC);
+    ASSERT(Param::GetInt(Param::ocurlim) == 100);
+}
+
+static void import_out_of_range_changes_nothing()
+{
+    ASSERT(Import(MakeBlob(0, { { 22, FP_FROMINT(200) }, { 22, FP_FROMINT(70000) } }, {})) == SDO_ERR_RANGE);
+    ASSERT(Param::GetInt(Param::ocurlim) == 100);
+    ASSERT(Import(MakeBlob(0, { { 2015, FP_FROMINT(1) } }, {})) == SDO_ERR_INVIDX);
+    ASSERT(Import(MakeBlob(0, { { 999, FP_FROMINT(1) } }, {})) == SDO_ERR_INVIDX);
+}
+
+static void import_invalid_mapping_changes_nothing()
+{
+    uint32_t canId;
+
+    canMap->AddSend(Param::ocurlim, 0x300, 0, 16, 1);
+
+    ASSERT(Import(MakeBlob(PARAMIMPORT_CANMAP, { { 22, FP_FROMINT(200) } }, { { 0x123, 2015, 60, 16 } })) == SDO_ERR_INVIDX);
+    ASSERT(Param::GetInt(Param::ocurlim) == 100);
+    ASSERT(canMap->GetMap(false, 0, 0, canId) != nullptr && canId == 0x300);
+}
+
+static void import_too_many_messages_changes_nothing()
+{
+    std::vector<Mapping> maps;
+    uint32_t canId;
+
+    canMap->AddSend(Param::ocurlim, 0x300, 0, 16, 1);
+
+    for (int i = 0; i <= MAX_MESSAGES; i++)
+        maps.push_back({ (uint32_t)(0x100 + i), 2015, 0, 8 });
+
+    ASSERT(Import(MakeBlob(PARAMIMPORT_CANMAP, {}, maps)) == SDO_ERR_RANGE);
+    ASSERT(canMap->GetMap(false, 0, 0, canId) != nullptr && canId == 0x300);
+}
+
+static void import_mappings_require_canmap_flag()
+{
+    ASSERT(Import(MakeBlob(0, {}, { { 0x123, 2015, 0, 16 } })) == SDO_ERR_GENERAL);
+}
+
+static void import_wrong_size_rejected()
+{
+    std::vector<uint8_t> blob = MakeBlob(0, { { 22, FP_FROMINT(200) } }, {});
+    blob.pop_back();
+
+    ASSERT(Import(blob) == SDO_ERR_LENGTH);
+    ASSERT(paramImport->Begin(sizeof(buffer) + 1) == SDO_ERR_LENGTH);
+}
+
+static void import_save_flag_saves()
+{
+    ASSERT(Import(MakeBlob(PARAMIMPORT_SAVE, { { 22, FP_FROMINT(200) } }, {})) == 0);
+    ASSERT(sdoSaveRequests == 1);
+}
+
+static void import_map_swap_restores_interrupt_mask()
+{
+    ASSERT(Import(MakeBlob(PARAMIMPORT_CANMAP, {}, { { 0x123, 2015, 8, 16 } })) == 0);
+    ASSERT(stub_primask == 0);
+
+    //Called with interrupts already masked they stay masked
+    stub_primask = 1;
+    ASSERT(Import(MakeBlob(PARAMIMPORT_CANMAP, {}, { { 0x124, 2015, 8, 16 } })) == 0);
+    ASSERT(stub_primask == 1);
+    stub_primask = 0;
+}
+
+REGISTER_TEST(
+    ParamImportTest,
+    import_crc32_check_value,
+    import_applies_params_and_map,
+    import_params_only_keeps_map,
+    import_crc_error_changes_nothing,
+    import_out_of_range_changes_nothing,
+    import_invalid_mapping_changes_nothing,
+    import_too_many_messages_changes_nothing,
+    import_mappings_require_canmap_flag,
+    import_wrong_size_rejected,
+    import_save_flag_saves,
+    import_map_swap_restores_interrupt_mask
+);
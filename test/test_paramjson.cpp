@@ -0,0 +1,173 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramjson.h"
+#include "canmap.h"
+#include "params.h"
+#include "stub_canhardware.h"
+#include "test.h"
+
+#include <memory>
+#include <string>
+
+class ParamJsonTest : public UnitTest
+{
+public:
+    explicit ParamJsonTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+static std::unique_ptr<CanStub> canStub;
+static std::unique_ptr<CanMap>  canMap;
+
+void ParamJsonTest::TestCaseSetup()
+{
+    canStub = std::make_unique<CanStub>();
+    canMap  = std::make_unique<CanMap>(canStub.get(), false);
+    Param::LoadDefaults();
+    Param::ClearFlag(Param::amp, Param::FLAG_HIDDEN);
+}
+
+// Read the entire document in chunks of the given size
+static std::string ReadAll(IStreamSource& source, int chunkSize)
+{
+    std::string result;
+    uint8_t buf[64];
+    int len;
+
+    while ((len = source.Read(buf, chunkSize)) > 0)
+        result.append((char*)buf, len);
+
+    return result;
+}
+
+static const std::string expectedJson =
+    "{ \r\n"
+    "   \"amp\": {\"unit\":\"dig\",\"id\":2013,\"value\":0.00,\"isparam\":false},\r\n"
+    "   \"pot\": {\"unit\":\"dig\",\"id\":2015,\"value\":0.00,\"isparam\":false},\r\n"
+    "   \"ocurlim\": {\"unit\":\"A\",\"id\":22,\"value\":100.00,\"isparam\":true,"
+    "\"minimum\":-65536.00,\"maximum\":65536.00,\"default\":100.00,\"category\":\"inverter\",\"i\":2},\r\n"
+    "   \"serial\": {\"unit\":\"\",\"value\":\"12345678\",\"isparam\":false}\r\n"
+    "}\r\n";
+
+static void json_complete_document()
+{
+    ParamJson json(canMap.get());
+
+    ASSERT(ReadAll(json, 64) == expectedJson);
+}
+
+static void json_independent_of_chunk_size()
+{
+    ParamJson json(canMap.get());
+
+    ASSERT(ReadAll(json, 7) == expectedJson);
+    json.Rewind();
+    ASSERT(ReadAll(json, 1) == expectedJson);
+}
+
+static void json_read_after_end_returns_nothing()
+{
+    ParamJson json(canMap.get());
+    uint8_t buf[8];
+
+    ReadAll(json, 64);
+    ASSERT(json.Read(buf, sizeof(buf)) == 0);
+}
+
+static void json_hidden_parameters()
+{
+    ParamJson json(canMap.get());
+    Param::SetFlag(Param::amp, Param::FLAG_HIDDEN);
+
+    std::string doc = ReadAll(json, 64);
+    ASSERT(doc.find("\"amp\"") == std::string::npos);
+    ASSERT(doc.find("{ \r\n   \"pot\"") == 0);
+
+    json.SetPrintHidden(true);
+    json.Rewind();
+    ASSERT(ReadAll(json, 64) == expectedJson);
+}
+
+static void json_can_mapping()
+{
+    ParamJson json(canMap.get());
+    canMap->AddSend(Param::ocurlim, 0x123, 8, 16, 1.0f, 0);
+
+    std::string doc = ReadAll(json, 64);
+    ASSERT(doc.find("\"id\":22,\"value\":100.00,\"canid\":291,\"canoffset\":8,\"canlength\":16,"
+                    "\"cangain\":1.00,\"canadd\":0,\"isrx\":false,\"isparam\":true") != std::string::npos);
+}
+
+static void json_filtered()
+{
+    ParamJson json(canMap.get());
+    ParamFilter filter;
+
+    filter.Parse("t=v");
+    json.SetFilter(&filter);
+    std::string doc = ReadAll(json, 64);
+    ASSERT(doc.find("\"amp\"") != std::string::npos);
+    ASSERT(doc.find("\"ocurlim\"") == std::string::npos);
+    ASSERT(doc.find("\"serial\"") != std::string::npos);
+}
+
+static void json_lists_given_store()
+{
+    ParamJson json(canMap.get());
+    ParamFilter filter;
+    Param::Store node;
+
+    node.SetFloat(Param::ocurlim, 12.0f);
+    filter.Parse("d");
+    json.SetFilter(&filter);
+    json.SetStore(&node);
+    std::string doc = ReadAll(json, 64);
+    ASSERT(doc.find("\"id\":22,\"value\":12.00") != std::string::npos);
+}
+
+static void json_paginated()
+{
+    ParamJson json(canMap.get());
+    ParamFilter filter;
+
+    filter.Parse("n=2");
+    json.SetFilter(&filter);
+    std::string doc = ReadAll(json, 64);
+    ASSERT(doc.find("\"pot\"") != std::string::npos);
+    ASSERT(doc.find("\"ocurlim\"") == std::string::npos);
+    ASSERT(doc.find("\"next\": {\"unit\":\"\",\"value\":2,\"isparam\":false}") != std::string::npos);
+
+    filter.Parse("n=2,s=2");
+    json.Rewind();
+    doc = ReadAll(json, 64);
+    ASSERT(doc.find("{ \r\n   \"ocurlim\"") == 0);
+    ASSERT(doc.find("\"next\"") == std::string::npos); //last page
+}
+
+REGISTER_TEST(
+    ParamJsonTest,
+    json_complete_document,
+    json_independent_of_chunk_size,
+    json_read_after_end_returns_nothing,
+    json_hidden_parameters,
+    json_can_mapping,
+    json_filtered,
+    json_lists_given_store,
+    json_paginated
+);
@@ -0,0 +1,210 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramrecorder.h"
+#include "errormessage.h"
+#include "test.h"
+
+#include <string>
+#include <vector>
+
+class ParamRecorderTest : public UnitTest
+{
+public:
+    explicit ParamRecorderTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+};
+
+static s32fp buffer[8];
+
+static std::string ReadAll(IStreamSource& source)
+{
+    std::string result;
+    uint8_t buf[5];
+    int len;
+
+    source.Rewind();
+    while ((len = source.Read(buf, sizeof(buf))) > 0)
+        result.append((char*)buf, len);
+
+    return result;
+}
+
+//Sample values of the first channel, in fixed point
+static std::vector<s32fp> Channel0(const std::string& block)
+{
+    std::vector<s32fp> samples;
+    int channels = *(uint16_t*)&block[0];
+    int count = *(uint16_t*)&block[2];
+    int data = RECORDER_HEADER_SIZE + 2 * channels;
+
+    for (int i = 0; i < count; i++)
+        samples.push_back(*(int32_t*)&block[data + 4 * i * channels]);
+
+    return samples;
+}
+
+//Sets pot to each value and samples it
+static void Feed(ParamRecorder& recorder, int first, int last)
+{
+    for (int i = first; i <= last; i++)
+    {
+        Param::SetInt(Param::pot, i);
+        recorder.Sample();
+    }
+}
+
+static void recorder_arm_needs_buffer_and_channels()
+{
+    ParamRecorder recorder;
+    Param::PARAM_NUM channels[] = { Param::pot, Param::amp };
+
+    ASSERT(!recorder.Arm());
+    recorder.SetBuffer(buffer, 8);
+    ASSERT(!recorder.Arm());
+    ASSERT(recorder.SetChannels(channels, 2));
+    ASSERT(recorder.GetCapacity() == 4);
+    recorder.SetPreTrigger(4);
+    ASSERT(!recorder.Arm());
+    recorder.SetPreTrigger(3);
+    ASSERT(recorder.Arm());
+    ASSERT(recorder.GetState() == ParamRecorder::STATE_ARMED);
+}
+
+static void recorder_captures_without_trigger()
+{
+    ParamRecorder recorder;
+    Param::PARAM_NUM channels[] = { Param::pot, Param::ocurlim };
+
+    recorder.SetBuffer(buffer, 8);
+    recorder.SetChannels(channels, 2);
+    recorder.SetPreTrigger(1);
+    recorder.Arm();
+
+    ASSERT(ReadAll(recorder).size() == RECORDER_HEADER_SIZE + 4);
+    Feed(recorder, 1, 3);
+    ASSERT(recorder.GetState() == ParamRecorder::STATE_TRIGGERED);
+    Feed(recorder, 4, 6);
+    ASSERT(recorder.GetState() == ParamRecorder::STATE_DONE);
+
+    std::string block = ReadAll(recorder);
+
+    ASSERT(block.size() == RECORDER_HEADER_SIZE + 4 + 4 * 8);
+    ASSERT(recorder.GetSize() == block.size());
+    ASSERT(*(uint16_t*)&block[0] == 2);
+    ASSERT(*(uint16_t*)&block[2] == 4);
+    ASSERT(*(uint16_t*)&block[4] == 1);
+    ASSERT(*(uint16_t*)&block[6] == 1);
+    ASSERT(*(uint16_t*)&block[8] == 2015);
+    ASSERT(*(uint16_t*)&block[10] == 22);
+    ASSERT(Channel0(block) == std::vector<s32fp>({ FP_FROMINT(1), FP_FROMINT(2), FP_FROMINT(3), FP_FROMINT(4) }));
+    ASSERT(*(int32_t*)&block[16] == Param::Get(Param::ocurlim));
+}
+
+static void recorder_rising_edge_keeps_pre_trigger_samples()
+{
+    ParamRecorder recorder;
+    Param::PARAM_NUM channels[] = { Param::pot };
+
+    Param::SetInt(Param::pot, 0);
+    recorder.SetBuffer(buffer, 4);
+    recorder.SetChannels(channels, 1);
+    recorder.SetPreTrigger(2);
+    ASSERT(recorder.SetTrigger(ParamRecorder::TRIG_RISING, Param::pot, FP_FROMINT(10)));
+    recorder.Arm();
+
+    Feed(recorder, 0, 9);
+    ASSERT(recorder.GetState() == ParamRecorder::STATE_ARMED);
+    Feed(recorder, 10, 20);
+
+    std::string block = ReadAll(recorder);
+    ASSERT(*(uint16_t*)&block[4] == 2);
+    ASSERT(Channel0(block) == std::vector<s32fp>({ FP_FROMINT(8), FP_FROMINT(9), FP_FROMINT(10), FP_FROMINT(11) }));
+}
+
+static void recorder_falling_edge_and_threshold()
+{
+    ParamRecorder recorder;
+    Param::PARAM_NUM channels[] = { Param::pot };
+
+    recorder.SetBuffer(buffer, 2);
+    recorder.SetChannels(channels, 1);
+    ASSERT(!recorder.SetTrigger(ParamRecorder::TRIG_FALLING, Param::PARAM_INVALID, 0));
+    recorder.SetTrigger(ParamRecorder::TRIG_FALLING, Param::pot, FP_FROMINT(5));
+    Param::SetInt(Param::pot, 10);
+    recorder.Arm();
+    Feed(recorder, 10, 10);
+    Feed(recorder, 3, 4);
+    ASSERT(Channel0(ReadAll(recorder)) == std::vector<s32fp>({ FP_FROMINT(3), FP_FROMINT(4) }));
+
+    recorder.SetTrigger(ParamRecorder::TRIG_ABOVE, Param::pot, FP_FROMINT(5));
+    recorder.Arm();
+    Feed(recorder, 1, 7);
+    ASSERT(Channel0(ReadAll(recorder)) == std::vector<s32fp>({ FP_FROMINT(6), FP_FROMINT(7) }));
+}
+
+static void recorder_decimation()
+{
+    ParamRecorder recorder;
+    Param::PARAM_NUM channels[] = { Param::pot };
+
+    recorder.SetBuffer(buffer, 3);
+    recorder.SetChannels(channels, 1);
+    recorder.SetDecimation(3);
+    recorder.Arm();
+    Feed(recorder, 1, 9);
+
+    std::string block = ReadAll(recorder);
+    ASSERT(*(uint16_t*)&block[6] == 3);
+    ASSERT(Channel0(block) == std::vector<s32fp>({ FP_FROMINT(3), FP_FROMINT(6), FP_FROMINT(9) }));
+}
+
+static void recorder_error_and_forced_trigger()
+{
+    ParamRecorder recorder;
+    Param::PARAM_NUM channels[] = { Param::pot };
+
+    recorder.SetBuffer(buffer, 2);
+    recorder.SetChannels(channels, 1);
+    recorder.SetTrigger(ParamRecorder::TRIG_ERROR);
+    recorder.Arm();
+    Feed(recorder, 1, 5);
+    ASSERT(recorder.GetState() == ParamRecorder::STATE_ARMED);
+
+    ErrorMessage::SetTime(1);
+    ErrorMessage::UnpostAll();
+    ErrorMessage::Post(ERROR_NONE);
+    Feed(recorder, 6, 7);
+    ASSERT(Channel0(ReadAll(recorder)) == std::vector<s32fp>({ FP_FROMINT(6), FP_FROMINT(7) }));
+
+    recorder.Arm();
+    Feed(recorder, 1, 5);
+    recorder.ForceTrigger();
+    Feed(recorder, 6, 7);
+    ASSERT(recorder.GetState() == ParamRecorder::STATE_DONE);
+    ASSERT(Channel0(ReadAll(recorder)) == std::vector<s32fp>({ FP_FROMINT(6), FP_FROMINT(7) }));
+}
+
+REGISTER_TEST(
+    ParamRecorderTest,
+    recorder_arm_needs_buffer_and_channels,
+    recorder_captures_without_trigger,
+    recorder_rising_edge_keeps_pre_trigger_samples,
+    recorder_falling_edge_and_threshold,
+    recorder_decimation,
+    recorder_error_and_forced_trigger
+);
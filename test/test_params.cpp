@@ -0,0 +1,433 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "params.h"
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+class ParamsTest : public UnitTest
+{
+public:
+    explicit ParamsTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+};
+
+static void num_from_id_finds_all_params()
+{
+    for (int i = 0; i < Param::PARAM_LAST; i++)
+    {
+        Param::PARAM_NUM param = (Param::PARAM_NUM)i;
+        ASSERT(Param::NumFromId(Param::GetAttrib(param)->id) == param);
+    }
+}
+
+static void num_from_id_unknown_id()
+{
+    ASSERT(Param::NumFromId(0) == Param::PARAM_INVALID);
+    ASSERT(Param::NumFromId(23) == Param::PARAM_INVALID);
+    ASSERT(Param::NumFromId(2014) == Param::PARAM_INVALID);
+    ASSERT(Param::NumFromId(0x10000 + 22) == Param::PARAM_INVALID);
+}
+
+static void num_from_string_finds_all_params()
+{
+    for (int i = 0; i < Param::PARAM_LAST; i++)
+    {
+        Param::PARAM_NUM param = (Param::PARAM_NUM)i;
+        ASSERT(Param::NumFromString(Param::GetAttrib(param)->name) == param);
+    }
+}
+
+static void num_from_string_unknown_name()
+{
+    ASSERT(Param::NumFromString("") == Param::PARAM_INVALID);
+    ASSERT(Param::NumFromString("nosuchparam") == Param::PARAM_INVALID);
+    ASSERT(Param::NumFromString("ampnom2") == Param::PARAM_INVALID);
+    ASSERT(Param::NumFromString("ampno") == Param::PARAM_INVALID);
+}
+
+static void set_marks_param_dirty()
+{
+    Param::ClearDirty();
+    ASSERT(Param::NextDirty(0) == Param::PARAM_LAST);
+
+    Param::SetInt(Param::ocurlim, Param::GetInt(Param::ocurlim) + 1);
+    Param::SetInt(Param::amp, Param::GetInt(Param::amp) + 1);
+    ASSERT(Param::IsDirty(Param::amp));
+    ASSERT(!Param::IsDirty(Param::pot));
+    ASSERT(Param::NextDirty(0) == Param::amp);
+    ASSERT(Param::NextDirty(Param::amp + 1) == Param::ocurlim);
+    ASSERT(Param::NextDirty(Param::ocurlim + 1) == Param::PARAM_LAST);
+
+    Param::ClearDirty(Param::amp);
+    ASSERT(Param::NextDirty(0) == Param::ocurlim);
+    Param::ClearDirty();
+    ASSERT(!Param::IsDirty(Param::ocurlim));
+}
+
+static void same_value_does_not_mark_dirty()
+{
+    Param::ClearDirty();
+    Param::SetFixed(Param::pot, Param::Get(Param::pot));
+    ASSERT(Param::NextDirty(0) == Param::PARAM_LAST);
+}
+
+static void journal_lists_changes_in_order()
+{
+    uint32_t seq = Param::GetChangeSeq();
+
+    Param::SetInt(Param::pot, Param::GetInt(Param::pot) + 1);
+    Param::SetInt(Param::amp, Param::GetInt(Param::amp) + 1);
+    Param::SetInt(Param::pot, Param::GetInt(Param::pot) + 1);
+
+    ASSERT(Param::NextChange(seq) == Param::pot);
+    ASSERT(Param::NextChange(seq) == Param::amp);
+    ASSERT(Param::NextChange(seq) == Param::pot);
+    ASSERT(seq == Param::GetChangeSeq());
+    ASSERT(Param::NextChange(seq) == Param::PARAM_LAST);
+    ASSERT(seq == Param::GetChangeSeq());
+}
+
+static void journal_reports_overrun()
+{
+    uint32_t seq = Param::GetChangeSeq();
+
+    for (int i = 0; i < 1000; i++)
+        Param::SetInt(Param::pot, Param::GetInt(Param::pot) + 1);
+
+    uint32_t before = seq;
+    ASSERT(Param::NextChange(seq) == Param::PARAM_INVALID);
+    ASSERT(seq == before);
+}
+
+static void snapshot_reads_values()
+{
+    Param::PARAM_NUM params[] = { Param::ocurlim, Param::amp };
+    s32fp out[2];
+
+    ASSERT(Param::Snapshot(params, out, 2));
+    ASSERT(out[0] == Param::Get(Param::ocurlim));
+    ASSERT(out[1] == Param::Get(Param::amp));
+}
+
+static void snapshot_retries_while_writer_is_interrupted()
+{
+    Param::PARAM_NUM params[] = { Param::amp };
+    s32fp out;
+    uint32_t seq = Param::ReadBegin();
+
+    //A reader that gets a sequence number during a write must read again
+    ASSERT(Param::ReadRetry(seq | 1));
+    ASSERT(!Param::ReadRetry(seq));
+    Param::SetFixed(Param::amp, Param::Get(Param::amp) + 1);
+    ASSERT(Param::ReadRetry(seq));
+    ASSERT(Param::Snapshot(params, &out, 1));
+}
+
+//The writer thread plays the role of an ISR that preempts the reader at random points
+static void snapshot_is_consistent_under_concurrent_writes()
+{
+    Param::PARAM_NUM params[] = { Param::amp, Param::pot };
+    std::atomic<bool> stop(false);
+    int torn = 0, consistent = 0;
+
+    Param::SetInt(Param::amp, 0);
+    Param::SetInt(Param::pot, 0);
+
+    std::thread writer([&stop]()
+    {
+        //amp is written first, so any consistent state has pot <= amp <= pot + 1
+        for (int i = 1; !stop && i < 10000000; i++)
+        {
+            Param::SetInt(Param::amp, i);
+            Param::SetInt(Param::pot, i);
+        }
+    });
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+
+    while (std::chrono::steady_clock::now() < end)
+    {
+        s32fp out[2];
+
+        if (Param::Snapshot(params, out, 2))
+        {
+            consistent++;
+            if (out[0] < out[1] || out[0] > out[1] + FP_FROMINT(1))
+                torn++;
+        }
+    }
+    stop = true;
+    writer.join();
+
+    ASSERT(consistent > 0);
+    ASSERT(torn == 0);
+}
+
+static void native_storage_keeps_precision()
+{
+    Param::SetFloat(Param::amp, 0.1f);
+    ASSERT(Param::GetFloat(Param::amp) == 0.1f);
+    ASSERT(Param::Get(Param::amp) == FP_FROMFLT(0.1f));
+
+    Param::SetInt(Param::pot, 100000000);
+    ASSERT(Param::GetInt(Param::pot) == 100000000);
+    ASSERT(Param::GetFloat(Param::pot) == 100000000.0f);
+}
+
+static void native_storage_saturates_fixed_view()
+{
+    Param::SetInt(Param::pot, 100000000);
+    ASSERT(Param::Get(Param::pot) == FP_FROMINT(Param::FIXED_INT_MAX));
+    Param::SetInt(Param::pot, -100000000);
+    ASSERT(Param::Get(Param::pot) == FP_FROMINT(-Param::FIXED_INT_MAX - 1));
+
+    Param::SetFloat(Param::amp, 1e9f);
+    ASSERT(Param::Get(Param::amp) == 0x7FFFFFFF);
+    Param::SetFloat(Param::amp, -1e9f);
+    ASSERT(Param::Get(Param::amp) == (s32fp)0x80000000);
+}
+
+static void native_storage_int_rounds_down()
+{
+    //Same result no matter how the value is stored
+    Param::SetFloat(Param::amp, -2.5f);
+    Param::SetFloat(Param::ocurlim, -2.5f);
+    ASSERT(Param::GetInt(Param::amp) == -3);
+    ASSERT(Param::GetInt(Param::ocurlim) == -3);
+
+    Param::SetFloat(Param::pot, -2.5f);
+    ASSERT(Param::GetInt(Param::pot) == -3);
+    Param::SetFloat(Param::amp, -2.0f);
+    ASSERT(Param::GetInt(Param::amp) == -2);
+}
+
+static void native_storage_converts_fixed_view()
+{
+    ASSERT(Param::GetStorage(Param::amp) == Param::STORAGE_FLOAT);
+    ASSERT(Param::GetStorage(Param::pot) == Param::STORAGE_INT);
+    ASSERT(Param::GetStorage(Param::ocurlim) == Param::STORAGE_FIXED);
+
+    Param::SetFixed(Param::amp, FP_FROMFLT(2.5));
+    ASSERT(Param::GetFloat(Param::amp) == 2.5f);
+    ASSERT(Param::GetInt(Param::amp) == 2);
+    ASSERT(Param::Get(Param::amp) == FP_FROMFLT(2.5));
+
+    Param::SetFixed(Param::pot, FP_FROMINT(-7));
+    ASSERT(Param::GetInt(Param::pot) == -7);
+    ASSERT(Param::Get(Param::pot) == FP_FROMINT(-7));
+    ASSERT(!Param::GetBool(Param::pot));
+    Param::SetInt(Param::pot, 1);
+    ASSERT(Param::GetBool(Param::pot));
+
+    Param::SetFloat(Param::ocurlim, 2.5f);
+    ASSERT(Param::Get(Param::ocurlim) == FP_FROMFLT(2.5));
+}
+
+static void native_storage_change_detection()
+{
+    uint32_t seq = Param::GetChangeSeq();
+
+    Param::SetFloat(Param::amp, 3.25f);
+    Param::SetFloat(Param::amp, 3.25f);
+    Param::SetFixed(Param::amp, FP_FROMFLT(3.25));
+    ASSERT(Param::GetChangeSeq() == seq + 1);
+}
+
+static int observedCalls;
+static Param::PARAM_NUM observedParam;
+
+static void CountingObserver(Param::PARAM_NUM param)
+{
+    observedCalls++;
+    observedParam = param;
+}
+
+static void observer_called_on_set()
+{
+    observedCalls = 0;
+    ASSERT(Param::AddObserver(Param::ocurlim, CountingObserver));
+
+    Param::Set(Param::ocurlim, FP_FROMINT(50));
+    ASSERT(observedCalls == 1);
+    ASSERT(observedParam == Param::ocurlim);
+
+    //Out of range values are not set and not observed
+    Param::Set(Param::ocurlim, FP_FROMINT(100000));
+    ASSERT(observedCalls == 1);
+
+    ASSERT(Param::AddObserver(Param::ocurlim, 0));
+    Param::Set(Param::ocurlim, FP_FROMINT(51));
+    ASSERT(observedCalls == 1);
+}
+
+static void deferred_observer_coalesces_changes()
+{
+    observedCalls = 0;
+    ASSERT(Param::AddObserver(Param::ocurlim, CountingObserver, true));
+
+    Param::Set(Param::ocurlim, FP_FROMINT(60));
+    Param::Set(Param::ocurlim, FP_FROMINT(61));
+    Param::Set(Param::ocurlim, FP_FROMINT(62));
+    ASSERT(observedCalls == 0);
+
+    Param::DeliverChanges();
+    ASSERT(observedCalls == 1);
+    ASSERT(observedParam == Param::ocurlim);
+
+    Param::DeliverChanges();
+    ASSERT(observedCalls == 1);
+
+    Param::AddObserver(Param::ocurlim, 0);
+}
+
+static void category_observer()
+{
+    observedCalls = 0;
+    ASSERT(Param::AddObserver("inverter", CountingObserver) == 1);
+    ASSERT(Param::AddObserver("nosuchcategory", CountingObserver) == 0);
+
+    Param::Set(Param::ocurlim, FP_FROMINT(70));
+    ASSERT(observedCalls == 1);
+
+    ASSERT(Param::AddObserver("inverter", 0) == 1);
+    Param::Set(Param::ocurlim, FP_FROMINT(71));
+    ASSERT(observedCalls == 1);
+}
+
+static void templated_accessors_match_functions()
+{
+    Param::SetFloat<Param::amp>(1.75f);
+    ASSERT(Param::GetFloat<Param::amp>() == 1.75f);
+    ASSERT(Param::Get<Param::amp>() == Param::Get(Param::amp));
+    ASSERT(Param::GetInt<Param::amp>() == 1);
+
+    Param::SetInt<Param::pot>(-3);
+    ASSERT(Param::GetInt(Param::pot) == -3);
+    ASSERT(Param::Get<Param::pot>() == FP_FROMINT(-3));
+
+    Param::SetFixed<Param::ocurlim>(FP_FROMFLT(12.5));
+    ASSERT(Param::GetFloat<Param::ocurlim>() == 12.5f);
+    ASSERT(Param::GetInt<Param::ocurlim>() == 12);
+    ASSERT(!Param::GetBool<Param::ocurlim>());
+}
+
+static void templated_setters_track_changes()
+{
+    Param::SetInt<Param::pot>(5);
+    uint32_t seq = Param::GetChangeSeq(Param::pot);
+    Param::ClearDirty(Param::pot);
+
+    //Same value, nothing is recorded
+    Param::SetInt<Param::pot>(5);
+    ASSERT(Param::GetChangeSeq(Param::pot) == seq);
+    ASSERT(!Param::IsDirty(Param::pot));
+
+    Param::SetInt<Param::pot>(6);
+    ASSERT(Param::ChangedSince(Param::pot, seq));
+    ASSERT(Param::IsDirty(Param::pot));
+}
+
+static void templated_set_checks_range()
+{
+    observedCalls = 0;
+    Param::AddObserver(Param::ocurlim, CountingObserver);
+
+    ASSERT(Param::Set<Param::ocurlim>(FP_FROMINT(100000)) == -1);
+    ASSERT(observedCalls == 0);
+    ASSERT(Param::Set<Param::ocurlim>(FP_FROMINT(80)) == 0);
+    ASSERT(Param::GetInt(Param::ocurlim) == 80);
+    ASSERT(observedCalls == 1);
+
+    Param::Set<Param::ocurlim, FP_FROMINT(81)>();
+    ASSERT(Param::GetInt(Param::ocurlim) == 81);
+    ASSERT(observedCalls == 2);
+
+    Param::AddObserver(Param::ocurlim, 0);
+}
+
+static void stores_are_independent()
+{
+    Param::Store node;
+
+    //A new store holds the defaults
+    ASSERT(node.Get(Param::ocurlim) == Param::GetAttrib(Param::ocurlim)->def);
+    ASSERT(node.GetChangeSeq() == 0);
+
+    node.SetInt(Param::ocurlim, 33);
+    Param::SetInt(Param::ocurlim, 44);
+    ASSERT(node.GetInt(Param::ocurlim) == 33);
+    ASSERT(Param::GetInt(Param::ocurlim) == 44);
+    ASSERT(node.GetChangeSeq() == 1);
+    ASSERT(node.IsDirty(Param::ocurlim));
+
+    node.SetFlag(Param::ocurlim, Param::FLAG_HIDDEN);
+    ASSERT(node.GetFlag(Param::ocurlim) == Param::FLAG_HIDDEN);
+    ASSERT(Param::GetFlag(Param::ocurlim) == Param::FLAG_NONE);
+
+    node.SetFloat<Param::amp>(2.5f);
+    ASSERT(node.GetFloat<Param::amp>() == 2.5f);
+    ASSERT(Param::GetFloat<Param::amp>() != 2.5f);
+}
+
+static void store_observers_are_per_store()
+{
+    Param::Store node;
+
+    observedCalls = 0;
+    ASSERT(node.AddObserver(Param::ocurlim, CountingObserver));
+
+    //The default store has no observer for ocurlim
+    Param::Set(Param::ocurlim, FP_FROMINT(90));
+    ASSERT(observedCalls == 0);
+
+    ASSERT(node.Set(Param::ocurlim, FP_FROMINT(91)) == 0);
+    ASSERT(observedCalls == 1);
+    ASSERT(node.Set(Param::ocurlim, FP_FROMINT(100000)) == -1);
+    ASSERT(observedCalls == 1);
+}
+
+REGISTER_TEST(
+    ParamsTest,
+    num_from_id_finds_all_params,
+    num_from_id_unknown_id,
+    num_from_string_finds_all_params,
+    num_from_string_unknown_name,
+    set_marks_param_dirty,
+    same_value_does_not_mark_dirty,
+    journal_lists_changes_in_order,
+    journal_reports_overrun,
+    snapshot_reads_values,
+    snapshot_retries_while_writer_is_interrupted,
+    snapshot_is_consistent_under_concurrent_writes,
+    native_storage_keeps_precision,
+    native_storage_saturates_fixed_view,
+    native_storage_int_rounds_down,
+    native_storage_converts_fixed_view,
+    native_storage_change_detection,
+    observer_called_on_set,
+    deferred_observer_coalesces_changes,
+    category_observer,
+    templated_accessors_match_functions,
+    templated_setters_track_changes,
+    templated_set_checks_range,
+    stores_are_independent,
+    store_observers_are_per_store
+);
@@ -0,0 +1,81 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "paramschema.h"
+#include "params.h"
+#include "test.h"
+
+#include <string>
+
+class ParamSchemaTest : public UnitTest
+{
+public:
+    explicit ParamSchemaTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+};
+
+static std::string ReadAll(IStreamSource& source, int chunkSize)
+{
+    std::string result;
+    uint8_t buf[64];
+    int len;
+
+    while ((len = source.Read(buf, chunkSize)) > 0)
+        result.append((char*)buf, len);
+
+    return result;
+}
+
+static const std::string expectedSchema =
+    "{\r\n"
+    "   \"amp\": {\"unit\":\"dig\",\"id\":2013,\"isparam\":false,\"i\":0},\r\n"
+    "   \"pot\": {\"unit\":\"dig\",\"id\":2015,\"isparam\":false,\"i\":1},\r\n"
+    "   \"ocurlim\": {\"unit\":\"A\",\"id\":22,\"isparam\":true,\"minimum\":-65536,\"maximum\":65536,\"default\":100,\"category\":\"inverter\",\"i\":2}\r\n"
+    "}\r\n";
+
+static void schema_complete_document()
+{
+    ParamSchema schema;
+
+    ASSERT(ReadAll(schema, 64) == expectedSchema);
+    ASSERT(schema.GetSize() == expectedSchema.size());
+}
+
+static void schema_independent_of_chunk_size()
+{
+    ParamSchema schema;
+
+    for (int chunk = 1; chunk < 10; chunk++)
+    {
+        schema.Rewind();
+        ASSERT(ReadAll(schema, chunk) == expectedSchema);
+    }
+}
+
+static void schema_hash_covers_id_sum()
+{
+    ASSERT(ParamSchema::GetHash() != 0);
+    ASSERT(ParamSchema::GetHash() != Param::GetIdSum());
+    ASSERT(ParamSchema::GetHash() == ParamSchema::GetHash());
+}
+
+REGISTER_TEST(
+    ParamSchemaTest,
+    schema_complete_document,
+    schema_independent_of_chunk_size,
+    schema_hash_covers_id_sum
+);
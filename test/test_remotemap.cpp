@@ -0,0 +1,254 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2025 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+// See test_cansdo.cpp for why IPutChar is declared here
+#include <cstdio>
+class IPutChar { public: virtual void PutChar(char c) = 0; };
+#define PRINTF_H_INCLUDED
+
+#include "remotemap.h"
+#include "cansdo.h"
+#include "canmap.h"
+#include "stub_canhardware.h"
+#include "test.h"
+
+#include <memory>
+#include <cstring>
+#include <vector>
+
+class RemoteMapTest : public UnitTest
+{
+public:
+    explicit RemoteMapTest(const std::list<VoidFunction>* cases) : UnitTest(cases) {}
+    virtual void TestCaseSetup();
+};
+
+static std::unique_ptr<CanStub> canStub;
+static std::unique_ptr<CanSdo>  canSdo;
+static std::unique_ptr<RemoteMapBatch> batch;
+static RemoteMapBatch::Item items[3];
+
+void RemoteMapTest::TestCaseSetup()
+{
+    canStub = std::make_unique<CanStub>();
+    canSdo  = std::make_unique<CanSdo>(canStub.get());
+    batch   = std::make_unique<RemoteMapBatch>(canSdo.get());
+
+    for (int i = 0; i < 3; i++)
+    {
+        items[i].cobId = 0x100 + i;
+        items[i].rx = i == 2;
+        items[i].mapping.mapParam = 2000 + i;
+        items[i].mapping.offsetBits = 8 * i;
+        items[i].mapping.numBits = 16;
+        items[i].mapping.gain = 0.5f;
+        items[i].mapping.offset = -1;
+        items[i].result = 0xFF;
+    }
+}
+
+static CanSdo::SdoFrame* GetRequest()
+{
+    return (CanSdo::SdoFrame*)&canStub->m_data[0];
+}
+
+// Answer the last request of node 2, echoing its index and sub index
+static void Reply(uint8_t cmd, uint32_t data = 0)
+{
+    uint32_t frame[2];
+    CanSdo::SdoFrame* sdo = (CanSdo::SdoFrame*)frame;
+    sdo->cmd      = cmd;
+    sdo->index    = GetRequest()->index;
+    sdo->subIndex = GetRequest()->subIndex;
+    sdo->data     = data;
+    canStub->HandleRx(0x582, frame, 8);
+}
+
+static void batch_sends_all_writes()
+{
+    ASSERT(batch->Start(2, items, 3));
+    ASSERT(canStub->m_frames.size() == 1);
+
+    for (int i = 0; i < 9 && !batch->IsDone(); i++)
+    {
+        CanSdo::SdoFrame* req = GetRequest();
+        ASSERT(canStub->m_canId == 0x602);
+        ASSERT(req->cmd == SDO_WRITE);
+        ASSERT(req->index == (i < 6 ? SDO_INDEX_MAP_TX : SDO_INDEX_MAP_RX));
+        ASSERT(req->subIndex == i % 3);
+
+        if (i == 3) ASSERT(req->data == 0x101);
+        if (i == 4) ASSERT(req->data == (2001 | (8 << 16) | (16 << 24)));
+        if (i == 5) ASSERT(req->data == (500 | (0xFF << 24)));
+        Reply(SDO_WRITE_REPLY);
+    }
+
+    ASSERT(batch->IsDone());
+    ASSERT(canStub->m_frames.size() == 9);
+    ASSERT(batch->GetFailures() == 0);
+    ASSERT(canSdo->GetPendingRequests() == 0);
+}
+
+static void batch_reports_failed_items()
+{
+    batch->Start(2, items, 3);
+
+    for (int i = 0; i < 9; i++)
+    {
+        //Second item has an unknown UID
+        if (i == 4 || i == 5)
+            Reply(SDO_ABORT, SDO_ERR_INVIDX + i - 4);
+        else
+            Reply(SDO_WRITE_REPLY);
+    }
+
+    ASSERT(batch->IsDone());
+    ASSERT(batch->GetFailures() == 1);
+    ASSERT(items[0].result == 0);
+    ASSERT(items[1].result == SDO_ERR_INVIDX); //first error is kept
+    ASSERT(items[2].result == 0);
+}
+
+static void batch_not_started_twice()
+{
+    ASSERT(batch->Start(2, items, 3));
+    ASSERT(!batch->Start(2, items, 3));
+}
+
+// Answer block download commands, those don't carry index and sub index
+static void BlockReply(uint8_t cmd, uint8_t ackSeq = 0, uint8_t blockSize = 0)
+{
+    uint32_t frame[2] = { (uint32_t)(cmd | (ackSeq << 8) | (blockSize << 16)), 0 };
+    canStub->HandleRx(0x582, frame, 8);
+}
+
+static void batch_as_download()
+{
+    std::vector<uint8_t> received;
+
+    ASSERT(batch->Start(2, items, 3, true));
+    ASSERT((GetRequest()->cmd & 0xE0) == SDO_REQUEST_BLOCK_DOWNLOAD);
+    ASSERT(GetRequest()->index == SDO_INDEX_MAP_LIST);
+    ASSERT(GetRequest()->data == 3 * CANMAP_RECORD_SIZE);
+
+    //All 6 segments go out as one block
+    size_t first = canStub->m_frames.size();
+    Reply(SDO_RESPONSE_BLOCK_DOWNLOAD, SDO_BLOCK_SIZE);
+    ASSERT(canStub->m_frames.size() == first + 6);
+
+    for (size_t i = first; i < canStub->m_frames.size(); i++)
+        received.insert(received.end(), &canStub->m_frames[i][1], &canStub->m_frames[i][8]);
+
+    BlockReply(SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK, 6, SDO_BLOCK_SIZE);
+    ASSERT((canStub->m_data[0] & ~(7 << 2)) == (SDO_REQUEST_BLOCK_DOWNLOAD | SDO_BLOCK_END));
+    ASSERT(!batch->IsDone());
+    BlockReply(SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_END);
+
+    uint32_t record[3];
+    CanMapStream::EncodeRecord(0x102, true, items[2].mapping, record);
+
+    ASSERT(batch->IsDone());
+    ASSERT(memcmp(&received[24], record, sizeof(record)) == 0);
+    ASSERT(batch->GetFailures() == 0);
+}
+
+static void batch_as_download_failing_item()
+{
+    batch->Start(2, items, 3, true);
+
+    //First block of 4 segments holds bytes 0..27, the server acknowledges it
+    Reply(SDO_RESPONSE_BLOCK_DOWNLOAD, 4);
+    BlockReply(SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK, 4, 4);
+
+    //Then it rejects the third record
+    uint32_t abort[2] = { SDO_ABORT | (SDO_INDEX_MAP_LIST << 8), SDO_ERR_INVIDX };
+    canStub->HandleRx(0x582, abort, 8);
+
+    ASSERT(batch->IsDone());
+    ASSERT(items[0].result == 0);
+    ASSERT(items[1].result == 0);
+    ASSERT(items[2].result == SDO_ERR_INVIDX);
+}
+
+static void batch_as_download_times_out()
+{
+    batch->Start(2, items, 3, true);
+    Reply(SDO_RESPONSE_BLOCK_DOWNLOAD, 2);
+    BlockReply(SDO_RESPONSE_BLOCK_DOWNLOAD | SDO_BLOCK_ACK, 2, 2);
+    canSdo->TriggerTimeout(SDO_CLIENT_TIMEOUT);
+
+    //Segments 1 and 2 hold the first record, the second one is unconfirmed
+    ASSERT(batch->IsDone());
+    ASSERT(items[0].result == 0);
+    ASSERT(items[1].result == SDO_ERR_TIMEOUT);
+    ASSERT(items[2].result == SDO_ERR_GENERAL);
+}
+
+static void batch_as_download_to_server()
+{
+    CanStub serverStub;
+    CanMap serverMap(&serverStub, false);
+    CanSdo server(&serverStub, &serverMap);
+    RemoteMapBatch::Item list[12];
+    uint32_t canId;
+
+    server.SetNodeId(2);
+
+    for (int i = 0; i < 12; i++)
+    {
+        static const uint16_t uids[] = { 2013, 2015, 22 };
+
+        list[i].cobId = 0x200 + i / 4;
+        list[i].rx = false;
+        list[i].mapping.mapParam = uids[i % 3];
+        list[i].mapping.offsetBits = 16 * (i % 4);
+        list[i].mapping.numBits = 16;
+        list[i].mapping.gain = 1;
+        list[i].mapping.offset = 0;
+    }
+
+    ASSERT(batch->Start(2, list, 12, true));
+
+    //Carry frames between both ends until they are done talking
+    for (size_t toServer = 0, toClient = 0; toServer < canStub->m_frames.size() || toClient < serverStub.m_frames.size();)
+    {
+        if (toServer < canStub->m_frames.size())
+            server.HandleRx(0x602, (uint32_t*)canStub->m_frames[toServer++].data(), 8);
+        else
+            canSdo->HandleRx(0x582, (uint32_t*)serverStub.m_frames[toClient++].data(), 8);
+    }
+
+    ASSERT(batch->IsDone());
+    ASSERT(batch->GetFailures() == 0);
+    //144 bytes take 21 segments, so 2 blocks plus initiate and end
+    ASSERT(canStub->m_frames.size() == 23);
+    ASSERT(serverStub.m_frames.size() == 4);
+    ASSERT(serverMap.GetMap(false, 2, 3, canId) != nullptr);
+    ASSERT(canId == 0x202);
+}
+
+REGISTER_TEST(
+    RemoteMapTest,
+    batch_sends_all_writes,
+    batch_reports_failed_items,
+    batch_not_started_twice,
+    batch_as_download,
+    batch_as_download_failing_item,
+    batch_as_download_times_out,
+    batch_as_download_to_server
+);